@@ -15,8 +15,11 @@
 
 #include <core/Database.hpp>
 
+#include <algorithm>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
+#include <boost/make_shared.hpp>
 
 #include <core/FileSerializer.hpp>
 #include <core/http/Util.hpp>
@@ -93,6 +96,19 @@ namespace rstudio {
 namespace core {
 namespace database {
 
+namespace {
+
+// prepared statements kept per connection
+const std::size_t kMaxPreparedQueries = 128;
+
+// pooled connections idle for at least this long are checked before use
+const int kDefaultValidateAfterIdleSeconds = 30;
+
+// the longest we wait for a pooled connection to become available by default
+const int kDefaultMaxWaitSeconds = 30;
+
+} // anonymous namespace
+
 class DatabaseErrorCategory : public boost::system::error_category
 {
 public:
@@ -559,7 +575,10 @@ Error Connection::execute(Query& query,
                           bool* pDataReturned)
 {
    if (query.prepareError_)
+   {
+      failed_ = true;
       return DatabaseError(query.prepareError_.get());
+   }
 
    try
    {
@@ -575,6 +594,7 @@ Error Connection::execute(Query& query,
    }
    catch (soci::soci_error& error)
    {
+      failed_ = true;
       return DatabaseError(error);
    }
 }
@@ -583,7 +603,10 @@ Error Connection::execute(Query& query,
                           Rowset& rowset)
 {
    if (query.prepareError_)
+   {
+      failed_ = true;
       return DatabaseError(query.prepareError_.get());
+   }
 
    try
    {
@@ -597,6 +620,7 @@ Error Connection::execute(Query& query,
    }
    catch (soci::soci_error& error)
    {
+      failed_ = true;
       return DatabaseError(error);
    }
 }
@@ -623,12 +647,65 @@ Error Connection::executeStr(const std::string& queryStr)
    }
    catch (soci::soci_error& error)
    {
+      failed_ = true;
       Error res = DatabaseError(error);
       res.addProperty("query", queryStr);
       return res;
    }
 }
 
+boost::shared_ptr<Query> Connection::preparedQuery(const std::string& sqlStatement)
+{
+   auto it = preparedQueries_.find(sqlStatement);
+   if (it != preparedQueries_.end())
+   {
+      recentPreparedQueries_.splice(recentPreparedQueries_.begin(),
+                                    recentPreparedQueries_,
+                                    it->second.recentPos);
+      preparedQueryHits_++;
+      return it->second.query;
+   }
+
+   preparedQueryMisses_++;
+   boost::shared_ptr<Query> pQuery = boost::make_shared<Query>(sqlStatement, session_);
+
+   // only cache statements that prepared successfully
+   if (!pQuery->prepareError_)
+   {
+      if (preparedQueries_.size() >= kMaxPreparedQueries)
+      {
+         preparedQueries_.erase(recentPreparedQueries_.back());
+         recentPreparedQueries_.pop_back();
+      }
+
+      recentPreparedQueries_.push_front(sqlStatement);
+      PreparedQuery& prepared = preparedQueries_[sqlStatement];
+      prepared.query = pQuery;
+      prepared.recentPos = recentPreparedQueries_.begin();
+   }
+
+   return pQuery;
+}
+
+void Connection::discardPreparedQuery(const std::string& sqlStatement)
+{
+   auto it = preparedQueries_.find(sqlStatement);
+   if (it == preparedQueries_.end())
+      return;
+
+   recentPreparedQueries_.erase(it->second.recentPos);
+   preparedQueries_.erase(it);
+}
+
+PreparedQueryMetrics Connection::preparedQueryMetrics() const
+{
+   PreparedQueryMetrics metrics;
+   metrics.cached = preparedQueries_.size();
+   metrics.hits = preparedQueryHits_;
+   metrics.misses = preparedQueryMisses_;
+   return metrics;
+}
+
 std::string Connection::driverName() const
 {
    return session_.get_backend_name();
@@ -668,30 +745,114 @@ Error PooledConnection::executeStr(const std::string& queryStr)
    return connection_->executeStr(queryStr);
 }
 
+boost::shared_ptr<Query> PooledConnection::preparedQuery(const std::string& sqlStatement)
+{
+   return connection_->preparedQuery(sqlStatement);
+}
+
+void PooledConnection::discardPreparedQuery(const std::string& sqlStatement)
+{
+   connection_->discardPreparedQuery(sqlStatement);
+}
+
+PreparedQueryMetrics PooledConnection::preparedQueryMetrics() const
+{
+   return connection_->preparedQueryMetrics();
+}
+
 std::string PooledConnection::driverName() const
 {
    return connection_->driverName();
 }
 
 ConnectionPool::ConnectionPool(const ConnectionOptions& options) :
-   connectionOptions_(options)
+   connectionOptions_(options),
+   validateAfterIdle_(boost::posix_time::seconds(kDefaultValidateAfterIdleSeconds)),
+   maxWait_(boost::posix_time::seconds(kDefaultMaxWaitSeconds))
+{
+}
+
+void ConnectionPool::setValidateAfterIdle(const boost::posix_time::time_duration& idle)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      validateAfterIdle_ = idle;
+   }
+   END_LOCK_MUTEX
+}
+
+void ConnectionPool::setConnectionCheck(const std::function<Error(IConnection&)>& check)
 {
+   LOCK_MUTEX(mutex_)
+   {
+      connectionCheck_ = check;
+   }
+   END_LOCK_MUTEX
+}
+
+void ConnectionPool::setMaxWait(const boost::posix_time::time_duration& maxWait)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      maxWait_ = maxWait;
+   }
+   END_LOCK_MUTEX
+}
+
+ConnectionPoolMetrics ConnectionPool::metrics() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return metrics_;
+   }
+   END_LOCK_MUTEX
+
+   return ConnectionPoolMetrics();
 }
 
 bool ConnectionPool::testAndReconnect(boost::shared_ptr<Connection>& connection)
 {
-   // do not test Sqlite connections - there is no backend system to connect to in this case
-   // so any errors on the file handle itself we do not want to gracefully recover from, as they would
-   // indicate a very serious programming error
-   if (connection->driver() == Driver::Sqlite)
+   boost::posix_time::time_duration validateAfterIdle;
+   std::function<Error(IConnection&)> connectionCheck;
+   LOCK_MUTEX(mutex_)
+   {
+      validateAfterIdle = validateAfterIdle_;
+      connectionCheck = connectionCheck_;
+   }
+   END_LOCK_MUTEX
+
+   // do not test Sqlite connections (unless asked to) - there is no backend system to connect to
+   // in this case so any errors on the file handle itself we do not want to gracefully recover from,
+   // as they would indicate a very serious programming error
+   if (!connectionCheck && connection->driver() == Driver::Sqlite)
       return true;
 
+   // connections in regular use are known to be working; only those which have been idle
+   // (during which the upstream connection may have been closed) or which have seen errors
+   // need testing
+
+   if (!connection->failed_ &&
+       (connection->lastReturned_.is_not_a_date_time() ||
+        boost::posix_time::microsec_clock::universal_time() - connection->lastReturned_ < validateAfterIdle))
+   {
+      return true;
+   }
+
+   LOCK_MUTEX(mutex_)
+   {
+      metrics_.validations++;
+   }
+   END_LOCK_MUTEX
+
    // it is possible for connections to go stale (such as if the upstream connection is closed)
    // which will prevent it from being usable - we test for this by running a very efficient query
    // and checking to make sure that no error has occurred
-   Error error = connection->executeStr("SELECT 1");
+   Error error = connectionCheck ? connectionCheck(*connection) : connection->executeStr("SELECT 1");
    if (!error)
+   {
+      connection->failed_ = false;
       return true;
+   }
 
    LOG_DEBUG_MESSAGE("Replacing stale db connection in pool - check query returned: " + error.asString() + ")");
 
@@ -710,40 +871,81 @@ bool ConnectionPool::testAndReconnect(boost::shared_ptr<Connection>& connection)
 
    connection = boost::static_pointer_cast<Connection>(newConnection);
 
+   LOCK_MUTEX(mutex_)
+   {
+      metrics_.reconnects++;
+   }
+   END_LOCK_MUTEX
+
    return true;
 }
 
-boost::shared_ptr<IConnection> ConnectionPool::getConnection()
+bool ConnectionPool::dequeConnection(const boost::posix_time::time_duration& maxWait,
+                                     boost::shared_ptr<Connection>* pConnection)
 {
-   // block until a connection is available, but log an error
-   // if this takes a long time, because we want to ensure that if we are in a hang
-   // condition (i.e. threads are not properly returning connections to the pool) we
-   // let the users/developers know that something is fishy
-   boost::shared_ptr<Connection> connection;
-   while (true)
+   LOCK_MUTEX(mutex_)
    {
-      if (connections_.deque(&connection, boost::posix_time::seconds(30)))
-      {
-         // test connection to ensure it is still alive
-         if (!testAndReconnect(connection))
-            LOG_WARNING_MESSAGE("DB get connection - returning invalid connection");
+      metrics_.waiting++;
+      metrics_.peakWaiting = std::max(metrics_.peakWaiting, metrics_.waiting);
+   }
+   END_LOCK_MUTEX
 
-         // create wrapper PooledConnection around retrieved Connection
-         return boost::shared_ptr<IConnection>(new PooledConnection(shared_from_this(), connection));
-      }
+   bool dequeued = connections_.deque(pConnection, maxWait);
+
+   LOCK_MUTEX(mutex_)
+   {
+      metrics_.waiting--;
+      if (dequeued)
+         metrics_.checkouts++;
       else
-      {
-         LOG_ERROR_MESSAGE("Potential hang detected: could not get database connection from pool "
-                           "after 30 seconds. If issue persists, please notify Posit Support");
-      }
+         metrics_.waitTimeouts++;
+   }
+   END_LOCK_MUTEX
+
+   return dequeued;
+}
+
+Error ConnectionPool::getConnection(boost::shared_ptr<IConnection>* pConnection)
+{
+   boost::posix_time::time_duration maxWait;
+   LOCK_MUTEX(mutex_)
+   {
+      maxWait = maxWait_;
+   }
+   END_LOCK_MUTEX
+
+   // fail rather than wait indefinitely; a pool which stays exhausted this long most likely
+   // means that connections are not being returned to it
+   boost::shared_ptr<Connection> connection;
+   if (!dequeConnection(maxWait, &connection))
+   {
+      return systemError(boost::system::errc::timed_out,
+                         "Could not get database connection from pool after " +
+                            boost::posix_time::to_simple_string(maxWait) +
+                            ". If issue persists, please notify Posit Support",
+                         ERROR_LOCATION);
+   }
+
+   // test connection to ensure it is still alive; if it isn't, it is still returned to the pool
+   // (by the PooledConnection) so that the next caller can try to re-establish it
+   bool valid = testAndReconnect(connection);
+   boost::shared_ptr<IConnection> pooled(new PooledConnection(shared_from_this(), connection));
+   if (!valid)
+   {
+      return systemError(boost::system::errc::not_connected,
+                         "Could not re-establish stale database connection",
+                         ERROR_LOCATION);
    }
+
+   *pConnection = pooled;
+   return Success();
 }
 
 bool ConnectionPool::getConnection(const boost::posix_time::time_duration& maxWait,
                                    boost::shared_ptr<IConnection>* pConnection)
 {
    boost::shared_ptr<Connection> connection;
-   if (!connections_.deque(&connection, maxWait))
+   if (!dequeConnection(maxWait, &connection))
    {
       LOG_DEBUG_MESSAGE("In DB getConnection - timed out in trying to find a connection");
       return false;
@@ -764,6 +966,7 @@ bool ConnectionPool::getConnection(const boost::posix_time::time_duration& maxWa
 
 void ConnectionPool::returnConnection(const boost::shared_ptr<Connection>& connection)
 {
+   connection->lastReturned_ = boost::posix_time::microsec_clock::universal_time();
    connections_.enque(connection);
 }
 
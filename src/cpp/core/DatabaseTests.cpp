@@ -238,7 +238,8 @@ TEST_CASE("Database", "[.database]")
       boost::shared_ptr<ConnectionPool> connectionPool;
       REQUIRE_FALSE(createConnectionPool(5, sqliteConnectionOptions(), &connectionPool));
 
-      boost::shared_ptr<IConnection> connection = connectionPool->getConnection();
+      boost::shared_ptr<IConnection> connection;
+      REQUIRE_FALSE(connectionPool->getConnection(&connection));
 
       int rowId;
       std::string rowText;
@@ -250,7 +251,8 @@ TEST_CASE("Database", "[.database]")
       REQUIRE_FALSE(connection->execute(query, &dataReturned));
       REQUIRE(dataReturned);
 
-      boost::shared_ptr<IConnection> connection2 = connectionPool->getConnection();
+      boost::shared_ptr<IConnection> connection2;
+      REQUIRE_FALSE(connectionPool->getConnection(&connection2));
       Query query2 = connection2->query("select id, text from Test where id = 25")
          .withOutput(rowId)
          .withOutput(rowText);
@@ -260,6 +262,135 @@ TEST_CASE("Database", "[.database]")
       REQUIRE(dataReturned);
    }
 
+   test_that("Prepared statements are cached within a bound")
+   {
+      boost::shared_ptr<IConnection> connection;
+      REQUIRE_FALSE(connect(sqliteConnectionOptions(), &connection));
+
+      boost::shared_ptr<Query> pQuery = connection->preparedQuery("select 0");
+      REQUIRE(connection->preparedQuery("select 0") == pQuery);
+      REQUIRE(connection->preparedQueryMetrics().hits == 1);
+      REQUIRE(connection->preparedQueryMetrics().misses == 1);
+      REQUIRE(connection->preparedQueryMetrics().cached == 1);
+
+      // a cached statement can be executed again once its inputs are rebound
+      int value = 0;
+      int result = -1;
+      for (int i = 1; i <= 3; ++i)
+      {
+         value = i;
+         boost::shared_ptr<Query> pSelect = connection->preparedQuery("select :val");
+         pSelect->withInput(value).withOutput(result);
+         REQUIRE_FALSE(connection->execute(*pSelect));
+         REQUIRE(result == i);
+      }
+      REQUIRE(connection->preparedQueryMetrics().hits == 3);
+      REQUIRE(connection->preparedQueryMetrics().misses == 2);
+
+      // the least recently used statements are discarded once there are too many
+      for (int i = 1; i <= 200; ++i)
+         connection->preparedQuery("select " + safe_convert::numberToString(i));
+      REQUIRE(connection->preparedQueryMetrics().cached == 128);
+      REQUIRE(connection->preparedQuery("select 200") ==
+              connection->preparedQuery("select 200"));
+      REQUIRE(connection->preparedQuery("select 0") != pQuery);
+
+      pQuery = connection->preparedQuery("select 0");
+      connection->discardPreparedQuery("select 0");
+      REQUIRE(connection->preparedQuery("select 0") != pQuery);
+   }
+
+   test_that("Connection pool reports waits for connections")
+   {
+      boost::shared_ptr<ConnectionPool> connectionPool;
+      REQUIRE_FALSE(createConnectionPool(1, sqliteConnectionOptions(), &connectionPool));
+
+      boost::shared_ptr<IConnection> connection;
+      REQUIRE_FALSE(connectionPool->getConnection(&connection));
+
+      boost::shared_ptr<IConnection> connection2;
+      REQUIRE_FALSE(connectionPool->getConnection(boost::posix_time::milliseconds(10), &connection2));
+      REQUIRE_FALSE(connection2);
+
+      // waits are bounded, and fail with an error
+      connectionPool->setMaxWait(boost::posix_time::milliseconds(10));
+      REQUIRE(connectionPool->getConnection(&connection2));
+      REQUIRE_FALSE(connection2);
+
+      ConnectionPoolMetrics metrics = connectionPool->metrics();
+      REQUIRE(metrics.checkouts == 1);
+      REQUIRE(metrics.waitTimeouts == 2);
+      REQUIRE(metrics.waiting == 0);
+      REQUIRE(metrics.peakWaiting == 1);
+
+      connection.reset();
+      REQUIRE(connectionPool->getConnection(boost::posix_time::milliseconds(10), &connection2));
+      REQUIRE(connectionPool->metrics().checkouts == 2);
+
+      // sqlite connections are never validated
+      REQUIRE(connectionPool->metrics().validations == 0);
+   }
+
+   test_that("Pooled connections are validated after idling or errors")
+   {
+      boost::shared_ptr<ConnectionPool> connectionPool;
+      REQUIRE_FALSE(createConnectionPool(1, sqliteConnectionOptions(), &connectionPool));
+
+      // stand in for a server connection check
+      int checks = 0;
+      bool failCheck = false;
+      connectionPool->setConnectionCheck([&](IConnection& connection)
+      {
+         ++checks;
+         if (failCheck)
+            return systemError(boost::system::errc::not_connected, ERROR_LOCATION);
+         return connection.executeStr("SELECT 1");
+      });
+      connectionPool->setValidateAfterIdle(boost::posix_time::seconds(60));
+
+      // connections in regular use are not checked
+      for (int i = 0; i < 2; ++i)
+      {
+         boost::shared_ptr<IConnection> connection;
+         REQUIRE_FALSE(connectionPool->getConnection(&connection));
+      }
+      REQUIRE(checks == 0);
+
+      // a connection which saw an error is checked before it is handed out again
+      {
+         boost::shared_ptr<IConnection> connection;
+         REQUIRE_FALSE(connectionPool->getConnection(&connection));
+         REQUIRE(connection->executeStr("SELECT * FROM NoSuchTable"));
+      }
+      {
+         boost::shared_ptr<IConnection> connection;
+         REQUIRE_FALSE(connectionPool->getConnection(&connection));
+      }
+      REQUIRE(checks == 1);
+
+      // as is a connection which has been idle for long enough
+      connectionPool->setValidateAfterIdle(boost::posix_time::milliseconds(10));
+      boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+      {
+         boost::shared_ptr<IConnection> connection;
+         REQUIRE_FALSE(connectionPool->getConnection(&connection));
+      }
+      REQUIRE(checks == 2);
+      REQUIRE(connectionPool->metrics().validations == 2);
+      REQUIRE(connectionPool->metrics().reconnects == 0);
+
+      // a connection which fails its check is replaced with a working one
+      failCheck = true;
+      boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+      {
+         boost::shared_ptr<IConnection> connection;
+         REQUIRE_FALSE(connectionPool->getConnection(&connection));
+         REQUIRE_FALSE(connection->executeStr("SELECT 1"));
+      }
+      REQUIRE(checks == 3);
+      REQUIRE(connectionPool->metrics().reconnects == 1);
+   }
+
    test_that("Can update schemas")
    {
       // generate some schema files
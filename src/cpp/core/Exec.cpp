@@ -15,27 +15,307 @@
 
 #include <core/Exec.hpp>
 
+#include <algorithm>
+
 #include <shared_core/Error.hpp>
 
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/Thread.hpp>
+
 namespace rstudio {
 namespace core {
 
+namespace {
+
+enum StepState
+{
+   StepPending,
+   StepRunning,
+   StepDone
+};
+
+// the state of a block whose functions are spread over a pool of threads
+class Execution : boost::noncopyable
+{
+public:
+   Execution(const std::vector<ExecBlock::Function>& functions,
+             const std::vector<std::string>& names,
+             const std::vector<bool>& anyThread,
+             const std::vector<std::vector<std::size_t> >& dependencies,
+             const ExecBlock::Observer& observer)
+      : functions_(functions),
+        names_(names),
+        anyThread_(anyThread),
+        dependencies_(dependencies),
+        observer_(observer),
+        states_(functions.size(), StepPending),
+        errors_(functions.size()),
+        failed_(false)
+   {
+   }
+
+   void runCallingThread()
+   {
+      for (std::size_t i = 0; i < functions_.size(); i++)
+      {
+         if (anyThread_[i])
+            continue;
+
+         // while waiting for this function's dependencies, help run the
+         // functions in the pool
+         for (;;)
+         {
+            std::size_t next = take(i);
+            if (next == kNone)
+               return;
+
+            run(next);
+            if (next == i)
+               break;
+         }
+      }
+
+      // run what remains in the pool, then wait for anything still running
+      for (;;)
+      {
+         std::size_t next = take(kNone);
+         if (next == kNone)
+            break;
+         run(next);
+      }
+   }
+
+   void runWorker()
+   {
+      for (;;)
+      {
+         std::size_t next = take(kNone);
+         if (next == kNone)
+            return;
+         run(next);
+      }
+   }
+
+   Error error() const
+   {
+      for (const Error& error : errors_)
+      {
+         if (error)
+            return error;
+      }
+      return Success();
+   }
+
+private:
+   static const std::size_t kNone;
+
+   // waits for and claims the next function to run: the given calling
+   // thread function once its dependencies are done, otherwise a ready pool
+   // function. returns kNone once there's nothing left to do
+   std::size_t take(std::size_t callingThreadFunction)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      for (;;)
+      {
+         if (failed_)
+         {
+            waitForRunning(lock);
+            return kNone;
+         }
+
+         if (callingThreadFunction != kNone && isReady(callingThreadFunction))
+         {
+            states_[callingThreadFunction] = StepRunning;
+            return callingThreadFunction;
+         }
+
+         bool poolPending = false;
+         for (std::size_t i = 0; i < functions_.size(); i++)
+         {
+            if (!anyThread_[i] || states_[i] != StepPending)
+               continue;
+
+            poolPending = true;
+            if (isReady(i))
+            {
+               states_[i] = StepRunning;
+               return i;
+            }
+         }
+
+         // with nothing more for the pool, workers are done; the calling
+         // thread also waits for the functions still running
+         if (!poolPending && callingThreadFunction == kNone)
+         {
+            if (!isWorker())
+               waitForRunning(lock);
+            return kNone;
+         }
+
+         changed_.wait(lock);
+      }
+   }
+
+   void run(std::size_t i)
+   {
+      using namespace boost::posix_time;
+      ptime started = observer_ ? microsec_clock::universal_time() : ptime();
+      Error error = functions_[i]();
+      ptime finished = observer_ ? microsec_clock::universal_time() : ptime();
+
+      LOCK_MUTEX(mutex_)
+      {
+         if (observer_)
+            observer_(names_[i], started, finished);
+
+         errors_[i] = error;
+         states_[i] = StepDone;
+         if (error)
+            failed_ = true;
+      }
+      END_LOCK_MUTEX
+
+      changed_.notify_all();
+   }
+
+   bool isReady(std::size_t i) const
+   {
+      for (std::size_t dependency : dependencies_[i])
+      {
+         if (states_[dependency] != StepDone)
+            return false;
+      }
+      return true;
+   }
+
+   bool isWorker() const
+   {
+      return boost::this_thread::get_id() != callingThreadId_;
+   }
+
+   void waitForRunning(boost::unique_lock<boost::mutex>& lock)
+   {
+      if (isWorker())
+         return;
+
+      while (std::find(states_.begin(), states_.end(), StepRunning) != states_.end())
+         changed_.wait(lock);
+   }
+
+   const std::vector<ExecBlock::Function>& functions_;
+   const std::vector<std::string>& names_;
+   const std::vector<bool>& anyThread_;
+   const std::vector<std::vector<std::size_t> >& dependencies_;
+   const ExecBlock::Observer& observer_;
+   const boost::thread::id callingThreadId_ = boost::this_thread::get_id();
+
+   boost::mutex mutex_;
+   boost::condition_variable changed_;
+   std::vector<StepState> states_;
+   std::vector<Error> errors_;
+   bool failed_;
+};
+
+const std::size_t Execution::kNone = static_cast<std::size_t>(-1);
+
+} // anonymous namespace
+
 ExecBlock& ExecBlock::add(Function function) 
 { 
-   functions_.push_back(function);
-   return *this;
+   return add(std::string(), function);
 }   
+
+ExecBlock& ExecBlock::add(const std::string& name, Function function)
+{
+   return add(name, function, CallingThread);
+}
+
+ExecBlock& ExecBlock::add(const std::string& name,
+                          Function function,
+                          ThreadAffinity affinity,
+                          const std::vector<std::string>& dependencies)
+{
+   Step step;
+   step.name = name;
+   step.function = function;
+   step.affinity = affinity;
+   step.dependencies = dependencies;
+   steps_.push_back(step);
+   return *this;
+}
    
 Error ExecBlock::execute() const
 {
-   for (std::vector<Function>::const_iterator
-            it = functions_.begin(); it != functions_.end(); ++it)
+   return execute(Observer());
+}
+
+Error ExecBlock::execute(const Observer& observer) const
+{
+   // resolve dependencies to the functions added before
+   std::vector<Function> functions;
+   std::vector<std::string> names;
+   std::vector<bool> anyThread;
+   std::vector<std::vector<std::size_t> > dependencies;
+   std::size_t poolSize = 0;
+   for (const Step& step : steps_)
    {
-      Error error = (*it)();
-      if (error)
-         return error;
+      std::vector<std::size_t> stepDependencies;
+      for (const std::string& dependency : step.dependencies)
+      {
+         auto it = std::find(names.begin(), names.end(), dependency);
+         if (it == names.end())
+         {
+            return systemError(boost::system::errc::invalid_argument,
+                               "'" + step.name + "' depends on '" + dependency +
+                                  "', which was not added before it",
+                               ERROR_LOCATION);
+         }
+         stepDependencies.push_back(it - names.begin());
+      }
+
+      functions.push_back(step.function);
+      names.push_back(step.name);
+      anyThread.push_back(step.affinity == AnyThread);
+      dependencies.push_back(stepDependencies);
+      if (step.affinity == AnyThread)
+         poolSize++;
    }
-   return Success();
+
+   // with nothing for the pool, everything runs in order on this thread
+   if (poolSize == 0)
+   {
+      using namespace boost::posix_time;
+      for (std::size_t i = 0; i < functions.size(); i++)
+      {
+         ptime started = observer ? microsec_clock::universal_time() : ptime();
+         Error error = functions[i]();
+         if (observer)
+            observer(names[i], started, microsec_clock::universal_time());
+         if (error)
+            return error;
+      }
+      return Success();
+   }
+
+   Execution execution(functions, names, anyThread, dependencies, observer);
+
+   poolSize = std::min<std::size_t>(poolSize,
+                                    std::max(1u, boost::thread::hardware_concurrency()));
+   std::vector<boost::thread> workers(poolSize);
+   for (boost::thread& worker : workers)
+      thread::safeLaunchThread(boost::bind(&Execution::runWorker, &execution), &worker);
+
+   execution.runCallingThread();
+
+   for (boost::thread& worker : workers)
+   {
+      if (worker.joinable())
+         worker.join();
+   }
+
+   return execution.error();
 }
    
 Error ExecBlock::operator()() const 
@@ -45,6 +325,3 @@ Error ExecBlock::operator()() const
    
 } // namespace core 
 } // namespace rstudio
-
-
-
@@ -0,0 +1,176 @@
+/*
+ * ExecTests.cpp
+ *
+ * Copyright (C) 2022 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <tests/TestThat.hpp>
+
+#include <string>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
+
+#include <shared_core/Error.hpp>
+#include <core/BoostThread.hpp>
+#include <core/Exec.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tests {
+
+namespace {
+
+// records the order in which functions ran and the threads they ran on
+struct Record
+{
+   boost::mutex mutex;
+   std::vector<std::string> order;
+   std::vector<boost::thread::id> threads;
+};
+
+Error recordRun(Record* pRecord, const std::string& name)
+{
+   boost::lock_guard<boost::mutex> lock(pRecord->mutex);
+   pRecord->order.push_back(name);
+   pRecord->threads.push_back(boost::this_thread::get_id());
+   return Success();
+}
+
+Error fail()
+{
+   return systemError(boost::system::errc::invalid_argument, ERROR_LOCATION);
+}
+
+std::size_t indexOf(const std::vector<std::string>& order, const std::string& name)
+{
+   return std::find(order.begin(), order.end(), name) - order.begin();
+}
+
+} // anonymous namespace
+
+test_context("ExecBlock")
+{
+   test_that("Named functions are reported to the observer in order")
+   {
+      Record record;
+      std::vector<std::string> observed;
+
+      ExecBlock block;
+      block.addFunctions()
+         ("first", boost::bind(recordRun, &record, "first"))
+         ("second", boost::bind(recordRun, &record, "second"));
+
+      Error error = block.execute(
+         [&](const std::string& name,
+             const boost::posix_time::ptime& started,
+             const boost::posix_time::ptime& finished)
+         {
+            expect_true(started <= finished);
+            observed.push_back(name);
+         });
+
+      expect_false(error);
+      expect_true(observed == std::vector<std::string>({ "first", "second" }));
+      expect_true(record.order == observed);
+   }
+
+   test_that("Functions after a failure are not run")
+   {
+      Record record;
+
+      ExecBlock block;
+      block.addFunctions()
+         ("first", boost::bind(recordRun, &record, "first"))
+         ("fails", fail)
+         ("third", boost::bind(recordRun, &record, "third"));
+
+      expect_true(block.execute());
+      expect_true(record.order == std::vector<std::string>({ "first" }));
+   }
+
+   test_that("Calling thread functions run in order on the calling thread")
+   {
+      Record record;
+
+      ExecBlock block;
+      block.addFunctions()
+         ("pool", boost::bind(recordRun, &record, "pool"), ExecBlock::AnyThread)
+         ("first", boost::bind(recordRun, &record, "first"))
+         ("second", boost::bind(recordRun, &record, "second"));
+
+      expect_false(block.execute());
+      expect_true(record.order.size() == 3);
+      expect_true(indexOf(record.order, "first") < indexOf(record.order, "second"));
+
+      for (std::size_t i = 0; i < record.order.size(); i++)
+      {
+         if (record.order[i] != "pool")
+            expect_true(record.threads[i] == boost::this_thread::get_id());
+      }
+   }
+
+   test_that("Functions run after their dependencies")
+   {
+      Record record;
+
+      ExecBlock block;
+      block.addFunctions()
+         ("a", boost::bind(recordRun, &record, "a"), ExecBlock::AnyThread)
+         ("b", boost::bind(recordRun, &record, "b"), ExecBlock::AnyThread,
+            std::vector<std::string>({ "a" }))
+         ("c", boost::bind(recordRun, &record, "c"))
+         ("d", boost::bind(recordRun, &record, "d"), ExecBlock::CallingThread,
+            std::vector<std::string>({ "b" }))
+         ("e", boost::bind(recordRun, &record, "e"), ExecBlock::AnyThread,
+            std::vector<std::string>({ "c" }));
+
+      expect_false(block.execute());
+      expect_true(record.order.size() == 5);
+      expect_true(indexOf(record.order, "a") < indexOf(record.order, "b"));
+      expect_true(indexOf(record.order, "b") < indexOf(record.order, "d"));
+      expect_true(indexOf(record.order, "c") < indexOf(record.order, "d"));
+      expect_true(indexOf(record.order, "c") < indexOf(record.order, "e"));
+   }
+
+   test_that("Unknown or later dependencies are rejected")
+   {
+      Record record;
+
+      ExecBlock block;
+      block.addFunctions()
+         ("a", boost::bind(recordRun, &record, "a"), ExecBlock::AnyThread,
+            std::vector<std::string>({ "b" }))
+         ("b", boost::bind(recordRun, &record, "b"));
+
+      expect_true(block.execute());
+      expect_true(record.order.empty());
+   }
+
+   test_that("A failed pool function stops the block and is reported")
+   {
+      Record record;
+
+      ExecBlock block;
+      block.addFunctions()
+         ("fails", fail, ExecBlock::AnyThread)
+         ("after", boost::bind(recordRun, &record, "after"), ExecBlock::CallingThread,
+            std::vector<std::string>({ "fails" }));
+
+      expect_true(block.execute());
+      expect_true(record.order.empty());
+   }
+}
+
+} // namespace tests
+} // namespace core
+} // namespace rstudio
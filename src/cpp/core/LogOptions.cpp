@@ -43,6 +43,7 @@ namespace log {
 #define kMaxRotations      "max-rotations"
 #define kDeleteDays        "delete-days"
 #define kWarnSyslog        "warn-syslog"
+#define kAsyncWrites       "async-writes"
 #define kLogConfFile       "logging.conf"
 
 #define kLogLevelEnvVar    "RS_LOG_LEVEL"
@@ -201,7 +202,8 @@ struct LoggerOptionsVisitor : boost::static_visitor<>
          kRotateDays, defaultOptions.getRotationDays(),
          kMaxRotations, defaultOptions.getMaxRotations(),
          kDeleteDays, defaultOptions.getDeletionDays(),
-         kWarnSyslog, defaultOptions.warnSyslog());
+         kWarnSyslog, defaultOptions.warnSyslog(),
+         kAsyncWrites, defaultOptions.asyncWrites());
    }
 
    void operator()(const StdErrLogOptions& options)
@@ -226,7 +228,8 @@ struct LoggerOptionsVisitor : boost::static_visitor<>
          kRotateDays, options.getRotationDays(),
          kMaxRotations, options.getMaxRotations(),
          kDeleteDays, options.getDeletionDays(),
-         kWarnSyslog, options.warnSyslog());
+         kWarnSyslog, options.warnSyslog(),
+         kAsyncWrites, options.asyncWrites());
    }
 
    ConfigProfile& profile_;
@@ -464,7 +467,7 @@ LoggerOptions LogOptions::loggerOptions(const std::string& loggerName) const
          std::vector<ConfigProfile::Level> levels = getLevels(loggerName);
 
          std::string logDir, fileMode, messageFormatStr;
-         bool rotate, includePid, warnSyslog;
+         bool rotate, includePid, warnSyslog, asyncWrites;
          double maxSizeMb;
          int rotateDays, maxRotations, deleteDays;
 
@@ -476,6 +479,7 @@ LoggerOptions LogOptions::loggerOptions(const std::string& loggerName) const
          profile_.getParam(kMaxRotations, &maxRotations, levels);
          profile_.getParam(kDeleteDays, &deleteDays, levels);
          profile_.getParam(kWarnSyslog, &warnSyslog, levels);
+         profile_.getParam(kAsyncWrites, &asyncWrites, levels);
 
          profile_.getParam(kLogDir, &logDir, levels);
          FilePath loggingDir(logDir);
@@ -496,7 +500,9 @@ LoggerOptions LogOptions::loggerOptions(const std::string& loggerName) const
          if (!logDirOverride.empty())
             loggingDir = FilePath(logDirOverride);
 
-         return FileLogOptions(loggingDir, fileMode, maxSizeMb, rotateDays, maxRotations, deleteDays, rotate, includePid, warnSyslog, forceLogDir);
+         FileLogOptions options(loggingDir, fileMode, maxSizeMb, rotateDays, maxRotations, deleteDays, rotate, includePid, warnSyslog, forceLogDir);
+         options.setAsyncWrites(asyncWrites);
+         return options;
       }
 
       case LoggerType::kStdErr:
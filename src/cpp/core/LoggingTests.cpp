@@ -23,11 +23,20 @@
 #include <core/system/System.hpp>
 
 #include <shared_core/DateTime.hpp>
+#include <shared_core/FileLogDestination.hpp>
 #include <shared_core/FilePath.hpp>
 #include <shared_core/json/Json.hpp>
 #include <shared_core/SafeConvert.hpp>
 
+#include <atomic>
+
 #include <boost/algorithm/string.hpp>
+#include <boost/thread.hpp>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 namespace rstudio {
 namespace core {
@@ -1065,6 +1074,93 @@ test_context("Logging")
       // only newline should be at the end of the log file, signifying the end of the log line
       REQUIRE(logFileContents.find("\n") == logFileContents.size() - 1);
    }
+
+   test_that("Asynchronous file log writes messages in order")
+   {
+      FilePath logDir;
+      REQUIRE_FALSE(FilePath::tempFilePath(logDir));
+      REQUIRE_FALSE(logDir.ensureDirectory());
+
+      log::FileLogOptions options(logDir, false);
+      options.setAsyncWrites(true);
+
+      std::string id = core::system::generateShortenedUuid();
+      log::FileLogDestination destination(
+               "async-" + id, log::LogLevel::DEBUG_LEVEL, log::LogMessageFormatType::PRETTY,
+               "logging-tests-" + id, options);
+
+      std::string expected;
+      for (int i = 0; i < 1000; ++i)
+      {
+         std::string message = "Info message " + safe_convert::numberToString(i) + "\n";
+         destination.writeLog(log::LogLevel::INFO, message);
+         expected += message;
+      }
+
+      // errors are written (along with everything queued before them) before returning
+      destination.writeLog(log::LogLevel::ERR, "Error message\n");
+      expected += "Error message\n";
+
+      FilePath logFile = logDir.completeChildPath("logging-tests-" + id + ".log");
+      REQUIRE(logFile.exists());
+
+      std::string logFileContents;
+      REQUIRE_FALSE(core::readStringFromFile(logFile, &logFileContents));
+      CHECK(logFileContents == expected);
+
+      destination.writeLog(log::LogLevel::INFO, "Last message\n");
+      destination.flush();
+      expected += "Last message\n";
+
+      REQUIRE_FALSE(core::readStringFromFile(logFile, &logFileContents));
+      CHECK(logFileContents == expected);
+      CHECK(destination.getDroppedMessageCount() == 0);
+   }
+
+#ifndef _WIN32
+   test_that("Forked children can log while the parent is writing asynchronously")
+   {
+      FilePath logDir;
+      REQUIRE_FALSE(FilePath::tempFilePath(logDir));
+      REQUIRE_FALSE(logDir.ensureDirectory());
+
+      log::FileLogOptions options(logDir, false);
+      options.setAsyncWrites(true);
+
+      std::string id = core::system::generateShortenedUuid();
+      log::FileLogDestination destination(
+               "async-fork-" + id, log::LogLevel::DEBUG_LEVEL, log::LogMessageFormatType::PRETTY,
+               "logging-tests-" + id, options);
+
+      // keep the writer thread busy, so that forks happen while it holds the file lock
+      std::atomic<bool> done(false);
+      boost::thread logger([&]()
+      {
+         while (!done)
+            destination.writeLog(log::LogLevel::INFO, std::string(1024, 'x') + "\n");
+      });
+
+      for (int i = 0; i < 20; ++i)
+      {
+         pid_t pid = ::fork();
+         if (pid == 0)
+         {
+            // a child which deadlocks is killed by the alarm
+            ::alarm(5);
+            destination.writeLog(log::LogLevel::INFO, "Child message\n");
+            ::_exit(0);
+         }
+
+         REQUIRE(pid > 0);
+         int status = 0;
+         REQUIRE(::waitpid(pid, &status, 0) == pid);
+         REQUIRE(WIFEXITED(status));
+      }
+
+      done = true;
+      logger.join();
+   }
+#endif
 }
 
 } // namespace unit_tests
@@ -19,7 +19,11 @@
 #include <core/Thread.hpp>
 #include <shared_core/FilePath.hpp>
 
+#include <cstdint>
+#include <list>
+
 #include <boost/assign.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/variant.hpp>
@@ -138,6 +142,17 @@ private:
    boost::optional<Query&> query_;
 };
 
+struct PreparedQueryMetrics
+{
+   // statements currently cached on the connection
+   std::size_t cached = 0;
+
+   // requests served from the cache, and statements prepared for requests
+   // which were not
+   std::uint64_t hits = 0;
+   std::uint64_t misses = 0;
+};
+
 class IConnection
 {
 public:
@@ -151,6 +166,18 @@ public:
 
    virtual Error executeStr(const std::string& queryStr) = 0;
 
+   // returns a query for the given statement, reusing the statement previously
+   // prepared on this connection for the same SQL text when one is available
+   // inputs are consumed by each execution, and so must be bound again with
+   // withInput() before the query is executed again
+   virtual boost::shared_ptr<Query> preparedQuery(const std::string& sqlStatement) = 0;
+
+   // discards the cached prepared statement for the given SQL text, if any
+   // (should be invoked if execution of a prepared query fails)
+   virtual void discardPreparedQuery(const std::string& sqlStatement) = 0;
+
+   virtual PreparedQueryMetrics preparedQueryMetrics() const = 0;
+
    Driver driver() const
    {
       std::string driverStr = driverName();
@@ -185,12 +212,19 @@ public:
 
    Error executeStr(const std::string& queryStr) override;
 
+   boost::shared_ptr<Query> preparedQuery(const std::string& sqlStatement) override;
+
+   void discardPreparedQuery(const std::string& sqlStatement) override;
+
+   PreparedQueryMetrics preparedQueryMetrics() const override;
+
    std::string driverName() const override;
 
    soci::session& session() override { return session_; }
 
 private:
    friend class ConnectVisitor;
+   friend class ConnectionPool;
    friend class Transaction;
 
    // private constructor - use global connect function
@@ -198,6 +232,25 @@ private:
               const std::string& connectionStr);
 
    soci::session session_;
+
+   struct PreparedQuery
+   {
+      boost::shared_ptr<Query> query;
+      std::list<std::string>::iterator recentPos;
+   };
+
+   // prepared statements, keyed by SQL text, and their SQL text from most to
+   // least recently used (the least recently used are discarded once there
+   // are too many)
+   std::map<std::string, PreparedQuery> preparedQueries_;
+   std::list<std::string> recentPreparedQueries_;
+   std::uint64_t preparedQueryHits_ = 0;
+   std::uint64_t preparedQueryMisses_ = 0;
+
+   // when the connection was last returned to its pool, and whether an
+   // error has occurred on it since it was last validated
+   boost::posix_time::ptime lastReturned_;
+   bool failed_ = false;
 };
 
 class PooledConnection : public IConnection
@@ -215,6 +268,12 @@ public:
 
    Error executeStr(const std::string& queryStr) override;
 
+   boost::shared_ptr<Query> preparedQuery(const std::string& sqlStatement) override;
+
+   void discardPreparedQuery(const std::string& sqlStatement) override;
+
+   PreparedQueryMetrics preparedQueryMetrics() const override;
+
    std::string driverName() const override;
 
    soci::session& session() override { return connection_->session(); }
@@ -230,13 +289,48 @@ private:
    boost::shared_ptr<Connection> connection_;
 };
 
+struct ConnectionPoolMetrics
+{
+   // callers currently waiting for a connection, and the most there have been
+   std::size_t waiting = 0;
+   std::size_t peakWaiting = 0;
+
+   // connections handed out, and waits which timed out
+   std::uint64_t checkouts = 0;
+   std::uint64_t waitTimeouts = 0;
+
+   // connections checked before use, and connections replaced
+   std::uint64_t validations = 0;
+   std::uint64_t reconnects = 0;
+};
+
 class ConnectionPool : public boost::enable_shared_from_this<ConnectionPool>
 {
 public:
    ConnectionPool(const ConnectionOptions& options);
 
-   // get a connection from the connection pool, blocking until one becomes available
-   boost::shared_ptr<IConnection> getConnection();
+   // connections are checked (and re-established if necessary) before being
+   // handed out only when they have been idle in the pool for at least this
+   // long, or when an error occurred while they were last in use
+   void setValidateAfterIdle(const boost::posix_time::time_duration& idle);
+
+   // sets the check run on connections which are due to be validated (see
+   // setValidateAfterIdle). by default a "SELECT 1" query is run, and SQLite
+   // connections (which have no server to lose their connection to) are not
+   // validated; a check set here is run on connections of any kind
+   void setConnectionCheck(const std::function<Error(IConnection&)>& check);
+
+   // sets the longest getConnection(pConnection) waits for a connection to
+   // become available (30 seconds by default)
+   void setMaxWait(const boost::posix_time::time_duration& maxWait);
+
+   ConnectionPoolMetrics metrics() const;
+
+   // get a connection from the connection pool, waiting for at most the pool's
+   // maximum wait (see setMaxWait) for one to become available. returns an
+   // error if no connection becomes available in time, or if the connection
+   // is stale and can't be re-established
+   Error getConnection(boost::shared_ptr<IConnection>* pConnection);
 
    // get a connection from the connection pool, waiting for at most maxWait for one
    // to become available. if no connection becomes available, false is returned and
@@ -252,9 +346,17 @@ private:
 
    void returnConnection(const boost::shared_ptr<Connection>& connection);
    bool testAndReconnect(boost::shared_ptr<Connection>& connection);
+   bool dequeConnection(const boost::posix_time::time_duration& maxWait,
+                        boost::shared_ptr<Connection>* pConnection);
 
    thread::ThreadsafeQueue<boost::shared_ptr<Connection> > connections_;
    ConnectionOptions connectionOptions_;
+
+   mutable boost::mutex mutex_;
+   boost::posix_time::time_duration validateAfterIdle_;
+   boost::posix_time::time_duration maxWait_;
+   std::function<Error(IConnection&)> connectionCheck_;
+   ConnectionPoolMetrics metrics_;
 };
 
 class Transaction
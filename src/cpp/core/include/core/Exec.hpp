@@ -16,8 +16,10 @@
 #ifndef CORE_EXEC_HPP
 #define CORE_EXEC_HPP
 
+#include <string>
 #include <vector>
 
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/function.hpp>
 
 namespace rstudio {
@@ -30,20 +32,50 @@ class ExecBlock
 public:
    typedef boost::function<core::Error()> Function;
 
+   // the threads a function may run on. functions with CallingThread affinity
+   // run in the order they were added on the thread executing the block;
+   // AnyThread functions run on a pool of worker threads (or on the calling
+   // thread while it would otherwise wait) as soon as their dependencies
+   // have completed
+   enum ThreadAffinity
+   {
+      CallingThread,
+      AnyThread
+   };
+
+   // notified after each function runs, with its name and when it started
+   // and finished. notifications are serialized, and are made on the thread
+   // which ran the function
+   typedef boost::function<void(const std::string&,
+                                const boost::posix_time::ptime&,
+                                const boost::posix_time::ptime&)> Observer;
+
 public:
    ExecBlock() {}
   
     // COPYING: via compiler (copyable members)
    
-   // add to the block
+   // add to the block (the name identifies the function to observers)
    ExecBlock& add(Function function);
+   ExecBlock& add(const std::string& name, Function function);
+
+   // add to the block with the given thread affinity; the function runs only
+   // after the named functions it depends on (which must have been added
+   // before it) have completed
+   ExecBlock& add(const std::string& name,
+                  Function function,
+                  ThreadAffinity affinity,
+                  const std::vector<std::string>& dependencies = std::vector<std::string>());
    
    // easy init style (based on idiom in boost::program_options)
    class EasyInit;
    EasyInit addFunctions() { return EasyInit(this); }
    
-   // execute the block
+   // execute the block; once a function fails no further functions are
+   // started, and the error of the first failed function (in the order they
+   // were added) is returned after those already running have completed
    core::Error execute() const;
+   core::Error execute(const Observer& observer) const;
    
    // allow an ExecBlock to act as a boost::function<core::Error()>
    core::Error operator()() const;
@@ -59,11 +91,33 @@ public:
          pExecBlock_->add(function);
          return *this;
       }
+      EasyInit& operator()(const std::string& name, Function function)
+      {
+         pExecBlock_->add(name, function);
+         return *this;
+      }
+      EasyInit& operator()(const std::string& name,
+                           Function function,
+                           ThreadAffinity affinity,
+                           const std::vector<std::string>& dependencies = std::vector<std::string>())
+      {
+         pExecBlock_->add(name, function, affinity, dependencies);
+         return *this;
+      }
    private:
       ExecBlock* pExecBlock_;
    };
+
 private:
-   std::vector<Function> functions_;
+   struct Step
+   {
+      std::string name;
+      Function function;
+      ThreadAffinity affinity;
+      std::vector<std::string> dependencies;
+   };
+
+   std::vector<Step> steps_;
 };
    
 
@@ -370,8 +370,15 @@ public:
       setField(json::kRpcResult, result);
    }
 
+   // sets the result from its json text, which is written into the response
+   // as is (avoiding the construction of a json::Value for large results)
+   void setRawResult(const std::string& result);
+
    Value result()
    {
+      if (!rawResult_.empty())
+         return rawResultValue();
+
       return response_[json::kRpcResult];
    }
 
@@ -405,6 +412,9 @@ public:
 
    void setField(const std::string& name, const Value& value)
    { 
+      if (name == json::kRpcResult)
+         rawResult_.clear();
+
       response_[name] = value;
    }
    
@@ -429,6 +439,7 @@ public:
    void setResponse(const Object& response)
    {
       response_ = response;
+      rawResult_.clear();
    }
    
    // specify a function to run after the response
@@ -453,7 +464,10 @@ public:
                      JsonRpcResponse* pResponse);
    
 private:
+   Value rawResultValue() const;
+
    Object response_;
+   std::string rawResult_;
    boost::function<void()> afterResponse_;
    bool suppressDetectChanges_;
 };
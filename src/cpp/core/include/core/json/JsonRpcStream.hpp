@@ -0,0 +1,125 @@
+/*
+ * JsonRpcStream.hpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_JSON_RPC_STREAM_HPP
+#define CORE_JSON_RPC_STREAM_HPP
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <shared_core/Error.hpp>
+
+namespace rstudio {
+namespace core {
+namespace json {
+
+// Support for JSON-RPC messages exchanged over a byte stream (typically the
+// stdin / stdout of a child process) using the base protocol of the Language
+// Server Protocol, where each message body is preceded by a block of headers:
+//
+//    Content-Length: <bytes>\r\n
+//    \r\n
+//    <body>
+
+// formats a message body as a framed message
+std::string formatFramedMessage(const std::string& body);
+
+// Incremental parser for framed messages. Input may be split at arbitrary
+// points (including within headers) across calls to parse(); any partial
+// message is retained until the remainder arrives.
+class FramedMessageParser : boost::noncopyable
+{
+public:
+   explicit FramedMessageParser(std::size_t maxMessageSize = 64 * 1024 * 1024);
+
+   // parses the next buffer, appending the body of any completed messages to
+   // pMessages. a malformed frame produces an error; the parser discards it
+   // and resumes with the next header block, so later messages still parse
+   Error parse(const char* buffer, std::size_t len, std::vector<std::string>* pMessages);
+   Error parse(const std::string& buffer, std::vector<std::string>* pMessages);
+
+   // discards any partially received message
+   void reset();
+
+   // whether a message has been partially received
+   bool hasPartialMessage() const;
+
+private:
+   Error endHeaderLine();
+
+   enum State
+   {
+      Header,
+      Body,
+      Discard
+   } state_;
+
+   std::size_t maxMessageSize_;
+
+   // the header line currently being read
+   std::string headerLine_;
+
+   // whether any header lines have been read for the current message
+   bool haveHeaders_;
+
+   // the content length of the current message (-1 if not yet known)
+   long long contentLength_;
+
+   // the body of the current message
+   std::string body_;
+};
+
+// Queue of framed messages waiting to be written to a peer. Writes are
+// performed in flush(), which writes whole messages up to a byte budget so
+// that a burst of large messages is spread across several flushes rather
+// than stalling the caller behind a slow reader; pendingBytes() lets
+// producers hold back (and coalesce) work while the peer is behind.
+class FramedMessageWriter : boost::noncopyable
+{
+public:
+   typedef boost::function<Error(const std::string&)> WriteFunction;
+
+   explicit FramedMessageWriter(std::size_t maxBytesPerFlush = 256 * 1024);
+
+   // queues a message body for writing
+   void enqueue(const std::string& body);
+
+   // writes queued messages using the supplied function. at least one message
+   // is written (if any are queued), regardless of its size. a message is only
+   // removed from the queue once it has been written successfully
+   Error flush(const WriteFunction& write);
+
+   // discards all queued messages
+   void clear();
+
+   bool empty() const { return frames_.empty(); }
+   std::size_t pendingMessages() const { return frames_.size(); }
+   std::size_t pendingBytes() const { return pendingBytes_; }
+
+private:
+   std::size_t maxBytesPerFlush_;
+   std::deque<std::string> frames_;
+   std::size_t pendingBytes_;
+};
+
+} // namespace json
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_JSON_RPC_STREAM_HPP
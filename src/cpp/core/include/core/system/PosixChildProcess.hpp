@@ -92,6 +92,10 @@ Error forkAndRun(const boost::function<int(void)>& func,
 // if this is not the case, the method will be run as the calling user
 Error forkAndRunPrivileged(const boost::function<int(void)>& func);
 
+// returns the number of child processes which were launched with posix_spawn
+// rather than fork (see canSpawnChild)
+uint64_t spawnedChildCount();
+
 // sends a signal to all child processes with the specified process name
 Error sendSignalToSpecifiedChildProcesses(const std::set<std::string>& procNames,
                                           int signal);
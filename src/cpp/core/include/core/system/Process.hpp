@@ -345,6 +345,11 @@ struct ProcessCallbacks
    // Streaming callback for standard output
    boost::function<void(ProcessOperations&, const std::string&)> onStdout;
 
+   // Called before reading output. While it returns false, output is left
+   // unread (once the pipe fills, the child blocks writing to it); used to
+   // keep a slow consumer from being flooded.
+   boost::function<bool()> readyForOutput;
+
    // Streaming callback for standard error
    boost::function<void(ProcessOperations&, const std::string&)> onStderr;
 
@@ -462,6 +467,13 @@ bool enableCallbacksRequireMainThread();
 
 void setEnableCallbacksRequireMainThread(bool enforce);
 
+// sets a function which is called (on a background thread) when a child
+// process run by a ProcessSupervisor produces output or exits, so that the
+// owner of the supervisor can poll it promptly rather than waiting for its
+// next scheduled poll. the function is called at most once between polls.
+// currently only supported on Linux (elsewhere the function is never called)
+void setChildProcessActivityCallback(const boost::function<void()>& callback);
+
 } // namespace system
 } // namespace core
 } // namespace rstudio
@@ -0,0 +1,43 @@
+/*
+ * ConsoleOutput.hpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_CONSOLE_OUTPUT_HPP
+#define CORE_TEXT_CONSOLE_OUTPUT_HPP
+
+#include <string>
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+// Removes text from (UTF-8) console output which would be overwritten when
+// the output is displayed, as happens with progress bars that redraw their
+// line after a carriage return: "10%\r20%\r30%" becomes "30%". The output is
+// rendered exactly as before by the client console.
+//
+// Only the lines at or after 'from' are examined, so output can be compacted
+// as it is appended by passing the length of the output before the append.
+// Text is dropped only when a later segment of the same line overwrites all
+// of it; ANSI color (SGR) codes from dropped text are retained (with
+// duplicates removed), and segments containing backspaces or other escape
+// sequences are left alone. The first line of the output is not assumed to
+// begin at the start of a line, since it may continue output already written.
+void compactConsoleOutput(std::string* pOutput, std::size_t from = 0);
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_TEXT_CONSOLE_OUTPUT_HPP
@@ -0,0 +1,98 @@
+/*
+ * TermEmulator.hpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_TERM_EMULATOR_HPP
+#define CORE_TEXT_TERM_EMULATOR_HPP
+
+#include <cstddef>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+// A headless xterm-compatible (vt100/xterm subset, as implemented by xterm.js)
+// terminal emulator. Output written to a terminal is fed through it to track
+// what the terminal is showing: the screen grid and its attributes, the
+// scrollback, the cursor, the alt-buffer and the terminal modes.
+//
+// From that state it produces a snapshot: output which, written to a freshly
+// created terminal of the same size, reproduces the primary screen, the most
+// recent scrollback, the cursor and the modes. Snapshots stay small however
+// much output the terminal has seen, unlike a replay of that output.
+//
+// While a full-screen program is showing the alt-buffer, snapshots hold the
+// primary buffer (the program is expected to redraw the alt-buffer itself).
+class TermEmulator : boost::noncopyable
+{
+public:
+   TermEmulator(int cols, int rows, int maxScrollback);
+   ~TermEmulator();
+
+   // Process terminal output; escape sequences and UTF-8 characters may be
+   // split across calls.
+   void write(const std::string& output);
+   void write(const char* pData, std::size_t length);
+
+   // Resize the screen (content isn't reflowed; lines are truncated or padded,
+   // and rows above the cursor move to the scrollback when rows shrink).
+   void resize(int cols, int rows);
+   int cols() const;
+   int rows() const;
+
+   // Maximum number of lines kept in the scrollback
+   void setMaxScrollback(int maxScrollback);
+
+   // Return to the initial state, clearing the screens and the scrollback.
+   void reset();
+
+   // Clear the line the cursor is on and move the cursor to its start.
+   void eraseCursorLine();
+
+   // Is the alt-buffer showing? Leaving it returns to the primary buffer.
+   bool altBufferActive() const;
+   void leaveAltBuffer();
+
+   // Cursor position on the active screen (0-based)
+   int cursorCol() const;
+   int cursorRow() const;
+
+   // Number of lines in the scrollback, and the number of lines a snapshot
+   // would hold (scrollback plus the used part of the primary screen).
+   std::size_t scrollbackLines() const;
+   std::size_t lineCount() const;
+
+   // Text of the given row of the active screen, without attributes or
+   // trailing blanks.
+   std::string rowText(int row) const;
+
+   // Output reproducing the primary screen, at most maxScrollback lines of
+   // scrollback (negative for all), the cursor and the current modes. Empty
+   // when nothing has been written.
+   std::string snapshot(int maxScrollback = -1) const;
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_TEXT_TERM_EMULATOR_HPP
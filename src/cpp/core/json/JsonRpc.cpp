@@ -203,14 +203,58 @@ void JsonRpcResponse::runAfterResponse()
       afterResponse_();
 }
    
+void JsonRpcResponse::setRawResult(const std::string& result)
+{
+   // keep a placeholder so that the result is written in its usual position
+   setField(json::kRpcResult, Value());
+   rawResult_ = result;
+}
+
+Value JsonRpcResponse::rawResultValue() const
+{
+   Value value;
+   Error error = value.parseFullPrecision(rawResult_);
+   if (error)
+      LOG_ERROR(error);
+
+   return value;
+}
+
 Object JsonRpcResponse::getRawResponse()
 {
-   return response_;
+   if (rawResult_.empty())
+      return response_;
+
+   Object response = response_;
+   response[json::kRpcResult] = rawResultValue();
+   return response;
 }
    
 void JsonRpcResponse::write(std::ostream& os) const
 {
-   response_.write(os);
+   if (rawResult_.empty())
+   {
+      response_.write(os);
+      return;
+   }
+
+   // write the members of the response, substituting the raw result
+   os << "{";
+   bool first = true;
+   for (const Object::Member& member : response_)
+   {
+      if (!first)
+         os << ",";
+      first = false;
+
+      Value(member.getName()).write(os);
+      os << ":";
+      if (member.getName() == json::kRpcResult)
+         os << rawResult_;
+      else
+         member.getValue().write(os);
+   }
+   os << "}";
 }
    
 void JsonRpcResponse::setError(const Error& error,
@@ -220,6 +264,7 @@ void JsonRpcResponse::setError(const Error& error,
    // remove result
    response_.erase(json::kRpcResult);
    response_.erase(json::kRpcAsyncHandle);
+   rawResult_.clear();
    
    if (error.getName() == json::jsonRpcCategory().name())
    {
@@ -290,6 +335,7 @@ void JsonRpcResponse::setError(const boost::system::error_code& ec,
    // remove result
    response_.erase(json::kRpcResult);
    response_.erase(json::kRpcAsyncHandle);
+   rawResult_.clear();
 
    // error from error code
    Object error;
@@ -326,6 +372,7 @@ void JsonRpcResponse::setAsyncHandle(const std::string& handle)
 {
    response_.erase(json::kRpcResult);
    response_.erase(json::kRpcError);
+   rawResult_.clear();
 
    setField(json::kRpcAsyncHandle, handle);
 }
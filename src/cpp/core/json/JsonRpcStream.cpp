@@ -0,0 +1,255 @@
+/*
+ * JsonRpcStream.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/json/JsonRpcStream.hpp>
+
+#include <cstring>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <shared_core/SafeConvert.hpp>
+
+namespace rstudio {
+namespace core {
+namespace json {
+
+namespace {
+
+// header lines are short; anything longer means we are not looking at headers
+const std::size_t kMaxHeaderLineSize = 8192;
+
+Error framingError(const std::string& description, const ErrorLocation& location)
+{
+   return systemError(boost::system::errc::protocol_error, description, location);
+}
+
+} // anonymous namespace
+
+std::string formatFramedMessage(const std::string& body)
+{
+   std::string frame = "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+   frame.reserve(frame.size() + body.size());
+   frame.append(body);
+   return frame;
+}
+
+FramedMessageParser::FramedMessageParser(std::size_t maxMessageSize)
+   : state_(Header),
+     maxMessageSize_(maxMessageSize),
+     haveHeaders_(false),
+     contentLength_(-1)
+{
+}
+
+Error FramedMessageParser::parse(const std::string& buffer, std::vector<std::string>* pMessages)
+{
+   return parse(buffer.c_str(), buffer.size(), pMessages);
+}
+
+Error FramedMessageParser::parse(const char* buffer,
+                                 std::size_t len,
+                                 std::vector<std::string>* pMessages)
+{
+   Error firstError;
+
+   std::size_t index = 0;
+   while (index < len)
+   {
+      if (state_ == Body)
+      {
+         // copy as much of the body as this buffer holds
+         std::size_t needed = static_cast<std::size_t>(contentLength_) - body_.size();
+         std::size_t available = std::min(needed, len - index);
+         body_.append(buffer + index, available);
+         index += available;
+
+         if (body_.size() == static_cast<std::size_t>(contentLength_))
+         {
+            pMessages->push_back(std::string());
+            pMessages->back().swap(body_);
+            reset();
+         }
+
+         continue;
+      }
+
+      // accumulate the current header line
+      const char* begin = buffer + index;
+      const char* newline = static_cast<const char*>(std::memchr(begin, '\n', len - index));
+      std::size_t count = newline ? static_cast<std::size_t>(newline - begin) : len - index;
+
+      if (headerLine_.size() + count > kMaxHeaderLineSize)
+      {
+         if (state_ == Header && !firstError)
+            firstError = framingError("Header line too long", ERROR_LOCATION);
+
+         state_ = Discard;
+         headerLine_.clear();
+         index += newline ? count + 1 : count;
+         continue;
+      }
+
+      headerLine_.append(begin, count);
+      index += count;
+      if (!newline)
+         break;
+
+      // consume the newline and process the completed line
+      ++index;
+      Error error = endHeaderLine();
+      if (error)
+      {
+         if (!firstError)
+            firstError = error;
+         continue;
+      }
+
+      if (state_ == Body && contentLength_ == 0)
+      {
+         pMessages->push_back(std::string());
+         reset();
+      }
+   }
+
+   return firstError;
+}
+
+Error FramedMessageParser::endHeaderLine()
+{
+   std::string line;
+   line.swap(headerLine_);
+   if (!line.empty() && line[line.size() - 1] == '\r')
+      line.resize(line.size() - 1);
+
+   // a blank line ends the header block (blank lines between messages are ignored)
+   if (line.empty())
+   {
+      if (state_ == Discard || !haveHeaders_)
+         return Success();
+
+      if (contentLength_ < 0)
+      {
+         reset();
+         state_ = Discard;
+         return framingError("Message has no Content-Length header", ERROR_LOCATION);
+      }
+
+      state_ = Body;
+      body_.reserve(static_cast<std::size_t>(contentLength_));
+      return Success();
+   }
+
+   std::string name, value;
+   std::size_t colon = line.find(':');
+   if (colon != std::string::npos)
+   {
+      name = boost::algorithm::trim_copy(line.substr(0, colon));
+      value = boost::algorithm::trim_copy(line.substr(colon + 1));
+   }
+
+   bool isContentLength = boost::algorithm::iequals(name, "Content-Length");
+
+   // after a malformed frame, skip ahead to the start of the next header block
+   if (state_ == Discard)
+   {
+      if (!isContentLength)
+         return Success();
+
+      reset();
+   }
+
+   if (colon == std::string::npos)
+   {
+      reset();
+      state_ = Discard;
+      return framingError("Malformed header line: " + line.substr(0, 64), ERROR_LOCATION);
+   }
+
+   haveHeaders_ = true;
+
+   // other headers (e.g. Content-Type) are accepted and ignored
+   if (isContentLength)
+   {
+      long long contentLength = safe_convert::stringTo<long long>(value, -1);
+      if (contentLength < 0 || static_cast<unsigned long long>(contentLength) > maxMessageSize_)
+      {
+         reset();
+         state_ = Discard;
+         return framingError("Invalid Content-Length: " + value, ERROR_LOCATION);
+      }
+
+      contentLength_ = contentLength;
+   }
+
+   return Success();
+}
+
+void FramedMessageParser::reset()
+{
+   state_ = Header;
+   headerLine_.clear();
+   haveHeaders_ = false;
+   contentLength_ = -1;
+   body_.clear();
+}
+
+bool FramedMessageParser::hasPartialMessage() const
+{
+   return state_ == Body || haveHeaders_ || !headerLine_.empty();
+}
+
+FramedMessageWriter::FramedMessageWriter(std::size_t maxBytesPerFlush)
+   : maxBytesPerFlush_(maxBytesPerFlush),
+     pendingBytes_(0)
+{
+}
+
+void FramedMessageWriter::enqueue(const std::string& body)
+{
+   frames_.push_back(formatFramedMessage(body));
+   pendingBytes_ += frames_.back().size();
+}
+
+Error FramedMessageWriter::flush(const WriteFunction& write)
+{
+   std::size_t written = 0;
+   while (!frames_.empty())
+   {
+      const std::string& frame = frames_.front();
+      if (written > 0 && written + frame.size() > maxBytesPerFlush_)
+         break;
+
+      Error error = write(frame);
+      if (error)
+         return error;
+
+      written += frame.size();
+      pendingBytes_ -= frame.size();
+      frames_.pop_front();
+   }
+
+   return Success();
+}
+
+void FramedMessageWriter::clear()
+{
+   frames_.clear();
+   pendingBytes_ = 0;
+}
+
+} // namespace json
+} // namespace core
+} // namespace rstudio
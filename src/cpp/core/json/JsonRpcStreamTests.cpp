@@ -0,0 +1,251 @@
+/*
+ * JsonRpcStreamTests.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/json/JsonRpcStream.hpp>
+
+#include <shared_core/json/Json.hpp>
+
+#ifndef _WIN32
+#include <core/system/Process.hpp>
+#endif
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace json {
+namespace tests {
+
+namespace {
+
+std::string requestBody(int id)
+{
+   json::Object requestJson;
+   requestJson["jsonrpc"] = "2.0";
+   requestJson["id"] = std::to_string(id);
+   requestJson["method"] = "echo";
+   requestJson["params"] = std::string(id * 100, 'x');
+   return requestJson.write();
+}
+
+} // anonymous namespace
+
+test_context("JsonRpcStreamTests")
+{
+   test_that("Can parse a single message")
+   {
+      FramedMessageParser parser;
+      std::vector<std::string> messages;
+
+      CHECK(!parser.parse(formatFramedMessage("{\"id\":1}"), &messages));
+      REQUIRE(messages.size() == 1);
+      CHECK(messages[0] == "{\"id\":1}");
+      CHECK_FALSE(parser.hasPartialMessage());
+   }
+
+   test_that("Can parse several messages delivered in one buffer")
+   {
+      std::string stream =
+            formatFramedMessage("{\"id\":1}") +
+            formatFramedMessage("") +
+            formatFramedMessage("{\"body\":\"\\r\\n\\r\\nContent-Length: 5\"}");
+
+      FramedMessageParser parser;
+      std::vector<std::string> messages;
+
+      CHECK(!parser.parse(stream, &messages));
+      REQUIRE(messages.size() == 3);
+      CHECK(messages[0] == "{\"id\":1}");
+      CHECK(messages[1] == "");
+      CHECK(messages[2] == "{\"body\":\"\\r\\n\\r\\nContent-Length: 5\"}");
+   }
+
+   test_that("Can parse messages split at every byte")
+   {
+      std::string stream;
+      for (int i = 0; i < 5; ++i)
+         stream += formatFramedMessage(requestBody(i));
+
+      FramedMessageParser parser;
+      std::vector<std::string> messages;
+      for (char ch : stream)
+         CHECK(!parser.parse(&ch, 1, &messages));
+
+      REQUIRE(messages.size() == 5);
+      for (int i = 0; i < 5; ++i)
+         CHECK(messages[i] == requestBody(i));
+      CHECK_FALSE(parser.hasPartialMessage());
+   }
+
+   test_that("Headers are case-insensitive and other headers are ignored")
+   {
+      std::string stream =
+            "content-length: 2\r\n"
+            "Content-Type: application/vscode-jsonrpc; charset=utf-8\r\n"
+            "\r\n"
+            "{}";
+
+      FramedMessageParser parser;
+      std::vector<std::string> messages;
+
+      CHECK(!parser.parse(stream, &messages));
+      REQUIRE(messages.size() == 1);
+      CHECK(messages[0] == "{}");
+   }
+
+   test_that("Parser recovers from a malformed frame")
+   {
+      std::string stream =
+            "this is not a header\r\n"
+            "\r\n" +
+            formatFramedMessage("{\"id\":2}") +
+            "Content-Length: abc\r\n"
+            "\r\n" +
+            formatFramedMessage("{\"id\":3}");
+
+      FramedMessageParser parser;
+      std::vector<std::string> messages;
+
+      CHECK(parser.parse(stream, &messages));
+      REQUIRE(messages.size() == 2);
+      CHECK(messages[0] == "{\"id\":2}");
+      CHECK(messages[1] == "{\"id\":3}");
+   }
+
+   test_that("Parser rejects oversized messages")
+   {
+      FramedMessageParser parser(16);
+      std::vector<std::string> messages;
+
+      CHECK(parser.parse(formatFramedMessage(std::string(17, 'x')), &messages));
+      CHECK(messages.empty());
+   }
+
+   test_that("Writer flushes whole messages within its budget")
+   {
+      FramedMessageWriter writer(150);
+      for (int i = 0; i < 3; ++i)
+         writer.enqueue(std::string(40, 'a' + i));
+
+      std::size_t totalBytes = writer.pendingBytes();
+      CHECK(writer.pendingMessages() == 3);
+
+      std::vector<std::string> writes;
+      auto write = [&](const std::string& frame)
+      {
+         writes.push_back(frame);
+         return Success();
+      };
+
+      // each frame (with its header) is 62 bytes, so only two fit in the budget
+      CHECK(!writer.flush(write));
+      CHECK(writes.size() == 2);
+      CHECK(writer.pendingMessages() == 1);
+
+      CHECK(!writer.flush(write));
+      CHECK(writes.size() == 3);
+      CHECK(writer.empty());
+      CHECK(writer.pendingBytes() == 0);
+
+      std::size_t writtenBytes = 0;
+      for (const std::string& frame : writes)
+         writtenBytes += frame.size();
+      CHECK(writtenBytes == totalBytes);
+   }
+
+   test_that("Writer retains messages that fail to write")
+   {
+      FramedMessageWriter writer;
+      writer.enqueue("{}");
+
+      Error error = writer.flush([](const std::string&)
+      {
+         return systemError(boost::system::errc::broken_pipe, ERROR_LOCATION);
+      });
+
+      CHECK(error);
+      CHECK(writer.pendingMessages() == 1);
+   }
+
+#ifndef _WIN32
+
+   test_that("Can exchange messages with a child process")
+   {
+      // a stub agent that echoes requests back, and which also writes a
+      // notification of its own in fragments with pauses in between, so
+      // that its frames arrive split across reads
+      std::string script =
+            "printf 'Content-Len'; sleep 0.2; "
+            "printf 'gth: 16\\r\\n\\r'; sleep 0.2; "
+            "printf '\\n{\"method\":\"hi\"}'; "
+            "exec cat";
+
+      system::ProcessOptions options;
+      options.threadSafe = true;
+
+      FramedMessageWriter writer(256);
+      for (int i = 0; i < 10; ++i)
+         writer.enqueue(requestBody(i));
+
+      FramedMessageParser parser;
+      std::vector<std::string> messages;
+      Error parseError;
+
+      system::ProcessCallbacks callbacks;
+      callbacks.onContinue = [&](system::ProcessOperations& operations)
+      {
+         if (writer.empty())
+            return true;
+
+         Error error = writer.flush([&](const std::string& frame)
+         {
+            return operations.writeToStdin(frame, false);
+         });
+         CHECK(!error);
+
+         if (writer.empty())
+            operations.writeToStdin(std::string(), true);
+
+         return true;
+      };
+
+      callbacks.onStdout = [&](system::ProcessOperations&, const std::string& output)
+      {
+         Error error = parser.parse(output, &messages);
+         if (error)
+            parseError = error;
+      };
+
+      system::ProcessSupervisor supervisor;
+      CHECK(!supervisor.runCommand(script, options, callbacks));
+      CHECK(supervisor.wait(boost::posix_time::milliseconds(20),
+                           boost::posix_time::seconds(10)));
+
+      CHECK(!parseError);
+      REQUIRE(messages.size() == 11);
+      CHECK(messages[0] == "{\"method\":\"hi\"}");
+      for (int i = 0; i < 10; ++i)
+         CHECK(messages[i + 1] == requestBody(i));
+      CHECK_FALSE(parser.hasPartialMessage());
+   }
+
+#endif
+
+}
+
+} // namespace tests
+} // namespace json
+} // namespace core
+} // namespace rstudio
@@ -16,6 +16,8 @@
 
 #include <tests/TestThat.hpp>
 
+#include <sstream>
+
 #include <core/json/JsonRpc.hpp>
 
 namespace rstudio {
@@ -350,6 +352,25 @@ TEST_CASE("JsonRpc")
       json::JsonRpcResponse jsonRpcResponse;
       jsonRpcResponse.setResult(root);
    }
+
+   SECTION("Raw results are written as if they had been set as values")
+   {
+      json::Object object = createObject();
+
+      json::JsonRpcResponse valueResponse;
+      valueResponse.setResult(object);
+
+      json::JsonRpcResponse rawResponse;
+      rawResponse.setRawResult(object.write());
+
+      std::ostringstream valueOutput, rawOutput;
+      valueResponse.write(valueOutput);
+      rawResponse.write(rawOutput);
+
+      REQUIRE(valueOutput.str() == rawOutput.str());
+      REQUIRE(rawResponse.result() == valueResponse.result());
+      REQUIRE(rawResponse.getRawResponse() == valueResponse.getRawResponse());
+   }
 }
 
 } // namespace tests
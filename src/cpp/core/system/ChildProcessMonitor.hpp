@@ -0,0 +1,84 @@
+/*
+ * ChildProcessMonitor.hpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_SYSTEM_CHILD_PROCESS_MONITOR_HPP
+#define CORE_SYSTEM_CHILD_PROCESS_MONITOR_HPP
+
+#include <atomic>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/system/System.hpp>
+
+namespace rstudio {
+namespace core {
+namespace system {
+
+// Watches the output descriptors and exit of a child process from the child
+// process monitor thread (see below). The watch only records that something
+// happened; reading output and reaping the child are still done by the
+// owner (in AsyncChildProcess::poll), which can skip those calls entirely
+// while the child is quiet.
+//
+// The watch must be destroyed before the watched descriptors are closed.
+class ChildProcessWatch : boost::noncopyable
+{
+public:
+   ~ChildProcessWatch();
+
+   // returns true if output may be available to read since the last call
+   // (reads must then continue until EAGAIN to re-arm the notification)
+   bool takeOutputReady()
+   {
+      return outputReady_.exchange(false);
+   }
+
+   // whether the exit of the child is reported by exitReady(); if not,
+   // the owner must keep checking for exit with waitpid
+   bool canDetectExit() const { return pidFd_ != -1; }
+
+   // whether the child has exited (and can now be reaped)
+   bool exitReady() const { return exitReady_.load(); }
+
+private:
+   friend class ChildProcessMonitor;
+
+   ChildProcessWatch(uint64_t id, int pidFd);
+
+   uint64_t id_;
+   int pidFd_;
+   std::vector<int> fds_;
+   std::atomic<bool> outputReady_;
+   std::atomic<bool> exitReady_;
+};
+
+// Begins watching the given child process and its output descriptors
+// (descriptors which are -1 are ignored). Returns null if child processes
+// cannot be monitored, in which case the owner should poll as usual.
+boost::shared_ptr<ChildProcessWatch> watchChildProcess(PidType pid,
+                                                       const std::vector<int>& fds);
+
+// Called when the children of a process supervisor have been polled, which
+// allows the activity callback (see setChildProcessActivityCallback) to be
+// invoked again.
+void onChildProcessesPolled();
+
+} // namespace system
+} // namespace core
+} // namespace rstudio
+
+#endif // CORE_SYSTEM_CHILD_PROCESS_MONITOR_HPP
@@ -0,0 +1,339 @@
+/*
+ * LinuxChildProcessMonitor.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ChildProcessMonitor.hpp"
+
+#include <map>
+
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/function.hpp>
+
+#include <shared_core/Error.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+#include <core/system/Process.hpp>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+namespace rstudio {
+namespace core {
+namespace system {
+
+namespace {
+
+// the low bit of the epoll event data distinguishes the pidfd of a watch
+// from its output descriptors
+const uint64_t kExitEvent = 1;
+
+int pidfdOpen(PidType pid)
+{
+   return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+}
+
+} // anonymous namespace
+
+// A single background thread which waits (with epoll) on the output
+// descriptors and pidfds of all watched child processes. When anything
+// happens it flags the affected watches and invokes the activity callback,
+// at most once between polls, so that the owner of the children (typically
+// the main thread) can be woken to poll them.
+class ChildProcessMonitor : boost::noncopyable
+{
+public:
+   ChildProcessMonitor()
+      : epollFd_(-1),
+        ownerPid_(::getpid()),
+        nextId_(0),
+        callbackPending_(false)
+   {
+   }
+
+   Error start()
+   {
+      epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+      if (epollFd_ == -1)
+         return systemError(errno, ERROR_LOCATION);
+
+      // launched with all signals blocked, so that signals meant for the
+      // session are never delivered to the monitor
+      boost::thread thread;
+      core::thread::safeLaunchThread(boost::bind(&ChildProcessMonitor::run, this), &thread);
+      if (!thread.joinable())
+      {
+         ::close(epollFd_);
+         epollFd_ = -1;
+         return systemError(boost::system::errc::resource_unavailable_try_again, ERROR_LOCATION);
+      }
+
+      thread.detach();
+      return Success();
+   }
+
+   // the epoll descriptor is inherited by forked (but not exec'd) children,
+   // which must not alter the parent's set of watched descriptors
+   bool isOwner() const
+   {
+      return ::getpid() == ownerPid_;
+   }
+
+   boost::shared_ptr<ChildProcessWatch> watch(PidType pid, const std::vector<int>& fds)
+   {
+      uint64_t id;
+      LOCK_MUTEX(mutex_)
+      {
+         // ids are even; the low bit marks exit events
+         nextId_ += 2;
+         id = nextId_;
+      }
+      END_LOCK_MUTEX
+
+      // the pidfd (which is always close-on-exec) becomes readable when the
+      // child exits. pidfds require Linux 5.3; without one the owner
+      // continues to check for exit with waitpid
+      int pidFd = pidfdOpen(pid);
+
+      boost::shared_ptr<ChildProcessWatch> pWatch(new ChildProcessWatch(id, pidFd));
+
+      LOCK_MUTEX(mutex_)
+      {
+         watches_[id] = pWatch.get();
+      }
+      END_LOCK_MUTEX
+
+      // output descriptors are edge triggered: we're notified when new output
+      // arrives, and the owner reads until EAGAIN before waiting again
+      for (int fd : fds)
+      {
+         if (fd == -1)
+            continue;
+
+         struct epoll_event event = {};
+         event.events = EPOLLIN | EPOLLET;
+         event.data.u64 = id;
+         if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) == -1)
+         {
+            // most likely a descriptor which epoll does not support (e.g. a
+            // regular file); fall back to polling this child
+            LOG_DEBUG_MESSAGE("Unable to monitor child process output: " +
+                              systemError(errno, ERROR_LOCATION).asString());
+            return boost::shared_ptr<ChildProcessWatch>();
+         }
+
+         pWatch->fds_.push_back(fd);
+      }
+
+      if (pidFd != -1)
+      {
+         struct epoll_event event = {};
+         event.events = EPOLLIN | EPOLLET;
+         event.data.u64 = id | kExitEvent;
+         if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, pidFd, &event) == -1)
+         {
+            LOG_DEBUG_MESSAGE("Unable to monitor child process exit: " +
+                              systemError(errno, ERROR_LOCATION).asString());
+            return boost::shared_ptr<ChildProcessWatch>();
+         }
+      }
+
+      return pWatch;
+   }
+
+   void unwatch(ChildProcessWatch* pWatch)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         watches_.erase(pWatch->id_);
+      }
+      END_LOCK_MUTEX
+
+      if (isOwner())
+      {
+         // errors are expected here if the owner has already closed a descriptor
+         for (int fd : pWatch->fds_)
+            ::epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+
+         if (pWatch->pidFd_ != -1)
+            ::epoll_ctl(epollFd_, EPOLL_CTL_DEL, pWatch->pidFd_, nullptr);
+      }
+
+      if (pWatch->pidFd_ != -1)
+         ::close(pWatch->pidFd_);
+   }
+
+   void setActivityCallback(const boost::function<void()>& callback)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         activityCallback_ = callback;
+      }
+      END_LOCK_MUTEX
+   }
+
+   void onPolled()
+   {
+      callbackPending_ = false;
+   }
+
+private:
+   void run()
+   {
+      const int kMaxEvents = 64;
+      struct epoll_event events[kMaxEvents];
+
+      while (true)
+      {
+         int count = ::epoll_wait(epollFd_, events, kMaxEvents, -1);
+         if (count == -1)
+         {
+            if (errno == EINTR)
+               continue;
+
+            LOG_ERROR(systemError(errno, ERROR_LOCATION));
+            return;
+         }
+
+         bool activity = false;
+         boost::function<void()> callback;
+
+         LOCK_MUTEX(mutex_)
+         {
+            for (int i = 0; i < count; ++i)
+            {
+               uint64_t data = events[i].data.u64;
+               auto it = watches_.find(data & ~kExitEvent);
+               if (it == watches_.end())
+                  continue;
+
+               if (data & kExitEvent)
+                  it->second->exitReady_ = true;
+               else
+                  it->second->outputReady_ = true;
+
+               activity = true;
+            }
+
+            callback = activityCallback_;
+         }
+         END_LOCK_MUTEX
+
+         // coalesce activity into a single callback until the next poll
+         if (activity && callback && !callbackPending_.exchange(true))
+            callback();
+      }
+   }
+
+   int epollFd_;
+   PidType ownerPid_;
+
+   boost::mutex mutex_;
+   uint64_t nextId_;
+   std::map<uint64_t, ChildProcessWatch*> watches_;
+   boost::function<void()> activityCallback_;
+
+   std::atomic<bool> callbackPending_;
+};
+
+namespace {
+
+// heap based so it is never destructed (the monitor thread may be waiting
+// on it at exit)
+std::atomic<ChildProcessMonitor*> s_pMonitor(nullptr);
+boost::mutex s_monitorMutex;
+boost::function<void()> s_activityCallback;
+
+ChildProcessMonitor* monitor()
+{
+   LOCK_MUTEX(s_monitorMutex)
+   {
+      static bool s_failed = false;
+      if (!s_pMonitor && !s_failed)
+      {
+         ChildProcessMonitor* pMonitor = new ChildProcessMonitor();
+         Error error = pMonitor->start();
+         if (error)
+         {
+            LOG_ERROR(error);
+            s_failed = true;
+            return nullptr;
+         }
+
+         pMonitor->setActivityCallback(s_activityCallback);
+         s_pMonitor = pMonitor;
+      }
+
+      ChildProcessMonitor* pMonitor = s_pMonitor.load();
+      if (pMonitor && !pMonitor->isOwner())
+         return nullptr;
+
+      return pMonitor;
+   }
+   END_LOCK_MUTEX
+
+   return nullptr;
+}
+
+} // anonymous namespace
+
+ChildProcessWatch::ChildProcessWatch(uint64_t id, int pidFd)
+   : id_(id),
+     pidFd_(pidFd),
+     outputReady_(true),
+     exitReady_(false)
+{
+}
+
+ChildProcessWatch::~ChildProcessWatch()
+{
+   if (ChildProcessMonitor* pMonitor = s_pMonitor.load())
+      pMonitor->unwatch(this);
+}
+
+boost::shared_ptr<ChildProcessWatch> watchChildProcess(PidType pid,
+                                                       const std::vector<int>& fds)
+{
+   ChildProcessMonitor* pMonitor = monitor();
+   if (!pMonitor)
+      return boost::shared_ptr<ChildProcessWatch>();
+
+   return pMonitor->watch(pid, fds);
+}
+
+void onChildProcessesPolled()
+{
+   if (ChildProcessMonitor* pMonitor = s_pMonitor.load())
+      pMonitor->onPolled();
+}
+
+void setChildProcessActivityCallback(const boost::function<void()>& callback)
+{
+   LOCK_MUTEX(s_monitorMutex)
+   {
+      s_activityCallback = callback;
+      if (ChildProcessMonitor* pMonitor = s_pMonitor.load())
+         pMonitor->setActivityCallback(callback);
+   }
+   END_LOCK_MUTEX
+}
+
+} // namespace system
+} // namespace core
+} // namespace rstudio
@@ -15,6 +15,10 @@
 
 #include "ChildProcessSubprocPoll.hpp"
 
+#ifdef __linux__
+#include "ChildProcessMonitor.hpp"
+#endif
+
 #include <atomic>
 #include <fcntl.h>
 #include <signal.h>
@@ -26,6 +30,7 @@
 #include <sys/ioctl.h>
 #elif defined(__linux__)
 #include <pty.h>
+#include <spawn.h>
 #include <asm/ioctls.h>
 #include <sys/prctl.h>
 #endif
@@ -35,6 +40,7 @@
 
 #include <boost/asio.hpp>
 #include <boost/bind/bind.hpp>
+#include <boost/noncopyable.hpp>
 
 #include <shared_core/Error.hpp>
 
@@ -50,6 +56,23 @@
 
 using namespace boost::placeholders;
 
+#ifdef __linux__
+
+extern char **environ;
+
+// posix_spawn file actions for changing directory and closing all inherited
+// descriptors are glibc extensions (2.29 and 2.34 respectively)
+#ifdef __GLIBC__
+# if __GLIBC_PREREQ(2, 29)
+#  define RSTUDIO_SPAWN_HAS_ADDCHDIR
+# endif
+# if __GLIBC_PREREQ(2, 34)
+#  define RSTUDIO_SPAWN_HAS_ADDCLOSEFROM
+# endif
+#endif
+
+#endif
+
 namespace rstudio {
 namespace core {
 namespace system {
@@ -74,6 +97,9 @@ const boost::posix_time::milliseconds kCheckSubprocDelay =
 const boost::posix_time::milliseconds kCheckCwdDelay =
                                          boost::posix_time::milliseconds(2000);
 
+// number of children launched with posix_spawn rather than fork
+std::atomic<uint64_t> s_spawnedChildCount(0);
+
 int resolveExitStatus(int status)
 {
    if (WIFEXITED(status))
@@ -162,6 +188,180 @@ Error readPipe(int pipeFd, std::string* pOutput, bool *pEOF = nullptr)
    return Success();
 }
 
+#ifdef __linux__
+
+struct SpawnAttributes : boost::noncopyable
+{
+   SpawnAttributes()
+   {
+      ::posix_spawn_file_actions_init(&actions);
+      ::posix_spawnattr_init(&attributes);
+   }
+
+   ~SpawnAttributes()
+   {
+      ::posix_spawn_file_actions_destroy(&actions);
+      ::posix_spawnattr_destroy(&attributes);
+   }
+
+   posix_spawn_file_actions_t actions;
+   posix_spawnattr_t attributes;
+};
+
+#endif
+
+// determines whether the child can be launched with posix_spawn rather than
+// fork. in a large process (e.g. an R session holding many GB of heap) fork
+// must copy the parent's page tables, which can stall the parent for hundreds
+// of milliseconds; glibc's posix_spawn uses clone(CLONE_VM|CLONE_VFORK) and
+// so costs the same regardless of the size of the parent. options which need
+// code to run in the child before exec cannot be expressed with posix_spawn,
+// so processes which use them are still forked
+bool canSpawnChild(const ProcessOptions& options)
+{
+#ifdef __linux__
+   // pseudoterminals need the child to acquire a controlling terminal
+   if (options.pseudoterminal)
+      return false;
+
+   if (!options.runAsUser.empty() || options.exitWithParent)
+      return false;
+
+   // the thread safe fork ignores these options, so only consider them
+   // when they would otherwise be honored
+   if (!options.threadSafe)
+   {
+      if (options.onAfterFork)
+         return false;
+
+#ifndef RSTUDIO_SPAWN_HAS_ADDCHDIR
+      if (!options.workingDir.isEmpty())
+         return false;
+#endif
+   }
+
+#ifndef POSIX_SPAWN_SETSID
+   if (options.detachSession)
+      return false;
+#endif
+
+   return true;
+#else
+   return false;
+#endif
+}
+
+// launches the child with posix_spawn, wiring its standard streams to the
+// given pipes; on error no child has been created and the pipes are untouched
+Error spawnChild(const std::string& exe,
+                 const ProcessArgs& args,
+                 const ProcessArgs* pEnvironment,
+                 const ProcessOptions& options,
+                 const int* fdInput,
+                 const int* fdOutput,
+                 const int* fdError,
+                 PidType* pPid)
+{
+#ifdef __linux__
+   SpawnAttributes spawn;
+
+   // wire standard streams
+   int result = ::posix_spawn_file_actions_adddup2(&spawn.actions, fdInput[READ], STDIN_FILENO);
+   if (result == 0)
+      result = ::posix_spawn_file_actions_adddup2(&spawn.actions, fdOutput[WRITE], STDOUT_FILENO);
+   if (result == 0)
+   {
+      int fdStderr = options.redirectStdErrToStdOut ? fdOutput[WRITE] : fdError[WRITE];
+      result = ::posix_spawn_file_actions_adddup2(&spawn.actions, fdStderr, STDERR_FILENO);
+   }
+
+   // close all inherited file descriptors other than the standard streams
+   // (including the pipe ends, which have now been duplicated)
+#ifdef RSTUDIO_SPAWN_HAS_ADDCLOSEFROM
+   if (result == 0)
+      result = ::posix_spawn_file_actions_addclosefrom_np(&spawn.actions, STDERR_FILENO + 1);
+#else
+   // without closefrom, close the descriptors that are open now; as with the
+   // fork, descriptors opened concurrently by other threads may be inherited
+   // unless they are close-on-exec. descriptors that are closed before the
+   // spawn are skipped by posix_spawn
+   if (result == 0)
+   {
+      std::vector<uint32_t> fds;
+      Error error = getOpenFds(&fds);
+      if (error)
+         return error;
+
+      for (uint32_t fd : fds)
+      {
+         if (fd <= STDERR_FILENO)
+            continue;
+
+         result = ::posix_spawn_file_actions_addclose(&spawn.actions, static_cast<int>(fd));
+         if (result != 0)
+            break;
+      }
+   }
+#endif
+
+#ifdef RSTUDIO_SPAWN_HAS_ADDCHDIR
+   if (result == 0 && !options.threadSafe && !options.workingDir.isEmpty())
+   {
+      result = ::posix_spawn_file_actions_addchdir_np(
+               &spawn.actions,
+               options.workingDir.getAbsolutePath().c_str());
+   }
+#endif
+
+   // clear the signal mask so that the child does not unintentionally
+   // block any signals that our parent is blocking
+   short flags = POSIX_SPAWN_SETSIGMASK;
+   sigset_t blockNoneMask;
+   sigemptyset(&blockNoneMask);
+   if (result == 0)
+      result = ::posix_spawnattr_setsigmask(&spawn.attributes, &blockNoneMask);
+
+   // create a new session or process group as requested (see run)
+   if (options.detachSession)
+   {
+#ifdef POSIX_SPAWN_SETSID
+      flags |= POSIX_SPAWN_SETSID;
+#endif
+   }
+   else if (options.terminateChildren)
+   {
+      flags |= POSIX_SPAWN_SETPGROUP;
+      if (result == 0)
+         result = ::posix_spawnattr_setpgroup(&spawn.attributes, 0);
+   }
+
+   if (result == 0)
+      result = ::posix_spawnattr_setflags(&spawn.attributes, flags);
+
+   if (result != 0)
+      return systemError(result, ERROR_LOCATION);
+
+   static char* emptyEnvironment[] = { nullptr };
+   char** envp = environ;
+   if (pEnvironment)
+      envp = pEnvironment->args() ? pEnvironment->args() : emptyEnvironment;
+
+   pid_t pid = -1;
+   result = ::posix_spawn(&pid, exe.c_str(), &spawn.actions, &spawn.attributes, args.args(), envp);
+   if (result != 0)
+   {
+      Error error = systemError(result, ERROR_LOCATION);
+      error.addProperty("exe", exe);
+      return error;
+   }
+
+   *pPid = pid;
+   return Success();
+#else
+   return systemError(boost::system::errc::operation_not_supported, ERROR_LOCATION);
+#endif
+}
+
 } // anonymous namespace
 
 
@@ -452,6 +652,7 @@ Error ChildProcess::run()
    int fdError[2] = {0,0};
    int fdCloseFd[2] = {0,0};
    int fdMaster = 0;
+   bool spawned = false;
 
    // build args (on heap so they stay around after exec)
    // create set of args to pass (needs to include the cmd)
@@ -552,10 +753,40 @@ Error ChildProcess::run()
          return error;
       }
 
-      // close fd communication channel - only used in threadsafe mode
-      if (options_.threadSafe)
+      // spawn rather than fork when the options allow it (see canSpawnChild).
+      // if the spawn fails (e.g. the program could not be executed) we fall
+      // back to the fork so that failures are reported as they always have
+      // been, as the exit status of the child
+      if (canSpawnChild(options_))
+      {
+         error = spawnChild(exe_, *pProcessArgs, pEnvironment, options_,
+                            fdInput, fdOutput, fdError, &pid);
+         if (!error)
+         {
+            spawned = true;
+            ++s_spawnedChildCount;
+         }
+         else
+            LOG_DEBUG_MESSAGE("Unable to spawn child process, forking instead: " + error.asString());
+      }
+
+      if (!spawned)
       {
-         error = posix::posixCall<int>(boost::bind(::pipe, fdCloseFd), ERROR_LOCATION);
+         // close fd communication channel - only used in threadsafe mode
+         if (options_.threadSafe)
+         {
+            error = posix::posixCall<int>(boost::bind(::pipe, fdCloseFd), ERROR_LOCATION);
+            if (error)
+            {
+               closePipe(fdInput, ERROR_LOCATION);
+               closePipe(fdOutput, ERROR_LOCATION);
+               closePipe(fdError, ERROR_LOCATION);
+               return error;
+            }
+         }
+
+         // fork
+         error = posix::posixCall<PidType>(::fork, ERROR_LOCATION, &pid);
          if (error)
          {
             closePipe(fdInput, ERROR_LOCATION);
@@ -564,16 +795,6 @@ Error ChildProcess::run()
             return error;
          }
       }
-
-      // fork
-      error = posix::posixCall<PidType>(::fork, ERROR_LOCATION, &pid);
-      if (error)
-      {
-         closePipe(fdInput, ERROR_LOCATION);
-         closePipe(fdOutput, ERROR_LOCATION);
-         closePipe(fdError, ERROR_LOCATION);
-         return error;
-      }
    }
 
    // child
@@ -858,7 +1079,7 @@ Error ChildProcess::run()
          closePipe(fdOutput[WRITE], ERROR_LOCATION);
          closePipe(fdError[WRITE], ERROR_LOCATION);
 
-         if (options_.threadSafe)
+         if (options_.threadSafe && !spawned)
          {
             closePipe(fdCloseFd[READ], ERROR_LOCATION);
          }
@@ -870,7 +1091,7 @@ Error ChildProcess::run()
       delete pProcessArgs;
       delete pEnvironment;
 
-      if (options_.threadSafe)
+      if (options_.threadSafe && !spawned)
       {
          // send the list of the child proc's fds to the child so
          // it can properly close its unneeded fds in a fast manner
@@ -943,6 +1164,9 @@ struct AsyncChildProcess::AsyncImpl
    bool finishedStderr_;
    bool exited_;
    boost::scoped_ptr<ChildProcessSubprocPoll> pSubprocPoll_;
+#ifdef __linux__
+   boost::shared_ptr<ChildProcessWatch> pWatch_;
+#endif
 };
 
 AsyncChildProcess::AsyncChildProcess(const std::string& exe,
@@ -1058,6 +1282,14 @@ void AsyncChildProcess::poll()
          options().ignoredSubprocs,
          options().trackCwd ? core::system::currentWorkingDir : nullptr));
 
+#ifdef __linux__
+      // have the child process monitor watch for output and exit, so that we
+      // can skip reading from (and reaping) the child while it is quiet
+      pAsyncImpl_->pWatch_ = watchChildProcess(
+               pImpl_->pid,
+               { pImpl_->fdStdout, options().pseudoterminal ? -1 : pImpl_->fdStderr });
+#endif
+
       if (callbacks_.onStarted)
          callbacks_.onStarted(*this);
       pAsyncImpl_->calledOnStarted_ = true;
@@ -1077,8 +1309,22 @@ void AsyncChildProcess::poll()
 
    bool hasRecentOutput = false;
 
+   // without a watch we read from the child and check for its exit on every
+   // poll; otherwise only once the monitor has seen output or the exit. when
+   // the consumer isn't ready for output, the monitor's output flag is left
+   // set so that reading picks up again once it is
+   bool readOutput = !callbacks_.readyForOutput || callbacks_.readyForOutput();
+   bool checkExit = true;
+#ifdef __linux__
+   if (pAsyncImpl_->pWatch_)
+   {
+      readOutput = readOutput && pAsyncImpl_->pWatch_->takeOutputReady();
+      checkExit = !pAsyncImpl_->pWatch_->canDetectExit() || pAsyncImpl_->pWatch_->exitReady();
+   }
+#endif
+
    // check stdout and fire event if we got output
-   if (!pAsyncImpl_->finishedStdout_)
+   if (readOutput && !pAsyncImpl_->finishedStdout_)
    {
       bool eof = false;
       std::string out;
@@ -1101,7 +1347,7 @@ void AsyncChildProcess::poll()
    }
 
    // check stderr and fire event if we got output
-   if (!pAsyncImpl_->finishedStderr_)
+   if (readOutput && !pAsyncImpl_->finishedStderr_)
    {
       bool eof = false;
       std::string err;
@@ -1131,8 +1377,12 @@ void AsyncChildProcess::poll()
    // case we'll allow the exit sequence to proceed and simply pass -1 as
    // the exit status.
    int status = -1;
-   PidType result = posix::posixCall<PidType>(
-            boost::bind(::waitpid, pImpl_->pid, &status, WNOHANG));
+   PidType result = 0;
+   if (checkExit)
+   {
+      result = posix::posixCall<PidType>(
+               boost::bind(::waitpid, pImpl_->pid, &status, WNOHANG));
+   }
 
    // either a normal exit or an error while waiting
    if (result != 0)
@@ -1184,6 +1434,11 @@ void AsyncChildProcess::poll()
          }
       }
       
+#ifdef __linux__
+      // stop watching before the pipes are closed
+      pAsyncImpl_->pWatch_.reset();
+#endif
+
       // close all of our pipes
       pImpl_->closeAll(ERROR_LOCATION);
 
@@ -1809,6 +2064,12 @@ Error forkAndRunImpl(const boost::function<int(void)>& func,
 }
 
 } // anonymous namespace
+
+uint64_t spawnedChildCount()
+{
+   return s_spawnedChildCount;
+}
+
 Error forkAndRun(const boost::function<int(void)>& func,
                  const std::string& runAs)
 {
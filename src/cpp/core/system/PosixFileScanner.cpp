@@ -15,15 +15,29 @@
 
 #include <core/system/FileScanner.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <boost/bind/bind.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <shared_core/Error.hpp>
 #include <core/Log.hpp>
 #include <shared_core/FilePath.hpp>
 #include <core/BoostThread.hpp>
-
-#include "config.h"
+#include <core/Thread.hpp>
 
 namespace rstudio {
 namespace core {
@@ -31,78 +45,836 @@ namespace system {
 
 namespace {
 
-#if defined(__APPLE__) && !defined(HAVE_SCANDIR_POSIX)
-int entryFilter(struct dirent *entry)
+// Recursive scans are split between the calling thread and a pool of worker
+// threads. The calling thread walks the tree exactly as a serial scan would:
+// it calls onBeforeScanDir and the filter (which are not required to be
+// thread safe) in depth-first order and builds the tree. The workers read
+// directories ahead of it, so that by the time the scan reaches a directory
+// its entries have usually already been read and stat'ed. Since the workers
+// can't apply the filter they may read directories which the filter goes on
+// to exclude; this is bounded by kMaxPendingEntries, and reading ahead is
+// cancelled for a directory as soon as the filter excludes it.
+//
+// When there's an onBeforeScanDir hook the attributes of files must be read
+// after the hook has run for their directory, so the workers read ahead only
+// the names and types of entries, and the scan shares the reading of the
+// attributes with the workers once it reaches the directory.
+
+// reading directories is bound by I/O latency (particularly on network file
+// systems) rather than CPU, so this is independent of the number of cores
+const std::size_t kMaxScanThreads = 8;
+
+// the number of entries in directories which have been read ahead but not yet
+// reached by the scan, beyond which the workers wait for the scan to catch up
+const std::size_t kMaxPendingEntries = 100000;
+
+// a directory listing read ahead of the scan is re-read (when there is an
+// onBeforeScanDir hook) if the directory was modified this recently, since
+// the modification time alone can't tell us whether the listing includes it
+const std::time_t kRacyListingSeconds = 2;
+
+// the number of entries whose attributes are read as a unit by one thread
+const std::size_t kAttributeChunkSize = 128;
+
+#ifdef __linux__
+// the size of the buffer used to read entries with getdents64; the larger the
+// buffer, the fewer the calls needed to read large directories
+const std::size_t kDirentBufferSize = 128 * 1024;
+
+// a directory entry as returned by getdents64
+struct LinuxDirent64
+{
+   uint64_t d_ino;
+   int64_t d_off;
+   unsigned short d_reclen;
+   unsigned char d_type;
+   char d_name[1];
+};
+
+// whether statx has failed with ENOSYS (it requires Linux 4.11)
+std::atomic<bool> s_statxUnavailable(false);
+#endif
+
+struct DirEntry
+{
+   DirEntry()
+      : isDirectory(false), isSymlink(false), size(0), lastWriteTime(0)
+   {
+   }
+
+   std::string name;
+   bool isDirectory;
+   bool isSymlink;
+   uintmax_t size;
+   std::time_t lastWriteTime;
+
+   // the entry as it's added to the tree
+   FileInfo fileInfo;
+};
+
+// the modification and change times of a directory, used to tell whether a
+// directory has changed since it was read
+struct DirStamp
+{
+   DirStamp()
+      : mtime(0), mtimeNsec(0), ctime(0), ctimeNsec(0)
+   {
+   }
+
+   explicit DirStamp(const struct stat& st)
+   {
+#ifdef __APPLE__
+      mtime = st.st_mtimespec.tv_sec;
+      mtimeNsec = st.st_mtimespec.tv_nsec;
+      ctime = st.st_ctimespec.tv_sec;
+      ctimeNsec = st.st_ctimespec.tv_nsec;
 #else
-int entryFilter(const struct dirent *entry)
+      mtime = st.st_mtim.tv_sec;
+      mtimeNsec = st.st_mtim.tv_nsec;
+      ctime = st.st_ctim.tv_sec;
+      ctimeNsec = st.st_ctim.tv_nsec;
 #endif
+   }
+
+   bool operator==(const DirStamp& other) const
+   {
+      return mtime == other.mtime && mtimeNsec == other.mtimeNsec &&
+             ctime == other.ctime && ctimeNsec == other.ctimeNsec;
+   }
+
+   bool operator!=(const DirStamp& other) const
+   {
+      return !(*this == other);
+   }
+
+   std::time_t mtime;
+   long mtimeNsec;
+   std::time_t ctime;
+   long ctimeNsec;
+};
+
+struct DirListing
 {
-   if (::strcmp(entry->d_name, ".") == 0 || ::strcmp(entry->d_name, "..") == 0)
-      return 0;
-   else
-      return 1;
-}
+   DirListing()
+      : readTime(0)
+   {
+   }
+
+   Error error;
+
+   // entries (other than . and ..) sorted by name
+   std::vector<DirEntry> entries;
+
+   // errors encountered reading individual entries
+   std::vector<Error> entryErrors;
+
+   DirStamp stamp;
+   std::time_t readTime;
+};
 
 // note: because R may change LC_COLLATE, we cannot
 // use strcoll (otherwise we run into race issues where
 // the file monitor attempts to access LC_COLLATE just as
-// R is replacing it). to avoid this, we use strcmp and
+// R is replacing it). to avoid this, we compare bytes and
 // don't sort according to locale.
-#if !defined(HAVE_SCANDIR_POSIX)
-int alphasort(const void* voidlhs, const void* voidrhs)
+bool compareEntries(const DirEntry& lhs, const DirEntry& rhs)
 {
-   const dirent** lhs = (const dirent**)voidlhs;
-   const dirent** rhs = (const dirent**)voidrhs;
+   return lhs.name < rhs.name;
+}
+
+bool isDotOrDotDot(const char* name)
+{
+   return name[0] == '.' &&
+          (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+void setEntryInfo(const struct stat& st, DirEntry* pEntry)
+{
+   pEntry->isDirectory = S_ISDIR(st.st_mode);
+   pEntry->isSymlink = S_ISLNK(st.st_mode);
+   pEntry->size = st.st_size;
+#ifdef __APPLE__
+   pEntry->lastWriteTime = st.st_mtimespec.tv_sec;
 #else
-int alphasort(const dirent** lhs, const dirent** rhs)
+   pEntry->lastWriteTime = st.st_mtime;
+#endif
+}
+
+// reads the attributes of the named entry (without following symlinks),
+// returning 0 or an errno value
+int statEntry(int dirFd, const char* name, DirEntry* pEntry)
 {
+#if defined(__linux__) && defined(STATX_TYPE)
+   if (!s_statxUnavailable)
+   {
+      // request only what FileInfo needs; the file system may then be able
+      // to skip the rest
+      const unsigned int mask = STATX_TYPE | STATX_SIZE | STATX_MTIME;
+
+      struct statx stx;
+      if (::statx(dirFd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_SYNC_AS_STAT, mask, &stx) == 0)
+      {
+         if ((stx.stx_mask & mask) == mask)
+         {
+            pEntry->isDirectory = S_ISDIR(stx.stx_mode);
+            pEntry->isSymlink = S_ISLNK(stx.stx_mode);
+            pEntry->size = stx.stx_size;
+            pEntry->lastWriteTime = stx.stx_mtime.tv_sec;
+            return 0;
+         }
+      }
+      else if (errno == ENOSYS)
+      {
+         s_statxUnavailable = true;
+      }
+      else
+      {
+         return errno;
+      }
+   }
 #endif
-   return strcmp((*lhs)->d_name, (*rhs)->d_name);
+
+   struct stat st;
+   if (::fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+      return errno;
+
+   setEntryInfo(st, pEntry);
+   return 0;
+}
+
+// adds the named entry to the listing, reading its attributes unless the
+// entry type reported by the directory is all we need (or readAttributes is
+// false, in which case only the type is read)
+void addEntry(int dirFd,
+              const std::string& dirPath,
+              const char* name,
+              unsigned char type,
+              bool readAttributes,
+              DirListing* pListing)
+{
+   DirEntry entry;
+   entry.name = name;
+
+   // directories don't need a size or modification time, so when the
+   // directory entry reports the type we can skip the stat altogether
+   if (type == DT_DIR)
+   {
+      entry.isDirectory = true;
+   }
+   else if (!readAttributes && type != DT_UNKNOWN)
+   {
+      entry.isSymlink = type == DT_LNK;
+   }
+   else
+   {
+      int res = statEntry(dirFd, name, &entry);
+      if (res != 0)
+      {
+         if (res != ENOENT && res != EACCES)
+         {
+            Error error = systemError(res, ERROR_LOCATION);
+            error.addProperty("path", dirPath + "/" + entry.name);
+            pListing->entryErrors.push_back(error);
+         }
+         return;
+      }
+   }
+
+   pListing->entries.push_back(entry);
+}
+
+// creates the FileInfo for an entry of the given directory
+void setFileInfo(const FilePath& rootPath, DirEntry* pEntry)
+{
+   std::string path = rootPath.completeChildPath(pEntry->name).getAbsolutePath();
+   if (pEntry->isDirectory)
+   {
+      pEntry->fileInfo = FileInfo(path, true, pEntry->isSymlink);
+   }
+   else
+   {
+      pEntry->fileInfo = FileInfo(path,
+                                  false,
+                                  pEntry->size,
+                                  pEntry->lastWriteTime,
+                                  pEntry->isSymlink);
+   }
 }
 
-// wrapper for scandir api
-Error scanDir(const std::string& dirPath, std::vector<std::string>* pNames)
+// reads the entries of a directory (and, if readAttributes is true, the
+// attributes of its entries)
+void readDirectory(const std::string& dirPath,
+                   bool readAttributes,
+                   std::vector<char>* pBuffer,
+                   DirListing* pListing)
 {
-   // read directory contents into namelist
-   struct dirent **namelist;
-   int entries = ::scandir(dirPath.c_str(),
-                           &namelist,
-                           entryFilter,
-                           alphasort);
-   if (entries == -1)
+   pListing->readTime = ::time(nullptr);
+
+#ifdef __linux__
+   int fd = ::open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (fd == -1)
    {
-      Error error = systemError(errno, ERROR_LOCATION);
-      error.addProperty("path", dirPath);
-      return error;
+      pListing->error = systemError(errno, ERROR_LOCATION);
+      pListing->error.addProperty("path", dirPath);
+      return;
    }
 
-   // extract the namelist then free it
-   for(int i=0; i<entries; i++)
+   struct stat st;
+   if (::fstat(fd, &st) == 0)
+      pListing->stamp = DirStamp(st);
+
+   pBuffer->resize(kDirentBufferSize);
+   while (true)
    {
-      // get the name (then free it)
-      std::string name(namelist[i]->d_name);
-      ::free(namelist[i]);
+      long bytes = ::syscall(SYS_getdents64, fd, pBuffer->data(), pBuffer->size());
+      if (bytes == -1)
+      {
+         if (errno == EINTR)
+            continue;
 
-      // add to the vector
-      pNames->push_back(name);
+         pListing->error = systemError(errno, ERROR_LOCATION);
+         pListing->error.addProperty("path", dirPath);
+         break;
+      }
+      else if (bytes == 0)
+      {
+         break;
+      }
+
+      for (long offset = 0; offset < bytes;)
+      {
+         const LinuxDirent64* pDirent =
+               reinterpret_cast<const LinuxDirent64*>(pBuffer->data() + offset);
+         offset += pDirent->d_reclen;
+
+         if (!isDotOrDotDot(pDirent->d_name))
+            addEntry(fd, dirPath, pDirent->d_name, pDirent->d_type, readAttributes, pListing);
+      }
    }
-   ::free(namelist);
 
-   return Success();
+   ::close(fd);
+#else
+   DIR* pDir = ::opendir(dirPath.c_str());
+   if (pDir == nullptr)
+   {
+      pListing->error = systemError(errno, ERROR_LOCATION);
+      pListing->error.addProperty("path", dirPath);
+      return;
+   }
+
+   int fd = ::dirfd(pDir);
+   struct stat st;
+   if (::fstat(fd, &st) == 0)
+      pListing->stamp = DirStamp(st);
+
+   while (true)
+   {
+      errno = 0;
+      struct dirent* pDirent = ::readdir(pDir);
+      if (pDirent == nullptr)
+      {
+         if (errno != 0)
+         {
+            pListing->error = systemError(errno, ERROR_LOCATION);
+            pListing->error.addProperty("path", dirPath);
+         }
+         break;
+      }
+
+      if (!isDotOrDotDot(pDirent->d_name))
+         addEntry(fd, dirPath, pDirent->d_name, pDirent->d_type, readAttributes, pListing);
+   }
+
+   ::closedir(pDir);
+#endif
+
+   if (pListing->error)
+   {
+      pListing->entries.clear();
+      pListing->entryErrors.clear();
+      return;
+   }
+
+   std::sort(pListing->entries.begin(), pListing->entries.end(), compareEntries);
+
+   // create the FileInfo for each entry here, so that this is also done
+   // ahead of the scan (for files, only once their attributes are known)
+   FilePath rootPath(dirPath);
+   for (DirEntry& entry : pListing->entries)
+   {
+      if (readAttributes || entry.isDirectory)
+         setFileInfo(rootPath, &entry);
+   }
 }
 
-} // anonymous namespace
+// The reading of the attributes of the entries of a listing, shared between
+// the scan and the workers in chunks.
+struct AttributeBatch
+{
+   int dirFd;
+   FilePath rootPath;
+   DirListing* pListing;
 
-Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
-                const FileScannerOptions& options,
-                tree<FileInfo>* pTree)
+   // chunks not yet read, and whether any entry could not be read
+   std::size_t remaining;
+   bool failed;
+};
+
+struct AttributeChunk
+{
+   AttributeBatch* pBatch;
+   std::size_t begin;
+   std::size_t end;
+};
+
+// reads the attributes of a chunk of the entries of a listing, returning
+// false if any entry could not be read or has changed type since the
+// listing was read
+bool readChunkAttributes(const AttributeChunk& chunk)
+{
+   const AttributeBatch& batch = *chunk.pBatch;
+   for (std::size_t i = chunk.begin; i < chunk.end; i++)
+   {
+      // directories have no attributes beyond their type
+      DirEntry& entry = batch.pListing->entries[i];
+      if (entry.isDirectory)
+         continue;
+
+      DirEntry current;
+      if (statEntry(batch.dirFd, entry.name.c_str(), &current) != 0 ||
+          current.isDirectory || current.isSymlink != entry.isSymlink)
+      {
+         return false;
+      }
+
+      entry.size = current.size;
+      entry.lastWriteTime = current.lastWriteTime;
+      setFileInfo(batch.rootPath, &entry);
+   }
+
+   return true;
+}
+
+// A directory to be read, either ahead of the scan by a worker or by the scan
+// itself when it reaches the directory first.
+struct ScanTask : boost::noncopyable
+{
+   enum State
+   {
+      Queued,
+      Running,
+      Done
+   };
+
+   explicit ScanTask(const std::string& path)
+      : path(path), state(Queued), cancelled(false), pending(false)
+   {
+   }
+
+   std::string path;
+   State state;
+   bool cancelled;
+
+   // whether the listing was read by a worker and counts towards the pending
+   // entries
+   bool pending;
+
+   DirListing listing;
+
+   // tasks for the subdirectories found in the listing, by name
+   std::map<std::string, boost::shared_ptr<ScanTask> > children;
+};
+
+// Schedules directory reads across the worker threads. Each worker has its
+// own queue of tasks, which it processes in last in, first out order (so
+// that, like the scan, it proceeds depth first); when it runs out it takes
+// the oldest task from another queue.
+class ScanScheduler : boost::noncopyable
+{
+public:
+   ScanScheduler(bool readAhead, bool deferAttributes)
+      : readAhead_(readAhead),
+        deferAttributes_(deferAttributes),
+        stopped_(false),
+        idleWorkers_(0),
+        pendingEntries_(0),
+        queues_(1)
+   {
+   }
+
+   ~ScanScheduler()
+   {
+      try
+      {
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            stopped_ = true;
+            queues_.clear();
+         }
+         changed_.notify_all();
+
+         boost::this_thread::disable_interruption interruptionDisabled;
+         for (const boost::shared_ptr<boost::thread>& pThread : threads_)
+            pThread->join();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   // Returns the listing for the task's directory (which must not have been
+   // cancelled), reading it on this thread if no worker has started to.
+   // When attributes are deferred, a listing read ahead of time is read again
+   // unless the directory is known to be unchanged since it was read, and the
+   // attributes of its entries are read now.
+   void takeListing(const boost::shared_ptr<ScanTask>& pTask,
+                    DirListing* pListing)
+   {
+      boost::this_thread::disable_interruption interruptionDisabled;
+      boost::unique_lock<boost::mutex> lock(mutex_);
+
+      while (pTask->state == ScanTask::Running)
+         changed_.wait(lock);
+
+      if (pTask->state == ScanTask::Done)
+      {
+         releasePending(pTask.get());
+         std::swap(*pListing, pTask->listing);
+         if (!deferAttributes_)
+            return;
+
+         lock.unlock();
+         bool unchanged = isUnchanged(pTask->path, *pListing) &&
+                          readAttributes(pTask->path, pListing);
+         lock.lock();
+         if (unchanged)
+            return;
+
+         // read again, discarding anything read ahead from the old listing
+         cancelChildren(pTask.get());
+         *pListing = DirListing();
+      }
+
+      pTask->state = ScanTask::Running;
+      lock.unlock();
+
+      readDirectory(pTask->path, true, &buffer_, pListing);
+
+      lock.lock();
+      pTask->state = ScanTask::Done;
+      if (!pListing->error)
+         addChildren(pTask.get(), *pListing, 0);
+   }
+
+   // Removes and returns the task for the named subdirectory of a task
+   // (or a new task if the directory isn't being read ahead).
+   boost::shared_ptr<ScanTask> takeChild(const boost::shared_ptr<ScanTask>& pTask,
+                                         const std::string& name,
+                                         const std::string& path)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+
+      auto it = pTask->children.find(name);
+      if (it == pTask->children.end())
+         return boost::shared_ptr<ScanTask>(new ScanTask(path));
+
+      boost::shared_ptr<ScanTask> pChild = it->second;
+      pTask->children.erase(it);
+      return pChild;
+   }
+
+   // Stops reading ahead in the task's directory and its subdirectories.
+   void cancel(const boost::shared_ptr<ScanTask>& pTask)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      cancelTask(pTask.get());
+   }
+
+   // Stops reading ahead in the named subdirectory of a task, which the scan
+   // will not enter.
+   void cancelChild(const boost::shared_ptr<ScanTask>& pTask, const std::string& name)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+
+      auto it = pTask->children.find(name);
+      if (it == pTask->children.end())
+         return;
+
+      cancelTask(it->second.get());
+      pTask->children.erase(it);
+   }
+
+private:
+   // Reads the attributes of the entries of a listing read ahead without
+   // them, sharing the work with the workers. Returns false if any entry
+   // could not be read or has changed type, in which case the directory
+   // should be read again.
+   bool readAttributes(const std::string& dirPath, DirListing* pListing)
+   {
+      int fd = ::open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (fd == -1)
+         return false;
+
+      AttributeBatch batch;
+      batch.dirFd = fd;
+      batch.rootPath = FilePath(dirPath);
+      batch.pListing = pListing;
+      batch.remaining = 0;
+      batch.failed = false;
+
+      // queue all but the first chunk for the workers
+      std::size_t count = pListing->entries.size();
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      for (std::size_t begin = kAttributeChunkSize; begin < count; begin += kAttributeChunkSize)
+      {
+         AttributeChunk chunk = { &batch, begin, std::min(begin + kAttributeChunkSize, count) };
+         attributeChunks_.push_back(chunk);
+         batch.remaining++;
+      }
+      if (batch.remaining > 0)
+         changed_.notify_all();
+      lock.unlock();
+
+      // read the first chunk here, then help with any the workers haven't
+      // taken before waiting for the rest
+      AttributeChunk first = { &batch, 0, std::min(kAttributeChunkSize, count) };
+      bool success = readChunkAttributes(first);
+
+      lock.lock();
+      if (!success)
+         batch.failed = true;
+
+      while (batch.remaining > 0)
+      {
+         if (attributeChunks_.empty())
+         {
+            changed_.wait(lock);
+            continue;
+         }
+
+         AttributeChunk chunk = attributeChunks_.front();
+         attributeChunks_.pop_front();
+         lock.unlock();
+         success = readChunkAttributes(chunk);
+         lock.lock();
+         finishChunk(chunk, success);
+      }
+
+      success = !batch.failed;
+      lock.unlock();
+
+      ::close(fd);
+      return success;
+   }
+
+   void finishChunk(const AttributeChunk& chunk, bool success)
+   {
+      if (!success)
+         chunk.pBatch->failed = true;
+      if (--chunk.pBatch->remaining == 0)
+         changed_.notify_all();
+   }
+
+   // returns true if the directory of a listing read ahead of time has not
+   // changed since (and could not have changed while) it was read
+   static bool isUnchanged(const std::string& path, const DirListing& listing)
+   {
+      if (listing.error)
+         return false;
+
+      struct stat st;
+      if (::lstat(path.c_str(), &st) == -1)
+         return false;
+
+      DirStamp stamp(st);
+      return stamp == listing.stamp &&
+             stamp.mtime < listing.readTime - kRacyListingSeconds;
+   }
+
+   void releasePending(ScanTask* pTask)
+   {
+      if (!pTask->pending)
+         return;
+
+      pTask->pending = false;
+      bool wasFull = pendingEntries_ >= kMaxPendingEntries;
+      pendingEntries_ -= pTask->listing.entries.size();
+      if (wasFull && pendingEntries_ < kMaxPendingEntries)
+         changed_.notify_all();
+   }
+
+   void cancelChildren(ScanTask* pTask)
+   {
+      for (auto& child : pTask->children)
+         cancelTask(child.second.get());
+      pTask->children.clear();
+   }
+
+   void cancelTask(ScanTask* pTask)
+   {
+      pTask->cancelled = true;
+      releasePending(pTask);
+      pTask->listing = DirListing();
+      cancelChildren(pTask);
+   }
+
+   // creates (and queues) tasks to read the subdirectories of a directory
+   void addChildren(ScanTask* pTask, const DirListing& listing, std::size_t queue)
+   {
+      if (!readAhead_ || stopped_)
+         return;
+
+      std::deque<boost::shared_ptr<ScanTask> >& tasks = queues_[queue];
+      std::size_t count = 0;
+
+      // queued in reverse so that they're taken in the order the scan will
+      // reach them
+      for (auto it = listing.entries.rbegin(); it != listing.entries.rend(); ++it)
+      {
+         if (!it->isDirectory || it->isSymlink)
+            continue;
+
+         boost::shared_ptr<ScanTask> pChild(
+                  new ScanTask(it->fileInfo.absolutePath()));
+         pTask->children[it->name] = pChild;
+         tasks.push_back(pChild);
+         count++;
+      }
+
+      if (count == 0)
+         return;
+
+      // start another worker if there's more to do than the idle workers
+      // can take on
+      if (idleWorkers_ < count && threads_.size() < kMaxScanThreads)
+      {
+         // if the thread can't be started no matter; the scan reads whatever
+         // the workers don't
+         std::size_t index = queues_.size();
+         queues_.resize(index + 1);
+         boost::shared_ptr<boost::thread> pThread(new boost::thread());
+         core::thread::safeLaunchThread(
+                  boost::bind(&ScanScheduler::runWorker, this, index), pThread.get());
+         if (pThread->joinable())
+            threads_.push_back(pThread);
+         else
+            queues_.resize(index);
+      }
+
+      changed_.notify_all();
+   }
+
+   boost::shared_ptr<ScanTask> nextTask(std::size_t queue)
+   {
+      // our own queue first, newest first
+      std::deque<boost::shared_ptr<ScanTask> >& own = queues_[queue];
+      while (!own.empty())
+      {
+         boost::shared_ptr<ScanTask> pTask = own.back();
+         own.pop_back();
+         if (pTask->state == ScanTask::Queued && !pTask->cancelled)
+            return pTask;
+      }
+
+      // then the oldest task from any other queue
+      for (std::size_t i = 0; i < queues_.size(); i++)
+      {
+         std::deque<boost::shared_ptr<ScanTask> >& other = queues_[i];
+         while (!other.empty())
+         {
+            boost::shared_ptr<ScanTask> pTask = other.front();
+            other.pop_front();
+            if (pTask->state == ScanTask::Queued && !pTask->cancelled)
+               return pTask;
+         }
+      }
+
+      return boost::shared_ptr<ScanTask>();
+   }
+
+   void runWorker(std::size_t queue)
+   {
+      try
+      {
+         std::vector<char> buffer;
+         boost::unique_lock<boost::mutex> lock(mutex_);
+         while (!stopped_)
+         {
+            // the scan waits for attributes, so they come before reading ahead
+            if (!attributeChunks_.empty())
+            {
+               AttributeChunk chunk = attributeChunks_.front();
+               attributeChunks_.pop_front();
+               lock.unlock();
+               bool success = readChunkAttributes(chunk);
+               lock.lock();
+               finishChunk(chunk, success);
+               continue;
+            }
+
+            boost::shared_ptr<ScanTask> pTask;
+            if (pendingEntries_ < kMaxPendingEntries)
+               pTask = nextTask(queue);
+
+            if (!pTask)
+            {
+               idleWorkers_++;
+               changed_.wait(lock);
+               idleWorkers_--;
+               continue;
+            }
+
+            pTask->state = ScanTask::Running;
+            lock.unlock();
+
+            DirListing listing;
+            readDirectory(pTask->path, !deferAttributes_, &buffer, &listing);
+
+            lock.lock();
+            pTask->state = ScanTask::Done;
+            if (!pTask->cancelled && !stopped_)
+            {
+               std::swap(pTask->listing, listing);
+               pTask->pending = true;
+               pendingEntries_ += pTask->listing.entries.size();
+               if (!pTask->listing.error)
+                  addChildren(pTask.get(), pTask->listing, queue);
+            }
+
+            // wake the scan if it's waiting for this directory
+            changed_.notify_all();
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   const bool readAhead_;
+   const bool deferAttributes_;
+
+   boost::mutex mutex_;
+   boost::condition_variable changed_;
+   bool stopped_;
+   std::size_t idleWorkers_;
+   std::size_t pendingEntries_;
+
+   // the first queue is used for directories read by the scan itself
+   std::vector<std::deque<boost::shared_ptr<ScanTask> > > queues_;
+   std::vector<boost::shared_ptr<boost::thread> > threads_;
+
+   // chunks of attributes the scan is waiting for
+   std::deque<AttributeChunk> attributeChunks_;
+
+   // the getdents64 buffer used by the scan itself
+   std::vector<char> buffer_;
+};
+
+Error scanDirectory(const tree<FileInfo>::iterator_base& fromNode,
+                    const boost::shared_ptr<ScanTask>& pTask,
+                    const FileScannerOptions& options,
+                    ScanScheduler* pScheduler,
+                    tree<FileInfo>* pTree)
 {
    // clear all existing
    pTree->erase_children(fromNode);
 
-   // create FilePath for root
-   FilePath rootPath(fromNode->absolutePath());
-
    // yield if requested (only applies to recursive scans)
    if (options.recursive && options.yield)
       boost::this_thread::yield();
@@ -112,64 +884,42 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
    {
       Error error = options.onBeforeScanDir(*fromNode);
       if (error)
+      {
+         pScheduler->cancel(pTask);
          return error;
+      }
    }
 
-   // read directory contents
-   std::vector<std::string> names;
-   Error error = scanDir(fromNode->absolutePath(), &names);
-   if (error)
-      return error;
+   // read directory contents (a listing read ahead of the hook may be out of
+   // date with respect to it -- e.g. a file monitor must see the directory
+   // and its files as they were no sooner than when the hook began watching)
+   DirListing listing;
+   pScheduler->takeListing(pTask, &listing);
+   if (listing.error)
+   {
+      pScheduler->cancel(pTask);
+      return listing.error;
+   }
+
+   for (const Error& error : listing.entryErrors)
+      LOG_ERROR(error);
 
-   // iterate over the names
-   for (const std::string& name : names)
+   // iterate over the entries
+   for (const DirEntry& entry : listing.entries)
    {
       // check for interrupt (mark as expected to suppress logging)
       if (boost::this_thread::interruption_requested())
       {
+         pScheduler->cancel(pTask);
          Error error = core::systemError(boost::system::errc::interrupted, ERROR_LOCATION);
          error.setExpected();
          return error;
       }
 
-      // compute the path
-      std::string path = rootPath.completeChildPath(name).getAbsolutePath();
-
-      // get the attributes
-      struct stat st;
-      int res = ::lstat(path.c_str(), &st);
-      if (res == -1)
-      {
-         if (errno != ENOENT && errno != EACCES)
-         {
-            Error error = systemError(errno, ERROR_LOCATION);
-            error.addProperty("path", path);
-            LOG_ERROR(error);
-         }
-         continue;
-      }
-
-      // create the FileInfo
-      FileInfo fileInfo;
-      bool isSymlink = S_ISLNK(st.st_mode);
-      if (S_ISDIR(st.st_mode))
-      {
-         fileInfo = FileInfo(path, true, isSymlink);
-      }
-      else
-      {
-         fileInfo = FileInfo(path,
-                             false,
-                             st.st_size,
-#ifdef __APPLE__
-                             st.st_mtimespec.tv_sec,
-#else
-                             st.st_mtime,
-#endif
-                             isSymlink);
-      }
+      const FileInfo& fileInfo = entry.fileInfo;
 
       // apply the filter (if any)
+      bool recurse = false;
       if (!options.filter || options.filter(fileInfo))
       {
          // add the correct type of FileEntry
@@ -180,12 +930,16 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
             // recurse if requested and this isn't a link
             if (options.recursive && !fileInfo.isSymlink())
             {
+               recurse = true;
+
                // try to scan the files in the subdirectory -- if we fail
                // we continue because we don't want one "bad" directory
                // to cause us to abort the entire scan. yes the tree
                // will be incomplete however it will be even more incomplete
                // if we fail entirely
-               Error error = scanFiles(child, options, pTree);
+               boost::shared_ptr<ScanTask> pChild =
+                     pScheduler->takeChild(pTask, entry.name, fileInfo.absolutePath());
+               Error error = scanDirectory(child, pChild, options, pScheduler, pTree);
                if (error)
                   LOG_ERROR(error);
             }
@@ -195,12 +949,27 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
             pTree->append_child(fromNode, fileInfo);
          }
       }
+
+      // don't read ahead in directories the scan won't enter
+      if (!recurse && entry.isDirectory)
+         pScheduler->cancelChild(pTask, entry.name);
    }
 
    // return success
    return Success();
 }
 
+} // anonymous namespace
+
+Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
+                const FileScannerOptions& options,
+                tree<FileInfo>* pTree)
+{
+   ScanScheduler scheduler(options.recursive, !!options.onBeforeScanDir);
+   boost::shared_ptr<ScanTask> pRootTask(new ScanTask(fromNode->absolutePath()));
+   return scanDirectory(fromNode, pRootTask, options, &scheduler, pTree);
+}
+
 } // namespace system
 } // namespace core
 } // namespace rstudio
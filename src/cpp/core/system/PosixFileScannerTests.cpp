@@ -0,0 +1,262 @@
+/*
+ * PosixFileScannerTests.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef _WIN32
+
+#include <core/system/FileScanner.hpp>
+
+#include <algorithm>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <shared_core/FilePath.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace system {
+namespace tests {
+
+namespace {
+
+void writeFile(const FilePath& filePath, std::size_t size)
+{
+   std::shared_ptr<std::ostream> pStream;
+   Error error = filePath.openForWrite(pStream);
+   REQUIRE_FALSE(error);
+   *pStream << std::string(size, 'x');
+}
+
+// a serial scan (as FileScanner used to do it) listing the paths of the
+// entries which are passed to the filter, in order
+void referenceScan(const std::string& dirPath,
+                   const std::string& excludedName,
+                   std::vector<std::string>* pFiltered,
+                   std::vector<std::string>* pScannedDirs)
+{
+   pScannedDirs->push_back(dirPath);
+
+   std::vector<std::string> names;
+   DIR* pDir = ::opendir(dirPath.c_str());
+   REQUIRE(pDir != nullptr);
+   while (struct dirent* pDirent = ::readdir(pDir))
+   {
+      std::string name = pDirent->d_name;
+      if (name != "." && name != "..")
+         names.push_back(name);
+   }
+   ::closedir(pDir);
+   std::sort(names.begin(), names.end());
+
+   for (const std::string& name : names)
+   {
+      std::string path = dirPath + "/" + name;
+      pFiltered->push_back(path);
+
+      struct stat st;
+      REQUIRE(::lstat(path.c_str(), &st) == 0);
+      if (S_ISDIR(st.st_mode) && name != excludedName)
+         referenceScan(path, excludedName, pFiltered, pScannedDirs);
+   }
+}
+
+} // anonymous namespace
+
+test_context("File scanner")
+{
+   FilePath rootPath;
+   REQUIRE_FALSE(FilePath::tempFilePath(rootPath));
+   REQUIRE_FALSE(rootPath.ensureDirectory());
+
+   // a tree wide and deep enough to be read by several threads
+   for (int i = 0; i < 6; i++)
+   {
+      FilePath dirPath = rootPath.completeChildPath("dir" + std::to_string(i));
+      for (int j = 0; j < 6; j++)
+      {
+         FilePath subdirPath = dirPath.completeChildPath("sub" + std::to_string(j));
+         REQUIRE_FALSE(subdirPath.completeChildPath("nested").ensureDirectory());
+         for (int k = 0; k < 10; k++)
+            writeFile(subdirPath.completeChildPath("file" + std::to_string(k) + ".R"), k);
+      }
+   }
+
+   // an excluded directory (which must not be entered) and a link to a
+   // directory (which must not be followed)
+   REQUIRE_FALSE(rootPath.completeChildPath("dir2/excluded/inner").ensureDirectory());
+   writeFile(rootPath.completeChildPath("dir2/excluded/inner/file.R"), 1);
+   REQUIRE(::symlink(rootPath.completeChildPath("dir1").getAbsolutePath().c_str(),
+                     rootPath.completeChildPath("dir3/link").getAbsolutePath().c_str()) == 0);
+
+   test_that("Recursive scans visit entries in the same order as a serial scan")
+   {
+      std::vector<std::string> expectedFiltered, expectedScannedDirs;
+      referenceScan(rootPath.getAbsolutePath(), "excluded", &expectedFiltered, &expectedScannedDirs);
+
+      std::vector<std::string> filtered, scannedDirs;
+      FileScannerOptions options;
+      options.recursive = true;
+      options.filter = [&](const FileInfo& fileInfo)
+      {
+         filtered.push_back(fileInfo.absolutePath());
+         return FilePath(fileInfo.absolutePath()).getFilename() != "excluded";
+      };
+      options.onBeforeScanDir = [&](const FileInfo& fileInfo)
+      {
+         scannedDirs.push_back(fileInfo.absolutePath());
+         return Success();
+      };
+
+      tree<FileInfo> fileTree;
+      Error error = scanFiles(FileInfo(rootPath), options, &fileTree);
+      REQUIRE_FALSE(error);
+
+      expect_true(filtered == expectedFiltered);
+      expect_true(scannedDirs == expectedScannedDirs);
+
+      // the tree holds everything but the excluded directory, depth first
+      std::vector<std::string> treePaths;
+      for (auto it = ++fileTree.begin(); it != fileTree.end(); ++it)
+         treePaths.push_back(it->absolutePath());
+
+      std::vector<std::string> expectedTreePaths;
+      for (const std::string& path : expectedFiltered)
+      {
+         if (FilePath(path).getFilename() != "excluded")
+            expectedTreePaths.push_back(path);
+      }
+      expect_true(treePaths == expectedTreePaths);
+   }
+
+   test_that("Scanned entries report their type, size and symlink status")
+   {
+      FileScannerOptions options;
+      options.recursive = true;
+
+      tree<FileInfo> fileTree;
+      REQUIRE_FALSE(scanFiles(FileInfo(rootPath), options, &fileTree));
+
+      bool foundLink = false, foundFile = false;
+      for (auto it = fileTree.begin(); it != fileTree.end(); ++it)
+      {
+         FilePath filePath(it->absolutePath());
+         if (filePath.getFilename() == "link")
+         {
+            foundLink = true;
+            expect_true(it->isSymlink());
+            expect_true(fileTree.number_of_children(it) == 0);
+         }
+         else if (filePath.getFilename() == "file7.R")
+         {
+            foundFile = true;
+            expect_false(it->isDirectory());
+            expect_true(it->size() == 7);
+            expect_true(it->lastWriteTime() == filePath.getLastWriteTime());
+         }
+         else if (filePath.getFilename() == "nested")
+         {
+            expect_true(it->isDirectory());
+            expect_false(it->isSymlink());
+         }
+      }
+
+      expect_true(foundLink);
+      expect_true(foundFile);
+   }
+
+   test_that("Entries changed by the hook are reported as they are after it")
+   {
+      // a directory large enough for its attributes to be read by several threads
+      FilePath bulkPath = rootPath.completeChildPath("dir5/sub5");
+      for (int i = 0; i < 500; i++)
+         writeFile(bulkPath.completeChildPath("bulk" + std::to_string(i)), 1);
+
+      // make the directories old enough that listings read ahead of the scan
+      // aren't read again merely because they were recently modified
+      std::time_t past = ::time(nullptr) - 3600;
+      rootPath.setLastWriteTime(past);
+      for (int i = 0; i < 6; i++)
+      {
+         FilePath dirPath = rootPath.completeChildPath("dir" + std::to_string(i));
+         dirPath.setLastWriteTime(past);
+         for (int j = 0; j < 6; j++)
+            dirPath.completeChildPath("sub" + std::to_string(j)).setLastWriteTime(past);
+      }
+
+      FileScannerOptions options;
+      options.recursive = true;
+      options.onBeforeScanDir = [&](const FileInfo& fileInfo)
+      {
+         FilePath dirPath(fileInfo.absolutePath());
+
+         // give the workers time to read the remaining directories ahead
+         if (dirPath.getFilename() == "dir0")
+            ::usleep(200000);
+
+         // change files without changing the directory itself
+         if (dirPath.getFilename().find("sub") == 0)
+            writeFile(dirPath.completeChildPath("file3.R"), 50);
+         if (dirPath == bulkPath)
+         {
+            for (int i = 0; i < 500; i++)
+               writeFile(bulkPath.completeChildPath("bulk" + std::to_string(i)), 2);
+         }
+
+         return Success();
+      };
+
+      tree<FileInfo> fileTree;
+      REQUIRE_FALSE(scanFiles(FileInfo(rootPath), options, &fileTree));
+
+      int found = 0, foundBulk = 0;
+      for (auto it = fileTree.begin(); it != fileTree.end(); ++it)
+      {
+         std::string name = FilePath(it->absolutePath()).getFilename();
+         if (name == "file3.R")
+         {
+            found++;
+            expect_true(it->size() == 50);
+         }
+         else if (name.find("bulk") == 0)
+         {
+            foundBulk++;
+            expect_true(it->size() == 2);
+         }
+      }
+      expect_true(found == 36);
+      expect_true(foundBulk == 500);
+   }
+
+   test_that("Non-recursive scans list only the immediate children")
+   {
+      FileScannerOptions options;
+
+      tree<FileInfo> fileTree;
+      REQUIRE_FALSE(scanFiles(FileInfo(rootPath), options, &fileTree));
+      expect_true(fileTree.size() == 7);
+   }
+
+   rootPath.remove();
+}
+
+} // end namespace tests
+} // end namespace system
+} // end namespace core
+} // end namespace rstudio
+
+#endif // _WIN32
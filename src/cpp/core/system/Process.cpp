@@ -30,6 +30,10 @@
 
 #include <core/Thread.hpp>
 
+#ifdef __linux__
+#include "ChildProcessMonitor.hpp"
+#endif
+
 using namespace boost::placeholders;
 
 namespace rstudio {
@@ -340,6 +344,11 @@ bool ProcessSupervisor::poll()
       pImpl_->isPolling = true;
       scope::SetOnExit<bool> setOnExit(&pImpl_->isPolling, false);
 
+#ifdef __linux__
+      // allow the next burst of child process activity to wake the owner
+      onChildProcessesPolled();
+#endif
+
       // call poll on all of our children via a copy of the std::vector that
       // holds all of the children. we do this because 'poll' can end up
       // executing R code (e.g. via onContinue) which can in term end up
@@ -414,6 +423,12 @@ bool enableCallbacksRequireMainThread()
    return s_enableCallbacksRequireMainThread;
 }
 
+#ifndef __linux__
+void setChildProcessActivityCallback(const boost::function<void()>& callback)
+{
+}
+#endif
+
 } // namespace system
 } // namespace core
 } // namespace rstudio
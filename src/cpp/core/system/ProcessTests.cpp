@@ -15,8 +15,13 @@
 
 #ifndef _WIN32
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <iostream>
+#include <fcntl.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include <boost/bind/bind.hpp>
 #include <boost/thread.hpp>
@@ -290,6 +295,92 @@ test_context("ProcessTests")
       }
    }
 
+#ifdef __linux__
+   test_that("Spawned children honor working directory, session, and descriptor options")
+   {
+      // a descriptor which the child would inherit if it were not closed
+      int fd = ::open("/dev/null", O_RDONLY);
+      REQUIRE(fd != -1);
+
+      std::string fdPath = "/proc/self/fd/" + safe_convert::numberToString(fd);
+      std::vector<std::string> args;
+      args.push_back("-c");
+      args.push_back("pwd; "
+                     "test -e " + fdPath + " && echo inherited || echo closed; "
+                     "test \"$(awk '{print $6}' /proc/$$/stat)\" = \"$$\" && echo detached");
+
+      ProcessOptions options;
+      options.workingDir = FilePath("/");
+      options.detachSession = true;
+
+      int exitCode = -1;
+      std::string output;
+      ProcessCallbacks callbacks;
+      callbacks.onExit = boost::bind(&checkExitCode, _1, &exitCode);
+      callbacks.onStdout = boost::bind(&appendOutput, _2, &output);
+
+      uint64_t spawnedBefore = spawnedChildCount();
+
+      ProcessSupervisor supervisor;
+      Error error = supervisor.runProgram("/bin/sh", args, options, callbacks);
+      REQUIRE(!error);
+      CHECK(supervisor.wait(boost::posix_time::milliseconds(10), boost::posix_time::seconds(5)));
+
+      // the child must have been spawned rather than forked
+      CHECK(spawnedChildCount() == spawnedBefore + 1);
+      CHECK(exitCode == 0);
+      CHECK(output == "/\nclosed\ndetached\n");
+
+      ::close(fd);
+   }
+#endif
+
+#ifdef __linux__
+   test_that("Child process activity wakes the poller")
+   {
+      boost::mutex mutex;
+      boost::condition_variable cond;
+      int wakeups = 0;
+
+      setChildProcessActivityCallback([&]()
+      {
+         LOCK_MUTEX(mutex)
+         {
+            ++wakeups;
+            cond.notify_all();
+         }
+         END_LOCK_MUTEX
+      });
+
+      int exitCode = -1;
+      std::string output;
+      ProcessCallbacks callbacks;
+      callbacks.onExit = boost::bind(&checkExitCode, _1, &exitCode);
+      callbacks.onStdout = boost::bind(&appendOutput, _2, &output);
+
+      ProcessOptions options;
+      ProcessSupervisor supervisor;
+      Error error = supervisor.runCommand("sleep 0.2; echo hello", options, callbacks);
+      REQUIRE(!error);
+
+      // only poll when woken; the output and exit must still be delivered
+      int polls = 0;
+      while (supervisor.poll() && polls < 20)
+      {
+         boost::unique_lock<boost::mutex> lock(mutex);
+         cond.timed_wait(lock, boost::posix_time::seconds(5), [&]{ return wakeups > 0; });
+         wakeups = 0;
+         ++polls;
+      }
+
+      CHECK(polls < 20);
+      CHECK(exitCode == 0);
+      CHECK(output == "hello\n");
+
+      setChildProcessActivityCallback(boost::function<void()>());
+   }
+#endif
+
    test_that("Can spawn multiple async processes and they all return correct results")
    {
       IoServiceFixture fixture;
@@ -594,6 +685,124 @@ test_context("ProcessTests")
    }
 }
 
+#ifdef __linux__
+// benchmarks for the child process monitor; run with: rstudio-tests "[benchmark]"
+TEST_CASE("Child process monitor benchmarks", "[.benchmark]")
+{
+   boost::mutex mutex;
+   boost::condition_variable cond;
+   int wakeups = 0;
+
+   setChildProcessActivityCallback([&]()
+   {
+      LOCK_MUTEX(mutex)
+      {
+         ++wakeups;
+         cond.notify_all();
+      }
+      END_LOCK_MUTEX
+   });
+
+   // waits for the activity callback (or the timeout), returning whether the
+   // callback woke us
+   auto waitForActivity = [&](const boost::posix_time::time_duration& timeout)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex);
+      bool woken = cond.timed_wait(lock, timeout, [&]{ return wakeups > 0; });
+      wakeups = 0;
+      return woken;
+   };
+
+   SECTION("Idle children don't wake the poller")
+   {
+      const int kChildren = 8;
+      const int kSeconds = 2;
+
+      ProcessOptions options;
+      ProcessCallbacks callbacks;
+      ProcessSupervisor supervisor;
+      for (int i = 0; i < kChildren; i++)
+         REQUIRE(!supervisor.runCommand("sleep " + std::to_string(kSeconds + 1), options, callbacks));
+
+      // poll as the session does, at most every 50ms but sooner when woken
+      int woken = 0, polls = 0;
+      auto start = std::chrono::steady_clock::now();
+      while (std::chrono::steady_clock::now() - start < std::chrono::seconds(kSeconds))
+      {
+         supervisor.poll();
+         polls++;
+         if (waitForActivity(boost::posix_time::milliseconds(50)))
+            woken++;
+      }
+
+      std::cout << "idle wakeups: " << woken << " of " << polls << " polls over "
+                << kSeconds << "s with " << kChildren << " idle children" << std::endl;
+      CHECK(woken == 0);
+
+      supervisor.terminateAll();
+      supervisor.wait(boost::posix_time::milliseconds(10), boost::posix_time::seconds(5));
+   }
+
+   SECTION("Output is delivered without waiting for the next scheduled poll")
+   {
+      const int kRounds = 100;
+
+      boost::weak_ptr<ProcessOperations> weakOps;
+      std::chrono::steady_clock::time_point received;
+      bool gotOutput = false;
+
+      ProcessCallbacks callbacks;
+      callbacks.onStarted = [&](ProcessOperations& ops)
+      {
+         weakOps = ops.getWeakPtr();
+      };
+      callbacks.onStdout = [&](ProcessOperations&, const std::string&)
+      {
+         received = std::chrono::steady_clock::now();
+         gotOutput = true;
+      };
+
+      ProcessOptions options;
+      ProcessSupervisor supervisor;
+      REQUIRE(!supervisor.runProgram("/bin/cat", std::vector<std::string>(), options, callbacks));
+      supervisor.poll();
+
+      // echo a line through the child and time how long it takes to reach
+      // onStdout when polling only when woken (or every 50ms otherwise)
+      std::vector<double> latencies;
+      for (int i = 0; i < kRounds; i++)
+      {
+         boost::shared_ptr<ProcessOperations> pOps = weakOps.lock();
+         REQUIRE(pOps);
+
+         gotOutput = false;
+         auto sent = std::chrono::steady_clock::now();
+         REQUIRE(!pOps->writeToStdin("x\n", false));
+         while (!gotOutput)
+         {
+            waitForActivity(boost::posix_time::milliseconds(50));
+            supervisor.poll();
+         }
+
+         latencies.push_back(
+            std::chrono::duration<double, std::micro>(received - sent).count());
+      }
+
+      std::sort(latencies.begin(), latencies.end());
+      std::cout << "output latency: median " << latencies[kRounds / 2]
+                << "us, p99 " << latencies[kRounds * 99 / 100]
+                << "us over " << kRounds << " lines (scheduled poll interval 50ms)"
+                << std::endl;
+      CHECK(latencies[kRounds / 2] < 50000);
+
+      supervisor.terminateAll();
+      supervisor.wait(boost::posix_time::milliseconds(10), boost::posix_time::seconds(5));
+   }
+
+   setChildProcessActivityCallback(boost::function<void()>());
+}
+#endif
+
 } // end namespace tests
 } // end namespace system
 } // end namespace core
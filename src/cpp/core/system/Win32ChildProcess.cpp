@@ -722,8 +722,11 @@ void AsyncChildProcess::poll()
 
    bool hasRecentOutput = false;
 
+   // leave output unread while the consumer isn't ready for it
+   bool readOutput = !callbacks_.readyForOutput || callbacks_.readyForOutput();
+
    // check stdout
-   if (pImpl_->hStdOutRead)
+   if (readOutput && pImpl_->hStdOutRead)
    {
       std::string stdOut;
       Error error = WinPty::readFromPty(pImpl_->hStdOutRead, &stdOut);
@@ -735,7 +738,7 @@ void AsyncChildProcess::poll()
    }
 
    // check stderr
-   if (pImpl_->hStdErrRead)
+   if (readOutput && pImpl_->hStdErrRead)
    {
       std::string stdErr;
       Error error = WinPty::readFromPty(pImpl_->hStdErrRead, &stdErr);
@@ -0,0 +1,278 @@
+/*
+ * ConsoleOutput.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/ConsoleOutput.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+namespace {
+
+// A run of text within a line which starts either at the start of the line
+// or just after a carriage return.
+struct Segment
+{
+   std::size_t begin;
+   std::size_t end;
+
+   // the width of the segment, measured as the client console measures it
+   // (in UTF-16 code units, excluding SGR codes)
+   std::size_t width;
+
+   // whether the segment contains anything (backspaces, cursor movement,
+   // hyperlinks, invalid UTF-8) that makes its effect on the line unknown
+   bool opaque;
+
+   // the SGR codes within the segment, as [begin, end) pairs
+   std::vector<std::pair<std::size_t, std::size_t>> codes;
+};
+
+// Returns the end of the SGR code (ESC [ params m) at pos, or npos if the
+// escape sequence at pos is anything else.
+std::size_t sgrCodeEnd(const std::string& output, std::size_t pos, std::size_t end)
+{
+   if (pos + 1 >= end || output[pos + 1] != '[')
+      return std::string::npos;
+
+   for (std::size_t i = pos + 2; i < end; ++i)
+   {
+      char ch = output[i];
+      if (ch == 'm')
+         return i + 1;
+      else if (!((ch >= '0' && ch <= '9') || ch == ';'))
+         return std::string::npos;
+   }
+
+   return std::string::npos;
+}
+
+void scanSegment(const std::string& output, Segment* pSegment)
+{
+   pSegment->width = 0;
+   pSegment->opaque = false;
+
+   std::size_t i = pSegment->begin;
+   while (i < pSegment->end)
+   {
+      unsigned char ch = static_cast<unsigned char>(output[i]);
+      if (ch == '\x1b')
+      {
+         std::size_t codeEnd = sgrCodeEnd(output, i, pSegment->end);
+         if (codeEnd == std::string::npos)
+         {
+            pSegment->opaque = true;
+            return;
+         }
+
+         pSegment->codes.push_back(std::make_pair(i, codeEnd));
+         i = codeEnd;
+      }
+      else if (ch == '\b' || ch == '\f')
+      {
+         pSegment->opaque = true;
+         return;
+      }
+      else if (ch < 0x80)
+      {
+         pSegment->width += 1;
+         i += 1;
+      }
+      else
+      {
+         std::size_t length = ch >= 0xF0 ? 4 : ch >= 0xE0 ? 3 : ch >= 0xC2 ? 2 : 0;
+         if (length == 0 || length > 4 || i + length > pSegment->end)
+         {
+            pSegment->opaque = true;
+            return;
+         }
+
+         for (std::size_t j = 1; j < length; ++j)
+         {
+            if ((static_cast<unsigned char>(output[i + j]) & 0xC0) != 0x80)
+            {
+               pSegment->opaque = true;
+               return;
+            }
+         }
+
+         // U+009B is the single character CSI
+         if (ch == 0xC2 && static_cast<unsigned char>(output[i + 1]) == 0x9B)
+         {
+            pSegment->opaque = true;
+            return;
+         }
+
+         // characters outside the BMP are surrogate pairs in UTF-16
+         pSegment->width += length == 4 ? 2 : 1;
+         i += length;
+      }
+   }
+}
+
+// Compacts the line [begin, end), appending the result to pResult. Returns
+// false (leaving pResult untouched) if there's nothing to remove.
+bool compactLine(const std::string& output,
+                 std::size_t begin,
+                 std::size_t end,
+                 bool atLineStart,
+                 std::string* pResult)
+{
+   std::vector<Segment> segments;
+   std::size_t pos = begin;
+   while (true)
+   {
+      std::size_t cr = output.find('\r', pos);
+      if (cr == std::string::npos || cr >= end)
+         cr = end;
+
+      Segment segment;
+      segment.begin = pos;
+      segment.end = cr;
+      segments.push_back(segment);
+
+      if (cr == end)
+         break;
+      pos = cr + 1;
+   }
+
+   if (segments.size() < 2)
+      return false;
+
+   // a segment can be dropped when a later segment (which, following a carriage
+   // return, is written from the start of the line) is at least as wide
+   std::vector<bool> dropped(segments.size(), false);
+   bool anyDropped = false;
+   std::size_t coverWidth = 0;
+   bool haveCover = false;
+   for (std::size_t i = segments.size(); i-- > 0;)
+   {
+      Segment& segment = segments[i];
+      scanSegment(output, &segment);
+
+      // we can't tell what an opaque segment does (for example, moving the
+      // cursor right depends on the length of the line), so nothing before it
+      // is dropped on account of the segments after it
+      if (segment.opaque)
+      {
+         haveCover = false;
+         coverWidth = 0;
+         continue;
+      }
+
+      bool canDrop = i + 1 < segments.size() && (i > 0 || atLineStart);
+      if (canDrop && haveCover && coverWidth >= segment.width)
+      {
+         dropped[i] = true;
+         anyDropped = true;
+      }
+
+      if (!haveCover || segment.width > coverWidth)
+         coverWidth = segment.width;
+      haveCover = true;
+   }
+
+   if (!anyDropped)
+      return false;
+
+   // SGR codes from dropped segments still affect the text that follows, so they
+   // are written ahead of the next remaining segment. Only the last occurrence
+   // of each code is needed: since each code sets attributes, keeping the last
+   // occurrences (in order) produces the same final attributes
+   std::vector<std::string> pendingCodes;
+   bool first = true;
+   for (std::size_t i = 0; i < segments.size(); ++i)
+   {
+      const Segment& segment = segments[i];
+      if (dropped[i])
+      {
+         for (const auto& code : segment.codes)
+         {
+            std::string text = output.substr(code.first, code.second - code.first);
+            auto it = std::find(pendingCodes.begin(), pendingCodes.end(), text);
+            if (it != pendingCodes.end())
+               pendingCodes.erase(it);
+            pendingCodes.push_back(text);
+         }
+         continue;
+      }
+
+      if (!first)
+         pResult->push_back('\r');
+      first = false;
+
+      for (const std::string& code : pendingCodes)
+         pResult->append(code);
+      pendingCodes.clear();
+
+      pResult->append(output, segment.begin, segment.end - segment.begin);
+   }
+
+   return true;
+}
+
+} // anonymous namespace
+
+void compactConsoleOutput(std::string* pOutput, std::size_t from)
+{
+   std::string& output = *pOutput;
+   if (from >= output.size() || output.find('\r', from) == std::string::npos)
+      return;
+
+   // start with the line containing 'from', which may have been redrawn
+   std::size_t begin = 0;
+   if (from > 0)
+   {
+      std::size_t newline = output.rfind('\n', from - 1);
+      if (newline != std::string::npos)
+         begin = newline + 1;
+   }
+
+   std::string result;
+   bool changed = false;
+   std::size_t pos = begin;
+   while (pos <= output.size())
+   {
+      std::size_t newline = output.find('\n', pos);
+      std::size_t end = newline == std::string::npos ? output.size() : newline;
+
+      std::size_t length = result.size();
+      if (!compactLine(output, pos, end, pos > 0, &result))
+      {
+         result.resize(length);
+         result.append(output, pos, end - pos);
+      }
+      else
+      {
+         changed = true;
+      }
+
+      if (newline == std::string::npos)
+         break;
+
+      result.push_back('\n');
+      pos = newline + 1;
+   }
+
+   if (changed)
+      output.replace(begin, output.size() - begin, result);
+}
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,138 @@
+/*
+ * ConsoleOutputTests.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/ConsoleOutput.hpp>
+
+#include <chrono>
+#include <iostream>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace text {
+namespace tests {
+
+namespace {
+
+std::string compact(std::string output)
+{
+   compactConsoleOutput(&output);
+   return output;
+}
+
+} // anonymous namespace
+
+test_context("Console output compaction")
+{
+   test_that("Output without carriage returns is unchanged")
+   {
+      expect_true(compact("abc\ndef\r\n\n") == "abc\ndef\r\n\n");
+   }
+
+   test_that("Overwritten progress updates are removed")
+   {
+      expect_true(compact("x\n 10%\r 20%\r 30%\n") == "x\n 30%\n");
+      expect_true(compact("x\n[==  ]\r[=== ]\r[====]\r") == "x\n[====]\r");
+   }
+
+   test_that("Text that is only partially overwritten is kept")
+   {
+      expect_true(compact("x\nlonger\rshort") == "x\nlonger\rshort");
+      expect_true(compact("x\nab\rlonger\rxy") == "x\nlonger\rxy");
+   }
+
+   test_that("The first line is not assumed to start a line")
+   {
+      expect_true(compact("10%\r20%\r30%") == "10%\r30%");
+   }
+
+   test_that("Color codes from removed text are retained once")
+   {
+      std::string output = "x\n\x1b[32m10%\x1b[39m\r\x1b[32m20%\x1b[39m\r\x1b[32m30%\x1b[39m";
+      expect_true(compact(output) == "x\n\x1b[32m\x1b[39m\x1b[32m30%\x1b[39m");
+   }
+
+   test_that("Segments with cursor movement are left alone")
+   {
+      expect_true(compact("x\nabc\b\rdef\rghi") == "x\nabc\b\rghi");
+      expect_true(compact("x\nabc\rde\x1b[1Cf\rghi") == "x\nabc\rde\x1b[1Cf\rghi");
+      expect_true(compact("x\na\rbb\rde\x1b[1Cf\rghi") == "x\nbb\rde\x1b[1Cf\rghi");
+   }
+
+   test_that("Width is measured in characters rather than bytes")
+   {
+      // two characters (six bytes) are covered by three characters
+      expect_true(compact("x\n\xe2\x96\x88\xe2\x96\x88\rabc") == "x\nabc");
+      expect_true(compact("x\nabc\r\xe2\x96\x88\xe2\x96\x88") == "x\nabc\r\xe2\x96\x88\xe2\x96\x88");
+   }
+
+   test_that("Output can be compacted as it is appended")
+   {
+      std::string output = "Downloading\n";
+      for (int i = 0; i <= 100000; ++i)
+      {
+         std::size_t from = output.size();
+         output += "\r" + std::to_string(i / 1000) + "%";
+         compactConsoleOutput(&output, from);
+      }
+
+      expect_true(output == "Downloading\n100%");
+   }
+}
+
+// run with: rstudio-tests "[benchmark]"
+TEST_CASE("Console output compaction benchmark", "[.benchmark]")
+{
+   const int kUpdates = 1000000;
+   const int kUpdatesPerFlush = 10000;
+
+   // a colored progress bar redrawn with "\r", compacted as it is appended
+   // and shipped (then cleared) every kUpdatesPerFlush updates
+   std::size_t rawBytes = 0, shippedBytes = 0;
+   std::chrono::steady_clock::duration elapsed(0);
+   std::string output;
+   for (int i = 0; i < kUpdates; ++i)
+   {
+      int percent = static_cast<int>(i * 100LL / kUpdates);
+      std::string update = "\r\033[32m" + std::string(percent / 2, '=') +
+                           std::string(50 - percent / 2, ' ') + "\033[0m " +
+                           std::to_string(percent) + "%";
+      rawBytes += update.size();
+
+      auto start = std::chrono::steady_clock::now();
+      std::size_t from = output.size();
+      output += update;
+      compactConsoleOutput(&output, from);
+      elapsed += std::chrono::steady_clock::now() - start;
+
+      if ((i + 1) % kUpdatesPerFlush == 0)
+      {
+         shippedBytes += output.size();
+         output.clear();
+      }
+   }
+
+   std::cout << kUpdates << " progress updates: " << rawBytes << " bytes raw, "
+             << shippedBytes << " bytes shipped, "
+             << std::chrono::duration<double, std::micro>(elapsed).count() / kUpdates
+             << "us per update" << std::endl;
+   CHECK(shippedBytes < rawBytes / 1000);
+}
+
+} // end namespace tests
+} // end namespace text
+} // end namespace core
+} // end namespace rstudio
@@ -0,0 +1,1895 @@
+/*
+ * TermEmulator.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/TermEmulator.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace rstudio {
+namespace core {
+namespace text {
+
+namespace {
+
+// colors hold their kind in the top byte: the default color, a palette index
+// (0-255) or a 24-bit RGB value
+const std::uint32_t kColorDefault = 0;
+const std::uint32_t kColorPalette = 0x01000000;
+const std::uint32_t kColorRgb = 0x02000000;
+const std::uint32_t kColorKindMask = 0xFF000000;
+
+// the character of the cell covered by the right half of a wide character
+const std::uint32_t kWideTail = 0xFFFFFFFF;
+
+const std::uint32_t kReplacementChar = 0xFFFD;
+
+const std::size_t kMaxParams = 32;
+const int kMaxParamValue = 99999;
+
+enum AttrFlags
+{
+   kBold          = 0x001,
+   kDim           = 0x002,
+   kItalic        = 0x004,
+   kUnderline     = 0x008,
+   kBlink         = 0x010,
+   kInverse       = 0x020,
+   kInvisible     = 0x040,
+   kStrikethrough = 0x080,
+   kOverline      = 0x100
+};
+
+// DEC private modes which don't change how output is processed, but which
+// matter to the terminal receiving a snapshot (how it encodes keys and mouse
+// events, how it pastes); they're set again when replaying a snapshot
+const int kTrackedModes[] = { 1, 9, 12, 66, 1000, 1002, 1003, 1004, 1005, 1006, 1015, 2004 };
+
+struct Attr
+{
+   Attr() : fg(kColorDefault), bg(kColorDefault), flags(0) {}
+
+   bool operator==(const Attr& other) const
+   {
+      return fg == other.fg && bg == other.bg && flags == other.flags;
+   }
+
+   bool operator!=(const Attr& other) const
+   {
+      return !(*this == other);
+   }
+
+   bool isDefault() const
+   {
+      return fg == kColorDefault && bg == kColorDefault && flags == 0;
+   }
+
+   std::uint32_t fg;
+   std::uint32_t bg;
+   std::uint16_t flags;
+};
+
+struct Cell
+{
+   std::uint32_t ch;
+   Attr attr;
+};
+
+struct Line
+{
+   Line() : wrapped(false) {}
+
+   std::vector<Cell> cells;
+
+   // whether the line continues onto the next (the cursor wrapped)
+   bool wrapped;
+
+   // combining characters (UTF-8) following the character in a column; rare
+   // enough that a list beats widening every cell
+   std::vector<std::pair<int, std::string> > combining;
+};
+
+struct SavedCursor
+{
+   SavedCursor() : col(0), row(0), originMode(false), g0LineDrawing(false) {}
+
+   int col;
+   int row;
+   Attr attr;
+   bool originMode;
+   bool g0LineDrawing;
+};
+
+struct Screen
+{
+   Screen() : col(0), row(0), pendingWrap(false), top(0), bottom(0) {}
+
+   std::vector<Line> lines;
+   int col;
+   int row;
+
+   // the cursor is past the last column; the next character wraps
+   bool pendingWrap;
+
+   // scroll region
+   int top;
+   int bottom;
+
+   SavedCursor saved;
+};
+
+enum ParseState
+{
+   Ground,
+   Escape,
+   EscapeIntermediate,
+   CsiParam,
+   CsiIgnore,
+   OscString,
+   IgnoredString,
+   StringEscape
+};
+
+Cell blankCell(const Attr& attr)
+{
+   // erased cells take the current background only (background color erase)
+   Cell cell;
+   cell.ch = ' ';
+   cell.attr.bg = attr.bg;
+   return cell;
+}
+
+bool isBlank(const Cell& cell)
+{
+   return cell.ch == ' ' && cell.attr.isDefault();
+}
+
+std::size_t trimmedLength(const Line& line)
+{
+   std::size_t length = line.cells.size();
+   while (length > 0 && isBlank(line.cells[length - 1]))
+      length--;
+
+   // keep columns carrying combining characters
+   for (const auto& entry : line.combining)
+      length = std::max(length, static_cast<std::size_t>(entry.first) + 1);
+
+   return length;
+}
+
+bool isBlankLine(const Line& line)
+{
+   return trimmedLength(line) == 0;
+}
+
+void appendUtf8(std::uint32_t ch, std::string* pOutput)
+{
+   std::string& output = *pOutput;
+   if (ch < 0x80)
+   {
+      output.push_back(static_cast<char>(ch));
+   }
+   else if (ch < 0x800)
+   {
+      output.push_back(static_cast<char>(0xC0 | (ch >> 6)));
+      output.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+   }
+   else if (ch < 0x10000)
+   {
+      output.push_back(static_cast<char>(0xE0 | (ch >> 12)));
+      output.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+      output.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+   }
+   else
+   {
+      output.push_back(static_cast<char>(0xF0 | (ch >> 18)));
+      output.push_back(static_cast<char>(0x80 | ((ch >> 12) & 0x3F)));
+      output.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+      output.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+   }
+}
+
+// Display width of a character, following the (Unicode 6 based) tables used
+// by xterm.js: 0 for combining characters, 2 for wide (mostly East Asian and
+// emoji) characters, 1 otherwise.
+int charWidth(std::uint32_t ch)
+{
+   if (ch < 0x300)
+      return 1;
+
+   static const std::uint32_t combining[][2] = {
+      { 0x0300, 0x036F }, { 0x0483, 0x0489 }, { 0x0591, 0x05BD }, { 0x05BF, 0x05BF },
+      { 0x05C1, 0x05C2 }, { 0x05C4, 0x05C5 }, { 0x05C7, 0x05C7 }, { 0x0610, 0x061A },
+      { 0x064B, 0x065F }, { 0x0670, 0x0670 }, { 0x06D6, 0x06DC }, { 0x06DF, 0x06E4 },
+      { 0x06E7, 0x06E8 }, { 0x06EA, 0x06ED }, { 0x0E31, 0x0E31 }, { 0x0E34, 0x0E3A },
+      { 0x0E47, 0x0E4E }, { 0x1AB0, 0x1AFF }, { 0x1DC0, 0x1DFF }, { 0x200B, 0x200F },
+      { 0x202A, 0x202E }, { 0x2060, 0x2064 }, { 0x20D0, 0x20FF }, { 0x302A, 0x302F },
+      { 0x3099, 0x309A }, { 0xFE00, 0xFE0F }, { 0xFE20, 0xFE2F }, { 0xFEFF, 0xFEFF },
+      { 0xE0100, 0xE01EF }
+   };
+
+   static const std::uint32_t wide[][2] = {
+      { 0x1100, 0x115F }, { 0x2329, 0x232A }, { 0x2E80, 0x303E }, { 0x3041, 0x33FF },
+      { 0x3400, 0x4DBF }, { 0x4E00, 0x9FFF }, { 0xA000, 0xA4CF }, { 0xAC00, 0xD7A3 },
+      { 0xF900, 0xFAFF }, { 0xFE10, 0xFE19 }, { 0xFE30, 0xFE6F }, { 0xFF00, 0xFF60 },
+      { 0xFFE0, 0xFFE6 }, { 0x1F300, 0x1F64F }, { 0x1F900, 0x1F9FF }, { 0x20000, 0x2FFFD },
+      { 0x30000, 0x3FFFD }
+   };
+
+   for (const auto& range : combining)
+   {
+      if (ch < range[0])
+         break;
+      if (ch <= range[1])
+         return 0;
+   }
+
+   for (const auto& range : wide)
+   {
+      if (ch < range[0])
+         break;
+      if (ch <= range[1])
+         return 2;
+   }
+
+   return 1;
+}
+
+// The DEC special graphics (line drawing) character set, for 0x5F - 0x7E
+std::uint32_t lineDrawingChar(std::uint32_t ch)
+{
+   static const std::uint32_t chars[] = {
+      0x00A0, 0x25C6, 0x2592, 0x2409, 0x240C, 0x240D, 0x240A, 0x00B0,
+      0x00B1, 0x2424, 0x240B, 0x2518, 0x2510, 0x250C, 0x2514, 0x253C,
+      0x23BA, 0x23BB, 0x2500, 0x23BC, 0x23BD, 0x251C, 0x2524, 0x2534,
+      0x252C, 0x2502, 0x2264, 0x2265, 0x03C0, 0x2260, 0x00A3, 0x00B7
+   };
+
+   if (ch >= 0x5F && ch <= 0x7E)
+      return chars[ch - 0x5F];
+   return ch;
+}
+
+void appendColor(std::uint32_t color, int base, int brightBase, std::string* pOutput)
+{
+   std::string& output = *pOutput;
+   std::uint32_t kind = color & kColorKindMask;
+   std::uint32_t value = color & ~kColorKindMask;
+   if (kind == kColorPalette)
+   {
+      if (value < 8)
+         output += ";" + std::to_string(base + value);
+      else if (value < 16)
+         output += ";" + std::to_string(brightBase + value - 8);
+      else
+         output += ";" + std::to_string(base + 8) + ";5;" + std::to_string(value);
+   }
+   else if (kind == kColorRgb)
+   {
+      output += ";" + std::to_string(base + 8) + ";2;" +
+            std::to_string((value >> 16) & 0xFF) + ";" +
+            std::to_string((value >> 8) & 0xFF) + ";" +
+            std::to_string(value & 0xFF);
+   }
+}
+
+// SGR sequence setting exactly the given attributes
+std::string sgr(const Attr& attr)
+{
+   std::string output = "\033[0";
+
+   static const std::pair<int, int> flags[] = {
+      { kBold, 1 }, { kDim, 2 }, { kItalic, 3 }, { kUnderline, 4 }, { kBlink, 5 },
+      { kInverse, 7 }, { kInvisible, 8 }, { kStrikethrough, 9 }, { kOverline, 53 }
+   };
+   for (const auto& flag : flags)
+   {
+      if (attr.flags & flag.first)
+         output += ";" + std::to_string(flag.second);
+   }
+
+   appendColor(attr.fg, 30, 90, &output);
+   appendColor(attr.bg, 40, 100, &output);
+   output.push_back('m');
+   return output;
+}
+
+std::string csi(int value, char final)
+{
+   return "\033[" + std::to_string(value) + final;
+}
+
+} // anonymous namespace
+
+struct TermEmulator::Impl
+{
+   Impl(int cols, int rows, int maxScrollback)
+      : cols(std::max(cols, 1)),
+        rows(std::max(rows, 1)),
+        maxScrollback(static_cast<std::size_t>(std::max(maxScrollback, 0)))
+   {
+      reset();
+   }
+
+   // --- state -------------------------------------------------------------
+
+   int cols;
+   int rows;
+   std::size_t maxScrollback;
+
+   Screen main;
+   Screen alt;
+   Screen* pScreen;
+   bool altActive;
+
+   std::deque<Line> scrollback;
+
+   Attr attr;
+   bool autowrap;
+   bool insertMode;
+   bool originMode;
+   bool cursorVisible;
+   bool appKeypad;
+   int cursorStyle;
+   bool g0LineDrawing;
+   bool g1LineDrawing;
+   bool shiftOut;
+   std::vector<bool> tabStops;
+   std::map<int, bool> modes;
+   std::uint32_t lastChar;
+   bool written;
+
+   // --- parser state ------------------------------------------------------
+
+   ParseState state;
+   ParseState stringState;
+   std::vector<int> params;
+   std::vector<bool> subParams;
+   bool paramStarted;
+   char privateMarker;
+   std::string intermediates;
+   std::uint32_t utf8Char;
+   int utf8Remaining;
+
+   // --- setup -------------------------------------------------------------
+
+   void reset()
+   {
+      main = Screen();
+      alt = Screen();
+      initScreen(&main);
+      initScreen(&alt);
+      pScreen = &main;
+      altActive = false;
+      scrollback.clear();
+
+      attr = Attr();
+      autowrap = true;
+      insertMode = false;
+      originMode = false;
+      cursorVisible = true;
+      appKeypad = false;
+      cursorStyle = 0;
+      g0LineDrawing = false;
+      g1LineDrawing = false;
+      shiftOut = false;
+      modes.clear();
+      lastChar = ' ';
+      written = false;
+      resetTabStops();
+
+      state = Ground;
+      stringState = Ground;
+      clearParams();
+      utf8Char = 0;
+      utf8Remaining = 0;
+   }
+
+   void initScreen(Screen* pTarget)
+   {
+      pTarget->lines.assign(rows, Line());
+      for (Line& line : pTarget->lines)
+         line.cells.assign(cols, blankCell(Attr()));
+      pTarget->col = 0;
+      pTarget->row = 0;
+      pTarget->pendingWrap = false;
+      pTarget->top = 0;
+      pTarget->bottom = rows - 1;
+   }
+
+   void resetTabStops()
+   {
+      tabStops.assign(cols, false);
+      for (int i = 8; i < cols; i += 8)
+         tabStops[i] = true;
+   }
+
+   void clearParams()
+   {
+      params.clear();
+      subParams.clear();
+      paramStarted = false;
+      privateMarker = '\0';
+      intermediates.clear();
+   }
+
+   // --- lines -------------------------------------------------------------
+
+   void clearLine(Line* pLine)
+   {
+      pLine->cells.assign(cols, blankCell(attr));
+      pLine->wrapped = false;
+      pLine->combining.clear();
+   }
+
+   void eraseCells(Line* pLine, int from, int to)
+   {
+      from = std::max(from, 0);
+      to = std::min(to, static_cast<int>(pLine->cells.size()));
+      if (from >= to)
+         return;
+
+      prepareOverwrite(pLine, from, to - from);
+      std::fill(pLine->cells.begin() + from, pLine->cells.begin() + to, blankCell(attr));
+   }
+
+   // Before the cells [col, col + count) are overwritten: clear wide characters
+   // which would be cut in half, and combining characters in the range.
+   void prepareOverwrite(Line* pLine, int col, int count)
+   {
+      std::vector<Cell>& cells = pLine->cells;
+      int end = col + count;
+      if (col > 0 && col < static_cast<int>(cells.size()) && cells[col].ch == kWideTail)
+         cells[col - 1].ch = ' ';
+      if (end < static_cast<int>(cells.size()) && cells[end].ch == kWideTail)
+         cells[end].ch = ' ';
+
+      if (!pLine->combining.empty())
+      {
+         pLine->combining.erase(
+                  std::remove_if(pLine->combining.begin(), pLine->combining.end(),
+                                 [&](const std::pair<int, std::string>& entry)
+         {
+            return entry.first >= col && entry.first < end;
+         }),
+                  pLine->combining.end());
+      }
+   }
+
+   void pushScrollback(Line* pLine)
+   {
+      // a recycled scrollback line replaces the one moved into the scrollback
+      Line recycled;
+      if (scrollback.size() >= maxScrollback && !scrollback.empty())
+      {
+         recycled = std::move(scrollback.front());
+         scrollback.pop_front();
+      }
+
+      if (maxScrollback > 0)
+      {
+         if (!pLine->wrapped)
+            pLine->cells.resize(trimmedLength(*pLine));
+         scrollback.push_back(std::move(*pLine));
+      }
+
+      *pLine = std::move(recycled);
+   }
+
+   // --- scrolling -----------------------------------------------------------
+
+   void scrollUp(int count, bool toScrollback)
+   {
+      Screen& screen = *pScreen;
+      count = std::min(count, screen.bottom - screen.top + 1);
+      for (int i = 0; i < count; i++)
+      {
+         std::rotate(screen.lines.begin() + screen.top,
+                     screen.lines.begin() + screen.top + 1,
+                     screen.lines.begin() + screen.bottom + 1);
+
+         Line& line = screen.lines[screen.bottom];
+         if (toScrollback && !altActive && screen.top == 0)
+            pushScrollback(&line);
+         clearLine(&line);
+      }
+   }
+
+   void scrollDown(int count)
+   {
+      Screen& screen = *pScreen;
+      count = std::min(count, screen.bottom - screen.top + 1);
+      for (int i = 0; i < count; i++)
+      {
+         std::rotate(screen.lines.begin() + screen.top,
+                     screen.lines.begin() + screen.bottom,
+                     screen.lines.begin() + screen.bottom + 1);
+         clearLine(&screen.lines[screen.top]);
+      }
+   }
+
+   void lineFeed()
+   {
+      Screen& screen = *pScreen;
+      screen.pendingWrap = false;
+      if (screen.row == screen.bottom)
+         scrollUp(1, true);
+      else if (screen.row < rows - 1)
+         screen.row++;
+   }
+
+   void reverseIndex()
+   {
+      Screen& screen = *pScreen;
+      screen.pendingWrap = false;
+      if (screen.row == screen.top)
+         scrollDown(1);
+      else if (screen.row > 0)
+         screen.row--;
+   }
+
+   void wrap()
+   {
+      Screen& screen = *pScreen;
+      screen.lines[screen.row].wrapped = true;
+      screen.col = 0;
+      lineFeed();
+   }
+
+   // --- printing ----------------------------------------------------------
+
+   void printAscii(const char* pData, std::size_t length)
+   {
+      Screen& screen = *pScreen;
+      while (length > 0)
+      {
+         if (screen.pendingWrap)
+            wrap();
+
+         Line& line = screen.lines[screen.row];
+         int count = static_cast<int>(std::min(length, static_cast<std::size_t>(cols - screen.col)));
+         prepareOverwrite(&line, screen.col, count);
+
+         Cell* pCell = &line.cells[screen.col];
+         for (int i = 0; i < count; i++)
+         {
+            pCell[i].ch = static_cast<unsigned char>(pData[i]);
+            pCell[i].attr = attr;
+         }
+
+         lastChar = static_cast<unsigned char>(pData[count - 1]);
+         pData += count;
+         length -= count;
+         screen.col += count;
+         if (screen.col >= cols)
+         {
+            screen.col = cols - 1;
+            screen.pendingWrap = true;
+         }
+      }
+   }
+
+   void print(std::uint32_t ch)
+   {
+      Screen& screen = *pScreen;
+      if (shiftOut ? g1LineDrawing : g0LineDrawing)
+         ch = lineDrawingChar(ch);
+
+      int width = charWidth(ch);
+      if (width == 0)
+      {
+         // combining characters join the previous character
+         int col = screen.pendingWrap ? screen.col : screen.col - 1;
+         Line& line = screen.lines[screen.row];
+         if (col >= 0 && line.cells[col].ch == kWideTail && col > 0)
+            col--;
+         if (col < 0)
+            return;
+
+         std::string utf8;
+         appendUtf8(ch, &utf8);
+         auto it = std::find_if(line.combining.begin(), line.combining.end(),
+                                [&](const std::pair<int, std::string>& entry)
+         {
+            return entry.first == col;
+         });
+         if (it != line.combining.end())
+            it->second += utf8;
+         else
+            line.combining.push_back(std::make_pair(col, utf8));
+         return;
+      }
+
+      if (width > cols)
+      {
+         ch = kReplacementChar;
+         width = 1;
+      }
+
+      if (screen.pendingWrap)
+      {
+         if (autowrap)
+            wrap();
+         else
+            screen.pendingWrap = false;
+      }
+
+      if (width == 2 && screen.col == cols - 1)
+      {
+         if (!autowrap)
+            return;
+
+         eraseCells(&screen.lines[screen.row], screen.col, cols);
+         wrap();
+      }
+
+      Line& line = screen.lines[screen.row];
+      if (insertMode)
+         insertCells(&line, screen.col, width);
+
+      prepareOverwrite(&line, screen.col, width);
+      line.cells[screen.col].ch = ch;
+      line.cells[screen.col].attr = attr;
+      if (width == 2)
+      {
+         line.cells[screen.col + 1].ch = kWideTail;
+         line.cells[screen.col + 1].attr = attr;
+      }
+
+      lastChar = ch;
+      screen.col += width;
+      if (screen.col >= cols)
+      {
+         screen.col = cols - 1;
+         screen.pendingWrap = autowrap;
+      }
+   }
+
+   void insertCells(Line* pLine, int col, int count)
+   {
+      count = std::min(count, cols - col);
+      if (count <= 0)
+         return;
+
+      std::vector<Cell>& cells = pLine->cells;
+      prepareOverwrite(pLine, col, 0);
+      prepareOverwrite(pLine, cols - count, count);
+      std::copy_backward(cells.begin() + col, cells.end() - count, cells.end());
+      std::fill(cells.begin() + col, cells.begin() + col + count, blankCell(attr));
+      for (auto& entry : pLine->combining)
+      {
+         if (entry.first >= col)
+            entry.first += count;
+      }
+   }
+
+   void deleteCells(Line* pLine, int col, int count)
+   {
+      count = std::min(count, cols - col);
+      if (count <= 0)
+         return;
+
+      std::vector<Cell>& cells = pLine->cells;
+      prepareOverwrite(pLine, col, count);
+      std::copy(cells.begin() + col + count, cells.end(), cells.begin() + col);
+      std::fill(cells.end() - count, cells.end(), blankCell(attr));
+      if (cells[col].ch == kWideTail)
+         cells[col].ch = ' ';
+      for (auto& entry : pLine->combining)
+      {
+         if (entry.first >= col + count)
+            entry.first -= count;
+      }
+   }
+
+   // --- cursor ------------------------------------------------------------
+
+   void moveTo(int col, int row)
+   {
+      Screen& screen = *pScreen;
+      int minRow = originMode ? screen.top : 0;
+      int maxRow = originMode ? screen.bottom : rows - 1;
+      screen.col = std::max(0, std::min(col, cols - 1));
+      screen.row = std::max(minRow, std::min(row, maxRow));
+      screen.pendingWrap = false;
+   }
+
+   // relative vertical moves stop at the scroll region's margins when they
+   // start inside it
+   void moveVertically(int count)
+   {
+      Screen& screen = *pScreen;
+      int row = screen.row + count;
+      if (screen.row >= screen.top && screen.row <= screen.bottom)
+         row = std::max(screen.top, std::min(row, screen.bottom));
+      else
+         row = std::max(0, std::min(row, rows - 1));
+      screen.row = row;
+      screen.pendingWrap = false;
+   }
+
+   void saveCursor()
+   {
+      Screen& screen = *pScreen;
+      screen.saved.col = screen.col;
+      screen.saved.row = screen.row;
+      screen.saved.attr = attr;
+      screen.saved.originMode = originMode;
+      screen.saved.g0LineDrawing = g0LineDrawing;
+   }
+
+   void restoreCursor()
+   {
+      Screen& screen = *pScreen;
+      attr = screen.saved.attr;
+      originMode = screen.saved.originMode;
+      g0LineDrawing = screen.saved.g0LineDrawing;
+      screen.col = std::min(screen.saved.col, cols - 1);
+      screen.row = std::min(screen.saved.row, rows - 1);
+      screen.pendingWrap = false;
+   }
+
+   void setAltBuffer(bool active)
+   {
+      if (active == altActive)
+         return;
+
+      altActive = active;
+      if (active)
+      {
+         // the alt-buffer starts out blank, with the cursor where it was
+         int col = main.col, row = main.row;
+         initScreen(&alt);
+         alt.col = col;
+         alt.row = row;
+         pScreen = &alt;
+      }
+      else
+      {
+         pScreen = &main;
+      }
+   }
+
+   // --- parsing -----------------------------------------------------------
+
+   void write(const char* pData, std::size_t length)
+   {
+      if (length > 0)
+         written = true;
+
+      std::size_t i = 0;
+      while (i < length)
+      {
+         unsigned char ch = static_cast<unsigned char>(pData[i]);
+
+         // runs of printable ASCII are written directly
+         if (state == Ground && utf8Remaining == 0 && ch >= 0x20 && ch < 0x7F &&
+             autowrap && !insertMode && !(shiftOut ? g1LineDrawing : g0LineDrawing))
+         {
+            std::size_t end = i + 1;
+            while (end < length &&
+                   static_cast<unsigned char>(pData[end]) >= 0x20 &&
+                   static_cast<unsigned char>(pData[end]) < 0x7F)
+            {
+               end++;
+            }
+            printAscii(pData + i, end - i);
+            i = end;
+            continue;
+         }
+
+         decode(ch);
+         i++;
+      }
+   }
+
+   void decode(unsigned char ch)
+   {
+      if (utf8Remaining > 0)
+      {
+         if ((ch & 0xC0) == 0x80)
+         {
+            utf8Char = (utf8Char << 6) | (ch & 0x3F);
+            if (--utf8Remaining == 0)
+               process(utf8Char);
+            return;
+         }
+
+         // truncated sequence
+         utf8Remaining = 0;
+         process(kReplacementChar);
+      }
+
+      if (ch < 0x80)
+         process(ch);
+      else if (ch >= 0xC2 && ch <= 0xDF)
+         utf8Char = ch & 0x1F, utf8Remaining = 1;
+      else if (ch >= 0xE0 && ch <= 0xEF)
+         utf8Char = ch & 0x0F, utf8Remaining = 2;
+      else if (ch >= 0xF0 && ch <= 0xF4)
+         utf8Char = ch & 0x07, utf8Remaining = 3;
+      else
+         process(kReplacementChar);
+   }
+
+   void process(std::uint32_t ch)
+   {
+      // controls which apply in any state
+      if (ch == 0x18 || ch == 0x1A)
+      {
+         state = Ground;
+         return;
+      }
+      else if (ch == 0x1B)
+      {
+         if (state == OscString || state == IgnoredString)
+         {
+            stringState = state;
+            state = StringEscape;
+         }
+         else
+         {
+            state = Escape;
+            clearParams();
+         }
+         return;
+      }
+
+      switch (state)
+      {
+      case Ground:
+         if (ch < 0x20 || ch == 0x7F)
+            execute(ch);
+         else if (ch >= 0x80 && ch < 0xA0)
+            executeC1(ch);
+         else
+            print(ch);
+         break;
+
+      case Escape:
+         if (ch < 0x20)
+            execute(ch);
+         else if (ch == '[')
+            state = CsiParam;
+         else if (ch == ']')
+            state = OscString;
+         else if (ch == 'P' || ch == 'X' || ch == '^' || ch == '_')
+            state = IgnoredString;
+         else if (ch >= 0x20 && ch <= 0x2F)
+         {
+            intermediates.push_back(static_cast<char>(ch));
+            state = EscapeIntermediate;
+         }
+         else
+         {
+            state = Ground;
+            escDispatch(ch);
+         }
+         break;
+
+      case EscapeIntermediate:
+         if (ch < 0x20)
+            execute(ch);
+         else if (ch <= 0x2F)
+            intermediates.push_back(static_cast<char>(ch));
+         else
+         {
+            state = Ground;
+            escDispatch(ch);
+         }
+         break;
+
+      case CsiParam:
+         if (ch < 0x20)
+            execute(ch);
+         else if (ch >= '0' && ch <= '9')
+         {
+            if (!paramStarted)
+               startParam(false);
+            int& value = params.back();
+            value = std::min(value * 10 + static_cast<int>(ch - '0'), kMaxParamValue);
+         }
+         else if (ch == ';' || ch == ':')
+         {
+            if (!paramStarted)
+               startParam(false);
+            startParam(ch == ':');
+         }
+         else if (ch >= '<' && ch <= '?')
+         {
+            if (paramStarted || privateMarker)
+               state = CsiIgnore;
+            else
+               privateMarker = static_cast<char>(ch);
+         }
+         else if (ch >= 0x20 && ch <= 0x2F)
+            intermediates.push_back(static_cast<char>(ch));
+         else if (ch >= 0x40 && ch <= 0x7E)
+         {
+            state = Ground;
+            csiDispatch(static_cast<char>(ch));
+         }
+         else
+            state = CsiIgnore;
+         break;
+
+      case CsiIgnore:
+         if (ch < 0x20)
+            execute(ch);
+         else if (ch >= 0x40 && ch <= 0x7E)
+            state = Ground;
+         break;
+
+      case OscString:
+         // titles and other strings don't affect the screen
+         if (ch == 0x07 || ch == 0x9C)
+            state = Ground;
+         break;
+
+      case IgnoredString:
+         if (ch == 0x9C)
+            state = Ground;
+         break;
+
+      case StringEscape:
+         if (ch == '\\')
+         {
+            state = Ground;
+         }
+         else
+         {
+            // the string was cut short by another escape sequence
+            state = Escape;
+            clearParams();
+            process(ch);
+         }
+         break;
+      }
+   }
+
+   void startParam(bool sub)
+   {
+      if (params.size() >= kMaxParams)
+      {
+         state = CsiIgnore;
+         return;
+      }
+      params.push_back(0);
+      subParams.push_back(sub);
+      paramStarted = true;
+   }
+
+   // the value of a parameter, or the given default when it's missing or zero
+   int param(std::size_t index, int defaultValue) const
+   {
+      if (index < params.size() && params[index] > 0)
+         return params[index];
+      return defaultValue;
+   }
+
+   void execute(std::uint32_t ch)
+   {
+      Screen& screen = *pScreen;
+      switch (ch)
+      {
+      case '\b':
+         screen.pendingWrap = false;
+         if (screen.col > 0)
+            screen.col--;
+         break;
+
+      case '\t':
+      {
+         int col = screen.col + 1;
+         while (col < cols - 1 && !tabStops[col])
+            col++;
+         screen.col = std::min(col, cols - 1);
+         screen.pendingWrap = false;
+         break;
+      }
+
+      case '\n':
+      case '\v':
+      case '\f':
+         lineFeed();
+         break;
+
+      case '\r':
+         screen.col = 0;
+         screen.pendingWrap = false;
+         break;
+
+      case 0x0E:
+         shiftOut = true;
+         break;
+
+      case 0x0F:
+         shiftOut = false;
+         break;
+
+      default:
+         break;
+      }
+   }
+
+   void executeC1(std::uint32_t ch)
+   {
+      switch (ch)
+      {
+      case 0x84:
+         lineFeed();
+         break;
+      case 0x85:
+         pScreen->col = 0;
+         lineFeed();
+         break;
+      case 0x88:
+         tabStops[pScreen->col] = true;
+         break;
+      case 0x8D:
+         reverseIndex();
+         break;
+      case 0x90:
+      case 0x98:
+      case 0x9E:
+      case 0x9F:
+         state = IgnoredString;
+         break;
+      case 0x9B:
+         clearParams();
+         state = CsiParam;
+         break;
+      case 0x9D:
+         state = OscString;
+         break;
+      default:
+         break;
+      }
+   }
+
+   void escDispatch(std::uint32_t ch)
+   {
+      if (!intermediates.empty())
+      {
+         char intermediate = intermediates[0];
+         if (intermediate == '(')
+            g0LineDrawing = ch == '0';
+         else if (intermediate == ')')
+            g1LineDrawing = ch == '0';
+         else if (intermediate == '#' && ch == '8')
+            alignmentTest();
+         return;
+      }
+
+      Screen& screen = *pScreen;
+      switch (ch)
+      {
+      case '7':
+         saveCursor();
+         break;
+      case '8':
+         restoreCursor();
+         break;
+      case 'D':
+         lineFeed();
+         break;
+      case 'E':
+         screen.col = 0;
+         lineFeed();
+         break;
+      case 'H':
+         tabStops[screen.col] = true;
+         break;
+      case 'M':
+         reverseIndex();
+         break;
+      case 'c':
+      {
+         std::size_t savedMaxScrollback = maxScrollback;
+         reset();
+         maxScrollback = savedMaxScrollback;
+         written = true;
+         break;
+      }
+      case '=':
+         appKeypad = true;
+         break;
+      case '>':
+         appKeypad = false;
+         break;
+      default:
+         break;
+      }
+   }
+
+   void alignmentTest()
+   {
+      Screen& screen = *pScreen;
+      for (Line& line : screen.lines)
+      {
+         line.cells.assign(cols, blankCell(Attr()));
+         for (Cell& cell : line.cells)
+            cell.ch = 'E';
+         line.wrapped = false;
+         line.combining.clear();
+      }
+      screen.top = 0;
+      screen.bottom = rows - 1;
+      moveTo(0, 0);
+   }
+
+   void csiDispatch(char final)
+   {
+      Screen& screen = *pScreen;
+
+      if (privateMarker == '?')
+      {
+         if (intermediates.empty() && (final == 'h' || final == 'l'))
+            setPrivateModes(final == 'h');
+         return;
+      }
+      else if (privateMarker)
+      {
+         return;
+      }
+
+      if (!intermediates.empty())
+      {
+         if (intermediates == " " && final == 'q')
+            cursorStyle = param(0, 0);
+         else if (intermediates == "!" && final == 'p')
+            softReset();
+         return;
+      }
+
+      switch (final)
+      {
+      case '@':
+         insertCells(&screen.lines[screen.row], screen.col, param(0, 1));
+         break;
+      case 'A':
+         moveVertically(-param(0, 1));
+         break;
+      case 'B':
+      case 'e':
+         moveVertically(param(0, 1));
+         break;
+      case 'C':
+      case 'a':
+         moveTo(screen.col + param(0, 1), screen.row);
+         break;
+      case 'D':
+         moveTo(screen.col - param(0, 1), screen.row);
+         break;
+      case 'E':
+         moveVertically(param(0, 1));
+         screen.col = 0;
+         break;
+      case 'F':
+         moveVertically(-param(0, 1));
+         screen.col = 0;
+         break;
+      case 'G':
+      case '`':
+         moveTo(param(0, 1) - 1, screen.row);
+         break;
+      case 'H':
+      case 'f':
+      {
+         int offset = originMode ? screen.top : 0;
+         moveTo(param(1, 1) - 1, param(0, 1) - 1 + offset);
+         break;
+      }
+      case 'd':
+      {
+         int offset = originMode ? screen.top : 0;
+         moveTo(screen.col, param(0, 1) - 1 + offset);
+         break;
+      }
+      case 'I':
+         for (int i = 0; i < param(0, 1); i++)
+            execute('\t');
+         break;
+      case 'Z':
+         for (int i = 0; i < param(0, 1) && screen.col > 0; i++)
+         {
+            do
+               screen.col--;
+            while (screen.col > 0 && !tabStops[screen.col]);
+         }
+         screen.pendingWrap = false;
+         break;
+      case 'J':
+         eraseInDisplay(param(0, 0));
+         break;
+      case 'K':
+         eraseInLine(param(0, 0));
+         break;
+      case 'L':
+      case 'M':
+         if (screen.row >= screen.top && screen.row <= screen.bottom)
+         {
+            int top = screen.top;
+            screen.top = screen.row;
+            if (final == 'L')
+               scrollDown(param(0, 1));
+            else
+               scrollUp(param(0, 1), false);
+            screen.top = top;
+            screen.col = 0;
+            screen.pendingWrap = false;
+         }
+         break;
+      case 'P':
+         deleteCells(&screen.lines[screen.row], screen.col, param(0, 1));
+         screen.pendingWrap = false;
+         break;
+      case 'X':
+         eraseCells(&screen.lines[screen.row], screen.col, screen.col + param(0, 1));
+         screen.pendingWrap = false;
+         break;
+      case 'S':
+         scrollUp(param(0, 1), false);
+         break;
+      case 'T':
+         if (params.size() <= 1)
+            scrollDown(param(0, 1));
+         break;
+      case 'b':
+      {
+         int count = std::min(param(0, 1), cols * rows);
+         for (int i = 0; i < count; i++)
+            print(lastChar);
+         break;
+      }
+      case 'g':
+         if (param(0, 0) == 0)
+            tabStops[screen.col] = false;
+         else if (param(0, 0) == 3)
+            tabStops.assign(cols, false);
+         break;
+      case 'h':
+      case 'l':
+         for (std::size_t i = 0; i < params.size(); i++)
+         {
+            if (params[i] == 4)
+               insertMode = final == 'h';
+         }
+         break;
+      case 'm':
+         setAttributes();
+         break;
+      case 'r':
+      {
+         int top = param(0, 1) - 1;
+         int bottom = std::min(param(1, rows), rows) - 1;
+         if (top < bottom)
+         {
+            screen.top = top;
+            screen.bottom = bottom;
+            moveTo(0, originMode ? top : 0);
+         }
+         break;
+      }
+      case 's':
+         saveCursor();
+         break;
+      case 'u':
+         restoreCursor();
+         break;
+      default:
+         break;
+      }
+   }
+
+   void setPrivateModes(bool set)
+   {
+      for (std::size_t i = 0; i < params.size(); i++)
+      {
+         int mode = params[i];
+         switch (mode)
+         {
+         case 6:
+            originMode = set;
+            moveTo(0, set ? pScreen->top : 0);
+            break;
+         case 7:
+            autowrap = set;
+            break;
+         case 25:
+            cursorVisible = set;
+            break;
+         case 47:
+         case 1047:
+            setAltBuffer(set);
+            break;
+         case 1048:
+            if (set)
+               saveCursor();
+            else
+               restoreCursor();
+            break;
+         case 1049:
+            if (set)
+            {
+               saveCursor();
+               setAltBuffer(true);
+            }
+            else
+            {
+               setAltBuffer(false);
+               restoreCursor();
+            }
+            break;
+         default:
+            if (std::find(std::begin(kTrackedModes), std::end(kTrackedModes), mode) !=
+                std::end(kTrackedModes))
+            {
+               if (set)
+                  modes[mode] = true;
+               else
+                  modes.erase(mode);
+            }
+            break;
+         }
+      }
+   }
+
+   void softReset()
+   {
+      attr = Attr();
+      insertMode = false;
+      originMode = false;
+      autowrap = true;
+      cursorVisible = true;
+      appKeypad = false;
+      g0LineDrawing = false;
+      g1LineDrawing = false;
+      shiftOut = false;
+      modes.erase(1);
+      pScreen->top = 0;
+      pScreen->bottom = rows - 1;
+      pScreen->saved = SavedCursor();
+   }
+
+   // reads an extended color (38/48/58) starting at params[*pIndex]
+   bool readExtendedColor(std::size_t* pIndex, std::uint32_t* pColor)
+   {
+      std::size_t i = *pIndex;
+
+      // colon separated sub-parameters (38:5:n, 38:2:r:g:b or 38:2:cs:r:g:b)
+      std::vector<int> values;
+      std::size_t end = i + 1;
+      while (end < params.size() && subParams[end])
+         values.push_back(params[end++]);
+
+      bool colonForm = !values.empty();
+      if (!colonForm)
+      {
+         for (std::size_t j = i + 1; j < params.size() && j < i + 5; j++)
+            values.push_back(params[j]);
+      }
+
+      bool ok = false;
+      std::size_t used = 0;
+      if (!values.empty() && values[0] == 5 && values.size() >= 2)
+      {
+         *pColor = kColorPalette | static_cast<std::uint32_t>(std::min(values[1], 255));
+         used = 2;
+         ok = true;
+      }
+      else if (!values.empty() && values[0] == 2 && values.size() >= 4)
+      {
+         std::size_t first = (colonForm && values.size() >= 5) ? 2 : 1;
+         std::uint32_t r = static_cast<std::uint32_t>(std::min(values[first], 255));
+         std::uint32_t g = static_cast<std::uint32_t>(std::min(values[first + 1], 255));
+         std::uint32_t b = static_cast<std::uint32_t>(std::min(values[first + 2], 255));
+         *pColor = kColorRgb | (r << 16) | (g << 8) | b;
+         used = first + 3;
+         ok = true;
+      }
+
+      *pIndex = colonForm ? end - 1 : std::min(i + used, params.size() - 1);
+      return ok;
+   }
+
+   void setAttributes()
+   {
+      if (params.empty())
+      {
+         attr = Attr();
+         return;
+      }
+
+      for (std::size_t i = 0; i < params.size(); i++)
+      {
+         int value = params[i];
+         if (subParams[i])
+            continue;
+
+         // a sub-parameter on an underline selects its style (4:0 is none)
+         bool hasSub = i + 1 < params.size() && subParams[i + 1];
+
+         if (value == 0)
+            attr = Attr();
+         else if (value == 1)
+            attr.flags |= kBold;
+         else if (value == 2)
+            attr.flags |= kDim;
+         else if (value == 3)
+            attr.flags |= kItalic;
+         else if (value == 4)
+         {
+            if (hasSub && params[i + 1] == 0)
+               attr.flags &= ~kUnderline;
+            else
+               attr.flags |= kUnderline;
+         }
+         else if (value == 5 || value == 6)
+            attr.flags |= kBlink;
+         else if (value == 7)
+            attr.flags |= kInverse;
+         else if (value == 8)
+            attr.flags |= kInvisible;
+         else if (value == 9)
+            attr.flags |= kStrikethrough;
+         else if (value == 21)
+            attr.flags |= kUnderline;
+         else if (value == 22)
+            attr.flags &= ~(kBold | kDim);
+         else if (value == 23)
+            attr.flags &= ~kItalic;
+         else if (value == 24)
+            attr.flags &= ~kUnderline;
+         else if (value == 25)
+            attr.flags &= ~kBlink;
+         else if (value == 27)
+            attr.flags &= ~kInverse;
+         else if (value == 28)
+            attr.flags &= ~kInvisible;
+         else if (value == 29)
+            attr.flags &= ~kStrikethrough;
+         else if (value >= 30 && value <= 37)
+            attr.fg = kColorPalette | static_cast<std::uint32_t>(value - 30);
+         else if (value == 38)
+         {
+            std::uint32_t color;
+            if (readExtendedColor(&i, &color))
+               attr.fg = color;
+         }
+         else if (value == 39)
+            attr.fg = kColorDefault;
+         else if (value >= 40 && value <= 47)
+            attr.bg = kColorPalette | static_cast<std::uint32_t>(value - 40);
+         else if (value == 48)
+         {
+            std::uint32_t color;
+            if (readExtendedColor(&i, &color))
+               attr.bg = color;
+         }
+         else if (value == 49)
+            attr.bg = kColorDefault;
+         else if (value == 53)
+            attr.flags |= kOverline;
+         else if (value == 55)
+            attr.flags &= ~kOverline;
+         else if (value == 58)
+         {
+            // underline color isn't tracked
+            std::uint32_t color;
+            readExtendedColor(&i, &color);
+         }
+         else if (value >= 90 && value <= 97)
+            attr.fg = kColorPalette | static_cast<std::uint32_t>(value - 90 + 8);
+         else if (value >= 100 && value <= 107)
+            attr.bg = kColorPalette | static_cast<std::uint32_t>(value - 100 + 8);
+      }
+   }
+
+   void eraseInDisplay(int mode)
+   {
+      Screen& screen = *pScreen;
+      switch (mode)
+      {
+      case 0:
+         eraseCells(&screen.lines[screen.row], screen.col, cols);
+         screen.lines[screen.row].wrapped = false;
+         for (int row = screen.row + 1; row < rows; row++)
+            clearLine(&screen.lines[row]);
+         break;
+      case 1:
+         for (int row = 0; row < screen.row; row++)
+            clearLine(&screen.lines[row]);
+         eraseCells(&screen.lines[screen.row], 0, screen.col + 1);
+         break;
+      case 2:
+         for (Line& line : screen.lines)
+            clearLine(&line);
+         break;
+      case 3:
+         scrollback.clear();
+         break;
+      default:
+         break;
+      }
+   }
+
+   void eraseInLine(int mode)
+   {
+      Screen& screen = *pScreen;
+      Line& line = screen.lines[screen.row];
+      switch (mode)
+      {
+      case 0:
+         eraseCells(&line, screen.col, cols);
+         line.wrapped = false;
+         break;
+      case 1:
+         eraseCells(&line, 0, screen.col + 1);
+         break;
+      case 2:
+         eraseCells(&line, 0, cols);
+         line.wrapped = false;
+         break;
+      default:
+         break;
+      }
+   }
+
+   // --- resizing ----------------------------------------------------------
+
+   void resize(int newCols, int newRows)
+   {
+      newCols = std::max(newCols, 1);
+      newRows = std::max(newRows, 1);
+      if (newCols == cols && newRows == rows)
+         return;
+
+      for (Screen* pTarget : { &main, &alt })
+      {
+         Screen& screen = *pTarget;
+         for (Line& line : screen.lines)
+            resizeLine(&line, newCols);
+
+         // when there are fewer rows, drop blank rows below the cursor, then
+         // move rows from the top into the scrollback
+         while (static_cast<int>(screen.lines.size()) > newRows)
+         {
+            if (screen.row < static_cast<int>(screen.lines.size()) - 1 &&
+                isBlankLine(screen.lines.back()))
+            {
+               screen.lines.pop_back();
+            }
+            else
+            {
+               if (pTarget == &main)
+               {
+                  Line line = std::move(screen.lines.front());
+                  pushScrollback(&line);
+               }
+               screen.lines.erase(screen.lines.begin());
+               screen.row = std::max(screen.row - 1, 0);
+               screen.saved.row = std::max(screen.saved.row - 1, 0);
+            }
+         }
+
+         while (static_cast<int>(screen.lines.size()) < newRows)
+         {
+            Line line;
+            line.cells.assign(newCols, blankCell(Attr()));
+            screen.lines.push_back(std::move(line));
+         }
+
+         screen.col = std::min(screen.col, newCols - 1);
+         screen.row = std::min(screen.row, newRows - 1);
+         screen.saved.col = std::min(screen.saved.col, newCols - 1);
+         screen.saved.row = std::min(screen.saved.row, newRows - 1);
+         screen.pendingWrap = false;
+         screen.top = 0;
+         screen.bottom = newRows - 1;
+      }
+
+      cols = newCols;
+      rows = newRows;
+      resetTabStops();
+   }
+
+   void resizeLine(Line* pLine, int newCols)
+   {
+      std::vector<Cell>& cells = pLine->cells;
+      if (newCols < static_cast<int>(cells.size()))
+      {
+         // don't leave half of a wide character behind
+         if (cells[newCols].ch == kWideTail)
+            cells[newCols - 1].ch = ' ';
+
+         pLine->combining.erase(
+                  std::remove_if(pLine->combining.begin(), pLine->combining.end(),
+                                 [&](const std::pair<int, std::string>& entry)
+         {
+            return entry.first >= newCols;
+         }),
+                  pLine->combining.end());
+      }
+      cells.resize(newCols, blankCell(Attr()));
+   }
+
+   // --- snapshots ---------------------------------------------------------
+
+   void appendLine(const Line& line, bool last, Attr* pCurrent, std::string* pOutput) const
+   {
+      std::string& output = *pOutput;
+
+      // a wrapped line is written in full, so that the receiving terminal
+      // wraps it in the same place (or reflows it, if it's since been resized)
+      bool continues = line.wrapped && !last;
+      std::size_t length = continues ? line.cells.size() : trimmedLength(line);
+
+      auto combining = line.combining.begin();
+      for (std::size_t col = 0; col < length; col++)
+      {
+         const Cell& cell = line.cells[col];
+         if (cell.ch == kWideTail)
+            continue;
+
+         if (cell.attr != *pCurrent)
+         {
+            output += sgr(cell.attr);
+            *pCurrent = cell.attr;
+         }
+         appendUtf8(cell.ch, &output);
+
+         if (combining != line.combining.end())
+         {
+            for (const auto& entry : line.combining)
+            {
+               if (entry.first == static_cast<int>(col))
+                  output += entry.second;
+            }
+         }
+      }
+
+      if (!continues && !last)
+      {
+         // don't paint the new line with the current background
+         if (!pCurrent->isDefault())
+         {
+            output += "\033[0m";
+            *pCurrent = Attr();
+         }
+         output += "\r\n";
+      }
+   }
+
+   std::string snapshot(int maxLines) const
+   {
+      if (!written)
+         return std::string();
+
+      std::string output;
+      Attr current;
+
+      std::size_t first = 0;
+      if (maxLines >= 0 && scrollback.size() > static_cast<std::size_t>(maxLines))
+         first = scrollback.size() - maxLines;
+      for (std::size_t i = first; i < scrollback.size(); i++)
+         appendLine(scrollback[i], false, &current, &output);
+
+      // the whole primary screen is written, so that it lines up with the
+      // receiving terminal's screen
+      for (int row = 0; row < rows; row++)
+         appendLine(main.lines[row], row == rows - 1, &current, &output);
+
+      output += "\033[0m";
+      current = Attr();
+
+      if (main.top != 0 || main.bottom != rows - 1)
+         output += "\033[" + std::to_string(main.top + 1) + ";" + std::to_string(main.bottom + 1) + "r";
+
+      // position the cursor; if it's waiting to wrap, rewrite the last
+      // character of the line to leave it in the same state
+      const Line& cursorLine = main.lines[main.row];
+      int col = main.col;
+      bool rewrite = main.pendingWrap && !altActive;
+      if (rewrite && col > 0 && cursorLine.cells[col].ch == kWideTail)
+         col--;
+
+      bool cursorOriginMode = altActive ? main.saved.originMode : originMode;
+      int row = cursorOriginMode ? main.row - main.top : main.row;
+      if (cursorOriginMode)
+         output += "\033[?6h";
+      output += "\033[" + std::to_string(row + 1) + ";" + std::to_string(col + 1) + "H";
+      if (rewrite)
+      {
+         const Cell& cell = cursorLine.cells[col];
+         output += sgr(cell.attr);
+         appendUtf8(cell.ch, &output);
+      }
+
+      // modes
+      if (!autowrap)
+         output += "\033[?7l";
+      if (insertMode)
+         output += "\033[4h";
+      for (const auto& mode : modes)
+         output += "\033[?" + std::to_string(mode.first) + "h";
+      if (appKeypad)
+         output += "\033=";
+      if (!cursorVisible)
+         output += "\033[?25l";
+      if (cursorStyle != 0)
+         output += "\033[" + std::to_string(cursorStyle) + " q";
+
+      // and the state further output expects
+      output += sgr(attr);
+      if (g0LineDrawing)
+         output += "\033(0";
+      if (g1LineDrawing)
+         output += "\033)0";
+      if (shiftOut)
+         output += "\x0E";
+
+      return output;
+   }
+
+   std::string rowText(int row) const
+   {
+      std::string text;
+      if (row < 0 || row >= rows)
+         return text;
+
+      const Line& line = pScreen->lines[row];
+      std::size_t length = trimmedLength(line);
+      for (std::size_t col = 0; col < length; col++)
+      {
+         if (line.cells[col].ch == kWideTail)
+            continue;
+         appendUtf8(line.cells[col].ch, &text);
+         for (const auto& entry : line.combining)
+         {
+            if (entry.first == static_cast<int>(col))
+               text += entry.second;
+         }
+      }
+
+      std::size_t end = text.find_last_not_of(' ');
+      text.erase(end == std::string::npos ? 0 : end + 1);
+      return text;
+   }
+
+   std::size_t usedRows() const
+   {
+      int used = main.row + 1;
+      for (int row = rows - 1; row >= used; row--)
+      {
+         if (!isBlankLine(main.lines[row]))
+         {
+            used = row + 1;
+            break;
+         }
+      }
+      return static_cast<std::size_t>(used);
+   }
+};
+
+TermEmulator::TermEmulator(int cols, int rows, int maxScrollback)
+   : pImpl_(new Impl(cols, rows, maxScrollback))
+{
+}
+
+TermEmulator::~TermEmulator()
+{
+}
+
+void TermEmulator::write(const std::string& output)
+{
+   pImpl_->write(output.data(), output.size());
+}
+
+void TermEmulator::write(const char* pData, std::size_t length)
+{
+   pImpl_->write(pData, length);
+}
+
+void TermEmulator::resize(int cols, int rows)
+{
+   pImpl_->resize(cols, rows);
+}
+
+int TermEmulator::cols() const
+{
+   return pImpl_->cols;
+}
+
+int TermEmulator::rows() const
+{
+   return pImpl_->rows;
+}
+
+void TermEmulator::setMaxScrollback(int maxScrollback)
+{
+   pImpl_->maxScrollback = static_cast<std::size_t>(std::max(maxScrollback, 0));
+   while (pImpl_->scrollback.size() > pImpl_->maxScrollback)
+      pImpl_->scrollback.pop_front();
+}
+
+void TermEmulator::reset()
+{
+   std::size_t maxScrollback = pImpl_->maxScrollback;
+   pImpl_->reset();
+   pImpl_->maxScrollback = maxScrollback;
+}
+
+void TermEmulator::eraseCursorLine()
+{
+   Screen& screen = *pImpl_->pScreen;
+   pImpl_->clearLine(&screen.lines[screen.row]);
+   screen.col = 0;
+   screen.pendingWrap = false;
+}
+
+bool TermEmulator::altBufferActive() const
+{
+   return pImpl_->altActive;
+}
+
+void TermEmulator::leaveAltBuffer()
+{
+   if (!pImpl_->altActive)
+      return;
+
+   pImpl_->setAltBuffer(false);
+   pImpl_->restoreCursor();
+}
+
+int TermEmulator::cursorCol() const
+{
+   return pImpl_->pScreen->col;
+}
+
+int TermEmulator::cursorRow() const
+{
+   return pImpl_->pScreen->row;
+}
+
+std::size_t TermEmulator::scrollbackLines() const
+{
+   return pImpl_->scrollback.size();
+}
+
+std::size_t TermEmulator::lineCount() const
+{
+   if (!pImpl_->written)
+      return 0;
+   return pImpl_->scrollback.size() + pImpl_->usedRows();
+}
+
+std::string TermEmulator::rowText(int row) const
+{
+   return pImpl_->rowText(row);
+}
+
+std::string TermEmulator::snapshot(int maxScrollback) const
+{
+   return pImpl_->snapshot(maxScrollback);
+}
+
+} // namespace text
+} // namespace core
+} // namespace rstudio
@@ -0,0 +1,221 @@
+/*
+ * TermEmulatorTests.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/TermEmulator.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace core {
+namespace tests {
+
+using namespace core::text;
+
+namespace {
+
+// replaying a snapshot into a new terminal reproduces the screen and cursor
+void checkReplay(const TermEmulator& term)
+{
+   TermEmulator replay(term.cols(), term.rows(), 1000);
+   replay.write(term.snapshot());
+   for (int row = 0; row < term.rows(); row++)
+      CHECK(replay.rowText(row) == term.rowText(row));
+   CHECK(replay.cursorCol() == term.cursorCol());
+   CHECK(replay.cursorRow() == term.cursorRow());
+   CHECK(replay.snapshot() == term.snapshot());
+}
+
+} // anonymous namespace
+
+TEST_CASE("Terminal Emulator")
+{
+   SECTION("Nothing written")
+   {
+      TermEmulator term(80, 24, 100);
+      CHECK(term.snapshot().empty());
+      CHECK(term.lineCount() == 0);
+   }
+
+   SECTION("Text and cursor movement")
+   {
+      TermEmulator term(20, 5, 100);
+      term.write("hello\r\nworld");
+      CHECK(term.rowText(0) == "hello");
+      CHECK(term.rowText(1) == "world");
+      CHECK(term.cursorCol() == 5);
+      CHECK(term.cursorRow() == 1);
+
+      // back up and overwrite, erase to end of line, position absolutely
+      term.write("\b\b\bXY\033[K\033[1;3H*");
+      CHECK(term.rowText(0) == "he*lo");
+      CHECK(term.rowText(1) == "woXY");
+      CHECK(term.cursorCol() == 3);
+      CHECK(term.cursorRow() == 0);
+      checkReplay(term);
+   }
+
+   SECTION("Escape sequences and characters split across writes")
+   {
+      TermEmulator term(20, 5, 100);
+      term.write("a\033");
+      term.write("[3");
+      term.write("1mb\xC3");
+      term.write("\xA9\xE4\xB8");
+      term.write("\xAD|");
+      CHECK(term.rowText(0) == "ab\xC3\xA9\xE4\xB8\xAD|");
+
+      // the wide character takes two columns
+      CHECK(term.cursorCol() == 6);
+      checkReplay(term);
+   }
+
+   SECTION("Long lines wrap")
+   {
+      TermEmulator term(10, 3, 100);
+      term.write("0123456789abcdef");
+      CHECK(term.rowText(0) == "0123456789");
+      CHECK(term.rowText(1) == "abcdef");
+
+      // filling a line exactly leaves the cursor waiting to wrap
+      term.write("\r\n0123456789");
+      CHECK(term.cursorCol() == 9);
+      checkReplay(term);
+
+      TermEmulator replay(10, 3, 100);
+      replay.write(term.snapshot());
+      replay.write("X");
+      term.write("X");
+      CHECK(replay.snapshot() == term.snapshot());
+   }
+
+   SECTION("Output scrolls into a bounded scrollback")
+   {
+      TermEmulator term(10, 3, 5);
+      for (int i = 0; i < 20; i++)
+         term.write("line " + std::to_string(i) + "\r\n");
+      CHECK(term.scrollbackLines() == 5);
+      CHECK(term.rowText(0) == "line 18");
+      CHECK(term.rowText(1) == "line 19");
+      CHECK(term.rowText(2).empty());
+      CHECK(term.lineCount() == 8);
+
+      std::string snapshot = term.snapshot();
+      CHECK(snapshot.find("line 12") == std::string::npos);
+      CHECK(snapshot.find("line 13\r\n") != std::string::npos);
+      CHECK(term.snapshot(2).find("line 15") == std::string::npos);
+
+      TermEmulator replay(10, 3, 5);
+      replay.write(snapshot);
+      CHECK(replay.scrollbackLines() == 5);
+      checkReplay(term);
+   }
+
+   SECTION("Colors are kept")
+   {
+      TermEmulator term(20, 3, 100);
+      term.write("\033[1;31mred\033[0m \033[38;5;200mpink\033[48;2;1;2;3m!\033[0m");
+      std::string snapshot = term.snapshot();
+      CHECK(snapshot.find("\033[0;1;31mred") != std::string::npos);
+      CHECK(snapshot.find("\033[0;38;5;200mpink") != std::string::npos);
+      CHECK(snapshot.find("\033[0;38;5;200;48;2;1;2;3m!") != std::string::npos);
+      checkReplay(term);
+   }
+
+   SECTION("Full-screen programs use the alt-buffer")
+   {
+      TermEmulator term(20, 5, 100);
+      term.write("$ vim\r\n");
+      term.write("\033[?1049h\033[?1h\033[H\033[2Jediting");
+      CHECK(term.altBufferActive());
+      CHECK(term.rowText(0) == "editing");
+
+      // snapshots show the primary screen, with the program's modes
+      std::string snapshot = term.snapshot();
+      CHECK(snapshot.find("editing") == std::string::npos);
+      CHECK(snapshot.find("$ vim") != std::string::npos);
+      CHECK(snapshot.find("\033[?1h") != std::string::npos);
+
+      term.write("\033[?1049l\033[?1l");
+      CHECK_FALSE(term.altBufferActive());
+      CHECK(term.rowText(0) == "$ vim");
+      CHECK(term.cursorRow() == 1);
+
+      term.write("\033[?1049h");
+      term.leaveAltBuffer();
+      CHECK_FALSE(term.altBufferActive());
+   }
+
+   SECTION("Scroll regions and line editing")
+   {
+      TermEmulator term(10, 5, 100);
+      term.write("1\r\n2\r\n3\r\n4\r\n5");
+      term.write("\033[2;4r\033[4;1H\n");
+      CHECK(term.rowText(0) == "1");
+      CHECK(term.rowText(1) == "3");
+      CHECK(term.rowText(2) == "4");
+      CHECK(term.rowText(3).empty());
+      CHECK(term.rowText(4) == "5");
+      CHECK(term.scrollbackLines() == 0);
+
+      term.write("\033[r\033[2;1H\033[L\033[3;2H\033[P");
+      CHECK(term.rowText(1).empty());
+      CHECK(term.rowText(2) == "3");
+      checkReplay(term);
+   }
+
+   SECTION("Line drawing characters")
+   {
+      TermEmulator term(10, 3, 100);
+      term.write("\033(0lqk\033(Bx");
+      CHECK(term.rowText(0) == "\xE2\x94\x8C\xE2\x94\x80\xE2\x94\x90x");
+      checkReplay(term);
+   }
+
+   SECTION("Resizing keeps the cursor's line on screen")
+   {
+      TermEmulator term(10, 5, 100);
+      term.write("1\r\n2\r\n3\r\n4\r\n5");
+      term.resize(6, 3);
+      CHECK(term.rowText(0) == "3");
+      CHECK(term.rowText(2) == "5");
+      CHECK(term.cursorRow() == 2);
+      CHECK(term.scrollbackLines() == 2);
+
+      TermEmulator other(10, 5, 100);
+      other.write("1\r\n2");
+      other.resize(10, 3);
+      CHECK(other.rowText(0) == "1");
+      CHECK(other.scrollbackLines() == 0);
+   }
+
+   SECTION("Erase the cursor line and reset")
+   {
+      TermEmulator term(10, 3, 100);
+      term.write("output\r\n$ ");
+      term.eraseCursorLine();
+      CHECK(term.rowText(1).empty());
+      CHECK(term.cursorCol() == 0);
+      CHECK(term.rowText(0) == "output");
+
+      term.reset();
+      CHECK(term.snapshot().empty());
+      CHECK(term.rowText(0).empty());
+   }
+}
+
+} // namespace tests
+} // namespace core
+} // namespace rstudio
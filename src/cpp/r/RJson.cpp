@@ -46,13 +46,17 @@
  
 */
 
+#include <cmath>
 #include <iostream>
+#include <unordered_map>
 #include <gsl/gsl>
 
 #define R_INTERNAL_FUNCTIONS
 #include <r/RJson.hpp>
 
 #include <shared_core/Error.hpp>
+#include <shared_core/json/rapidjson/stringbuffer.h>
+#include <shared_core/json/rapidjson/writer.h>
 #include <core/StringUtils.hpp>
 
 #include <r/RSexp.hpp>
@@ -66,6 +70,12 @@ namespace json {
 
 namespace {
 
+// R objects are written as json text with a rapidjson writer rather than being
+// assembled as a tree of json::Values (each of which owns a document, and which
+// would be deep copied at every level as the tree is built). non-finite values
+// are written as null, since Infinity and NaN aren't valid json
+typedef rapidjson::Writer<rapidjson::StringBuffer> JsonWriter;
+
 enum IntValueType
 {
    UNKNOWN,
@@ -104,10 +114,93 @@ IntValueType getIntType(SEXP vectorSEXP)
    return UNKNOWN;
 }
 
-Error jsonValueFromVectorElement(SEXP vectorSEXP, 
-                                 int i, 
-                                 core::json::Value* pValue)
-{   
+// A vector whose elements are written one at a time (e.g. a data frame column).
+// The element type (and integer type) are looked up once rather than per element
+struct VectorInfo
+{
+   explicit VectorInfo(SEXP vectorSEXP)
+      : vectorSEXP(vectorSEXP),
+        type(TYPEOF(vectorSEXP)),
+        intType(type == INTSXP ? getIntType(vectorSEXP) : UNKNOWN)
+   {
+   }
+
+   SEXP vectorSEXP;
+   int type;
+   IntValueType intType;
+};
+
+Error writeObject(SEXP objectSEXP, JsonWriter* pWriter);
+
+void writeInteger(int value, IntValueType type, JsonWriter* pWriter)
+{
+   // NOTE: the conversions below match those made when these values were
+   // assigned to a json::Value (e.g. int16_t values are promoted to int)
+   switch (type)
+   {
+      case UINT16:
+      {
+         if ((value >= 0) && (value <= UINT16_MAX))
+         {
+            pWriter->Int(static_cast<uint16_t>(value));
+            return;
+         }
+
+         // Fall through intentional - upgrading type size.
+      }
+      case UINT32:
+      {
+         if (value >= 0)
+         {
+            pWriter->Uint(static_cast<uint32_t>(value));
+            return;
+         }
+
+         // Fall through intentional - upgrading type size.
+      }
+      case UINT64:
+      {
+         if (value >= 0)
+         {
+            pWriter->Uint64(static_cast<uint64_t>(value));
+            return;
+         }
+
+         // Fall through intentional - upgrading type size.
+      }
+      case INT16:
+      {
+         if (value <= INT16_MAX)
+         {
+            pWriter->Int(static_cast<int16_t>(value));
+            return;
+         }
+
+         // Fall through intentional - upgrading type size.
+      }
+      case INT32:
+      {
+         if (value <= INT32_MAX)
+         {
+            pWriter->Int(static_cast<int32_t>(value));
+            return;
+         }
+
+         // Fall through intentional - upgrading type size.
+      }
+      case INT64:
+      {
+         pWriter->Uint64(static_cast<uint64_t>(value));
+         return;
+      }
+      case UNKNOWN:
+      case INT:
+         pWriter->Int(value);
+   }
+}
+
+Error writeVectorElement(const VectorInfo& vector, int i, JsonWriter* pWriter)
+{
    // NOTE: currently NaN is represented in json as null. this is problematic
    // as parsing routines (such as JS overlay types in GWT) won't handle
    // this properly. we need to either have a higher level representation
@@ -116,19 +209,16 @@ Error jsonValueFromVectorElement(SEXP vectorSEXP,
    // values like infinity) or we need to use a lower level JSON interface
    // (not JS overlay types for accessing R data
    
-   // NOTE: we currently don't use NA_REAL (rather we use ISNAN). these
+   // NOTE: we currently don't use NA_REAL (rather we use isfinite). these
    // are different concepts (no value and NaN). distinguish these cases
    // and also make sure they are distinguished for other types
    
-   // default to null
-   *pValue = core::json::Value();
-   
-   // check for underlying value
-   switch(TYPEOF(vectorSEXP))
+   SEXP vectorSEXP = vector.vectorSEXP;
+   switch (vector.type)
    {
       case NILSXP:
       {
-         *pValue = core::json::Value();
+         pWriter->Null();
          break;
       }
       case STRSXP:
@@ -136,116 +226,64 @@ Error jsonValueFromVectorElement(SEXP vectorSEXP,
          SEXP stringSEXP = STRING_ELT(vectorSEXP, i);
          if (stringSEXP != NA_STRING)
          {
-            std::string value(Rf_translateCharUTF8(stringSEXP));
-            *pValue = value;
+            const char* value = Rf_translateCharUTF8(stringSEXP);
+            pWriter->String(value, gsl::narrow_cast<rapidjson::SizeType>(std::strlen(value)));
+         }
+         else
+         {
+            pWriter->Null();
          }
          break;
       }   
       case INTSXP:
       {
          int value = INTEGER(vectorSEXP)[i];
-         IntValueType type = getIntType(vectorSEXP);
-
          if (value != NA_INTEGER)
-         {
-            switch (type)
-            {
-               case UINT16:
-               {
-                  if ((value >= 0) && (value <= UINT16_MAX))
-                  {
-                     *pValue = static_cast<uint16_t>(value);
-                     break;
-                  }
-
-                  // Fall through intentional - upgrading type size.
-               }
-               case UINT32:
-               {
-                  if (value >= 0)
-                  {
-                     *pValue = static_cast<uint32_t>(value);
-                     break;
-                  }
-
-                  // Fall through intentional - upgrading type size.
-               }
-               case UINT64:
-               {
-                  if (value >= 0)
-                  {
-                     *pValue = static_cast<uint64_t>(value);
-                     break;
-                  }
-
-                  // Fall through intentional - upgrading type size.
-               }
-               case INT16:
-               {
-                  if (value <= INT16_MAX)
-                  {
-                     *pValue = static_cast<int16_t>(value);
-                     break;
-                  }
-
-                  // Fall through intentional - upgrading type size.
-               }
-               case INT32:
-               {
-                  if (value <= INT32_MAX)
-                  {
-                     *pValue = static_cast<int32_t>(value);
-                     break;
-                  }
-
-                  // Fall through intentional - upgrading type size.
-               }
-               case INT64:
-               {
-                  *pValue = static_cast<uint64_t>(value);
-                  break;
-               }
-               case UNKNOWN:
-               case INT:
-                  *pValue = value;
-            }
-         }
-
+            writeInteger(value, vector.intType, pWriter);
+         else
+            pWriter->Null();
          break;
       }
       case REALSXP:
       {
          double value = REAL(vectorSEXP)[i];
-         if (!ISNAN(value))
-            *pValue = value;
+         if (std::isfinite(value))
+            pWriter->Double(value);
+         else
+            pWriter->Null();
          break;
       }
       case LGLSXP:
       {
          int value = LOGICAL(vectorSEXP)[i];
          if (value != NA_LOGICAL)
-         {
-            bool boolValue = (value == TRUE);
-            *pValue = boolValue;
-         }
+            pWriter->Bool(value == TRUE);
+         else
+            pWriter->Null();
          break;
       }
       case CPLXSXP:
       {
          double real = COMPLEX(vectorSEXP)[i].r;
          double imaginary = COMPLEX(vectorSEXP)[i].i;
-         if ( !ISNAN(real) && !ISNAN(imaginary))
+         if (std::isfinite(real) && std::isfinite(imaginary))
+         {
+            pWriter->StartObject();
+            pWriter->Key("r");
+            pWriter->Double(real);
+            pWriter->Key("i");
+            pWriter->Double(imaginary);
+            pWriter->EndObject();
+         }
+         else
          {
-            core::json::Object jsonComplex;
-            jsonComplex["r"] = real;
-            jsonComplex["i"] = imaginary;
-            *pValue = jsonComplex;
+            pWriter->Null();
          }
          break;
       }
       case ENVSXP:
       {
-         *pValue = std::string("<environment>");
+         pWriter->String("<environment>");
          break;
       }
       default:
@@ -254,34 +292,6 @@ Error jsonValueFromVectorElement(SEXP vectorSEXP,
       }
    }
    
-   return Success();
-}  
-
-
-Error jsonValueArrayFromList(SEXP listSEXP, core::json::Value* pValue)
-{
-   // value array to return
-   core::json::Array jsonValueArray;
-   
-   // return a value for each list item
-   int listLength = Rf_length(listSEXP);
-   for (int i=0; i<listLength; i++)
-   {
-      // get the value
-      SEXP valueSEXP = VECTOR_ELT(listSEXP, i);
-      
-      // extract the value
-      core::json::Value jsonValue;
-      Error error = jsonValueFromObject(valueSEXP, &jsonValue);
-      if (error)
-         return error;
-      
-      // add it to our result array
-      jsonValueArray.push_back(jsonValue);
-   }
-   
-   // set value then return success
-   *pValue = jsonValueArray;
    return Success();
 }
 
@@ -309,53 +319,46 @@ bool isNamedList(SEXP listSEXP)
    // passed all the tests!
    return true;
 }
-   
-Error jsonObjectFromListElement(SEXP listSEXP, 
-                                const std::vector<std::string>& fieldNames,
-                                int index,
-                                core::json::Value* pValue)
+
+// Returns, for each field, the index of the field whose value is written in its
+// place, or -1 if it isn't written. Fields are normally written as is, but a name
+// that appears more than once is written once (at its first position) with the
+// value of its last occurrence, as json::Object does when fields are assigned
+std::vector<int> objectFieldIndexes(const std::vector<std::string>& fieldNames)
 {
-   // note list length
-   int listLength = Rf_length(listSEXP);
-   
-   // compose an object by iterating through the fields
-   core::json::Object jsonObject;
-   for (int f=0; f<listLength; f++)
+   std::vector<int> indexes(fieldNames.size());
+   std::unordered_map<std::string, int> firstIndexes;
+   for (int i = 0, n = gsl::narrow_cast<int>(fieldNames.size()); i < n; i++)
    {
-      // get the field
-      SEXP fieldSEXP = VECTOR_ELT(listSEXP, f);
-      
-      // extract the value
-      core::json::Value fieldValue;
-      switch(TYPEOF(fieldSEXP))
+      auto result = firstIndexes.insert(std::make_pair(fieldNames[i], i));
+      if (result.second)
       {
-         case VECSXP:
-         {
-            SEXP valueSEXP = VECTOR_ELT(fieldSEXP, index);
-            Error error = jsonValueFromObject(valueSEXP, &fieldValue);
-            if (error)
-               return error;
-            
-            break;
-         }
-         default:
-         {
-            Error error = jsonValueFromVectorElement(fieldSEXP, 
-                                                     index,
-                                                     &fieldValue);
-            if (error)
-               return error;
-            
-            break;
-         }
+         indexes[i] = i;
       }
-      
-      // add it to the json object
-      jsonObject[fieldNames[gsl::narrow_cast<size_t>(f)]] = fieldValue;
+      else
+      {
+         indexes[result.first->second] = i;
+         indexes[i] = -1;
+      }
+   }
+
+   return indexes;
+}
+
+Error writeArrayFromList(SEXP listSEXP, JsonWriter* pWriter)
+{
+   pWriter->StartArray();
+
+   // write a value for each list item
+   int listLength = Rf_length(listSEXP);
+   for (int i=0; i<listLength; i++)
+   {
+      Error error = writeObject(VECTOR_ELT(listSEXP, i), pWriter);
+      if (error)
+         return error;
    }
    
-   // set value and return success
-   *pValue = jsonObject;
+   pWriter->EndArray();
    return Success();
 }
 
@@ -363,7 +366,7 @@ Error jsonObjectFromListElement(SEXP listSEXP,
 // NOTE: this function assumes that isNamedList has been called
 // and returned true for this list (validates a name for each element)
 //   
-Error jsonObjectFromList(SEXP listSEXP, core::json::Value* pValue)  
+Error writeObjectFromList(SEXP listSEXP, JsonWriter* pWriter)
 {
    // get the names of the list elements
    std::vector<std::string> fieldNames;
@@ -371,23 +374,23 @@ Error jsonObjectFromList(SEXP listSEXP, core::json::Value* pValue)
    if (error)
       return error;
    
-   // compose object
-   core::json::Object object;
-   int fields = Rf_length(listSEXP);
-   for (int i=0; i<fields; i++)
+   std::vector<int> fieldIndexes = objectFieldIndexes(fieldNames);
+
+   pWriter->StartObject();
+   for (std::size_t i = 0; i < fieldNames.size(); i++)
    {
-      SEXP fieldSEXP = VECTOR_ELT(listSEXP, i);
-      
-      core::json::Value objectValue;
-      error = jsonValueFromObject(fieldSEXP, &objectValue);
+      if (fieldIndexes[i] == -1)
+         continue;
+
+      const std::string& name = fieldNames[i];
+      pWriter->Key(name.c_str(), gsl::narrow_cast<rapidjson::SizeType>(std::strlen(name.c_str())));
+
+      error = writeObject(VECTOR_ELT(listSEXP, fieldIndexes[i]), pWriter);
       if (error)
          return error;
-      
-      object[fieldNames[i]] = objectValue;
    }
-   
-   // set object as return value
-   *pValue = object;
+   pWriter->EndObject();
+
    return Success();
 }
 
@@ -395,12 +398,13 @@ Error jsonObjectFromList(SEXP listSEXP, core::json::Value* pValue)
 // NOTE: this function assumes that isNamedList has been called
 // and returned true for this list (validates a name for each element)
 //   
-Error jsonObjectArrayFromDataFrame(SEXP listSEXP, core::json::Value* pValue)
+Error writeObjectArrayFromDataFrame(SEXP listSEXP, JsonWriter* pWriter)
 {
    // handle empty-list case up-front
    if (Rf_length(listSEXP) == 0)
    {
-      *pValue = core::json::Array();
+      pWriter->StartArray();
+      pWriter->EndArray();
       return Success();
    }
    
@@ -410,90 +414,89 @@ Error jsonObjectArrayFromDataFrame(SEXP listSEXP, core::json::Value* pValue)
    if (error)
       return error;
    
-   // object array to return
-   core::json::Array jsonObjectArray;
-   
-   // iterate through the values
+   // the columns are walked in place, writing each row as an object
+   std::vector<int> fieldIndexes = objectFieldIndexes(fieldNames);
+   std::vector<VectorInfo> columns;
+   for (int f = 0, n = Rf_length(listSEXP); f < n; f++)
+      columns.push_back(VectorInfo(VECTOR_ELT(listSEXP, f)));
+
+   pWriter->StartArray();
+
    int values = Rf_length(VECTOR_ELT(listSEXP, 0));
    for (int v=0; v<values; v++)
    {
-      core::json::Value objectValue;
-      error = jsonObjectFromListElement(listSEXP, fieldNames, v, &objectValue);
-      if (error)
-         return error;
-      
-      jsonObjectArray.push_back(objectValue);
+      pWriter->StartObject();
+      for (std::size_t f = 0; f < columns.size(); f++)
+      {
+         if (fieldIndexes[f] == -1)
+            continue;
+
+         const std::string& name = fieldNames[f];
+         pWriter->Key(name.c_str(), gsl::narrow_cast<rapidjson::SizeType>(std::strlen(name.c_str())));
+
+         const VectorInfo& column = columns[fieldIndexes[f]];
+         if (column.type == VECSXP)
+            error = writeObject(VECTOR_ELT(column.vectorSEXP, v), pWriter);
+         else
+            error = writeVectorElement(column, v, pWriter);
+
+         if (error)
+            return error;
+      }
+      pWriter->EndObject();
    }
    
-   // return array and success
-   *pValue = jsonObjectArray;
+   pWriter->EndArray();
    return Success();
 }
 
-} // anonymous namespace
-
-Error jsonValueFromScalar(SEXP scalarSEXP, core::json::Value* pValue)
-{
-   // verify length
-   if (sexp::length(scalarSEXP) != 1)
-      return Error(errc::UnexpectedDataTypeError, ERROR_LOCATION);
-   
-   // get element
-   return jsonValueFromVectorElement(scalarSEXP, 0, pValue);
-}
-   
-   
-Error jsonValueFromVector(SEXP vectorSEXP, core::json::Value* pValue)
+Error writeVector(SEXP vectorSEXP, JsonWriter* pWriter)
 {
    int vectorLength = Rf_length(vectorSEXP);
+   VectorInfo vector(vectorSEXP);
 
    if (Rf_inherits(vectorSEXP, "rs.scalar") || Rf_inherits(vectorSEXP, "AsIs"))
    {
       if (vectorLength > 0)
       {
-         return jsonValueFromVectorElement(vectorSEXP, 0, pValue);
+         return writeVectorElement(vector, 0, pWriter);
       }
       else
       {
-         // return null
-         *pValue = core::json::Value();
+         // write null
+         pWriter->Null();
          return Success();
       }
    }
 
-   core::json::Array vectorValues;
+   pWriter->StartArray();
    for (int i = 0; i < vectorLength; i++)
    {
-      core::json::Value elementValue;
-      Error error = jsonValueFromVectorElement(vectorSEXP, i, &elementValue);
+      Error error = writeVectorElement(vector, i, pWriter);
       if (error)
          return error;
-      
-      vectorValues.push_back(elementValue);
    }
-   
-   *pValue = vectorValues;
+   pWriter->EndArray();
+
    return Success();
-}   
-   
-   
-Error jsonValueFromList(SEXP listSEXP, core::json::Value* pValue)
+}
+
+Error writeList(SEXP listSEXP, JsonWriter* pWriter)
 {
    if (isNamedList(listSEXP))
    {
       if (Rf_inherits(listSEXP, "data.frame"))
-          return jsonObjectArrayFromDataFrame(listSEXP, pValue);
+          return writeObjectArrayFromDataFrame(listSEXP, pWriter);
       else
-          return jsonObjectFromList(listSEXP, pValue);
+          return writeObjectFromList(listSEXP, pWriter);
    }
    else
    {
-      return jsonValueArrayFromList(listSEXP, pValue);
+      return writeArrayFromList(listSEXP, pWriter);
    }
 }
-   
-   
-Error jsonValueFromObject(SEXP objectSEXP, core::json::Value* pValue)
+
+Error writeObject(SEXP objectSEXP, JsonWriter* pWriter)
 {
    // NOTE: a few additional types/scenarios we could support are:
    //         - special handling for array
@@ -506,27 +509,91 @@ Error jsonValueFromObject(SEXP objectSEXP, core::json::Value* pValue)
    {
       case NILSXP:
       {
-         *pValue = core::json::Value();
+         pWriter->Null();
          return Success();
       }   
       case VECSXP:
       {
-         return jsonValueFromList(objectSEXP, pValue);
+         return writeList(objectSEXP, pWriter);
       }  
       case SYMSXP:
       case LANGSXP:
       {
-         *pValue = sexp::asString(objectSEXP);
+         std::string value = sexp::asString(objectSEXP);
+         pWriter->String(value.c_str(), gsl::narrow_cast<rapidjson::SizeType>(std::strlen(value.c_str())));
          return Success();
       }
       default:
       {
-         return jsonValueFromVector(objectSEXP, pValue);
+         return writeVector(objectSEXP, pWriter);
       }
    }
-} 
+}
+
+typedef Error (*WriteFunction)(SEXP, JsonWriter*);
+
+Error writeJson(WriteFunction write, SEXP objectSEXP, std::string* pJson)
+{
+   rapidjson::StringBuffer buffer;
+   JsonWriter writer(buffer);
+
+   Error error = write(objectSEXP, &writer);
+   if (error)
+      return error;
+
+   pJson->assign(buffer.GetString(), buffer.GetSize());
+   return Success();
+}
+
+Error jsonValue(WriteFunction write, SEXP objectSEXP, core::json::Value* pValue)
+{
+   rapidjson::StringBuffer buffer;
+   JsonWriter writer(buffer);
+
+   Error error = write(objectSEXP, &writer);
+   if (error)
+      return error;
+
+   return pValue->parseFullPrecision(buffer.GetString());
+}
+
+Error writeScalar(SEXP scalarSEXP, JsonWriter* pWriter)
+{
+   // verify length
+   if (sexp::length(scalarSEXP) != 1)
+      return Error(errc::UnexpectedDataTypeError, ERROR_LOCATION);
+
+   // write element
+   return writeVectorElement(VectorInfo(scalarSEXP), 0, pWriter);
+}
+
+} // anonymous namespace
+
+Error jsonValueFromScalar(SEXP scalarSEXP, core::json::Value* pValue)
+{
+   return jsonValue(writeScalar, scalarSEXP, pValue);
+}
+   
+Error jsonValueFromVector(SEXP vectorSEXP, core::json::Value* pValue)
+{
+   return jsonValue(writeVector, vectorSEXP, pValue);
+}   
+   
+Error jsonValueFromList(SEXP listSEXP, core::json::Value* pValue)
+{
+   return jsonValue(writeList, listSEXP, pValue);
+}
+   
+Error jsonValueFromObject(SEXP objectSEXP, core::json::Value* pValue)
+{
+   return jsonValue(writeObject, objectSEXP, pValue);
+}
+
+Error writeJsonFromObject(SEXP objectSEXP, std::string* pJson)
+{
+   return writeJson(writeObject, objectSEXP, pJson);
+}
    
 } // namespace json
 } // namespace r
 } // namespace rstudio
-
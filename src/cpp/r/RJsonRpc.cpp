@@ -68,14 +68,15 @@ namespace {
          
 Error setJsonResult(SEXP resultSEXP, core::json::JsonRpcResponse* pResponse)
 {   
-   // get the result
-   core::json::Value resultValue;
-   Error error = jsonValueFromObject(resultSEXP, &resultValue);
+   // write the result directly as json (results such as large data frames
+   // are then never held as a json::Value)
+   std::string result;
+   Error error = writeJsonFromObject(resultSEXP, &result);
    if (error)
       return error;
    
    // set the result and return success
-   pResponse->setResult(resultValue);
+   pResponse->setRawResult(result);
    return Success();
 }
 
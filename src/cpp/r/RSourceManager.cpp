@@ -22,6 +22,8 @@
 
 #include <shared_core/Error.hpp>
 #include <shared_core/FilePath.hpp>
+#include <shared_core/Hash.hpp>
+#include <core/FileSerializer.hpp>
 #include <core/Log.hpp>
 
 #include <r/RExec.hpp>
@@ -31,7 +33,18 @@ using namespace boost::placeholders;
 
 namespace rstudio {
 namespace r {
-   
+
+namespace {
+
+std::string escapedPath(const FilePath& filePath)
+{
+   // do \ escaping (for windows)
+   std::string path = filePath.getAbsolutePath();
+   boost::algorithm::replace_all(path, "\\", "\\\\");
+   return path;
+}
+
+} // anonymous namespace
    
 SourceManager& sourceManager()
 {
@@ -102,10 +115,27 @@ Error SourceManager::source(const FilePath& filePath, bool local)
    std::string localPrefix = local ? "local(" : "";
    std::string localParam = local ? "TRUE" : "FALSE";
    std::string localSuffix = local ? ")" : "";
-      
-   // do \ escaping (for windows)
-   std::string path = filePath.getAbsolutePath();
-   boost::algorithm::replace_all(path, "\\", "\\\\");
+
+#ifdef NDEBUG
+   // tools sources are parsed and byte-compiled once per R version and file
+   // content, and read back from the cache in later sessions. not done when
+   // auto-reloading, since then the sources are expected to change.
+   if (local && !autoReload_ && !cachePath_.isEmpty())
+   {
+      std::string rCode;
+      Error error = cachedSourceCode(filePath, &rCode);
+      if (!error)
+      {
+         recordSourcedFile(filePath, local);
+         return r::exec::executeString(rCode);
+      }
+
+      // fall back to sourcing the file
+      LOG_ERROR(error);
+   }
+#endif
+
+   std::string path = escapedPath(filePath);
 
    // Build the code. If this build is targeted for debugging, keep the source
    // code around; otherwise, turn it off to conserve memory and expose fewer
@@ -129,6 +159,60 @@ Error SourceManager::source(const FilePath& filePath, bool local)
    return r::exec::executeString(rCode);
 }
 
+Error SourceManager::cachedSourceCode(const FilePath& filePath,
+                                      std::string* pCode)
+{
+   std::string contents;
+   Error error = readStringFromFile(filePath, &contents);
+   if (error)
+      return error;
+
+   // files are keyed by name and directory, and by content so that a cached
+   // file is never used for a different build of the sources; entries for
+   // older content are removed when a file is recompiled
+   std::string stem = filePath.getStem();
+   boost::algorithm::replace_all(stem, ".", "_");
+   std::string prefix = stem + "-" +
+      core::hash::crc32HexHash(filePath.getParent().getAbsolutePath());
+   std::string cacheName = prefix + "-" + core::hash::crc32HexHash(contents) + ".rds";
+   std::string stalePattern = "^" + prefix + "-[0-9A-F]+\\\\.rds$";
+
+   // the cache is read and written, and the expressions evaluated, in
+   // anonymous functions so that neither their helpers nor the loop variables
+   // leak into the local environment the code is evaluated in (as with
+   // source(local = TRUE)); a cache which can't be read or written is
+   // ignored, while errors from the file itself are reported as usual
+   *pCode =
+      "local({\n"
+      "   (function(exprs, env) {\n"
+      "      for (expr in exprs)\n"
+      "         eval(expr, envir = env)\n"
+      "   })((function(path, cacheDir, cacheName, stalePattern) {\n"
+      "      cacheDir <- file.path(cacheDir, paste(getRversion(), R.version[[\"svn rev\"]], sep = \"-\"))\n"
+      "      cacheFile <- file.path(cacheDir, cacheName)\n"
+      "      exprs <- tryCatch(readRDS(cacheFile), condition = function(e) NULL)\n"
+      "      if (is.list(exprs))\n"
+      "         return(exprs)\n"
+      "      exprs <- parse(path, keep.source = FALSE, encoding = \"UTF-8\")\n"
+      "      exprs <- lapply(exprs, compiler::compile)\n"
+      "      tryCatch({\n"
+      "         dir.create(cacheDir, recursive = TRUE, showWarnings = FALSE)\n"
+      "         unlink(list.files(cacheDir, pattern = stalePattern, full.names = TRUE))\n"
+      "         tmp <- tempfile(tmpdir = cacheDir)\n"
+      "         saveRDS(exprs, tmp)\n"
+      "         if (!file.rename(tmp, cacheFile))\n"
+      "            unlink(tmp)\n"
+      "      }, condition = function(e) NULL)\n"
+      "      exprs\n"
+      "   })(\"" + escapedPath(filePath) + "\", "
+      "\"" + escapedPath(cachePath_) + "\", "
+      "\"" + cacheName + "\", "
+      "\"" + stalePattern + "\"), environment())\n"
+      "})";
+
+   return Success();
+}
+
 void SourceManager::recordSourcedFile(const FilePath& filePath, bool local)
 {
    SourcedFileInfo fileInfo(filePath.getLastWriteTime(), local);
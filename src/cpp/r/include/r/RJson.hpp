@@ -38,6 +38,11 @@ core::Error jsonValueFromScalar(SEXP scalarSEXP, core::json::Value* pValue);
 core::Error jsonValueFromVector(SEXP vectorSEXP, core::json::Value* pValue);
 core::Error jsonValueFromList(SEXP listSEXP, core::json::Value* pValue);
 core::Error jsonValueFromObject(SEXP objectSEXP, core::json::Value* pValue);
+
+// writes the json representation of an R object (the same json as would be
+// written for the value produced by jsonValueFromObject) directly as text,
+// without building a json::Value
+core::Error writeJsonFromObject(SEXP objectSEXP, std::string* pJson);
    
 } // namespace json
 } // namespace r
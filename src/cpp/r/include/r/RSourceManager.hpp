@@ -50,6 +50,10 @@ public:
    
    bool autoReload() const { return autoReload_; }
    void setAutoReload(bool autoReload) { autoReload_ = autoReload; }
+
+   // directory in which parsed, byte-compiled tools sources are cached
+   // (caching is disabled when empty or when auto-reloading)
+   void setCachePath(const core::FilePath& cachePath) { cachePath_ = cachePath; }
    
    core::Error sourceTools(const core::FilePath& filePath);
    void ensureToolsLoaded();
@@ -75,12 +79,15 @@ private:
    
    // helper functions
    core::Error source(const core::FilePath& filePath, bool local);
+   core::Error cachedSourceCode(const core::FilePath& filePath,
+                                std::string* pCode);
    void reSourceTools(const core::FilePath& filePath);
    void recordSourcedFile(const core::FilePath& filePath, bool local);
    void reloadSourceIfNecessary(const SourcedFileMap::value_type& value);
    
    // members
    bool autoReload_;
+   core::FilePath cachePath_;
    SourcedFileMap sourcedFiles_;
    std::vector<core::FilePath> toolsFilePaths_;
 };
@@ -27,6 +27,7 @@
 #include <core/Log.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/Thread.hpp>
+#include <core/text/ConsoleOutput.hpp>
 
 #include <r/ROptions.hpp>
 
@@ -98,8 +99,10 @@ void ConsoleActions::add(int type, const std::string& data)
 
       // if we've received more output of the same type, we can append that data
       bool isOutputType = type == kConsoleActionOutput || kConsoleActionOutputError;
+      std::size_t appendedAt = 0;
       if (isOutputType && type == action_.type)
       {
+         appendedAt = action_.data.size();
          action_.data.append(data);
       }
       else
@@ -112,6 +115,11 @@ void ConsoleActions::add(int type, const std::string& data)
          action_.type = type;
          action_.data = data;
       }
+
+      // drop output overwritten by carriage returns (e.g. progress bars) so
+      // that it doesn't fill the buffer that's replayed on reconnect
+      if (type == kConsoleActionOutput || type == kConsoleActionOutputError)
+         text::compactConsoleOutput(&action_.data, appendedAt);
       
       // consume chunks of data if available
       std::size_t offset = 0;
@@ -122,7 +130,7 @@ void ConsoleActions::add(int type, const std::string& data)
          if (action_.data.length() < offset + kChunkSize)
          {
             if (offset > 0)
-               action_.data = action_.data.substr(offset);
+               action_.data.erase(0, offset);
             break;
          }
          
@@ -320,6 +320,8 @@ Error run(const ROptions& options, const RCallbacks& callbacks)
 
    // set source reloading behavior
    sourceManager().setAutoReload(options.autoReloadSource);
+   sourceManager().setCachePath(
+      s_options.userScratchPath.completePath("r-source-cache"));
    
    // initialize suspended session path
    FilePath userScratch = s_options.userScratchPath;
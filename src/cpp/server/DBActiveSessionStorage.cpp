@@ -148,6 +148,11 @@ Error getSessionCount(boost::shared_ptr<database::IConnection> connection, std::
 
 } // anonymous namespace
 
+const std::string& activeSessionColumnName(const std::string& propertyName)
+{
+   return columnName(propertyName);
+}
+
 Error getConn(boost::shared_ptr<database::IConnection>* connection) {
    bool success = server_core::database::getConnection(boost::posix_time::milliseconds(500), connection);
 
@@ -172,7 +177,8 @@ Error DBActiveSessionStorage::getConnectionOrOverride(boost::shared_ptr<database
 
 DBActiveSessionStorage::DBActiveSessionStorage(const std::string& sessionId, const system::User& user) :
    sessionId_(sessionId),
-   user_(user)
+   user_(user),
+   writeBuffer_(writeBuffer())
 {
 }
 
@@ -183,6 +189,18 @@ DBActiveSessionStorage::DBActiveSessionStorage(const std::string& sessionId, con
 {
 }
 
+DBActiveSessionStorage::DBActiveSessionStorage(
+   const std::string& sessionId,
+   const system::User& user,
+   boost::shared_ptr<core::database::IConnection> overrideConnection,
+   boost::shared_ptr<DBActiveSessionWriteBuffer> writeBuffer) :
+   sessionId_(sessionId),
+   user_(user),
+   overrideConnection_(overrideConnection),
+   writeBuffer_(writeBuffer)
+{
+}
+
 Error DBActiveSessionStorage::readProperty(const std::string& name, std::string* pValue)
 {
    static const std::string empty;
@@ -222,6 +240,14 @@ Error DBActiveSessionStorage::readProperty(const std::string& name, std::string*
    else
       *pValue = std::to_string(iter->get<int>(0));
 
+   if (writeBuffer_)
+   {
+      std::map<std::string, std::string> pending;
+      writeBuffer_->overlayPending(sessionId_, std::set<std::string>{name}, &pending);
+      if (!pending.empty())
+         *pValue = pending.begin()->second;
+   }
+
    // Sanity check number of returned rows, by using the pk in the where clause we should only get 1 row
    if (++iter != rowset.end())
    {
@@ -259,6 +285,15 @@ Error DBActiveSessionStorage::readProperties(const std::set<std::string>& names,
 
    populateMapWithRow(iter, pValues);
 
+   // reads must observe writes which have not been flushed yet
+   if (writeBuffer_)
+   {
+      if (names.count("*"))
+         writeBuffer_->overlayPending(sessionId_, std::set<std::string>(), pValues);
+      else
+         writeBuffer_->overlayPending(sessionId_, names, pValues);
+   }
+
    // Sanity check number of returned rows, by using the pk in the where clause we should only get 1 row
    if (++iter != rowset.end())
    {
@@ -284,12 +319,22 @@ Error DBActiveSessionStorage::readProperties(std::map<std::string, std::string>*
 
 Error DBActiveSessionStorage::writeProperty(const std::string& name, const std::string& value)
 {
+   if (writeBuffer_ && DBActiveSessionWriteBuffer::isDeferrable(name))
+   {
+      writeBuffer_->enqueue(sessionId_, user_, std::map<std::string, std::string>{{name, value}}, false);
+      return Success();
+   }
+
    boost::shared_ptr<database::IConnection> connection;
    Error error = getConnectionOrOverride(&connection);
 
    if (error)
       return error;
 
+   // state-critical write - send it along with anything pending for this session
+   if (writeBuffer_)
+      return writeBuffer_->flushSession(connection, sessionId_, std::map<std::string, std::string>{{name, value}});
+
    database::Query query = connection->query("UPDATE " + kTableName + " SET " + columnName(name) + " = :value WHERE " + kSessionIdColumnName + " = :id")
       .withInput(value)
       .withInput(sessionId_);
@@ -305,12 +350,27 @@ Error DBActiveSessionStorage::writeProperty(const std::string& name, const std::
 Error DBActiveSessionStorage::writeProperties(const std::map<std::string, std::string>& properties)
 {
    LOG_DEBUG_MESSAGE("Writing session properties: " + sessionId_);
+
+   if (writeBuffer_ && DBActiveSessionWriteBuffer::isDeferrable(properties))
+   {
+      writeBuffer_->enqueue(sessionId_, user_, properties, true);
+      return Success();
+   }
+
    boost::shared_ptr<database::IConnection> connection;
    Error error = getConnectionOrOverride(&connection);
 
    if (error)
       return error;
 
+   // write out anything pending first so it cannot later overwrite these values
+   if (writeBuffer_)
+   {
+      error = writeBuffer_->flushSession(connection, sessionId_, std::map<std::string, std::string>());
+      if (error)
+         LOG_ERROR(error);
+   }
+
    database::Query query = connection->query("SELECT * FROM " + kTableName + " WHERE " + kSessionIdColumnName + " = :id")
       .withInput(sessionId_);
    database::Rowset rowset;
@@ -377,6 +437,9 @@ Error DBActiveSessionStorage::destroy()
 {
    LOG_DEBUG_MESSAGE("Removing active session for: " + sessionId_ + " from database");
 
+   if (writeBuffer_)
+      writeBuffer_->discard(sessionId_);
+
    boost::shared_ptr<database::IConnection> connection;
    Error error = getConnectionOrOverride(&connection);
 
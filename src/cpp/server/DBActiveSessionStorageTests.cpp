@@ -287,3 +287,108 @@ TEST_CASE("Database Session Storage, Postgres","[database][integration][session]
    DBActiveSessionStorage storage{sessionId, currUser, connection};
    runTests(storage);
 }
+
+TEST_CASE("Database Session Storage Write Coalescing, Sqlite","[database][integration][session][sqlite]")
+{
+   system::User currUser;
+   Error error = system::User::getCurrentUser(currUser);
+   REQUIRE(!error);
+
+   SqliteConnectionOptions options = sqliteConnectionOptions();
+   boost::shared_ptr<IConnection> connection = initializeSQLiteDatabase(options, currUser);
+   boost::shared_ptr<DBActiveSessionWriteBuffer> buffer(new DBActiveSessionWriteBuffer(
+      [=](boost::shared_ptr<IConnection>* pConnection)
+      {
+         *pConnection = connection;
+         return Success();
+      }));
+
+   DBActiveSessionStorage storage{sessionId, currUser, connection, buffer};
+   DBActiveSessionStorage unbufferedStorage{sessionId, currUser, connection};
+
+   REQUIRE_FALSE(storage.writeProperties(initialProps));
+   REQUIRE(buffer->pendingCount() == 0);
+
+   WHEN("Heartbeat properties are written repeatedly")
+   {
+      REQUIRE_FALSE(storage.writeProperty("last_used", "2020-05-01T00:00:00.000Z"));
+      REQUIRE_FALSE(storage.writeProperty("last_used", "2020-05-02T00:00:00.000Z"));
+      REQUIRE_FALSE(storage.writeProperty("executing", "1"));
+
+      THEN("They are coalesced and not yet written")
+      {
+         REQUIRE(buffer->pendingCount() == 1);
+         REQUIRE(buffer->stats().propertyWrites == 3);
+         REQUIRE(buffer->stats().coalescedWrites == 1);
+         REQUIRE(buffer->stats().statementsExecuted == 0);
+
+         std::string lastUsed;
+         REQUIRE_FALSE(unbufferedStorage.readProperty("last_used", &lastUsed));
+         REQUIRE(lastUsed == "2020-04-30T00:00:00.000Z");
+      }
+
+      THEN("Reads observe the pending values")
+      {
+         std::string lastUsed;
+         REQUIRE_FALSE(storage.readProperty("last_used", &lastUsed));
+         REQUIRE(lastUsed == "2020-05-02T00:00:00.000Z");
+
+         std::map<std::string, std::string> readProps{};
+         REQUIRE_FALSE(storage.readProperties(&readProps));
+         REQUIRE(readProps.find("last_used")->second == "2020-05-02T00:00:00.000Z");
+         REQUIRE(readProps.find("executing")->second == "1");
+      }
+
+      THEN("A periodic flush writes them with one statement")
+      {
+         REQUIRE_FALSE(buffer->flush());
+         REQUIRE(buffer->pendingCount() == 0);
+         REQUIRE(buffer->stats().statementsExecuted == 1);
+
+         std::map<std::string, std::string> readProps{};
+         REQUIRE_FALSE(unbufferedStorage.readProperties(&readProps));
+         REQUIRE(readProps.find("last_used")->second == "2020-05-02T00:00:00.000Z");
+         REQUIRE(readProps.find("executing")->second == "1");
+      }
+
+      THEN("A state-critical write flushes them synchronously")
+      {
+         REQUIRE_FALSE(storage.writeProperty("activity_state", "running"));
+         REQUIRE(buffer->pendingCount() == 0);
+         REQUIRE(buffer->stats().statementsExecuted == 1);
+         REQUIRE(buffer->stats().synchronousFlushes == 1);
+
+         std::map<std::string, std::string> readProps{};
+         REQUIRE_FALSE(unbufferedStorage.readProperties(&readProps));
+         REQUIRE(readProps.find("last_used")->second == "2020-05-02T00:00:00.000Z");
+         REQUIRE(readProps.find("activity_state")->second == "running");
+      }
+
+      THEN("Destroying the session discards them")
+      {
+         REQUIRE_FALSE(storage.destroy());
+         REQUIRE(buffer->pendingCount() == 0);
+         REQUIRE_FALSE(buffer->flush());
+         REQUIRE(buffer->stats().statementsExecuted == 0);
+      }
+   }
+
+   WHEN("The same statement is flushed repeatedly")
+   {
+      for (int i = 0; i < 10; i++)
+      {
+         REQUIRE_FALSE(storage.writeProperty("last_used", "2020-05-0" + std::to_string(i) + "T00:00:00.000Z"));
+         REQUIRE_FALSE(buffer->flush());
+      }
+
+      THEN("The prepared statement is reused for each flush")
+      {
+         REQUIRE(buffer->stats().statementsExecuted == 10);
+         REQUIRE(buffer->stats().failedFlushes == 0);
+
+         std::string lastUsed;
+         REQUIRE_FALSE(unbufferedStorage.readProperty("last_used", &lastUsed));
+         REQUIRE(lastUsed == "2020-05-09T00:00:00.000Z");
+      }
+   }
+}
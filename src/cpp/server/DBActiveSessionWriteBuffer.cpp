@@ -0,0 +1,349 @@
+/*
+ * DBActiveSessionWriteBuffer.cpp
+ *
+ * Copyright (C) 2022 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <server/DBActiveSessionWriteBuffer.hpp>
+
+#include <boost/make_shared.hpp>
+
+#include <core/PeriodicCommand.hpp>
+#include <core/r_util/RActiveSessions.hpp>
+
+#include <server/DBActiveSessionStorage.hpp>
+#include <server/ServerScheduler.hpp>
+
+using namespace rstudio::core;
+using namespace rstudio::core::r_util;
+
+namespace rstudio {
+namespace server {
+namespace storage {
+
+namespace {
+
+// how long deferrable writes may be held before being flushed
+const boost::posix_time::time_duration kFlushInterval = boost::posix_time::seconds(1);
+
+// how often the write statistics are logged (in flush intervals)
+const int kStatsLogIntervals = 60;
+
+boost::shared_ptr<DBActiveSessionWriteBuffer> s_pWriteBuffer;
+
+std::string updateStatement(const std::map<std::string, std::string>& properties)
+{
+   // the statement text depends only on the set of columns, so the number of
+   // distinct prepared statements stays small
+   std::string sql = "UPDATE active_session_metadata SET ";
+   int index = 0;
+   for (const auto& property : properties)
+   {
+      if (index > 0)
+         sql.append(", ");
+
+      sql.append(activeSessionColumnName(property.first))
+         .append(" = :value")
+         .append(std::to_string(index++));
+   }
+   sql.append(" WHERE session_id = :id");
+   return sql;
+}
+
+bool flushWriteBuffer()
+{
+   static int s_intervals = 0;
+
+   Error error = s_pWriteBuffer->flush();
+   if (error)
+      LOG_ERROR(error);
+
+   if (++s_intervals >= kStatsLogIntervals)
+   {
+      s_intervals = 0;
+      DBActiveSessionWriteStats stats = s_pWriteBuffer->stats();
+      LOG_DEBUG_MESSAGE("Session metadata writes: " +
+                        std::to_string(stats.propertyWrites) + " properties written, " +
+                        std::to_string(stats.coalescedWrites) + " coalesced, " +
+                        std::to_string(stats.statementsExecuted) + " statements executed, " +
+                        std::to_string(stats.synchronousFlushes) + " synchronous flushes, " +
+                        std::to_string(stats.failedFlushes) + " failed flushes");
+   }
+
+   return true;
+}
+
+} // anonymous namespace
+
+DBActiveSessionWriteBuffer::DBActiveSessionWriteBuffer(const ConnectionProvider& connectionProvider) :
+   connectionProvider_(connectionProvider),
+   propertyWrites_(0),
+   coalescedWrites_(0),
+   statementsExecuted_(0),
+   synchronousFlushes_(0),
+   failedFlushes_(0)
+{
+}
+
+bool DBActiveSessionWriteBuffer::isDeferrable(const std::string& name)
+{
+   // heartbeat-style properties which are rewritten constantly while a session
+   // is in use; losing the latest value of one of these within the flush window
+   // is harmless, unlike activity state transitions which others act upon
+   return name == ActiveSession::kLastUsed ||
+          name == ActiveSession::kLastStateUpdated ||
+          name == ActiveSession::kExecuting;
+}
+
+bool DBActiveSessionWriteBuffer::isDeferrable(const std::map<std::string, std::string>& properties)
+{
+   if (properties.empty())
+      return false;
+
+   for (const auto& property : properties)
+   {
+      if (!isDeferrable(property.first))
+         return false;
+   }
+
+   return true;
+}
+
+void DBActiveSessionWriteBuffer::enqueue(const std::string& sessionId,
+                                         const system::User& user,
+                                         const std::map<std::string, std::string>& properties,
+                                         bool upsert)
+{
+   propertyWrites_ += properties.size();
+
+   LOCK_MUTEX(mutex_)
+   {
+      auto it = pending_.find(sessionId);
+      if (it == pending_.end())
+      {
+         pending_[sessionId] = PendingWrite(user, properties, upsert);
+         return;
+      }
+
+      PendingWrite& pending = it->second;
+      for (const auto& property : properties)
+      {
+         auto existing = pending.properties.find(property.first);
+         if (existing != pending.properties.end())
+         {
+            existing->second = property.second;
+            ++coalescedWrites_;
+         }
+         else
+         {
+            pending.properties.insert(property);
+         }
+      }
+      pending.upsert = pending.upsert || upsert;
+   }
+   END_LOCK_MUTEX
+}
+
+void DBActiveSessionWriteBuffer::overlayPending(const std::string& sessionId,
+                                                const std::set<std::string>& names,
+                                                std::map<std::string, std::string>* pValues)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      auto it = pending_.find(sessionId);
+      if (it == pending_.end())
+         return;
+
+      for (const auto& property : it->second.properties)
+      {
+         if (names.empty() || names.count(property.first))
+            (*pValues)[property.first] = property.second;
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+bool DBActiveSessionWriteBuffer::takePending(const std::string& sessionId, PendingWrite* pPending)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      auto it = pending_.find(sessionId);
+      if (it == pending_.end())
+         return false;
+
+      *pPending = it->second;
+      pending_.erase(it);
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+Error DBActiveSessionWriteBuffer::executeUpdate(const boost::shared_ptr<database::IConnection>& connection,
+                                                const std::string& sessionId,
+                                                const std::map<std::string, std::string>& properties,
+                                                int* pAffectedRows)
+{
+   std::string sql = updateStatement(properties);
+   boost::shared_ptr<database::Query> pQuery = connection->preparedQuery(sql);
+   for (const auto& property : properties)
+      pQuery->withInput(property.second);
+   pQuery->withInput(sessionId);
+
+   Error error = connection->execute(*pQuery);
+   ++statementsExecuted_;
+   if (error)
+   {
+      // the statement may be left in an unusable state - prepare it again next time
+      connection->discardPreparedQuery(sql);
+      ++failedFlushes_;
+      return Error("DatabaseException", errc::DBError, "Database error while flushing session metadata [ session: " + sessionId + " ]", error, ERROR_LOCATION);
+   }
+
+   *pAffectedRows = pQuery->getAffectedRows();
+   return Success();
+}
+
+Error DBActiveSessionWriteBuffer::flushSession(const boost::shared_ptr<database::IConnection>& connection,
+                                               const std::string& sessionId,
+                                               const std::map<std::string, std::string>& properties,
+                                               int* pAffectedRows)
+{
+   Error error;
+   int affectedRows = 0;
+
+   LOCK_MUTEX(flushMutex_)
+   {
+      PendingWrite pending;
+      if (takePending(sessionId, &pending))
+         ++synchronousFlushes_;
+
+      // values written now supersede anything pending
+      for (const auto& property : properties)
+         pending.properties[property.first] = property.second;
+
+      if (!pending.properties.empty())
+         error = executeUpdate(connection, sessionId, pending.properties, &affectedRows);
+   }
+   END_LOCK_MUTEX
+
+   if (pAffectedRows)
+      *pAffectedRows = affectedRows;
+
+   return error;
+}
+
+Error DBActiveSessionWriteBuffer::writePending(const boost::shared_ptr<database::IConnection>& connection,
+                                               const std::string& sessionId,
+                                               const PendingWrite& pending)
+{
+   int affectedRows = 0;
+   Error error = executeUpdate(connection, sessionId, pending.properties, &affectedRows);
+   if (error)
+      return error;
+
+   // the row did not exist yet - fall back to the regular upsert
+   if (affectedRows == 0 && pending.upsert)
+   {
+      DBActiveSessionStorage storage(sessionId, pending.user, connection);
+      return storage.writeProperties(pending.properties);
+   }
+
+   return Success();
+}
+
+void DBActiveSessionWriteBuffer::discard(const std::string& sessionId)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      pending_.erase(sessionId);
+   }
+   END_LOCK_MUTEX
+}
+
+Error DBActiveSessionWriteBuffer::flush()
+{
+   std::vector<std::string> sessionIds;
+   LOCK_MUTEX(mutex_)
+   {
+      for (const auto& pending : pending_)
+         sessionIds.push_back(pending.first);
+   }
+   END_LOCK_MUTEX
+
+   if (sessionIds.empty())
+      return Success();
+
+   boost::shared_ptr<database::IConnection> connection;
+   Error error = connectionProvider_(&connection);
+   if (error)
+      return error;
+
+   for (const std::string& sessionId : sessionIds)
+   {
+      LOCK_MUTEX(flushMutex_)
+      {
+         PendingWrite pending;
+         if (!takePending(sessionId, &pending))
+            continue;
+
+         Error writeError = writePending(connection, sessionId, pending);
+         if (writeError)
+            LOG_ERROR(writeError);
+      }
+      END_LOCK_MUTEX
+   }
+
+   return Success();
+}
+
+size_t DBActiveSessionWriteBuffer::pendingCount()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return pending_.size();
+   }
+   END_LOCK_MUTEX
+
+   return 0;
+}
+
+DBActiveSessionWriteStats DBActiveSessionWriteBuffer::stats() const
+{
+   return DBActiveSessionWriteStats {
+      propertyWrites_.load(),
+      coalescedWrites_.load(),
+      statementsExecuted_.load(),
+      synchronousFlushes_.load(),
+      failedFlushes_.load()
+   };
+}
+
+boost::shared_ptr<DBActiveSessionWriteBuffer> writeBuffer()
+{
+   return s_pWriteBuffer;
+}
+
+Error initializeWriteBuffer()
+{
+   s_pWriteBuffer = boost::make_shared<DBActiveSessionWriteBuffer>(getConn);
+
+   scheduler::addCommand(boost::shared_ptr<ScheduledCommand>(
+      new PeriodicCommand(kFlushInterval, flushWriteBuffer, false)));
+
+   return Success();
+}
+
+} // namespace storage
+} // namespace server
+} // namespace rstudio
@@ -57,6 +57,7 @@
 #include <server/ServerUriHandlers.hpp>
 #include <server/ServerScheduler.hpp>
 #include <server/ServerProcessSupervisor.hpp>
+#include <server/DBActiveSessionWriteBuffer.hpp>
 #include <server/ServerPaths.hpp>
 
 #include <server/session/ServerSessionProxy.hpp>
@@ -802,6 +803,15 @@ int main(int argc, char * const argv[])
       if (error)
          return core::system::exitFailure(error, ERROR_LOCATION);
 
+      // initialize coalescing of session metadata writes (also needs
+      // access to the scheduled command list)
+      if (!options.sessionUseFileStorage())
+      {
+         error = storage::initializeWriteBuffer();
+         if (error)
+            return core::system::exitFailure(error, ERROR_LOCATION);
+      }
+
       // initialize monitor (needs to happen post http server init for access
       // to the server's io service)
       monitor::initializeMonitorClient(monitorSocketPath().getAbsolutePath(),
@@ -19,6 +19,8 @@
 #include <server/auth/ServerAuthHandler.hpp>
 #include <server/auth/ServerAuthHandlerOverlay.hpp>
 
+#include <unordered_map>
+
 #include <boost/algorithm/string.hpp>
 
 #include <core/DateTime.hpp>
@@ -30,6 +32,7 @@
 #include <core/system/User.hpp>
 #include <core/Thread.hpp>
 #include <core/PeriodicCommand.hpp>
+#include <shared_core/ReaderWriterMutex.hpp>
 #include <server/ServerScheduler.hpp>
 
 #include <server_core/ServerDatabase.hpp>
@@ -87,9 +90,90 @@ boost::posix_time::ptime cookieExpiration(const std::string& cookie)
 // inordinate amounts of revocation entries
 std::map<std::string, boost::posix_time::ptime> s_loginTimes;
 
-// sorted array of revoked cookies, where the first to expire appears as the first element
-// allows for quickly removing the first element
-std::deque<RevokedCookie> s_revokedCookies;
+// number of independently locked partitions of the revoked cookie set
+constexpr size_t kRevokedCookieShards = 16;
+
+// set of revoked cookies, hash-partitioned so that the revocation check made
+// for every authenticated request takes a read lock on a single partition and
+// does a single hash lookup. each partition also orders its cookies by expiration
+// so that expired cookies can be purged without scanning the whole set
+class RevokedCookieSet : boost::noncopyable
+{
+public:
+   bool contains(const std::string& cookie)
+   {
+      Shard& shard = shardFor(cookie);
+      READ_LOCK_BEGIN(shard.mutex)
+      {
+         return shard.cookies.find(cookie) != shard.cookies.end();
+      }
+      RW_LOCK_END(false)
+
+      return false;
+   }
+
+   void insert(const RevokedCookie& cookie)
+   {
+      Shard& shard = shardFor(cookie.cookie);
+      WRITE_LOCK_BEGIN(shard.mutex)
+      {
+         if (shard.cookies.emplace(cookie.cookie, cookie.expiration).second)
+            shard.expirations.emplace(cookie.expiration, cookie.cookie);
+      }
+      RW_LOCK_END(true)
+   }
+
+   // removes all cookies expiring at or before the given time, returning them in pExpired
+   void removeExpired(const boost::posix_time::ptime& now, std::vector<RevokedCookie>* pExpired)
+   {
+      for (Shard& shard : shards_)
+      {
+         WRITE_LOCK_BEGIN(shard.mutex)
+         {
+            auto it = shard.expirations.begin();
+            while (it != shard.expirations.end() && it->first <= now)
+            {
+               pExpired->push_back(RevokedCookie(it->second));
+               shard.cookies.erase(it->second);
+               it = shard.expirations.erase(it);
+            }
+         }
+         RW_LOCK_END(true)
+      }
+   }
+
+   std::vector<RevokedCookie> snapshot()
+   {
+      std::vector<RevokedCookie> cookies;
+      for (Shard& shard : shards_)
+      {
+         READ_LOCK_BEGIN(shard.mutex)
+         {
+            for (const auto& entry : shard.expirations)
+               cookies.push_back(RevokedCookie(entry.second));
+         }
+         RW_LOCK_END(true)
+      }
+      return cookies;
+   }
+
+private:
+   struct Shard
+   {
+      thread::ReaderWriterMutex mutex;
+      std::unordered_map<std::string, boost::posix_time::ptime> cookies;
+      std::multimap<boost::posix_time::ptime, std::string> expirations;
+   };
+
+   Shard& shardFor(const std::string& cookie)
+   {
+      return shards_[std::hash<std::string>()(cookie) % kRevokedCookieShards];
+   }
+
+   Shard shards_[kRevokedCookieShards];
+};
+
+RevokedCookieSet s_revokedCookies;
 
 // Stores revoked cookies that have been expired and can be purged from the db
 std::vector<RevokedCookie> s_expiredCookies;
@@ -101,7 +185,7 @@ std::map<std::string,UidType> s_usernameToUID;
 
 std::map<UidType,std::string> s_UIDToUsername;
 
-boost::posix_time::ptime s_lastCookieCheckTime = boost::posix_time::second_clock::universal_time();
+// how often expired cookies are purged from the revocation list and database
 boost::posix_time::time_duration s_cookieCheckDuration = boost::posix_time::seconds(5);
 
 // mutex for providing concurrent access to internal structures
@@ -131,13 +215,17 @@ void updateCredentialsNotSupported(
 Error readRevocationListFromDatabase(std::vector<std::string>* pEntries)
 {
    // establish a new transaction with the database
-   boost::shared_ptr<IConnection> connection = server_core::database::getConnection();
+   boost::shared_ptr<IConnection> connection;
+   Error error = server_core::database::getConnection(&connection);
+   if (error)
+      return error;
+
    // first, delete all stale cookies from the database
    std::string expiration = date_time::format(boost::posix_time::microsec_clock::universal_time(),
                                               date_time::kIso8601Format);
    Query deleteQuery = connection->query("DELETE FROM revoked_cookie WHERE expiration <= :val")
          .withInput(expiration);
-   Error error = connection->execute(deleteQuery);
+   error = connection->execute(deleteQuery);
    if (error)
    {
       error.addProperty("description", "Could not delete expired revoked cookies from the database");
@@ -185,7 +273,11 @@ Error writeRevokedCookieToDatabase(const RevokedCookie& cookie,
 
    // use existing connection if passed in, otherwise grab a new one
    if (!connection)
-      connection = server_core::database::getConnection();
+   {
+      Error error = server_core::database::getConnection(&connection);
+      if (error)
+         return error;
+   }
 
    Query query = connection->query("INSERT INTO revoked_cookie (expiration, cookie_data) VALUES (:exp, :dat)")
          .withInput(expiration)
@@ -205,20 +297,19 @@ Error writeRevokedCookieToDatabase(const RevokedCookie& cookie,
 
 Error writeRevokedCookiesToDatabase()
 {
-   boost::shared_ptr<IConnection> connection = server_core::database::getConnection();
+   boost::shared_ptr<IConnection> connection;
+   Error error = server_core::database::getConnection(&connection);
+   if (error)
+      return error;
+
    Transaction transaction(connection);
 
-   RECURSIVE_LOCK_MUTEX(s_mutex)
+   for (const RevokedCookie& cookie : s_revokedCookies.snapshot())
    {
-      for (auto it = s_revokedCookies.begin(); it != s_revokedCookies.end(); ++it)
-      {
-         const RevokedCookie& cookie = *it;
-         Error error = writeRevokedCookieToDatabase(cookie, connection);
-         if (error)
-            return error;
-      }
+      error = writeRevokedCookieToDatabase(cookie, connection);
+      if (error)
+         return error;
    }
-   END_LOCK_MUTEX
 
    transaction.commit();
    return Success();
@@ -363,56 +454,36 @@ void removeExpiredCookies()
    }
 }
 
-} // anonymous namespace
-
-bool isCookieRevoked(const std::string& cookie)
+// invoked periodically to move expired cookies out of the in-memory revocation
+// list and delete them from the database, away from the request path
+bool purgeExpiredCookies()
 {
-   if (cookie.empty())
-      return true;
-
-   boost::posix_time::ptime now = boost::posix_time::second_clock::universal_time();
+   std::vector<RevokedCookie> expired;
+   s_revokedCookies.removeExpired(boost::posix_time::second_clock::universal_time(), &expired);
 
-   bool removeStaleCookies;
-   bool expireCookies = false;
-
-   RECURSIVE_LOCK_MUTEX(s_mutex)
+   if (!expired.empty())
    {
-      removeStaleCookies = now > s_lastCookieCheckTime + s_cookieCheckDuration;
-
-      if (removeStaleCookies)
+      RECURSIVE_LOCK_MUTEX(s_mutex)
       {
-         s_lastCookieCheckTime = now;
+         s_expiredCookies.insert(s_expiredCookies.end(), expired.begin(), expired.end());
       }
+      END_LOCK_MUTEX
+   }
 
-      // check for cookie in revocation list, deleting expired elements as we go
-      for (auto it = s_revokedCookies.begin(); it != s_revokedCookies.end();)
-      {
-         const RevokedCookie& other = *it;
-         if (other.cookie == cookie)
-         {
-            return true;
-         }
+   removeExpiredCookies();
+   return true;
+}
 
-         if (removeStaleCookies && other.expiration <= now)
-         {
-            expireCookies = true;
-            // Put it in the list to remove from the DB
-            s_expiredCookies.push_back(other);
-            // Remove it from this list
-            it = s_revokedCookies.erase(it);
-         }
-         else
-         {
-            ++it;
-         }
-      }
-   }
-   END_LOCK_MUTEX
+} // anonymous namespace
 
-   if (expireCookies)
-      removeExpiredCookies();
+bool isCookieRevoked(const std::string& cookie)
+{
+   if (cookie.empty())
+      return true;
 
-   return false;
+   // expired cookies are purged by purgeExpiredCookies - until then they
+   // still count as revoked, which is harmless as they can no longer be used
+   return s_revokedCookies.contains(cookie);
 }
 
 Error getUserFromDatabase(const boost::shared_ptr<IConnection>& connection,
@@ -809,7 +880,11 @@ Result<int> getUserId(const std::string& username,
                       database::DatabaseConnection connection)
 {
    if (!connection)
-      connection = server_core::database::getConnection();
+   {
+      Error error = server_core::database::getConnection(&connection);
+      if (error)
+         return Unexpected(error);
+   }
 
    int userId = -1;
    std::string statement = "SELECT id FROM licensed_users";
@@ -873,7 +948,14 @@ void ensureDatabaseUser(const std::string& username)
 
    bool locked, exists;
    boost::posix_time::ptime lastSignIn;
-   boost::shared_ptr<IConnection> connection = server_core::database::getConnection();
+   boost::shared_ptr<IConnection> connection;
+   error = server_core::database::getConnection(&connection);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
    error = getUserFromDatabase(connection, user, &locked, &lastSignIn, &exists);
    if (error)
    {
@@ -1267,23 +1349,7 @@ bool insertRevokedCookie(const RevokedCookie& cookie)
    if (cookie.expiration <= boost::posix_time::second_clock::universal_time())
       return false;
 
-   RECURSIVE_LOCK_MUTEX(s_mutex)
-   {
-      for (auto it = s_revokedCookies.begin(); it != s_revokedCookies.end(); ++it)
-      {
-         const RevokedCookie& other = *it;
-         if (other.expiration > cookie.expiration)
-         {
-            s_revokedCookies.insert(it, cookie);
-            return true;
-         }
-      }
-
-      // no elements were greater - insert at the end
-      s_revokedCookies.insert(s_revokedCookies.end(), cookie);
-   }
-   END_LOCK_MUTEX
-
+   s_revokedCookies.insert(cookie);
    return true;
 }
 
@@ -1399,6 +1465,12 @@ Error initialize()
                              boost::bind(invalidateExpiredSessions),
                              false)));
 
+      // Periodically purge expired cookies from the revocation list and the database
+      scheduler::addCommand(boost::shared_ptr<ScheduledCommand>(
+         new PeriodicCommand(s_cookieCheckDuration,
+                             boost::bind(purgeExpiredCookies),
+                             false)));
+
       return overlay::initialize();
    }
 
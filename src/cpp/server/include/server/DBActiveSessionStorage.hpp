@@ -19,6 +19,8 @@
 #include <core/Database.hpp>
 #include <core/r_util/RActiveSessionStorage.hpp>
 
+#include <server/DBActiveSessionWriteBuffer.hpp>
+
 #include <shared_core/Error.hpp>
 #include <shared_core/system/User.hpp>
 
@@ -34,6 +36,11 @@ public:
       const std::string& sessionId,
       const core::system::User& user,
       boost::shared_ptr<core::database::IConnection> overrideConnection);
+   explicit DBActiveSessionStorage(
+      const std::string& sessionId,
+      const core::system::User& user,
+      boost::shared_ptr<core::database::IConnection> overrideConnection,
+      boost::shared_ptr<DBActiveSessionWriteBuffer> writeBuffer);
    ~DBActiveSessionStorage() = default;
    core::Error readProperty(const std::string& name, std::string* pValue) override;   
    core::Error readProperties(const std::set<std::string>& names, std::map<std::string, std::string>* pValues) override;
@@ -49,11 +56,17 @@ private:
 
    boost::shared_ptr<core::database::IConnection> overrideConnection_;
 
+   // when set, deferrable writes are coalesced through this buffer
+   boost::shared_ptr<DBActiveSessionWriteBuffer> writeBuffer_;
+
    core::Error getConnectionOrOverride(boost::shared_ptr<core::database::IConnection>* connection);
 };
 
 core::Error getConn(boost::shared_ptr<core::database::IConnection>* connection);
 
+// returns the active_session_metadata column which stores the given property
+const std::string& activeSessionColumnName(const std::string& propertyName);
+
 namespace errc
 {
    enum errc_t {
@@ -0,0 +1,163 @@
+/*
+ * DBActiveSessionWriteBuffer.hpp
+ *
+ * Copyright (C) 2022 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef DB_ACTIVE_SESSION_WRITE_BUFFER_HPP
+#define DB_ACTIVE_SESSION_WRITE_BUFFER_HPP
+
+#include <atomic>
+#include <map>
+#include <set>
+#include <string>
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Database.hpp>
+#include <core/Thread.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/system/User.hpp>
+
+namespace rstudio {
+namespace server {
+namespace storage {
+
+// counters describing the write traffic absorbed by a write buffer
+struct DBActiveSessionWriteStats
+{
+   // number of property values handed to the buffer
+   uint64_t propertyWrites;
+
+   // number of property values that were replaced by a newer value before being flushed
+   uint64_t coalescedWrites;
+
+   // number of UPDATE statements issued against the database
+   uint64_t statementsExecuted;
+
+   // number of flushes forced by a state-critical write, read, or destroy
+   uint64_t synchronousFlushes;
+
+   // number of flushes that failed (the pending values are dropped)
+   uint64_t failedFlushes;
+};
+
+// Coalesces frequent, non-critical session metadata writes (such as last used
+// time) over a short window so that each session issues at most one
+// multi-column UPDATE per window, rather than one UPDATE per property change.
+class DBActiveSessionWriteBuffer : boost::noncopyable
+{
+public:
+   typedef boost::function<core::Error(boost::shared_ptr<core::database::IConnection>*)> ConnectionProvider;
+
+   explicit DBActiveSessionWriteBuffer(const ConnectionProvider& connectionProvider);
+
+   // returns whether or not a write of the given property may be deferred;
+   // writes of any other property are state-critical and flushed immediately
+   static bool isDeferrable(const std::string& name);
+
+   // returns whether or not every property in the set may be deferred
+   static bool isDeferrable(const std::map<std::string, std::string>& properties);
+
+   // queues property values for the session, replacing any pending values
+   // for the same properties. if upsert is true and the session row does
+   // not exist at flush time, it is created as writeProperties() would
+   void enqueue(const std::string& sessionId,
+                const core::system::User& user,
+                const std::map<std::string, std::string>& properties,
+                bool upsert);
+
+   // overlays any pending (not yet flushed) values for the session on the given
+   // map; if names is non-empty only the named properties are overlaid
+   void overlayPending(const std::string& sessionId,
+                       const std::set<std::string>& names,
+                       std::map<std::string, std::string>* pValues);
+
+   // writes any pending values for the session together with the given
+   // properties as a single UPDATE, using the supplied connection
+   core::Error flushSession(const boost::shared_ptr<core::database::IConnection>& connection,
+                            const std::string& sessionId,
+                            const std::map<std::string, std::string>& properties,
+                            int* pAffectedRows = nullptr);
+
+   // drops any pending values for the session (used when it is destroyed)
+   void discard(const std::string& sessionId);
+
+   // flushes all pending values; invoked periodically
+   core::Error flush();
+
+   // returns the number of sessions with pending values
+   size_t pendingCount();
+
+   DBActiveSessionWriteStats stats() const;
+
+private:
+   struct PendingWrite
+   {
+      PendingWrite() : upsert(false) {}
+
+      PendingWrite(const core::system::User& user,
+                   const std::map<std::string, std::string>& properties,
+                   bool upsert) :
+         user(user), properties(properties), upsert(upsert)
+      {
+      }
+
+      core::system::User user;
+      std::map<std::string, std::string> properties;
+      bool upsert;
+   };
+
+   bool takePending(const std::string& sessionId, PendingWrite* pPending);
+
+   core::Error executeUpdate(const boost::shared_ptr<core::database::IConnection>& connection,
+                             const std::string& sessionId,
+                             const std::map<std::string, std::string>& properties,
+                             int* pAffectedRows);
+
+   core::Error writePending(const boost::shared_ptr<core::database::IConnection>& connection,
+                            const std::string& sessionId,
+                            const PendingWrite& pending);
+
+   ConnectionProvider connectionProvider_;
+
+   // protects pending_
+   boost::mutex mutex_;
+   std::map<std::string, PendingWrite> pending_;
+
+   // serializes writes so that a periodic flush can never overwrite the
+   // values of a newer synchronous flush for the same session
+   boost::mutex flushMutex_;
+
+   std::atomic<uint64_t> propertyWrites_;
+   std::atomic<uint64_t> coalescedWrites_;
+   std::atomic<uint64_t> statementsExecuted_;
+   std::atomic<uint64_t> synchronousFlushes_;
+   std::atomic<uint64_t> failedFlushes_;
+};
+
+// returns the process-wide write buffer, or null if write coalescing has not been initialized
+boost::shared_ptr<DBActiveSessionWriteBuffer> writeBuffer();
+
+// creates the process-wide write buffer and schedules its periodic flush
+// (must be called during server init, after database initialization)
+core::Error initializeWriteBuffer();
+
+} // namespace storage
+} // namespace server
+} // namespace rstudio
+
+#endif
@@ -114,10 +114,12 @@ void validateMinimumPostgreSqlVersion()
       return;
    }
 
-   const auto connection = s_connectionPool->getConnection();
-   if(!connection)
+   boost::shared_ptr<IConnection> connection;
+   Error connectionError = s_connectionPool->getConnection(&connection);
+   if (connectionError)
    {
-      LOG_WARNING_MESSAGE("Failed to get connection from connection pool to determine PostgreSQL version.");
+      LOG_WARNING_MESSAGE("Failed to get connection from connection pool to determine PostgreSQL version: " +
+                          connectionError.asString());
       return;
    }
    const std::string queryStatement = "SHOW server_version;";
@@ -446,7 +448,10 @@ Error initialize(const std::string& databaseConfigFile,
 
    if (updateSchema)
    {
-      boost::shared_ptr<IConnection> connection = s_connectionPool->getConnection();
+      boost::shared_ptr<IConnection> connection;
+      error = s_connectionPool->getConnection(&connection);
+      if (error)
+         return error;
 
       FilePath migrationsDirectory;
       error = migrationsDir(&migrationsDirectory);
@@ -477,9 +482,9 @@ Error execute(const std::string& databaseConfigFile,
    return Success();
 }
 
-boost::shared_ptr<IConnection> getConnection()
+Error getConnection(boost::shared_ptr<IConnection>* pConnection)
 {
-   return s_connectionPool->getConnection();
+   return s_connectionPool->getConnection(pConnection);
 }
 
 bool getConnection(const boost::posix_time::time_duration& waitTime,
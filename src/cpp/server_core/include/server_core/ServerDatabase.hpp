@@ -52,7 +52,9 @@ core::Error execute(const std::string& databaseConfigFile,
                     const boost::optional<core::system::User>& databaseFileUser,
                     std::string command);
 
-boost::shared_ptr<core::database::IConnection> getConnection();
+// Gets a connection from the pool, returning an error if none becomes available within the
+// pool's maximum wait
+core::Error getConnection(boost::shared_ptr<core::database::IConnection>* pConnection);
 bool getConnection(const boost::posix_time::time_duration& waitTime,
                    boost::shared_ptr<core::database::IConnection>* pConnection);
 
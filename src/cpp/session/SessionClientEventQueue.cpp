@@ -24,6 +24,8 @@
 
 #include <r/session/RConsoleActions.hpp>
 
+#include <session/SessionOptions.hpp>
+
 #include "SessionHttpMethods.hpp"
 
 using namespace rstudio::core;
@@ -35,6 +37,9 @@ namespace {
 
 ClientEventQueue* s_pClientEventQueue = nullptr;
 
+const char * const kConsoleOutputTruncated =
+      "\n[... console output truncated (too much output) ...]\n";
+
 } // end anonymous namespace
 
 void initializeClientEventQueue()
@@ -54,7 +59,11 @@ ClientEventQueue::ClientEventQueue()
       lastEventAddTime_(boost::posix_time::not_a_date_time),
       consoleOutput_(client_events::kConsoleWriteOutput, true),
       consoleErrors_(client_events::kConsoleWriteError, true),
-      buildOutput_(client_events::kBuildOutput, false)
+      buildOutput_(client_events::kBuildOutput, false),
+      consoleOutputLimit_(std::max(0, options().consoleOutputLimitKbps()) * 1024),
+      consoleOutputWindowStart_(boost::posix_time::not_a_date_time),
+      consoleOutputWindowBytes_(0),
+      consoleOutputTruncated_(false)
 {
    // buffered outputs (required for parts that might overflow)
    bufferedOutputs_.push_back(&consoleOutput_);
@@ -111,13 +120,13 @@ void ClientEventQueue::add(const ClientEvent& event)
           event.data().getType() == json::Type::STRING)
       {
          flushBufferedOutput(&consoleErrors_);
-         consoleOutput_.append(event.data().getString());
+         appendConsoleOutput(&consoleOutput_, event.data().getString());
       }
       else if (event.type() == client_events::kConsoleWriteError &&
                event.data().getType() == json::Type::STRING)
       {
          flushBufferedOutput(&consoleOutput_);
-         consoleErrors_.append(event.data().getString());
+         appendConsoleOutput(&consoleErrors_, event.data().getString());
       }
       else if (event.type() == client_events::kBuildOutput &&
                event.data().getType() == json::Type::OBJECT)
@@ -231,6 +240,43 @@ bool ClientEventQueue::eventAddedSince(const boost::posix_time::ptime& time)
    return false;
 }
 
+void ClientEventQueue::appendConsoleOutput(BufferedOutput* pBuffer, const std::string& output)
+{
+   // NOTE: Private helper so no lock required (mutex is not recursive)
+   if (consoleOutputLimit_ > 0)
+   {
+      using namespace boost::posix_time;
+      ptime now = microsec_clock::universal_time();
+      if (consoleOutputWindowStart_.is_not_a_date_time() ||
+          now - consoleOutputWindowStart_ >= seconds(1))
+      {
+         consoleOutputWindowStart_ = now;
+         consoleOutputWindowBytes_ = 0;
+         consoleOutputTruncated_ = false;
+      }
+
+      // drop output once the limit has been reached, noting that we did so once
+      if (consoleOutputWindowBytes_ >= consoleOutputLimit_)
+      {
+         if (!consoleOutputTruncated_)
+         {
+            pBuffer->append(kConsoleOutputTruncated);
+            consoleOutputTruncated_ = true;
+         }
+         return;
+      }
+   }
+
+   // console output is compacted as it's appended, so that (for example) a
+   // progress bar which redraws itself thousands of times costs only its
+   // latest state; just the growth of the buffer counts against the limit
+   std::size_t previousSize = pBuffer->output().size();
+   pBuffer->append(output);
+   std::size_t size = pBuffer->output().size();
+   if (size > previousSize)
+      consoleOutputWindowBytes_ += size - previousSize;
+}
+
 void ClientEventQueue::flushAllBufferedOutput()
 {
    // NOTE: Private helper so no lock required (mutex is not recursive)
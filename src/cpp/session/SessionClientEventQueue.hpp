@@ -24,6 +24,7 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/BoostThread.hpp>
+#include <core/text/ConsoleOutput.hpp>
 
 #include <session/SessionClientEvent.hpp>
 
@@ -57,7 +58,16 @@ private:
       int event() const { return event_; }
       bool useConsoleActionLimit() const { return useConsoleActionLimit_; }
       
-      void append(const std::string& data) { output_ += data; }
+      void append(const std::string& data)
+      {
+         std::size_t size = output_.size();
+         output_ += data;
+
+         // drop console output that would be overwritten (e.g. by progress bars)
+         if (useConsoleActionLimit_)
+            core::text::compactConsoleOutput(&output_, size);
+      }
+
       void clear() { output_.clear(); }
       bool empty() const { return output_.empty(); }
       
@@ -94,6 +104,7 @@ public:
       
 private:
    
+   void appendConsoleOutput(BufferedOutput* pOutput, const std::string& output);
    void flushBufferedOutput(BufferedOutput* pOutput);
    void flushAllBufferedOutput();
  
@@ -120,6 +131,13 @@ private:
    // iteration easier in places where we need to flush all buffers
    std::vector<BufferedOutput*> bufferedOutputs_;
 
+   // console output flood control: the number of bytes of console output
+   // accepted per second (0 for no limit) and the current one second window
+   std::size_t consoleOutputLimit_;
+   boost::posix_time::ptime consoleOutputWindowStart_;
+   std::size_t consoleOutputWindowBytes_;
+   bool consoleOutputTruncated_;
+
 };
 
 } // namespace session
@@ -40,6 +40,10 @@ namespace {
 
 ConsoleProcessSocket s_terminalSocket;
 
+// how long terminal output may go unsaved (in case the session goes away
+// without saving it)
+const int kOutputSaveDelaySeconds = 10;
+
 // Posix-only, use is gated via getTrackEnv() always being false on Win32.
 const std::string kEnvCommand = "/usr/bin/env";
 
@@ -481,33 +485,61 @@ void ConsoleProcess::enquePrompt(const std::string& prompt)
 
 void ConsoleProcess::interrupt()
 {
-   interrupt_ = true;
+   LOCK_MUTEX(inputOutputQueueMutex_)
+   {
+      interrupt_ = true;
+   }
+   END_LOCK_MUTEX
 }
 
 void ConsoleProcess::interruptChild()
 {
-   interruptChild_ = true;
+   LOCK_MUTEX(inputOutputQueueMutex_)
+   {
+      interruptChild_ = true;
+   }
+   END_LOCK_MUTEX
 }
 
 void ConsoleProcess::resize(int cols, int rows)
 {
-   newCols_ = cols;
-   newRows_ = rows;
+   LOCK_MUTEX(inputOutputQueueMutex_)
+   {
+      newCols_ = cols;
+      newRows_ = rows;
+   }
+   END_LOCK_MUTEX
 }
 
 bool ConsoleProcess::onContinue(core::system::ProcessOperations& ops)
 {
+   // take any pending interrupt and resize requests
+   bool interrupt = false;
+   bool interruptChild = false;
+   int newCols = -1;
+   int newRows = -1;
+   LOCK_MUTEX(inputOutputQueueMutex_)
+   {
+      interrupt = interrupt_;
+      interruptChild = interruptChild_;
+      newCols = newCols_;
+      newRows = newRows_;
+      interruptChild_ = false;
+      newCols_ = -1;
+      newRows_ = -1;
+   }
+   END_LOCK_MUTEX
+
    // full stop interrupt if requested
-   if (interrupt_)
+   if (interrupt)
       return false;
 
    // send SIGINT to children of the shell
-   if (interruptChild_)
+   if (interruptChild)
    {
       Error error = ops.ptyInterrupt();
       if (error)
          LOG_ERROR(error);
-      interruptChild_ = false;
    }
 
    LOCK_MUTEX(inputOutputQueueMutex_)
@@ -532,18 +564,20 @@ bool ConsoleProcess::onContinue(core::system::ProcessOperations& ops)
    }
    END_LOCK_MUTEX
 
-   if (newCols_ != -1 && newRows_ != -1)
+   if (newCols != -1 && newRows != -1)
    {
-      ops.ptySetSize(newCols_, newRows_);
-      procInfo_->setCols(newCols_);
-      procInfo_->setRows(newRows_);
-      newCols_ = -1;
-      newRows_ = -1;
+      ops.ptySetSize(newCols, newRows);
+      procInfo_->setCols(newCols);
+      procInfo_->setRows(newRows);
       saveConsoleProcesses();
    }
 
    pid_ = ops.getPid();
 
+   // send output that has waited long enough for more to batch with it
+   if (procInfo_->getChannelMode() == Websocket)
+      flushOutput(false);
+
    // continue
    return true;
 }
@@ -615,6 +649,27 @@ std::string ConsoleProcess::getBuffer() const
    return procInfo_->getFullSavedBuffer();
 }
 
+void ConsoleProcess::scheduleOutputSave()
+{
+   if (outputSaveScheduled_ || !procInfo_->hasUnsavedOutput())
+      return;
+
+   // save once the delay passes, whether or not more output arrives
+   outputSaveScheduled_ = true;
+   boost::weak_ptr<ConsoleProcess> weakThis = shared_from_this();
+   module_context::scheduleDelayedWork(
+      boost::posix_time::seconds(kOutputSaveDelaySeconds),
+      [weakThis]()
+      {
+         if (ConsoleProcessPtr pProc = weakThis.lock())
+         {
+            pProc->outputSaveScheduled_ = false;
+            pProc->saveOutputBuffer();
+         }
+      },
+      false);
+}
+
 void ConsoleProcess::enqueOutputEvent(const std::string &output)
 {
    if (envCaptureCmd_.output(output))
@@ -625,24 +680,25 @@ void ConsoleProcess::enqueOutputEvent(const std::string &output)
 
    // copy to output buffer
    procInfo_->appendToOutputBuffer(output);
+   scheduleOutputSave();
 
    if (procInfo_->getAltBufferActive() != currentAltBufferStatus)
       saveConsoleProcesses();
 
-   // If there's more output than the client can even show, then
+   if (procInfo_->getChannelMode() == Websocket)
+   {
+      outputFlow_.append(output);
+      flushOutput(false);
+      return;
+   }
+
+   // Rpc: if there's more output than the client can even show, then
    // truncate it to the amount that the client can show. Too much
    // output can overwhelm the client, making it unresponsive.
    std::string trimmedOutput = output;
    if (!prefs::userPrefs().limitVisibleConsole())
       string_utils::trimLeadingLines(procInfo_->getMaxOutputLines(), &trimmedOutput);
 
-   if (procInfo_->getChannelMode() == Websocket)
-   {
-      s_terminalSocket.sendText(procInfo_->getHandle(), output);
-      return;
-   }
-
-   // Rpc
    json::Object data;
    data["handle"] = handle();
    data["output"] = trimmedOutput;
@@ -650,6 +706,36 @@ void ConsoleProcess::enqueOutputEvent(const std::string &output)
          ClientEvent(client_events::kConsoleProcessOutput, data));
 }
 
+// send batched websocket output, if it's due (or regardless, when forced)
+void ConsoleProcess::flushOutput(bool force)
+{
+   boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+   if (!force && !outputFlow_.batchReady(now))
+      return;
+
+   std::string batch = outputFlow_.takeBatch(now);
+   if (batch.empty())
+      return;
+
+   Error error = s_terminalSocket.sendText(procInfo_->getHandle(), batch);
+   if (error)
+      outputFlow_.dropped(batch.size());
+}
+
+// stop reading terminal output while the client is too far behind
+bool ConsoleProcess::readyForOutput()
+{
+   bool paused = outputFlow_.paused();
+   if (paused != outputPaused_)
+   {
+      outputPaused_ = paused;
+      LOG_DEBUG_MESSAGE("Terminal " + handle() + (paused ? " paused" : " resumed") +
+                        " reading output; " +
+                        std::to_string(outputFlow_.queuedBytes()) + " bytes queued");
+   }
+   return !paused;
+}
+
 void ConsoleProcess::onStdout(core::system::ProcessOperations& ops,
                               const std::string& output)
 {
@@ -738,6 +824,9 @@ void ConsoleProcess::handleConsolePrompt(core::system::ProcessOperations& ops,
 
 void ConsoleProcess::onExit(int exitCode)
 {
+   if (procInfo_->getChannelMode() == Websocket)
+      flushOutput(true);
+
    procInfo_->setExitCode(exitCode);
    procInfo_->setHasChildProcs(false);
 
@@ -811,6 +900,7 @@ std::string ConsoleProcess::getChannelMode() const
 void ConsoleProcess::setRpcMode()
 {
    s_terminalSocket.stopListening(handle());
+   outputFlow_.reset();
    procInfo_->setChannelMode(Rpc, "");
 }
 
@@ -839,6 +929,10 @@ core::system::ProcessCallbacks ConsoleProcess::createProcessCallbacks()
    cb.onContinue = boost::bind(&ConsoleProcess::onContinue, ConsoleProcess::shared_from_this(), _1);
    cb.onStdout = boost::bind(&ConsoleProcess::onStdout, ConsoleProcess::shared_from_this(), _1, _2);
    cb.onExit = boost::bind(&ConsoleProcess::onExit, ConsoleProcess::shared_from_this(), _1);
+   if (options_.smartTerminal)
+   {
+      cb.readyForOutput = boost::bind(&ConsoleProcess::readyForOutput, ConsoleProcess::shared_from_this());
+   }
    if (options_.reportHasSubprocs)
    {
       cb.onHasSubprocs = boost::bind(&ConsoleProcess::onHasSubprocs, ConsoleProcess::shared_from_this(), _1, _2);
@@ -1118,6 +1212,7 @@ ConsoleProcessSocketConnectionCallbacks ConsoleProcess::createConsoleProcessSock
    cb.onReceivedInput = boost::bind(&ConsoleProcess::onReceivedInput, ConsoleProcess::shared_from_this(), _1);
    cb.onConnectionOpened = boost::bind(&ConsoleProcess::onConnectionOpened, ConsoleProcess::shared_from_this());
    cb.onConnectionClosed = boost::bind(&ConsoleProcess::onConnectionClosed, ConsoleProcess::shared_from_this());
+   cb.onOutputAcknowledged = boost::bind(&ConsoleProcess::onOutputAcknowledged, ConsoleProcess::shared_from_this(), _1);
    return cb;
 }
 
@@ -1142,11 +1237,20 @@ void ConsoleProcess::onReceivedInput(const std::string& input)
 void ConsoleProcess::onConnectionClosed()
 {
    s_terminalSocket.stopListening(handle());
+   outputFlow_.reset();
 }
 
 // websocket connection opened; called on different thread
 void ConsoleProcess::onConnectionOpened()
 {
+   outputFlow_.reset();
+}
+
+// client has written output it received over the websocket; called on
+// different thread
+void ConsoleProcess::onOutputAcknowledged(std::uint64_t frames)
+{
+   outputFlow_.acknowledge(frames);
 }
 
 void ConsoleProcess::saveEnvironment(const std::string& env)
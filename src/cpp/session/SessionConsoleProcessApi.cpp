@@ -271,6 +271,9 @@ SEXP rs_terminalContext(SEXP terminalSEXP)
    builder.add("pid", gsl::narrow_cast<int>(proc->getPid()));
    builder.add("full_screen", proc->getAltBufferActive());
    builder.add("restarted", proc->getWasRestarted());
+   builder.add("output_queued", static_cast<double>(proc->getOutputQueuedBytes()));
+   builder.add("output_queued_peak", static_cast<double>(proc->getOutputPeakQueuedBytes()));
+   builder.add("output_dropped", static_cast<double>(proc->getOutputDroppedBytes()));
 
    return r::sexp::create(builder, &protect);
 }
@@ -967,19 +970,19 @@ Error initializeApi()
    ExecBlock initBlock;
    initBlock.addFunctions()
       (bind(registerRpcMethod, "process_start", procStart))
-      (bind(registerRpcMethod, "process_interrupt", procInterrupt))
+      (bind(registerRIndependentRpcMethod, "process_interrupt", procInterrupt))
       (bind(registerRpcMethod, "process_reap", procReap))
-      (bind(registerRpcMethod, "process_write_stdin", procWriteStdin))
-      (bind(registerRpcMethod, "process_set_size", procSetSize))
+      (bind(registerRIndependentRpcMethod, "process_write_stdin", procWriteStdin))
+      (bind(registerRIndependentRpcMethod, "process_set_size", procSetSize))
       (bind(registerRpcMethod, "process_set_caption", procSetCaption))
       (bind(registerRpcMethod, "process_set_title", procSetTitle))
-      (bind(registerRpcMethod, "process_erase_buffer", procEraseBuffer))
-      (bind(registerRpcMethod, "process_get_buffer_chunk", procGetBufferChunk))
-      (bind(registerRpcMethod, "process_test_exists", procTestExists))
+      (bind(registerRIndependentRpcMethod, "process_erase_buffer", procEraseBuffer))
+      (bind(registerRIndependentRpcMethod, "process_get_buffer_chunk", procGetBufferChunk))
+      (bind(registerRIndependentRpcMethod, "process_test_exists", procTestExists))
       (bind(registerRpcMethod, "process_use_rpc", procUseRpc))
       (bind(registerRpcMethod, "process_notify_visible", procNotifyVisible))
-      (bind(registerRpcMethod, "process_interrupt_child", procInterruptChild))
-      (bind(registerRpcMethod, "process_get_buffer", procGetBuffer))
+      (bind(registerRIndependentRpcMethod, "process_interrupt_child", procInterruptChild))
+      (bind(registerRIndependentRpcMethod, "process_get_buffer", procGetBuffer))
       (bind(registerRpcMethod, "get_terminal_shells", getTerminalShells))
       (bind(registerRpcMethod, "start_terminal", startTerminal));
 
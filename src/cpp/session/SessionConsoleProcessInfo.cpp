@@ -15,8 +15,11 @@
 
 #include <session/SessionConsoleProcessInfo.hpp>
 
+#include <gsl/gsl>
+
+#include <core/Thread.hpp>
 #include <core/system/System.hpp>
-#include <core/text/TermBufferParser.hpp>
+#include <core/text/TermEmulator.hpp>
 
 #include "session-config.h"
 
@@ -86,6 +89,53 @@ void ConsoleProcessInfo::ensureHandle()
       handle_ = core::system::generateShortenedUuid();
 }
 
+void ConsoleProcessInfo::setMaxOutputLines(int maxOutputLines)
+{
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      maxOutputLines_ = maxOutputLines;
+      if (pTerminal_)
+         pTerminal_->setMaxScrollback(maxOutputLines);
+   }
+   END_LOCK_MUTEX
+}
+
+void ConsoleProcessInfo::setAltBufferActive(bool altBufferActive)
+{
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      altBufferActive_ = altBufferActive;
+      if (!altBufferActive && pTerminal_ && pTerminal_->altBufferActive())
+      {
+         pTerminal_->leaveAltBuffer();
+         outputUnsaved_ = true;
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void ConsoleProcessInfo::setCols(int cols)
+{
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      cols_ = cols;
+      if (pTerminal_ && cols_ > 0)
+         pTerminal_->resize(cols_, pTerminal_->rows());
+   }
+   END_LOCK_MUTEX
+}
+
+void ConsoleProcessInfo::setRows(int rows)
+{
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      rows_ = rows;
+      if (pTerminal_ && rows_ > 0)
+         pTerminal_->resize(pTerminal_->cols(), rows_);
+   }
+   END_LOCK_MUTEX
+}
+
 void ConsoleProcessInfo::setExitCode(int exitCode)
 {
    exitCode_.reset(exitCode);
@@ -100,18 +150,23 @@ void ConsoleProcessInfo::appendToOutputBuffer(const std::string &str)
 {
    // For modal console procs, store terminal output directly in the
    // ConsoleProcInfo INDEX
-   if (getTerminalSequence() == kNoTerminal)
+   if (!isTerminal())
    {
       std::copy(str.begin(), str.end(), std::back_inserter(outputBuffer_));
       return;
    }
 
-   // For terminal tabs, store in a separate file, first removing any
-   // output targeting the alternate terminal buffer.
-   std::string mainBufferStr =
-         core::text::stripSecondaryBuffer(str, &altBufferActive_);
-
-   console_persist::appendToOutputBuffer(handle_, mainBufferStr);
+   // For terminal tabs, feed the output to the terminal emulator; its
+   // snapshot is saved by the owning ConsoleProcess shortly after output
+   // arrives (and along with the console process metadata)
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      core::text::TermEmulator& term = terminal();
+      term.write(str);
+      altBufferActive_ = term.altBufferActive();
+      outputUnsaved_ = true;
+   }
+   END_LOCK_MUTEX
 }
 
 void ConsoleProcessInfo::appendToOutputBuffer(char ch)
@@ -119,22 +174,42 @@ void ConsoleProcessInfo::appendToOutputBuffer(char ch)
    outputBuffer_.push_back(ch);
 }
 
+// NOTE: callers must hold terminalMutex_ while using the terminal
+core::text::TermEmulator& ConsoleProcessInfo::terminal() const
+{
+   if (!pTerminal_)
+   {
+      pTerminal_.reset(new core::text::TermEmulator(
+                          cols_ > 0 ? cols_ : core::system::kDefaultCols,
+                          rows_ > 0 ? rows_ : core::system::kDefaultRows,
+                          maxOutputLines_));
+
+      // Recreate the terminal's state from the saved buffer: a snapshot, or
+      // raw output saved by earlier versions
+      std::string buffer = console_persist::getSavedBuffer(handle_, 0);
+      if (!buffer.empty())
+         pTerminal_->write(buffer);
+   }
+   return *pTerminal_;
+}
+
 std::string ConsoleProcessInfo::getSavedBufferChunk(
       int requestedChunk, bool* pMoreAvailable) const
 {
-   // We read the entire buffer into memory to return a given chunk. This is
-   // ok for our current usage pattern, where the buffer-size is bounded
-   // to a certain number of lines and is infrequently reloaded (only upon
-   // browser refresh or reloading a session). If this pattern becomes
-   // more frequent and/or we support much larger buffers, we'd want to
-   // reconsider this implementation.
-
-   // Read buffer (trims to maxOutputLines_ when chunk zero is requested)
-   std::string buffer = console_persist::getSavedBuffer(
-            handle_,
-            requestedChunk == 0 ? maxOutputLines_ : 0);
-
    *pMoreAvailable = false;
+   if (!isTerminal())
+      return std::string();
+
+   // The snapshot is taken when chunk zero is requested, and the following
+   // chunks are cut from that same snapshot.
+   std::string buffer;
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      if (requestedChunk == 0)
+         savedBuffer_ = terminal().snapshot(maxOutputLines_);
+      buffer = savedBuffer_;
+   }
+   END_LOCK_MUTEX
 
    // Common case, entire buffer fits in chunk zero
    if (requestedChunk == 0 && (buffer.length() <= kOutputBufferSize))
@@ -157,13 +232,54 @@ std::string ConsoleProcessInfo::getSavedBufferChunk(
 
 std::string ConsoleProcessInfo::getFullSavedBuffer() const
 {
-   // Read buffer (trims to maxOutputLines_)
-   return console_persist::getSavedBuffer(handle_, maxOutputLines_);
+   if (!isTerminal())
+      return std::string();
+
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      return terminal().snapshot(maxOutputLines_);
+   }
+   END_LOCK_MUTEX
+
+   return std::string();
 }
 
 int ConsoleProcessInfo::getBufferLineCount() const
 {
-   return console_persist::getSavedBufferLineCount(handle_, maxOutputLines_);
+   if (!isTerminal())
+      return 0;
+
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      return gsl::narrow_cast<int>(terminal().lineCount());
+   }
+   END_LOCK_MUTEX
+
+   return 0;
+}
+
+bool ConsoleProcessInfo::hasUnsavedOutput() const
+{
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      return outputUnsaved_;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void ConsoleProcessInfo::saveOutputBuffer() const
+{
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      if (!outputUnsaved_ || !pTerminal_)
+         return;
+
+      console_persist::saveOutputBuffer(handle_, pTerminal_->snapshot(maxOutputLines_));
+      outputUnsaved_ = false;
+   }
+   END_LOCK_MUTEX
 }
 
 std::string ConsoleProcessInfo::bufferedOutput() const
@@ -181,7 +297,24 @@ std::string ConsoleProcessInfo::bufferedOutput() const
 
 void ConsoleProcessInfo::deleteLogFile(bool lastLineOnly) const
 {
-   console_persist::deleteLogFile(handle_, lastLineOnly);
+   RECURSIVE_LOCK_MUTEX(terminalMutex_)
+   {
+      if (lastLineOnly && isTerminal())
+      {
+         // remove the line the cursor is on (typically a prompt)
+         terminal().eraseCursorLine();
+         outputUnsaved_ = true;
+         saveOutputBuffer();
+         return;
+      }
+
+      if (pTerminal_)
+         pTerminal_->reset();
+      outputUnsaved_ = false;
+      savedBuffer_.clear();
+      console_persist::deleteLogFile(handle_, lastLineOnly);
+   }
+   END_LOCK_MUTEX
 }
 
 void ConsoleProcessInfo::deleteEnvFile() const
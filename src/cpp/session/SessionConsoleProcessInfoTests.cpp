@@ -17,6 +17,7 @@
 #include <boost/filesystem.hpp>
 
 #include <session/SessionConsoleProcessInfo.hpp>
+#include <session/SessionConsoleProcessPersist.hpp>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/optional/optional_io.hpp>
@@ -313,9 +314,8 @@ TEST_CASE("ConsoleProcessInfo")
    SECTION("Persist and restore for terminals")
    {
       // terminal sequence other than kNoTerminal triggers terminal
-      // behavior where buffer are saved to an external file instead of
-      // in the JSON. Same comment on the leaky abstractions here as for
-      // previous non-terminal test.
+      // behavior where output is fed to a terminal emulator, and a snapshot
+      // of the terminal is saved to an external file instead of in the JSON.
       ConsoleProcessInfo cpi(caption, title, handle1, sequence, shellType,
                              altActive, cwd, cols, rows, zombie, trackEnv);
 
@@ -329,20 +329,33 @@ TEST_CASE("ConsoleProcessInfo")
       CHECK(loaded.empty());
       CHECK_FALSE(moreAvailable);
 
-      std::string orig = "one\ntwo\nthree\nfour\nfive";
-      CHECK(orig.length() < kOutputBufferSize);
+      std::string orig = "one\r\ntwo\r\nthree\r\nfour\r\nfive";
       cpi.appendToOutputBuffer(orig);
       loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
       CHECK_FALSE(moreAvailable);
-      CHECK_FALSE(loaded.compare(orig));
+      CHECK((loaded.find(orig) == 0));
 
-      std::string orig2 = "\nsix\nseven\neight\nnine\nten\n";
-      CHECK(orig.length() + orig2.length() < kOutputBufferSize);
+      std::string orig2 = "\r\nsix\r\nseven\r\n";
       cpi.appendToOutputBuffer(orig2);
       loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
       orig.append(orig2);
       CHECK_FALSE(moreAvailable);
-      CHECK_FALSE(loaded.compare(orig));
+      CHECK((loaded.find(orig) == 0));
+      CHECK((loaded == cpi.getFullSavedBuffer()));
+
+      // a terminal restored from the saved snapshot shows the same output
+      CHECK(cpi.hasUnsavedOutput());
+      cpi.saveOutputBuffer();
+      CHECK_FALSE(cpi.hasUnsavedOutput());
+      ConsoleProcessInfo restored(caption, title, handle1, sequence, shellType,
+                                  altActive, cwd, cols, rows, zombie, trackEnv);
+      CHECK((restored.getFullSavedBuffer() == loaded));
+
+      // erasing the last line leaves the rest
+      restored.appendToOutputBuffer("$ prompt");
+      restored.deleteLogFile(true);
+      CHECK((restored.getFullSavedBuffer().find(orig) == 0));
+      CHECK((restored.getFullSavedBuffer().find("prompt") == std::string::npos));
 
       cpi.deleteLogFile();
       loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
@@ -359,54 +372,37 @@ TEST_CASE("ConsoleProcessInfo")
       // failed run
       cpi.deleteLogFile();
 
-      bool moreAvailable;
-      std::string loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
-      CHECK(loaded.empty());
-      CHECK_FALSE(moreAvailable);
-
-      // fill buffer with less than one chunk
-      std::string firstChunk(kOutputBufferSize - 1, 'a');
-      CHECK(firstChunk.length() < kOutputBufferSize);
-      cpi.appendToOutputBuffer(firstChunk);
-      loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
-      CHECK_FALSE(moreAvailable);
-      CHECK_FALSE(loaded.compare(firstChunk));
-
-      // pad to exactly one chunk
-      firstChunk += 'a';
-      CHECK((firstChunk.length() == kOutputBufferSize));
-      cpi.appendToOutputBuffer("a");
-      loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
-      CHECK_FALSE(moreAvailable);
-      CHECK_FALSE(loaded.compare(firstChunk));
-
-      // add partial second chunk
-      std::string secondChunk(2, 'b');
-      CHECK(secondChunk.length() < kOutputBufferSize);
-      cpi.appendToOutputBuffer(secondChunk);
-      loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
-      CHECK(moreAvailable);
-      CHECK_FALSE(loaded.compare(firstChunk));
-      loaded = cpi.getSavedBufferChunk(1, &moreAvailable);
-      CHECK_FALSE(moreAvailable);
-      CHECK_FALSE(loaded.compare(secondChunk));
+      // fill the scrollback with several chunks worth of output
+      std::string padding(40, '.');
+      for (int i = 0; i < 500; i++)
+         cpi.appendToOutputBuffer(padding + boost::lexical_cast<std::string>(i) + "\r\n");
 
-      // finish second chunk and add a single character as third chunk
-      std::string finishSecond(kOutputBufferSize - secondChunk.length(), 'b');
-      CHECK((finishSecond.length() + secondChunk.length() == kOutputBufferSize));
-      cpi.appendToOutputBuffer(finishSecond);
-
-      // try to read non-existent third chunk
-      std::string thirdChunk = cpi.getSavedBufferChunk(3, &moreAvailable);
-      CHECK_FALSE(moreAvailable);
-      CHECK((thirdChunk.length() == 0));
+      bool moreAvailable;
+      std::string full = cpi.getFullSavedBuffer();
+      CHECK((full.length() > kOutputBufferSize * 2));
 
-      // add a single character third chunk and read it
-      thirdChunk = "c";
-      cpi.appendToOutputBuffer(thirdChunk);
-      loaded = cpi.getSavedBufferChunk(2, &moreAvailable);
+      // the chunks add up to the whole snapshot
+      std::string loaded;
+      int chunk = 0;
+      do
+      {
+         std::string next = cpi.getSavedBufferChunk(chunk++, &moreAvailable);
+         CHECK((next.length() <= kOutputBufferSize));
+         loaded += next;
+      } while (moreAvailable);
+      CHECK((loaded == full));
+
+      // output arriving between chunks doesn't change the snapshot being
+      // returned
+      CHECK((cpi.getSavedBufferChunk(0, &moreAvailable) == full.substr(0, kOutputBufferSize)));
+      cpi.appendToOutputBuffer("more\r\n");
+      CHECK((cpi.getSavedBufferChunk(1, &moreAvailable) ==
+             full.substr(kOutputBufferSize, kOutputBufferSize)));
+
+      // try to read non-existent chunk
+      std::string pastEnd = cpi.getSavedBufferChunk(chunk + 1, &moreAvailable);
       CHECK_FALSE(moreAvailable);
-      CHECK_FALSE(loaded.compare(thirdChunk));
+      CHECK((pastEnd.length() == 0));
 
       // cleanup
       cpi.deleteLogFile();
@@ -422,29 +418,27 @@ TEST_CASE("ConsoleProcessInfo")
       ConsoleProcessInfo cpiBad(caption, title, bogusHandle1, sequence, shellType,
                                 altActive, cwd, cols, rows, zombie, trackEnv);
 
-      std::string orig1("hello how are you?\nthat is good\nhave a nice day");
-      CHECK(orig1.length() < kOutputBufferSize);
+      std::string orig1("hello how are you?\r\nthat is good\r\nhave a nice day");
       std::string bogus1("doom");
-      CHECK(bogus1.length() < kOutputBufferSize);
 
       cpiGood.appendToOutputBuffer(orig1);
       cpiBad.appendToOutputBuffer(bogus1);
-
-      bool moreAvailable;
-      std::string loadedGood = cpiGood.getSavedBufferChunk(0, &moreAvailable);
-      CHECK_FALSE(loadedGood.compare(orig1));
-      CHECK_FALSE(moreAvailable);
-      std::string loadedBad = cpiBad.getSavedBufferChunk(0, &moreAvailable);
-      CHECK_FALSE(loadedBad.compare(bogus1));
-      CHECK_FALSE(moreAvailable);
+      cpiGood.saveOutputBuffer();
+      cpiBad.saveOutputBuffer();
 
       cpiGood.deleteOrphanedLogs(testHandle);
       cpiBad.deleteOrphanedLogs(testHandle);
 
-      loadedGood = cpiGood.getSavedBufferChunk(0, &moreAvailable);
-      CHECK_FALSE(loadedGood.compare(orig1));
+      // only the known terminal is restored
+      bool moreAvailable;
+      ConsoleProcessInfo restoredGood(caption, title, handle1, sequence, shellType,
+                                      altActive, cwd, cols, rows, zombie, trackEnv);
+      ConsoleProcessInfo restoredBad(caption, title, bogusHandle1, sequence, shellType,
+                                     altActive, cwd, cols, rows, zombie, trackEnv);
+      std::string loadedGood = restoredGood.getSavedBufferChunk(0, &moreAvailable);
+      CHECK((loadedGood.find(orig1) == 0));
       CHECK_FALSE(moreAvailable);
-      loadedBad = cpiBad.getSavedBufferChunk(0, &moreAvailable);
+      std::string loadedBad = restoredBad.getSavedBufferChunk(0, &moreAvailable);
       CHECK_FALSE(moreAvailable);
       CHECK(loadedBad.empty());
 
@@ -452,46 +446,22 @@ TEST_CASE("ConsoleProcessInfo")
       cpiBad.deleteLogFile();
    }
 
-   SECTION("Persist and restore terminals with multiple chunks and trimmable buffer")
+   SECTION("Restore terminals from raw output")
    {
-      const int smallMaxLines = 5;
+      // earlier versions saved the terminal's output itself
       ConsoleProcessInfo cpi(caption, title, handle1, sequence, shellType,
                              altActive, cwd, cols, rows, zombie, trackEnv);
-      cpi.setMaxOutputLines(smallMaxLines);
-
-      // blow away anything that might have been left over from a previous
-      // failed run
       cpi.deleteLogFile();
+      console_persist::appendToOutputBuffer(handle1, "\033[31mred\033[0m\r\nplain\r\n");
 
-      bool moreAvailable;
-      std::string loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
-      CHECK(loaded.empty());
-      CHECK_FALSE(moreAvailable);
-
-      // fill buffer with more than one chunk and more lines than the
-      // maximum specified; each line is one-chunk in length, and filled
-      // with digits corresponding to the line #, "0000...", "1111..."
-      for (int i = 0; i < smallMaxLines + 2; i++)
-      {
-         std::string str = boost::lexical_cast<std::string>(i);
-         std::string line(kOutputBufferSize - 1, str[0]);
-         line += "\n";
-         cpi.appendToOutputBuffer(line);
-      }
-
-      // now when we request the first chunk, we expect the buffer to
-      // be trimmed to have smallMaxLines + 1 before first chunk is returned
-      std::string expected(kOutputBufferSize -1, '2');
-      expected = std::string("\n") + expected;
-      loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
-      CHECK(moreAvailable);
-      CHECK_FALSE(loaded.compare(expected));
+      ConsoleProcessInfo restored(caption, title, handle1, sequence, shellType,
+                                  altActive, cwd, cols, rows, zombie, trackEnv);
+      std::string loaded = restored.getFullSavedBuffer();
+      CHECK((loaded.find("\033[0;31mred") == 0));
+      CHECK((loaded.find("\r\nplain\r\n") != std::string::npos));
 
       // cleanup
-      cpi.deleteLogFile();
-      loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
-      CHECK(loaded.empty());
-      CHECK_FALSE(moreAvailable);
+      restored.deleteLogFile();
    }
 
    SECTION("Verify loading entire buffer trims to max allowed")
@@ -505,37 +475,20 @@ TEST_CASE("ConsoleProcessInfo")
       // failed run
       cpi.deleteLogFile();
 
-      bool moreAvailable;
-      std::string loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
-      CHECK(loaded.empty());
-      CHECK_FALSE(moreAvailable);
-
-      // fill buffer with more than one chunk and more lines than the
-      // maximum specified; each line is one-chunk in length, and filled
-      // with digits corresponding to the line #, "0000...", "1111..."
-      for (int i = 0; i < smallMaxLines + 2; i++)
-      {
-         std::string str = boost::lexical_cast<std::string>(i);
-         std::string line(kOutputBufferSize - 1, str[0]);
-         line += "\n";
-         cpi.appendToOutputBuffer(line);
-      }
+      // write enough lines to scroll several off the screen
+      for (int i = 0; i < rows + smallMaxLines + 2; i++)
+         cpi.appendToOutputBuffer("line " + boost::lexical_cast<std::string>(i) + "\r\n");
 
-      // now when we request the full buffer, we expect the buffer to
-      // be trimmed to have smallMaxLines + 1
-      std::string expected2(kOutputBufferSize -1, '2');
-      std::string expected3(kOutputBufferSize -1, '3');
-      std::string expected4(kOutputBufferSize -1, '4');
-      std::string expected = std::string("\n") + expected2 + std::string("\n") +
-            expected3 + std::string("\n") + expected4 + std::string("\n");
-      loaded = cpi.getFullSavedBuffer();
-      CHECK_FALSE(loaded.compare(expected));
+      // the saved buffer holds the screen and the last smallMaxLines lines
+      // scrolled off it
+      std::string loaded = cpi.getFullSavedBuffer();
+      CHECK((loaded.find("line 2\r\n") == std::string::npos));
+      CHECK((loaded.find("line 3\r\n") == 0));
+      CHECK((loaded.find("line " + boost::lexical_cast<std::string>(rows + smallMaxLines + 1)) !=
+             std::string::npos));
 
       // cleanup
       cpi.deleteLogFile();
-      loaded = cpi.getSavedBufferChunk(0, &moreAvailable);
-      CHECK(loaded.empty());
-      CHECK_FALSE(moreAvailable);
    }
 
    SECTION("Verify line counting")
@@ -548,22 +501,26 @@ TEST_CASE("ConsoleProcessInfo")
       // blow away anything that might have been left over from a previous
       // failed run
       cpi.deleteLogFile();
+      CHECK((cpi.getBufferLineCount() == 0));
 
-      // fill buffer with several lines of text
-      // maximum specified; each line is one-chunk in length, and filled
-      // with digits corresponding to the line #, "0000...", "1111..."
+      // fill buffer with several lines of text, each filled with digits
+      // corresponding to the line #, "0000...", "1111..."
       for (int i = 0; i < lines; i++)
       {
          std::string str = boost::lexical_cast<std::string>(i);
          std::string line(10, str[0]);
-         line += "\n";
+         line += "\r\n";
          cpi.appendToOutputBuffer(line);
       }
 
-      // line count includes any partial lines at the end (even a zero-
-      // length line after a final \n)
+      // line count includes the line the cursor is on (even when empty)
       CHECK((cpi.getBufferLineCount() == lines + 1));
 
+      // lines scrolled off the screen are still counted
+      for (int i = 0; i < rows; i++)
+         cpi.appendToOutputBuffer("more\r\n");
+      CHECK((cpi.getBufferLineCount() == lines + rows + 1));
+
       // cleanup
       cpi.deleteLogFile();
    }
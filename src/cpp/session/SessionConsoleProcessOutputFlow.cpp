@@ -0,0 +1,200 @@
+/*
+ * SessionConsoleProcessOutputFlow.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <session/SessionConsoleProcessOutputFlow.hpp>
+
+#include <algorithm>
+
+#include <core/Thread.hpp>
+
+namespace rstudio {
+namespace session {
+namespace console_process {
+
+const std::size_t kOutputBatchBytes = 32 * 1024;
+const int kOutputBatchMs = 10;
+const std::size_t kOutputHighWatermark = 512 * 1024;
+const std::size_t kOutputLowWatermark = 128 * 1024;
+
+namespace {
+
+// bookkeeping kept for clients which haven't acknowledged anything (yet)
+const std::size_t kMaxUntrackedBatches = 256;
+
+} // anonymous namespace
+
+ConsoleProcessOutputFlow::ConsoleProcessOutputFlow(std::size_t batchBytes,
+                                                   int batchMs,
+                                                   std::size_t highWatermark,
+                                                   std::size_t lowWatermark)
+   : batchBytes_(batchBytes),
+     batchDelay_(boost::posix_time::milliseconds(batchMs)),
+     highWatermark_(highWatermark),
+     lowWatermark_(lowWatermark)
+{
+}
+
+void ConsoleProcessOutputFlow::append(const std::string& output)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      batch_.append(output);
+      updateQueued();
+   }
+   END_LOCK_MUTEX
+}
+
+bool ConsoleProcessOutputFlow::batchReady(const boost::posix_time::ptime& now) const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      if (batch_.empty())
+         return false;
+
+      return batch_.size() >= batchBytes_ ||
+             lastSent_.is_not_a_date_time() ||
+             now - lastSent_ >= batchDelay_;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+std::string ConsoleProcessOutputFlow::takeBatch(const boost::posix_time::ptime& now)
+{
+   std::string batch;
+   LOCK_MUTEX(mutex_)
+   {
+      if (batch_.empty())
+         return batch;
+
+      batch.swap(batch_);
+      lastSent_ = now;
+
+      unacknowledged_.push_back(std::make_pair(batchesSent_++, batch.size()));
+      unacknowledgedBytes_ += batch.size();
+      if (!acknowledging_ && unacknowledged_.size() > kMaxUntrackedBatches)
+      {
+         unacknowledgedBytes_ -= unacknowledged_.front().second;
+         unacknowledged_.pop_front();
+      }
+
+      if (acknowledging_ && unacknowledgedBytes_ >= highWatermark_)
+         paused_ = true;
+   }
+   END_LOCK_MUTEX
+
+   return batch;
+}
+
+void ConsoleProcessOutputFlow::dropped(std::size_t bytes)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      droppedBytes_ += bytes;
+
+      // the client won't acknowledge what it never received
+      if (!unacknowledged_.empty() && unacknowledged_.back().second == bytes)
+      {
+         unacknowledgedBytes_ -= bytes;
+         unacknowledged_.pop_back();
+         batchesSent_--;
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void ConsoleProcessOutputFlow::acknowledge(std::uint64_t batches)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      acknowledging_ = true;
+      while (!unacknowledged_.empty() && unacknowledged_.front().first < batches)
+      {
+         unacknowledgedBytes_ -= unacknowledged_.front().second;
+         unacknowledged_.pop_front();
+      }
+
+      if (unacknowledgedBytes_ <= lowWatermark_)
+         paused_ = false;
+   }
+   END_LOCK_MUTEX
+}
+
+bool ConsoleProcessOutputFlow::paused() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return paused_;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void ConsoleProcessOutputFlow::reset()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      unacknowledged_.clear();
+      unacknowledgedBytes_ = 0;
+      batchesSent_ = 0;
+      acknowledging_ = false;
+      paused_ = false;
+   }
+   END_LOCK_MUTEX
+}
+
+std::size_t ConsoleProcessOutputFlow::queuedBytes() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return batch_.size() + unacknowledgedBytes_;
+   }
+   END_LOCK_MUTEX
+
+   return 0;
+}
+
+std::size_t ConsoleProcessOutputFlow::peakQueuedBytes() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return peakQueuedBytes_;
+   }
+   END_LOCK_MUTEX
+
+   return 0;
+}
+
+std::uint64_t ConsoleProcessOutputFlow::droppedBytes() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return droppedBytes_;
+   }
+   END_LOCK_MUTEX
+
+   return 0;
+}
+
+void ConsoleProcessOutputFlow::updateQueued()
+{
+   peakQueuedBytes_ = std::max(peakQueuedBytes_, batch_.size() + unacknowledgedBytes_);
+}
+
+} // namespace console_process
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,156 @@
+/*
+ * SessionConsoleProcessOutputFlowTests.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <session/SessionConsoleProcessOutputFlow.hpp>
+#include <session/SessionConsoleProcessSocketPacket.hpp>
+
+#define RSTUDIO_NO_TESTTHAT_ALIASES
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace console_process {
+namespace tests {
+
+using namespace console_process;
+using namespace boost::posix_time;
+
+namespace {
+
+const ptime start(boost::gregorian::date(2023, 1, 1));
+
+ptime after(int ms)
+{
+   return start + milliseconds(ms);
+}
+
+} // anonymous namespace
+
+TEST_CASE("ConsoleProcess Output Flow")
+{
+   SECTION("Output after a quiet spell is sent right away")
+   {
+      ConsoleProcessOutputFlow flow(100, 10, 1000, 100);
+      CHECK_FALSE(flow.batchReady(start));
+
+      flow.append("$ ");
+      CHECK(flow.batchReady(start));
+      CHECK(flow.takeBatch(start) == "$ ");
+      CHECK_FALSE(flow.batchReady(start));
+
+      flow.append("l");
+      CHECK_FALSE(flow.batchReady(after(5)));
+      CHECK(flow.batchReady(after(10)));
+   }
+
+   SECTION("Output is batched by size and time")
+   {
+      ConsoleProcessOutputFlow flow(100, 10, 1000, 100);
+      flow.append("x");
+      flow.takeBatch(start);
+
+      flow.append(std::string(60, 'a'));
+      CHECK_FALSE(flow.batchReady(after(1)));
+      flow.append(std::string(60, 'b'));
+      CHECK(flow.batchReady(after(1)));
+      CHECK(flow.takeBatch(after(1)) == std::string(60, 'a') + std::string(60, 'b'));
+
+      flow.append("c");
+      CHECK_FALSE(flow.batchReady(after(2)));
+      CHECK(flow.batchReady(after(11)));
+   }
+
+   SECTION("Reading pauses until the client catches up")
+   {
+      ConsoleProcessOutputFlow flow(100, 10, 250, 100);
+
+      // clients which don't acknowledge output aren't flow controlled
+      for (int i = 0; i < 5; i++)
+      {
+         flow.append(std::string(100, 'x'));
+         flow.takeBatch(after(i));
+      }
+      CHECK_FALSE(flow.paused());
+
+      flow.acknowledge(5);
+      CHECK(flow.queuedBytes() == 0);
+
+      for (int i = 0; i < 3; i++)
+      {
+         flow.append(std::string(100, 'x'));
+         flow.takeBatch(after(i));
+      }
+      CHECK(flow.paused());
+      CHECK(flow.queuedBytes() == 300);
+
+      // not yet under the low watermark
+      flow.acknowledge(6);
+      CHECK(flow.paused());
+      flow.acknowledge(7);
+      CHECK_FALSE(flow.paused());
+      CHECK(flow.queuedBytes() == 100);
+      CHECK(flow.peakQueuedBytes() == 500);
+   }
+
+   SECTION("Output which can't be sent isn't waited on")
+   {
+      ConsoleProcessOutputFlow flow(100, 10, 250, 100);
+      flow.acknowledge(0);
+      for (int i = 0; i < 3; i++)
+      {
+         flow.append(std::string(100, 'x'));
+         flow.dropped(flow.takeBatch(after(i)).size());
+      }
+      CHECK_FALSE(flow.paused());
+      CHECK(flow.queuedBytes() == 0);
+      CHECK(flow.droppedBytes() == 300);
+
+      // batches are counted from the first one the client received
+      flow.append(std::string(100, 'x'));
+      flow.takeBatch(after(5));
+      flow.acknowledge(1);
+      CHECK(flow.queuedBytes() == 0);
+   }
+
+   SECTION("Reset starts over for a new connection")
+   {
+      ConsoleProcessOutputFlow flow(100, 10, 250, 100);
+      flow.acknowledge(0);
+      for (int i = 0; i < 3; i++)
+      {
+         flow.append(std::string(100, 'x'));
+         flow.takeBatch(after(i));
+      }
+      CHECK(flow.paused());
+
+      flow.reset();
+      CHECK_FALSE(flow.paused());
+      CHECK(flow.queuedBytes() == 0);
+   }
+
+   SECTION("Acknowledgement packets")
+   {
+      CHECK(ConsoleProcessSocketPacket::isAck("c42"));
+      CHECK(ConsoleProcessSocketPacket::getAckCount("c42") == 42);
+      CHECK(ConsoleProcessSocketPacket::getAckCount("cx") == 0);
+      CHECK_FALSE(ConsoleProcessSocketPacket::isAck("ac42"));
+      CHECK_FALSE(ConsoleProcessSocketPacket::isAck("b"));
+   }
+}
+
+} // namespace tests
+} // namespace console_process
+} // namespace session
+} // namespace rstudio
@@ -226,6 +226,29 @@ void appendToOutputBuffer(const std::string& handle, const std::string& buffer)
    }
 }
 
+void saveOutputBuffer(const std::string& handle, const std::string& buffer)
+{
+   if (buffer.empty())
+   {
+      deleteLogFile(handle);
+      return;
+   }
+
+   FilePath log;
+   Error error = getLogFilePath(handle, &log);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   error = core::writeStringToFile(log, buffer);
+   if (error)
+   {
+      LOG_ERROR(error);
+   }
+}
+
 void deleteLogFile(const std::string &handle, bool lastLineOnly)
 {
    FilePath log;
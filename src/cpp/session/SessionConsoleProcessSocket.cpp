@@ -330,6 +330,11 @@ void ConsoleProcessSocket::onMessage(terminalServer* s,
    {
       sendPong(handle);
    }
+   else if (ConsoleProcessSocketPacket::isAck(payload))
+   {
+      if (details.connectionCallbacks_.onOutputAcknowledged)
+         details.connectionCallbacks_.onOutputAcknowledged(ConsoleProcessSocketPacket::getAckCount(payload));
+   }
    else if (details.connectionCallbacks_.onReceivedInput)
    {
       details.connectionCallbacks_.onReceivedInput(ConsoleProcessSocketPacket::getMessage(payload));
@@ -15,12 +15,15 @@
 
 #include <session/SessionConsoleProcessSocketPacket.hpp>
 
+#include <shared_core/SafeConvert.hpp>
+
 namespace rstudio {
 namespace session {
 namespace console_process {
 
 const std::string ConsoleProcessSocketPacket::kKeepAlivePrefix = "b";
 const std::string ConsoleProcessSocketPacket::kTextPrefix = "a";
+const std::string ConsoleProcessSocketPacket::kAckPrefix = "c";
 
 /* static */
 std::string ConsoleProcessSocketPacket::textPacket(const std::string& text)
@@ -53,6 +56,21 @@ std::string ConsoleProcessSocketPacket::getMessage(const std::string& text)
    }
 }
 
+/* static */
+bool ConsoleProcessSocketPacket::isAck(const std::string& text)
+{
+   return !text.compare(0, kAckPrefix.length(), kAckPrefix);
+}
+
+/* static */
+std::uint64_t ConsoleProcessSocketPacket::getAckCount(const std::string& text)
+{
+   if (!isAck(text))
+      return 0;
+
+   return core::safe_convert::stringTo<std::uint64_t>(text.substr(kAckPrefix.length()), 0);
+}
+
 } // namespace console_process
 } // namespace session
 } // namespace rstudio
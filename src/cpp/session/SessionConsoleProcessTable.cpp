@@ -19,6 +19,8 @@
 
 #include <shared_core/SafeConvert.hpp>
 
+#include <core/Thread.hpp>
+
 #include <session/SessionModuleContext.hpp>
 
 #include "SessionConsoleProcessApi.hpp"
@@ -39,14 +41,29 @@ typedef std::map<std::string, ConsoleProcessPtr> ProcTable;
 
 ProcTable s_procs;
 
+// guards s_procs; processes are looked up by RPCs that can run off the main
+// thread, while the table is otherwise only changed on the main thread
+boost::mutex s_procsMutex;
+
+// snapshot of the table, so processes can be visited without holding the lock
+std::vector<ConsoleProcessPtr> allProcs()
+{
+   std::vector<ConsoleProcessPtr> procs;
+   LOCK_MUTEX(s_procsMutex)
+   {
+      for (const ConsoleProcessPtr& proc : s_procs | boost::adaptors::map_values)
+         procs.push_back(proc);
+   }
+   END_LOCK_MUTEX
+   return procs;
+}
+
 std::string serializeConsoleProcs(SerializationMode serialMode)
 {
    json::Array array;
-   for (ProcTable::const_iterator it = s_procs.begin();
-        it != s_procs.end();
-        it++)
+   for (const ConsoleProcessPtr& proc : allProcs())
    {
-      array.push_back(it->second->toJson(serialMode));
+      array.push_back(proc->toJson(serialMode));
    }
 
    std::ostringstream ostr;
@@ -81,7 +98,15 @@ void deserializeConsoleProcs(const std::string& jsonStr)
       // session.
       proc->setNotBusy();
 
-      s_procs[proc->handle()] = proc;
+      addConsoleProcess(proc);
+   }
+}
+
+void saveOutputBuffers()
+{
+   for (const ConsoleProcessPtr& proc : allProcs())
+   {
+      proc->saveOutputBuffer();
    }
 }
 
@@ -92,6 +117,7 @@ bool isKnownProcHandle(const std::string& handle)
 
 void onSuspend(core::Settings* /*pSettings*/)
 {
+   saveOutputBuffers();
    serializeConsoleProcs(PersistentSerialization);
    s_visibleTerminalHandle.clear();
 }
@@ -113,16 +139,19 @@ void loadConsoleProcesses()
 
 ConsoleProcessPtr findProcByHandle(const std::string& handle)
 {
-   ProcTable::const_iterator pos = s_procs.find(handle);
-   if (pos != s_procs.end())
-      return pos->second;
-   else
-      return ConsoleProcessPtr();
+   LOCK_MUTEX(s_procsMutex)
+   {
+      ProcTable::const_iterator pos = s_procs.find(handle);
+      if (pos != s_procs.end())
+         return pos->second;
+   }
+   END_LOCK_MUTEX
+   return ConsoleProcessPtr();
 }
 
 ConsoleProcessPtr findProcByCaption(const std::string& caption)
 {
-   for (ConsoleProcessPtr& proc : s_procs | boost::adaptors::map_values)
+   for (const ConsoleProcessPtr& proc : allProcs())
    {
       if (proc->getCaption() == caption)
          return proc;
@@ -148,9 +177,9 @@ void setVisibleProc(const std::string& handle)
 std::vector<std::string> getAllHandles()
 {
    std::vector<std::string> allHandles;
-   for (ProcTable::const_iterator it = s_procs.begin(); it != s_procs.end(); it++)
+   for (const ConsoleProcessPtr& proc : allProcs())
    {
-      allHandles.push_back(it->second->handle());
+      allHandles.push_back(proc->handle());
    }
    return allHandles;
 }
@@ -159,7 +188,7 @@ std::vector<std::string> getAllHandles()
 std::pair<int, std::string> nextTerminalName()
 {
    int maxNum = kNoTerminal;
-   for (ConsoleProcessPtr& proc : s_procs | boost::adaptors::map_values)
+   for (const ConsoleProcessPtr& proc : allProcs())
    {
       maxNum = std::max(maxNum, proc->getTerminalSequence());
    }
@@ -172,6 +201,7 @@ std::pair<int, std::string> nextTerminalName()
 
 void saveConsoleProcesses()
 {
+   saveOutputBuffers();
    ConsoleProcessInfo::saveConsoleProcesses(serializeConsoleProcs(PersistentSerialization));
 }
 
@@ -182,18 +212,22 @@ void saveConsoleProcessesAtShutdown(bool terminatedNormally)
 
    // When shutting down, only preserve ConsoleProcesses that are marked
    // with allow_restart. Others should not survive a shutdown/restart.
-   ProcTable::const_iterator nextIt;
-   for (ProcTable::const_iterator it = s_procs.begin();
-        it != s_procs.end();
-        it = nextIt)
+   LOCK_MUTEX(s_procsMutex)
    {
-      nextIt = it;
-      ++nextIt;
-      if (!it->second->getAllowRestart())
+      ProcTable::const_iterator nextIt;
+      for (ProcTable::const_iterator it = s_procs.begin();
+           it != s_procs.end();
+           it = nextIt)
       {
-         s_procs.erase(it->second->handle());
+         nextIt = it;
+         ++nextIt;
+         if (!it->second->getAllowRestart())
+         {
+            s_procs.erase(it->second->handle());
+         }
       }
    }
+   END_LOCK_MUTEX
 
    s_visibleTerminalHandle.clear();
    saveConsoleProcesses();
@@ -201,17 +235,27 @@ void saveConsoleProcessesAtShutdown(bool terminatedNormally)
 
 void addConsoleProcess(const ConsoleProcessPtr& proc)
 {
-   s_procs[proc->handle()] = proc;
+   LOCK_MUTEX(s_procsMutex)
+   {
+      s_procs[proc->handle()] = proc;
+   }
+   END_LOCK_MUTEX
 }
 
 Error reapConsoleProcess(const ConsoleProcess& proc)
 {
    proc.deleteLogFile();
    proc.deleteEnvFile();
-   if (s_procs.erase(proc.handle()))
+
+   bool erased = false;
+   LOCK_MUTEX(s_procsMutex)
    {
-      saveConsoleProcesses();
+      erased = s_procs.erase(proc.handle()) > 0;
    }
+   END_LOCK_MUTEX
+
+   if (erased)
+      saveConsoleProcesses();
 
    // don't report errors if tried to reap something that isn't in the
    // table; there are cases where we do reaping on the server-side and
@@ -222,11 +266,9 @@ Error reapConsoleProcess(const ConsoleProcess& proc)
 core::json::Array allProcessesAsJson(SerializationMode serialMode)
 {
    json::Array procInfos;
-   for (ProcTable::const_iterator it = s_procs.begin();
-        it != s_procs.end();
-        it++)
+   for (const ConsoleProcessPtr& proc : allProcs())
    {
-      procInfos.push_back(it->second->toJson(serialMode));
+      procInfos.push_back(proc->toJson(serialMode));
    }
    return procInfos;
 }
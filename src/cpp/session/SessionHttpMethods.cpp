@@ -40,6 +40,7 @@
 #include <core/json/JsonRpc.hpp>
 
 #include <core/system/Crypto.hpp>
+#include <core/system/Process.hpp>
 
 #include <core/text/TemplateFilter.hpp>
 
@@ -66,6 +67,7 @@
 
 #include "SessionAsyncRpcConnection.hpp"
 #include "SessionOfflineService.hpp"
+#include "SessionRpcWorkers.hpp"
 
 using namespace rstudio::core;
 using namespace boost::placeholders;
@@ -205,6 +207,12 @@ Error startHttpConnectionListener()
    if (error)
       return error;
 
+   // wake the main thread (when it is waiting for a method) as soon as a
+   // child process has output or exits, rather than at its next timeout
+   core::system::setChildProcessActivityCallback(
+            boost::bind(&HttpConnectionQueue::wakeup,
+                        &httpConnectionListener().mainConnectionQueue()));
+
    if (options().standalone())
    {
       // log the endpoint to which we have bound to so other services can discover us
@@ -812,6 +820,7 @@ void handleConnection(boost::shared_ptr<HttpConnection> ptrConnection,
             // stop the offline service thread -- we don't want to service any
             // more incoming requests while preparing to restart
             offlineService().stop();
+            rpcWorkerPool().stop();
             
             // check for force
             bool force = true;
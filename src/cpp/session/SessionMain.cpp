@@ -127,6 +127,7 @@
 #include "SessionMainProcess.hpp"
 #include "SessionRpc.hpp"
 #include "SessionOfflineService.hpp"
+#include "SessionRpcWorkers.hpp"
 
 #include <session/SessionRUtil.hpp>
 #include <session/SessionPackageProvidedExtension.hpp>
@@ -370,6 +371,7 @@ Error suspendForRestart(const core::json::JsonRpcRequest& request,
    // stop the offline service thread -- we don't want to service any
    // more incoming requests while preparing to restart
    offlineService().stop();
+   rpcWorkerPool().stop();
    
    // when launcher sessions restart, they need to set a special exit code
    // to ensure that the rsession-run script restarts the rsession process
@@ -422,6 +424,11 @@ Error startOfflineService()
    return offlineService().start();
 }
 
+Error startRpcWorkers()
+{
+   return rpcWorkerPool().start();
+}
+
 Error registerSignalHandlers()
 {
    using boost::bind;
@@ -505,6 +512,66 @@ void exitEarly(int status)
    ::exit(status);
 }
 
+// duration of each session initialization step, as Chrome trace events
+// (viewable in chrome://tracing or Perfetto)
+json::Array s_startupTraceEvents;
+boost::posix_time::ptime s_startupTraceStart;
+std::vector<boost::thread::id> s_startupTraceThreads;
+
+// trace thread number for the current thread: 1 for the main thread, and
+// then numbered as worker threads first report a step
+int startupTraceThread()
+{
+   boost::thread::id id = boost::this_thread::get_id();
+   if (core::thread::isMainThread())
+      return 1;
+
+   auto it = std::find(s_startupTraceThreads.begin(), s_startupTraceThreads.end(), id);
+   if (it == s_startupTraceThreads.end())
+      it = s_startupTraceThreads.insert(it, id);
+   return static_cast<int>(it - s_startupTraceThreads.begin()) + 2;
+}
+
+void recordStartupStep(const std::string& name,
+                       const boost::posix_time::ptime& started,
+                       const boost::posix_time::ptime& finished)
+{
+   if (s_startupTraceStart.is_not_a_date_time())
+      s_startupTraceStart = started;
+
+   json::Object event;
+   event["name"] = name;
+   event["cat"] = "init";
+   event["ph"] = "X";
+   event["ts"] = static_cast<double>((started - s_startupTraceStart).total_microseconds());
+   event["dur"] = static_cast<double>((finished - started).total_microseconds());
+   event["pid"] = static_cast<int>(core::system::currentProcessId());
+   event["tid"] = startupTraceThread();
+   s_startupTraceEvents.push_back(event);
+}
+
+void writeStartupTrace()
+{
+   FilePath logDir = options().userLogPath();
+   Error error = logDir.ensureDirectory();
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   json::Object trace;
+   trace["traceEvents"] = s_startupTraceEvents;
+   trace["displayTimeUnit"] = "ms";
+   error = writeStringToFile(logDir.completeChildPath("rsession-startup-trace.json"),
+                             trace.write());
+   if (error)
+      LOG_ERROR(error);
+
+   s_startupTraceEvents = json::Array();
+   s_startupTraceThreads.clear();
+}
+
 Error rInit(const rstudio::r::session::RInitInfo& rInitInfo)
 {
    // save state we need to reference later
@@ -541,163 +608,172 @@ Error rInit(const rstudio::r::session::RInitInfo& rInitInfo)
    initialize.addFunctions()
 
       // client event service
-      (startClientEventService)
+      ("startClientEventService", startClientEventService)
          
       // session state
-      (initializeSessionState)
+      ("initializeSessionState", initializeSessionState)
 
       // json-rpc listeners
-      (bind(registerRpcMethod, kConsoleInput, bufferConsoleInput))
-      (bind(registerRpcMethod, kSuspendForRestart, suspendForRestart))
+      ("registerRpcMethod kConsoleInput", bind(registerRpcMethod, kConsoleInput, bufferConsoleInput))
+      ("registerRpcMethod kSuspendForRestart", bind(registerRpcMethod, kSuspendForRestart, suspendForRestart))
 
       // signal handlers
-      (registerSignalHandlers)
+      ("registerSignalHandlers", registerSignalHandlers)
          
       // main module context
-      (module_context::initialize)
+      ("module_context", module_context::initialize)
+
+      // file and process I/O which doesn't depend on R or on the handler tables
+      // runs on a worker pool while the steps below register handlers and source
+      // R code. the remaining steps all do one or the other, and stay on this thread
+      ("modules::quarto::findUserInstalledQuarto", modules::quarto::findUserInstalledQuarto,
+         ExecBlock::AnyThread)
 
       // debugging
-      (modules::debugging::initialize)
+      ("modules::debugging", modules::debugging::initialize)
 
       // prefs (early init required -- many modules including projects below require
       // preference access)
-      (modules::prefs::initialize)
+      ("modules::prefs", modules::prefs::initialize)
 
       // projects (early project init required -- module inits below
       // can then depend on e.g. computed defaultEncoding)
-      (projects::initialize)
+      ("projects", projects::initialize)
 
       // source database
-      (source_database::initialize)
+      ("source_database", source_database::initialize)
 
       // content urls
-      (content_urls::initialize)
+      ("content_urls", content_urls::initialize)
 
       // URL port transformations
-      (url_ports::initialize)
+      ("url_ports", url_ports::initialize)
 
       // overlay R
-      (bind(sourceModuleRFile, "SessionOverlay.R"))
+      ("sourceModuleRFile SessionOverlay.R", bind(sourceModuleRFile, "SessionOverlay.R"))
 
       // addins
-      (addins::initialize)
+      ("addins", addins::initialize)
 
       // console processes
-      (console_process::initialize)
+      ("console_process", console_process::initialize)
 
-      (http_methods::initialize)
+      ("http_methods", http_methods::initialize)
 
       // r utils
-      (r_utils::initialize)
+      ("r_utils", r_utils::initialize)
 
       // suspend timeout
-      (suspend::initialize)
+      ("suspend", suspend::initialize)
 
       // modules with c++ implementations
-      (modules::spelling::initialize)
-      (modules::lists::initialize)
-      (modules::limits::initialize)
-      (modules::ppe::initialize)
-      (modules::ask_pass::initialize)
-      (modules::console::initialize)
+      ("modules::spelling", modules::spelling::initialize)
+      ("modules::lists", modules::lists::initialize)
+      ("modules::limits", modules::limits::initialize)
+      ("modules::ppe", modules::ppe::initialize)
+      ("modules::ask_pass", modules::ask_pass::initialize)
+      ("modules::console", modules::console::initialize)
 #ifdef RSTUDIO_SERVER
-      (modules::crypto::initialize)
+      ("modules::crypto", modules::crypto::initialize)
 #endif
-      (modules::code_search::initialize)
-      (modules::clipboard::initialize)
-      (modules::clang::initialize)
-      (modules::cpp::initialize)
-      (modules::connections::initialize)
-      (modules::files::initialize)
-      (modules::find::initialize)
-      (modules::environment::initialize)
-      (modules::dependencies::initialize)
-      (modules::dependency_list::initialize)
-      (modules::dirty::initialize)
-      (modules::workbench::initialize)
-      (modules::data::initialize)
-      (modules::help::initialize)
-      (modules::presentation::initialize)
-      (modules::preview::initialize)
-      (modules::plots::initialize)
-      (modules::packages::initialize)
-      (modules::cran_mirrors::initialize)
-      (modules::profiler::initialize)
-      (modules::viewer::initialize)
-      (modules::quarto::initialize)
-      (modules::rmarkdown::initialize)
-      (modules::rmarkdown::notebook::initialize)
-      (modules::rmarkdown::templates::initialize)
-      (modules::rmarkdown::bookdown::initialize)
-      (modules::rpubs::initialize)
-      (modules::pyshiny::initialize)
-      (modules::shiny::initialize)
-      (modules::sql::initialize)
-      (modules::stan::initialize)
-      (modules::plumber::initialize)
-      (modules::source::initialize)
-      (modules::source_control::initialize)
-      (modules::authoring::initialize)
-      (modules::html_preview::initialize)
-      (modules::history::initialize)
-      (modules::build::initialize)
-      (modules::overlay::initialize)
-      (modules::breakpoints::initialize)
-      (modules::errors::initialize)
-      (modules::updates::initialize)
-      (modules::about::initialize)
-      (modules::shiny_viewer::initialize)
-      (modules::plumber_viewer::initialize)
-      (modules::rsconnect::initialize)
-      (modules::packrat::initialize)
-      (modules::renv::initialize)
-      (modules::rhooks::initialize)
-      (modules::r_packages::initialize)
-      (modules::diagnostics::initialize)
-      (modules::markers::initialize)
-      (modules::snippets::initialize)
-      (modules::user_commands::initialize)
-      (modules::r_addins::initialize)
-      (modules::projects::templates::initialize)
-      (modules::mathjax::initialize)
-      (modules::panmirror::initialize)
-      (modules::zotero::initialize)
-      (modules::rstudioapi::initialize)
-      (modules::libpaths::initialize)
-      (modules::explorer::initialize)
-      (modules::ask_secret::initialize)
-      (modules::reticulate::initialize)
-      (modules::python_environments::initialize)
-      (modules::tests::initialize)
-      (modules::jobs::initialize)
-      (modules::themes::initialize)
-      (modules::customsource::initialize)
-      (modules::crash_handler::initialize)
-      (modules::r_versions::initialize)
-      (modules::terminal::initialize)
-      (modules::config_file::initialize)
-      (modules::tutorial::initialize)
-      (modules::graphics::initialize)
-      (modules::fonts::initialize)
-      (modules::system_resources::initialize)
-      (modules::copilot::initialize)
-      (modules::automation::initialize)
+      ("modules::code_search", modules::code_search::initialize)
+      ("modules::clipboard", modules::clipboard::initialize)
+      ("modules::clang", modules::clang::initialize)
+      ("modules::cpp", modules::cpp::initialize)
+      ("modules::connections", modules::connections::initialize)
+      ("modules::files", modules::files::initialize)
+      ("modules::find", modules::find::initialize)
+      ("modules::environment", modules::environment::initialize)
+      ("modules::dependencies", modules::dependencies::initialize)
+      ("modules::dependency_list", modules::dependency_list::initialize)
+      ("modules::dirty", modules::dirty::initialize)
+      ("modules::workbench", modules::workbench::initialize)
+      ("modules::data", modules::data::initialize)
+      ("modules::help", modules::help::initialize)
+      ("modules::presentation", modules::presentation::initialize)
+      ("modules::preview", modules::preview::initialize)
+      ("modules::plots", modules::plots::initialize)
+      ("modules::packages", modules::packages::initialize)
+      ("modules::cran_mirrors", modules::cran_mirrors::initialize)
+      ("modules::profiler", modules::profiler::initialize)
+      ("modules::viewer", modules::viewer::initialize)
+      ("modules::quarto", modules::quarto::initialize, ExecBlock::CallingThread,
+         std::vector<std::string>({ "modules::quarto::findUserInstalledQuarto" }))
+      ("modules::rmarkdown", modules::rmarkdown::initialize)
+      ("modules::rmarkdown::notebook", modules::rmarkdown::notebook::initialize)
+      ("modules::rmarkdown::templates", modules::rmarkdown::templates::initialize)
+      ("modules::rmarkdown::bookdown", modules::rmarkdown::bookdown::initialize)
+      ("modules::rpubs", modules::rpubs::initialize)
+      ("modules::pyshiny", modules::pyshiny::initialize)
+      ("modules::shiny", modules::shiny::initialize)
+      ("modules::sql", modules::sql::initialize)
+      ("modules::stan", modules::stan::initialize)
+      ("modules::plumber", modules::plumber::initialize)
+      ("modules::source", modules::source::initialize)
+      ("modules::source_control", modules::source_control::initialize)
+      ("modules::authoring", modules::authoring::initialize)
+      ("modules::html_preview", modules::html_preview::initialize)
+      ("modules::history", modules::history::initialize)
+      ("modules::build", modules::build::initialize)
+      ("modules::overlay", modules::overlay::initialize)
+      ("modules::breakpoints", modules::breakpoints::initialize)
+      ("modules::errors", modules::errors::initialize)
+      ("modules::updates", modules::updates::initialize)
+      ("modules::about", modules::about::initialize)
+      ("modules::shiny_viewer", modules::shiny_viewer::initialize)
+      ("modules::plumber_viewer", modules::plumber_viewer::initialize)
+      ("modules::rsconnect", modules::rsconnect::initialize)
+      ("modules::packrat", modules::packrat::initialize)
+      ("modules::renv", modules::renv::initialize)
+      ("modules::rhooks", modules::rhooks::initialize)
+      ("modules::r_packages", modules::r_packages::initialize)
+      ("modules::diagnostics", modules::diagnostics::initialize)
+      ("modules::markers", modules::markers::initialize)
+      ("modules::snippets", modules::snippets::initialize)
+      ("modules::user_commands", modules::user_commands::initialize)
+      ("modules::r_addins", modules::r_addins::initialize)
+      ("modules::projects::templates", modules::projects::templates::initialize)
+      ("modules::mathjax", modules::mathjax::initialize)
+      ("modules::panmirror", modules::panmirror::initialize)
+      ("modules::zotero", modules::zotero::initialize)
+      ("modules::rstudioapi", modules::rstudioapi::initialize)
+      ("modules::libpaths", modules::libpaths::initialize)
+      ("modules::explorer", modules::explorer::initialize)
+      ("modules::ask_secret", modules::ask_secret::initialize)
+      ("modules::reticulate", modules::reticulate::initialize)
+      ("modules::python_environments", modules::python_environments::initialize)
+      ("modules::tests", modules::tests::initialize)
+      ("modules::jobs", modules::jobs::initialize)
+      ("modules::themes", modules::themes::initialize)
+      ("modules::customsource", modules::customsource::initialize)
+      ("modules::crash_handler", modules::crash_handler::initialize)
+      ("modules::r_versions", modules::r_versions::initialize)
+      ("modules::terminal", modules::terminal::initialize)
+      ("modules::config_file", modules::config_file::initialize)
+      ("modules::tutorial", modules::tutorial::initialize)
+      ("modules::graphics", modules::graphics::initialize)
+      ("modules::fonts", modules::fonts::initialize)
+      ("modules::system_resources", modules::system_resources::initialize)
+      ("modules::copilot", modules::copilot::initialize)
+      ("modules::automation", modules::automation::initialize)
 
       // workers
-      (workers::web_request::initialize)
+      ("workers::web_request", workers::web_request::initialize)
 
       // R code
-      (bind(sourceModuleRFile, "SessionCodeTools.R"))
-      (bind(sourceModuleRFile, "SessionPatches.R"))
+      ("sourceModuleRFile SessionCodeTools.R", bind(sourceModuleRFile, "SessionCodeTools.R"))
+      ("sourceModuleRFile SessionPatches.R", bind(sourceModuleRFile, "SessionPatches.R"))
 
-      (startOfflineService)
+      ("startOfflineService", startOfflineService)
+      ("startRpcWorkers", startRpcWorkers)
 
       // unsupported functions
-      (bind(rstudio::r::function_hook::registerUnsupported, "bug.report", "utils"))
-      (bind(rstudio::r::function_hook::registerUnsupported, "help.request", "utils"))
+      ("registerUnsupported bug.report", bind(rstudio::r::function_hook::registerUnsupported, "bug.report", "utils"))
+      ("registerUnsupported help.request", bind(rstudio::r::function_hook::registerUnsupported, "help.request", "utils"))
    ;
 
-   Error error = initialize.execute();
+   Error error = initialize.execute(recordStartupStep);
+   writeStartupTrace();
    if (error)
       return error;
 
@@ -43,6 +43,9 @@ int s_rpcDelayMs = -1;
 
 std::set<std::string> s_offlineableUris;
 
+// uris of rpc methods registered as R-independent
+std::set<std::string> s_rIndependentUris;
+
 // json rpc methods
 core::json::JsonRpcAsyncMethods* s_pJsonRpcMethods = nullptr;
    
@@ -181,6 +184,13 @@ void registerRpcMethod(const core::json::JsonRpcAsyncMethod& method)
    s_pJsonRpcMethods->insert(method);
 }
 
+Error registerRIndependentRpcMethod(const std::string& name,
+                                    const core::json::JsonRpcFunction& function)
+{
+   s_rIndependentUris.insert("/rpc/" + name);
+   return registerRpcMethod(name, function);
+}
+
 } // namespace module_context
 
 namespace rpc {
@@ -374,6 +384,11 @@ bool isOfflineableRequest(boost::shared_ptr<HttpConnection> ptrConnection)
    return true;
 }
 
+bool isRIndependentRequest(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   return s_rIndependentUris.find(ptrConnection->request().uri()) != s_rIndependentUris.end();
+}
+
 Error initialize()
 {
    // intentionally allocate methods on the heap and let them leak
@@ -42,6 +42,9 @@ core::Error initialize();
 
 bool isOfflineableRequest(boost::shared_ptr<HttpConnection> ptrConnection);
 
+// is this a request for a method registered with registerRIndependentRpcMethod?
+bool isRIndependentRequest(boost::shared_ptr<HttpConnection> ptrConnection);
+
 void sendJsonAsyncPendingResponse(const core::json::JsonRpcRequest &request,
                                   boost::shared_ptr<HttpConnection> ptrConnection,
                                   std::string &asyncHandle);
@@ -0,0 +1,309 @@
+/*
+ * SessionRpcWorkers.cpp
+ *
+ * Copyright (C) 2022 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionRpcWorkers.hpp"
+
+#include <algorithm>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <shared_core/Error.hpp>
+
+#include <core/BoostErrors.hpp>
+#include <core/Log.hpp>
+#include <core/Macros.hpp>
+#include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
+#include <core/json/JsonRpc.hpp>
+
+#include <core/system/System.hpp>
+
+#include <r/RExec.hpp>
+
+#include <session/SessionOptions.hpp>
+#include <session/SessionHttpConnectionListener.hpp>
+
+#include "SessionConsoleInput.hpp"
+#include "SessionHttpMethods.hpp"
+#include "SessionInit.hpp"
+#include "SessionRpc.hpp"
+
+using namespace rstudio::core;
+using namespace boost::placeholders;
+
+namespace rstudio {
+namespace session {
+
+namespace {
+
+// how many requests are run between logging the pool statistics
+const uint64_t kStatsLogRequests = 500;
+
+bool isMainThreadBusy()
+{
+   return console_input::executing() || r::exec::isExecuting();
+}
+
+bool dispatchConnection(const boost::shared_ptr<HttpConnection>& ptrConnection,
+                        const std::vector<boost::shared_ptr<HttpConnection> >& queued)
+{
+   return rpcWorkerPool().dispatch(ptrConnection, queued);
+}
+
+bool isClientRequest(const boost::shared_ptr<HttpConnection>& ptrConnection,
+                     const std::string& clientId)
+{
+   if (!boost::algorithm::starts_with(ptrConnection->request().uri(), "/rpc/"))
+      return false;
+
+   json::JsonRpcRequest request;
+   Error error = json::parseJsonRpcRequest(ptrConnection->request().body(), &request);
+   return !error && request.clientId == clientId;
+}
+
+} // anonymous namespace
+
+RpcWorkerPool& rpcWorkerPool()
+{
+   static RpcWorkerPool instance;
+   return instance;
+}
+
+Error RpcWorkerPool::start()
+{
+   int threads = options().rpcWorkerThreads();
+   if (threads <= 0)
+   {
+      LOG_DEBUG_MESSAGE("No rpc worker threads - session-rpc-worker-threads=0");
+      return Success();
+   }
+
+   // block all signals for launch of the worker threads (will cause them
+   // to never receive signals)
+   core::system::SignalBlocker signalBlocker;
+   Error error = signalBlocker.blockAll();
+   if (error)
+      return error;
+
+   try
+   {
+      for (int i = 0; i < threads; i++)
+         workers_.create_thread(boost::bind(&RpcWorkerPool::run, this));
+   }
+   catch(const boost::thread_resource_error& e)
+   {
+      return Error(boost::thread_error::ec_from_exception(e), ERROR_LOCATION);
+   }
+
+   httpConnectionListener().mainConnectionQueue().setDispatcher(dispatchConnection);
+
+   LOG_DEBUG_MESSAGE("RpcWorkerPool started with " + std::to_string(threads) + " threads");
+   return Success();
+}
+
+void RpcWorkerPool::stop()
+{
+   // stop taking new connections; anything already queued here is dropped
+   // along with the rest of the session's pending connections
+   httpConnectionListener().mainConnectionQueue().setDispatcher(HttpConnectionDispatcher());
+
+   LOCK_MUTEX(mutex_)
+   {
+      stopped_ = true;
+   }
+   END_LOCK_MUTEX
+
+   wakeup_.notify_all();
+
+   try
+   {
+      workers_.interrupt_all();
+      workers_.join_all();
+   }
+   catch(const boost::thread_interrupted&)
+   {
+      // the main thread is the one who calls stop() and it should
+      // NEVER be interrupted for any reason
+      LOG_WARNING_MESSAGE("RpcWorkerPool thread interrupted during stop");
+   }
+}
+
+bool RpcWorkerPool::dispatch(const boost::shared_ptr<HttpConnection>& ptrConnection,
+                             const std::vector<boost::shared_ptr<HttpConnection> >& queued)
+{
+   // the main thread services these itself when it is idle; this keeps
+   // request ordering identical to the single threaded case whenever R
+   // isn't occupying it
+   if (!rpc::isRIndependentRequest(ptrConnection))
+      return false;
+
+   if (!init::isSessionInitializedAndRestored() || !isMainThreadBusy())
+      return false;
+
+   json::JsonRpcRequest request;
+   Error error = json::parseJsonRpcRequest(ptrConnection->request().body(), &request);
+   if (error)
+      return false;
+
+   // earlier requests from the client still waiting for the main thread must
+   // be serviced first, so this one waits behind them
+   for (const boost::shared_ptr<HttpConnection>& ptrQueued : queued)
+   {
+      if (isClientRequest(ptrQueued, request.clientId))
+         return false;
+   }
+
+   // requests accepted here are serialized per client, so they complete in
+   // the order they were received
+   QueuedConnection queuedConnection;
+   queuedConnection.ptrConnection = ptrConnection;
+   queuedConnection.queuedTime = std::chrono::steady_clock::now();
+
+   LOCK_MUTEX(mutex_)
+   {
+      if (stopped_)
+         return false;
+
+      pending_[request.clientId].push_back(queuedConnection);
+      if (scheduledClients_.insert(request.clientId).second)
+         readyClients_.push_back(request.clientId);
+   }
+   END_LOCK_MUTEX
+
+   wakeup_.notify_one();
+   return true;
+}
+
+RpcWorkerStats RpcWorkerPool::stats()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return stats_;
+   }
+   END_LOCK_MUTEX
+
+   return RpcWorkerStats();
+}
+
+void RpcWorkerPool::run()
+{
+   try
+   {
+      while (true)
+      {
+         std::string clientId;
+         QueuedConnection queued;
+
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (!stopped_ && readyClients_.empty())
+               wakeup_.wait(lock);
+
+            if (stopped_)
+               break;
+
+            clientId = readyClients_.front();
+            readyClients_.pop_front();
+
+            std::deque<QueuedConnection>& clientQueue = pending_[clientId];
+            queued = clientQueue.front();
+            clientQueue.pop_front();
+         }
+
+         handle(queued);
+
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+
+            // hand the client back if more of its requests arrived while
+            // this one was running; otherwise it is free to be scheduled again
+            auto it = pending_.find(clientId);
+            if (it != pending_.end() && !it->second.empty())
+            {
+               readyClients_.push_back(clientId);
+               wakeup_.notify_one();
+            }
+            else
+            {
+               if (it != pending_.end())
+                  pending_.erase(it);
+               scheduledClients_.erase(clientId);
+            }
+         }
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+void RpcWorkerPool::handle(const QueuedConnection& queued)
+{
+   boost::shared_ptr<HttpConnection> ptrConnection = queued.ptrConnection;
+
+   std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+   std::chrono::microseconds queueWait =
+         std::chrono::duration_cast<std::chrono::microseconds>(startTime - queued.queuedTime);
+
+   bool logStats = false;
+   RpcWorkerStats stats;
+   LOCK_MUTEX(mutex_)
+   {
+      stats_.requests++;
+      stats_.totalQueueWait += queueWait;
+      stats_.maxQueueWait = std::max(stats_.maxQueueWait, queueWait);
+
+      logStats = (stats_.requests % kStatsLogRequests) == 0;
+      stats = stats_;
+   }
+   END_LOCK_MUTEX
+
+   if (logStats)
+   {
+      LOG_DEBUG_MESSAGE("RpcWorkerPool: " + std::to_string(stats.requests) + " requests, " +
+                        "mean queue wait: " + std::to_string(stats.totalQueueWait.count() / stats.requests) + "us, " +
+                        "max queue wait: " + std::to_string(stats.maxQueueWait.count()) + "us");
+   }
+
+   try
+   {
+      // ensure request signature is valid
+      if (!http_methods::verifyRequestSignature(ptrConnection->request()))
+      {
+         LOG_ERROR_MESSAGE("Invalid signature in rpc worker for request URI " + ptrConnection->request().uri());
+         core::http::Response response;
+         response.setError(http::status::Unauthorized, "Invalid message signature");
+         ptrConnection->sendResponse(response);
+         return;
+      }
+
+      http_methods::handleConnection(ptrConnection, http_methods::BackgroundConnection);
+
+      if (http_methods::protocolDebugEnabled())
+      {
+         std::chrono::duration<double> waitTime = startTime - queued.queuedTime;
+         std::chrono::duration<double> runTime = std::chrono::steady_clock::now() - startTime;
+         LOG_DEBUG_MESSAGE("- Rpc worker:        " + ptrConnection->request().uri() +
+                           " waited: " + string_utils::formatDouble(waitTime.count(), 2) +
+                           " ran: " + string_utils::formatDouble(runTime.count(), 2));
+      }
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+} // namespace session
+} // namespace rstudio
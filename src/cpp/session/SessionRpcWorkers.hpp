@@ -0,0 +1,111 @@
+/*
+ * SessionRpcWorkers.hpp
+ *
+ * Copyright (C) 2022 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_RPC_WORKERS_HPP
+#define SESSION_RPC_WORKERS_HPP
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <core/BoostThread.hpp>
+
+#include <session/SessionHttpConnection.hpp>
+
+namespace rstudio {
+namespace core {
+class Error;
+}
+}
+
+namespace rstudio {
+namespace session {
+
+struct RpcWorkerStats
+{
+   // number of requests run by the pool
+   uint64_t requests;
+
+   // total and maximum time requests spent queued before a worker picked them up
+   std::chrono::microseconds totalQueueWait;
+   std::chrono::microseconds maxQueueWait;
+};
+
+// singleton
+class RpcWorkerPool;
+RpcWorkerPool& rpcWorkerPool();
+
+// Runs requests for R-independent rpc methods (see registerRIndependentRpcMethod)
+// on a pool of worker threads while the main thread is busy running R code.
+// Requests from the same client are run one at a time, in the order received,
+// and a request is only taken while none of the client's earlier requests are
+// waiting in the main connection queue. (A request the main thread has
+// already started on can still complete after later requests run here.)
+class RpcWorkerPool : boost::noncopyable
+{
+private:
+   RpcWorkerPool() : stopped_(false), stats_() {}
+   friend RpcWorkerPool& rpcWorkerPool();
+
+public:
+   core::Error start();
+   void stop();
+
+   // takes the connection if it is for an R-independent method, the main
+   // thread is busy, and none of the client's requests are among the queued
+   // connections; returns false if the connection should be queued as usual
+   bool dispatch(const boost::shared_ptr<HttpConnection>& ptrConnection,
+                 const std::vector<boost::shared_ptr<HttpConnection> >& queued);
+
+   RpcWorkerStats stats();
+
+private:
+   struct QueuedConnection
+   {
+      boost::shared_ptr<HttpConnection> ptrConnection;
+      std::chrono::steady_clock::time_point queuedTime;
+   };
+
+   void run();
+   void handle(const QueuedConnection& queued);
+
+private:
+   boost::mutex mutex_;
+   boost::condition_variable wakeup_;
+
+   // pending requests per client id
+   std::map<std::string, std::deque<QueuedConnection> > pending_;
+
+   // clients waiting for a worker, and clients which are either waiting or
+   // currently being serviced (a client is never serviced by two workers)
+   std::deque<std::string> readyClients_;
+   std::set<std::string> scheduledClients_;
+
+   bool stopped_;
+   boost::thread_group workers_;
+
+   RpcWorkerStats stats_;
+};
+
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_RPC_WORKERS_HPP
@@ -31,6 +31,11 @@ void HttpConnectionQueue::enqueConnection(
 {
    LOCK_MUTEX(*pMutex_)
    {
+      // Offer the connection to the dispatcher; it's decided while the queue
+      // is locked so that the queue can't change in the meantime
+      if (dispatcher_ && dispatcher_(ptrConnection, queue_))
+         return;
+
       // Add the new connection to the end of the queue
       queue_.push_back(ptrConnection);
    }
@@ -39,6 +44,14 @@ void HttpConnectionQueue::enqueConnection(
    pWaitCondition_->notify_all();
 }
 
+void HttpConnectionQueue::setDispatcher(const HttpConnectionDispatcher& dispatcher)
+{
+   LOCK_MUTEX(*pMutex_)
+   {
+      dispatcher_ = dispatcher;
+   }
+   END_LOCK_MUTEX
+}
 
 boost::shared_ptr<HttpConnection> HttpConnectionQueue::doDequeConnection()
 {
@@ -92,6 +105,18 @@ boost::shared_ptr<HttpConnection> HttpConnectionQueue::dequeConnection(
       return boost::shared_ptr<HttpConnection>();
 }
 
+void HttpConnectionQueue::wakeup()
+{
+   // set under the lock so a waiter that is about to wait still sees it
+   LOCK_MUTEX(*pMutex_)
+   {
+      wakeupPending_ = true;
+   }
+   END_LOCK_MUTEX
+
+   pWaitCondition_->notify_all();
+}
+
 std::string HttpConnectionQueue::peekNextConnectionUri()
 {
    LOCK_MUTEX(*pMutex_)
@@ -115,7 +140,11 @@ bool HttpConnectionQueue::waitForConnection(
    {
       unique_lock<mutex> lock(*pMutex_);
       system_time timeoutTime = get_system_time() + waitDuration;
-      return pWaitCondition_->timed_wait(lock, timeoutTime);
+      bool signaled = pWaitCondition_->timed_wait(
+               lock, timeoutTime,
+               [this]() { return !queue_.empty() || wakeupPending_; });
+      wakeupPending_ = false;
+      return signaled;
    }
    catch(const thread_resource_error& e)
    {
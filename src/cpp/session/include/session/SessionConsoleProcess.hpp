@@ -29,6 +29,7 @@
 #include <core/terminal/PrivateCommand.hpp>
 
 #include <session/SessionConsoleProcessConnectionCallbacks.hpp>
+#include <session/SessionConsoleProcessOutputFlow.hpp>
 
 namespace rstudio {
 namespace core {
@@ -176,6 +177,7 @@ public:
    std::string getChannelMode() const;
    int getTerminalSequence() const { return procInfo_->getTerminalSequence(); }
    int getBufferLineCount() const { return procInfo_->getBufferLineCount(); }
+   void saveOutputBuffer() const { procInfo_->saveOutputBuffer(); }
    int getCols() const { return procInfo_->getCols(); }
    int getRows() const { return procInfo_->getRows(); }
    PidType getPid() const { return pid_; }
@@ -184,6 +186,12 @@ public:
    bool getWasRestarted() const { return procInfo_->getRestarted(); }
    boost::optional<int> getExitCode() const { return procInfo_->getExitCode(); }
 
+   // Websocket output waiting to be sent or acknowledged by the client, and
+   // output which couldn't be sent
+   std::size_t getOutputQueuedBytes() const { return outputFlow_.queuedBytes(); }
+   std::size_t getOutputPeakQueuedBytes() const { return outputFlow_.peakQueuedBytes(); }
+   std::uint64_t getOutputDroppedBytes() const { return outputFlow_.droppedBytes(); }
+
    core::FilePath getShellPath() const;
    std::string getShellName() const;
    TerminalShell::ShellType getShellType() const { return procInfo_->getShellType(); }
@@ -220,6 +228,9 @@ private:
 
    std::string bufferedOutput() const;
    void enqueOutputEvent(const std::string& output);
+   void scheduleOutputSave();
+   void flushOutput(bool force);
+   bool readyForOutput();
    void enquePromptEvent(const std::string& prompt);
    void handleConsolePrompt(core::system::ProcessOperations& ops,
                             const std::string& prompt);
@@ -229,6 +240,7 @@ private:
    ConsoleProcessSocketConnectionCallbacks createConsoleProcessSocketConnectionCallbacks();
    void onConnectionOpened();
    void onConnectionClosed();
+   void onOutputAcknowledged(std::uint64_t frames);
 
    void saveEnvironment(const std::string& env);
    static void loadEnvironment(const std::string& handle, core::system::Options* pEnv);
@@ -243,7 +255,9 @@ private:
    core::system::ProcessOptions options_;
    boost::shared_ptr<ConsoleProcessInfo> procInfo_;
 
-   // Whether the process should be stopped
+   // Whether the process should be stopped; this and the pending pty
+   // interrupt and resize below are guarded by inputOutputQueueMutex_, as
+   // they are requested by RPCs that can run off the main thread
    bool interrupt_ = false;
 
    // Whether to send pty interrupt
@@ -283,6 +297,13 @@ private:
 
    // private command handler, used to capture environment variables during terminal idle time
    core::terminal::PrivateCommand envCaptureCmd_;
+
+   // batching and flow control of output sent over the websocket
+   ConsoleProcessOutputFlow outputFlow_;
+   bool outputPaused_ = false;
+
+   // is a save of the terminal's output buffer pending?
+   bool outputSaveScheduled_ = false;
 };
 
 core::json::Array processesAsJson(SerializationMode serialMode);
@@ -15,6 +15,7 @@
 #ifndef SESSION_CONSOLE_PROCESS_CONNECTION_CALLBACKS_HPP
 #define SESSION_CONSOLE_PROCESS_CONNECTION_CALLBACKS_HPP
 
+#include <cstdint>
 #include <string>
 
 #include <boost/function.hpp>
@@ -38,6 +39,10 @@ struct ConsoleProcessSocketConnectionCallbacks
 
    // invoked when connection closes
    boost::function<void ()> onConnectionClosed;
+
+   // invoked when the client acknowledges output it has written, with the
+   // number of output frames written since the connection opened
+   boost::function<void (std::uint64_t frames)> onOutputAcknowledged;
 };
 
 } // namespace console_process
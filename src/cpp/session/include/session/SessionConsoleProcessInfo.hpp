@@ -17,6 +17,7 @@
 
 #include <boost/circular_buffer.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/thread/recursive_mutex.hpp>
 
 #include <shared_core/FilePath.hpp>
 #include <core/json/JsonRpc.hpp>
@@ -28,6 +29,9 @@
 namespace rstudio {
 namespace core {
    class Error;
+namespace text {
+   class TermEmulator;
+}
 }
 }
 
@@ -123,20 +127,24 @@ public:
    void setInteractionMode(InteractionMode mode) { interactionMode_ = mode; }
    InteractionMode getInteractionMode() const { return interactionMode_; }
 
-   void setMaxOutputLines(int maxOutputLines) { maxOutputLines_ = maxOutputLines; }
+   void setMaxOutputLines(int maxOutputLines);
    int getMaxOutputLines() const { return maxOutputLines_; }
 
    void setShowOnOutput(bool showOnOutput) { showOnOutput_ = showOnOutput; }
    bool getShowOnOutput() const { return showOnOutput_; }
 
    // Buffer output in case client disconnects/reconnects and needs
-   // to recover some history.
+   // to recover some history. Terminal output is tracked by a terminal
+   // emulator; the saved buffer is a snapshot of the terminal's screen and
+   // scrollback rather than the output itself.
    void appendToOutputBuffer(const std::string &str);
    void appendToOutputBuffer(char ch);
    std::string bufferedOutput() const;
    std::string getSavedBufferChunk(int chunk, bool* pMoreAvailable) const;
    std::string getFullSavedBuffer() const;
    int getBufferLineCount() const;
+   bool hasUnsavedOutput() const;
+   void saveOutputBuffer() const;
    void deleteLogFile(bool lastLineOnly = false) const;
    void deleteEnvFile() const;
    void saveConsoleEnvironment(const core::system::Options& environment);
@@ -167,7 +175,7 @@ public:
    }
 
    // Is terminal showing alt-buffer (a full-screen ncurses program)?
-   void setAltBufferActive(bool altBufferActive) { altBufferActive_ = altBufferActive; }
+   void setAltBufferActive(bool altBufferActive);
    bool getAltBufferActive() const { return altBufferActive_; }
 
    // Last-known current working directory
@@ -175,8 +183,8 @@ public:
    core::FilePath getCwd() const { return cwd_; }
 
    // Last-known terminal dimensions
-   void setCols(int cols) { cols_ = cols; }
-   void setRows(int rows) { rows_ = rows; }
+   void setCols(int cols);
+   void setRows(int rows);
    int getCols() const { return cols_; }
    int getRows() const { return rows_; }
 
@@ -207,6 +215,9 @@ public:
    static AutoCloseMode closeModeFromPref(std::string prefValue);
 
 private:
+   bool isTerminal() const { return terminalSequence_ != kNoTerminal; }
+   core::text::TermEmulator& terminal() const;
+
    std::string caption_;
    std::string title_;
    std::string handle_;
@@ -233,6 +244,18 @@ private:
    AutoCloseMode autoClose_ = DefaultAutoClose;
    bool zombie_ = false;
    bool trackEnv_ = false;
+
+   // guards the terminal emulator and its saved state; the terminal is written
+   // on the thread polling processes, while its buffer is also requested by
+   // RPCs served off the main thread
+   mutable boost::recursive_mutex terminalMutex_;
+
+   // created on first use, from the saved buffer
+   mutable boost::shared_ptr<core::text::TermEmulator> pTerminal_;
+   mutable bool outputUnsaved_ = false;
+
+   // snapshot being returned in chunks
+   mutable std::string savedBuffer_;
 };
 
 } // namespace console_process
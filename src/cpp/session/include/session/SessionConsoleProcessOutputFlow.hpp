@@ -0,0 +1,120 @@
+/*
+ * SessionConsoleProcessOutputFlow.hpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+#ifndef SESSION_CONSOLE_PROCESS_OUTPUT_FLOW_HPP
+#define SESSION_CONSOLE_PROCESS_OUTPUT_FLOW_HPP
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace rstudio {
+namespace session {
+namespace console_process {
+
+// Output is sent once this much has been batched, or once this long has
+// passed since output was last sent
+extern const std::size_t kOutputBatchBytes;
+extern const int kOutputBatchMs;
+
+// Reading from the terminal pauses once this much output is unacknowledged,
+// and resumes once acknowledgements bring it back under the low watermark
+extern const std::size_t kOutputHighWatermark;
+extern const std::size_t kOutputLowWatermark;
+
+// Flow control for terminal output sent over the websocket.
+//
+// Output is batched: output arriving after a quiet spell is sent right away
+// (so echoed keystrokes aren't held back), while a stream of output is sent
+// in batches limited by size and time.
+//
+// Clients acknowledge the batches they have written to their terminal with
+// a running count. Once too much output is unacknowledged, the terminal
+// stops being read until the client catches up; clients which never send an
+// acknowledgement aren't flow-controlled.
+//
+// Output is added and sent on the thread polling the terminal, while
+// acknowledgements arrive on the websocket thread.
+class ConsoleProcessOutputFlow : boost::noncopyable
+{
+public:
+   ConsoleProcessOutputFlow(std::size_t batchBytes = kOutputBatchBytes,
+                            int batchMs = kOutputBatchMs,
+                            std::size_t highWatermark = kOutputHighWatermark,
+                            std::size_t lowWatermark = kOutputLowWatermark);
+
+   // Add output to the current batch
+   void append(const std::string& output);
+
+   // Is the current batch due to be sent?
+   bool batchReady(const boost::posix_time::ptime& now) const;
+
+   // Take the current batch for sending; it remains unacknowledged until the
+   // client acknowledges it (or the connection is reset)
+   std::string takeBatch(const boost::posix_time::ptime& now);
+
+   // Record output which couldn't be sent
+   void dropped(std::size_t bytes);
+
+   // The client has written the given number of batches (counted from the
+   // start of the connection)
+   void acknowledge(std::uint64_t batches);
+
+   // Should reading from the terminal pause?
+   bool paused() const;
+
+   // Start over for a new (or closed) connection; output sent over the old
+   // connection is no longer waiting on acknowledgements
+   void reset();
+
+   // Output waiting to be sent or acknowledged, the most there has been, and
+   // the output which couldn't be sent
+   std::size_t queuedBytes() const;
+   std::size_t peakQueuedBytes() const;
+   std::uint64_t droppedBytes() const;
+
+private:
+   void updateQueued();
+
+   const std::size_t batchBytes_;
+   const boost::posix_time::time_duration batchDelay_;
+   const std::size_t highWatermark_;
+   const std::size_t lowWatermark_;
+
+   mutable boost::mutex mutex_;
+
+   std::string batch_;
+   boost::posix_time::ptime lastSent_;
+
+   // (batch number, size) of the batches not yet acknowledged
+   std::deque<std::pair<std::uint64_t, std::size_t> > unacknowledged_;
+   std::size_t unacknowledgedBytes_ = 0;
+   std::uint64_t batchesSent_ = 0;
+   bool acknowledging_ = false;
+   bool paused_ = false;
+
+   std::size_t peakQueuedBytes_ = 0;
+   std::uint64_t droppedBytes_ = 0;
+};
+
+} // namespace console_process
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_CONSOLE_PROCESS_OUTPUT_FLOW_HPP
@@ -50,6 +50,10 @@ int getSavedBufferLineCount(const std::string& handle, int maxLines);
 // Add to the saved buffer for the given ConsoleProcess
 void appendToOutputBuffer(const std::string& handle, const std::string& buffer);
 
+// Replace the saved buffer for the given ConsoleProcess; an empty buffer
+// deletes it
+void saveOutputBuffer(const std::string& handle, const std::string& buffer);
+
 // Delete the persisted saved buffer for the given ConsoleProcess
 void deleteLogFile(const std::string& handle, bool lastLineOnly = false);
 
@@ -15,6 +15,7 @@
 #ifndef SESSION_CONSOLE_PROCESS_SOCKET_PACKET_HPP
 #define SESSION_CONSOLE_PROCESS_SOCKET_PACKET_HPP
 
+#include <cstdint>
 #include <string>
 
 namespace rstudio {
@@ -29,8 +30,11 @@ namespace console_process {
  * First character is a method indicator, as follows:
  *    "a" = send text, e.g. "aHello"
  *    "b" = ping/pong, e.g. "b"
+ *    "c" = acknowledge output, e.g. "c42"
  *
- * Only the "send text" method has a payload (everything after the "a").
+ * The "send text" method has a payload (everything after the "a"). The client
+ * acknowledges output once it has written it to the terminal, with the number
+ * of text packets it has written since connecting (everything after the "c").
  *
  * See TerminalSocketPacket in Java code for client-side of this.
  */
@@ -49,9 +53,16 @@ public:
    // extract text from packet (empty string if unable to comply)
    static std::string getMessage(const std::string& text);
 
+   // is this packet an output acknowledgement?
+   static bool isAck(const std::string& text);
+
+   // extract count of text packets acknowledged (0 if unable to comply)
+   static std::uint64_t getAckCount(const std::string& text);
+
 private:
    static const std::string kKeepAlivePrefix;
    static const std::string kTextPrefix;
+   static const std::string kAckPrefix;
 };
 
 } // namespace console_process
@@ -95,6 +95,8 @@
 #define kSessionAsyncRpcTimeoutMs         "session-async-rpc-timeout-ms"
 #define kSessionHandleOfflineEnabled      "session-handle-offline-enabled"
 #define kSessionHandleOfflineTimeoutMs    "session-handle-offline-timeout-ms"
+#define kSessionRpcWorkerThreads          "session-rpc-worker-threads"
+#define kSessionConsoleOutputLimitKbps    "session-console-output-limit-kbps"
 #define kSessionUseFileStorage            "session-use-file-storage"
 
 #define kLauncherSessionOption            "launcher-session"
@@ -43,22 +43,38 @@ typedef boost::function<boost::shared_ptr<HttpConnection>(const boost::shared_pt
                                                           const std::chrono::steady_clock::time_point)>
         HttpConnectionConverter;
 
+// returns true if the dispatcher took ownership of the connection. called
+// with the queue locked, along with the connections still waiting in it (so
+// that a connection is never dispatched ahead of ones queued before it)
+typedef boost::function<bool(const boost::shared_ptr<HttpConnection>&,
+                             const std::vector<boost::shared_ptr<HttpConnection> >&)>
+        HttpConnectionDispatcher;
+
 class HttpConnectionQueue : boost::noncopyable
 {
 public:
    HttpConnectionQueue()
       : pMutex_(new boost::mutex()),
-        pWaitCondition_(new boost::condition())
+        pWaitCondition_(new boost::condition()),
+        wakeupPending_(false)
    {
    }
 
    void enqueConnection(boost::shared_ptr<HttpConnection> ptrConnection);
 
+   // connections accepted by the dispatcher are handed to it rather than
+   // being queued (used to route requests away from a busy main thread)
+   void setDispatcher(const HttpConnectionDispatcher& dispatcher);
+
    boost::shared_ptr<HttpConnection> dequeConnection();
 
    boost::shared_ptr<HttpConnection> dequeConnection(
                const boost::posix_time::time_duration& waitDuration);
 
+   // wakes any thread waiting for a connection (without providing one), so
+   // that it can attend to other work without waiting for its timeout
+   void wakeup();
+
    std::string peekNextConnectionUri();
 
    boost::posix_time::ptime lastConnectionTime();
@@ -87,6 +103,10 @@ private:
    // instance data
    boost::posix_time::ptime lastConnectionTime_;
    std::vector<boost::shared_ptr<HttpConnection> > queue_;
+   HttpConnectionDispatcher dispatcher_;
+
+   // set by wakeup() and cleared by the next wait it ends
+   bool wakeupPending_;
 };
 
 } // namespace session
@@ -249,6 +249,13 @@ core::Error registerRpcMethod(const std::string& name,
 
 void registerRpcMethod(const core::json::JsonRpcAsyncMethod& method);
 
+// register an rpc method which is thread-safe and never touches R or any other
+// state owned by the main thread. while R is busy, requests for such methods
+// are run on the rpc worker pool rather than waiting for the main thread.
+// (must be called during session initialization)
+core::Error registerRIndependentRpcMethod(const std::string& name,
+                                          const core::json::JsonRpcFunction& function);
+
 core::Error executeAsync(const core::json::JsonRpcFunction& function,
                          const core::json::JsonRpcRequest& request,
                          core::json::JsonRpcResponse* pResponse);
@@ -244,6 +244,12 @@ protected:
       (kSessionHandleOfflineTimeoutMs,
       value<int>(&handleOfflineTimeoutMs_)->default_value(200),
       "Duration in millis before requests that can be handled offline are processed by the offline handler thread.")
+      (kSessionRpcWorkerThreads,
+      value<int>(&rpcWorkerThreads_)->default_value(2),
+      "Number of threads used to run R-independent rpc requests while the R process is busy. Set to 0 to disable.")
+      (kSessionConsoleOutputLimitKbps,
+      value<int>(&consoleOutputLimitKbps_)->default_value(0),
+      "Maximum amount of console output (in KB per second) sent to the client. Output beyond the limit is dropped and replaced with a notice. Defaults to 0 (no limit).")
       (kSessionUseFileStorage,
       value<bool>(&sessionUseFileStorage_)->default_value(true),
       "Controls whether the session should store its metadata on the file system or send it to the server to be stored in the internal database.");
@@ -510,6 +516,8 @@ public:
    int asyncRpcTimeoutMs() const { return asyncRpcTimeoutMs_; }
    bool handleOfflineEnabled() const { return handleOfflineEnabled_; }
    int handleOfflineTimeoutMs() const { return handleOfflineTimeoutMs_; }
+   int rpcWorkerThreads() const { return rpcWorkerThreads_; }
+   int consoleOutputLimitKbps() const { return consoleOutputLimitKbps_; }
    bool sessionUseFileStorage() const { return sessionUseFileStorage_; }
    bool allowVcsExecutableEdit() const { return allowVcsExecutableEdit_ || allowOverlay(); }
    bool allowCRANReposEdit() const { return allowCRANReposEdit_ || allowOverlay(); }
@@ -627,6 +635,8 @@ protected:
    int asyncRpcTimeoutMs_;
    bool handleOfflineEnabled_;
    int handleOfflineTimeoutMs_;
+   int rpcWorkerThreads_;
+   int consoleOutputLimitKbps_;
    bool sessionUseFileStorage_;
    bool allowVcsExecutableEdit_;
    bool allowCRANReposEdit_;
@@ -51,6 +51,8 @@ enum JobType {
    JobTypeLauncher = 2 // cluster job via job launcher
 };
 
+class JobOutputLog;
+
 typedef std::function<void(const std::string&)> JobAction;
 typedef std::vector<std::pair<std::string,JobAction>> JobActions;
 
@@ -163,6 +165,7 @@ public:
 private:
    core::FilePath jobCacheFolder();
    core::FilePath outputCacheFile();
+   JobOutputLog& outputLog();
 
    std::string id_;
    std::string name_;
@@ -190,6 +193,9 @@ private:
    JobActions cppActions_;
 
    std::vector<std::string> tags_;
+
+   // the job's output, created on first use
+   boost::shared_ptr<JobOutputLog> pOutputLog_;
 };
 
 
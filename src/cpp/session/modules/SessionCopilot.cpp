@@ -24,8 +24,8 @@
 
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
-#include <core/http/Header.hpp>
 #include <core/json/JsonRpc.hpp>
+#include <core/json/JsonRpcStream.hpp>
 #include <core/system/Process.hpp>
 #include <core/system/System.hpp>
 #include <core/system/Xdg.hpp>
@@ -75,6 +75,10 @@
 #define kCopilotDefaultDocumentVersion (0)
 #define kMaxIndexingFileSize (1048576)
 
+// While more than this many bytes are waiting to be written to the agent,
+// document changes are held back (and coalesced) rather than queued.
+#define kCopilotWriterHighWaterMark (1048576)
+
 using namespace rstudio::core;
 using namespace rstudio::core::system;
 
@@ -240,6 +244,52 @@ std::map<std::string, CopilotContinuation> s_pendingContinuations;
 // A queue of pending responses, sent via the agent's stdout.
 std::queue<std::string> s_pendingResponses;
 
+// Parser for the framed messages written by the agent to its stdout.
+json::FramedMessageParser s_agentParser;
+
+// Framed messages waiting to be written to the agent's stdin.
+json::FramedMessageWriter s_agentWriter;
+
+// The state of a document as synchronized with the agent.
+struct CopilotDocument
+{
+   CopilotDocument()
+      : version(kCopilotDefaultDocumentVersion),
+        opened(false),
+        incremental(false),
+        hasText(false)
+   {
+   }
+
+   std::string languageId;
+
+   // The version most recently sent to the agent.
+   int version;
+
+   // Whether the agent has been sent a 'didOpen' notification.
+   bool opened;
+
+   // Whether changes are sent as edits to the previous contents (rather than
+   // as the full document text), which requires retaining those contents.
+   bool incremental;
+
+   // The contents most recently sent to the agent, when retained.
+   bool hasText;
+   std::string text;
+
+   // The latest contents, not yet sent to the agent.
+   std::string pendingText;
+};
+
+// Documents known to the agent, indexed by URI.
+std::map<std::string, CopilotDocument> s_documents;
+
+// Documents with changes not yet sent to the agent.
+std::set<std::string> s_changedDocuments;
+
+// Documents which have been closed, but not yet reported to the agent.
+std::vector<std::string> s_closedDocuments;
+
 // Whether we're about to shut down.
 bool s_isSessionShuttingDown = false;
 
@@ -581,11 +631,78 @@ std::string formatRequest(const CopilotRequest& request)
    if (!id.empty())
       requestJson["id"] = id;
 
-   // Convert to a JSON string
-   std::string requestBody = requestJson.write();
+   // Convert to a JSON string; framing is added when the request is written
+   return requestJson.write();
+}
+
+bool isContinuationByte(char ch)
+{
+   return (static_cast<unsigned char>(ch) & 0xC0) == 0x80;
+}
+
+// Converts a byte offset into UTF-8 text into an LSP position, whose
+// character offsets are counted in UTF-16 code units.
+json::Object positionFromOffset(const std::string& text, std::size_t offset)
+{
+   auto begin = text.begin();
+   int line = static_cast<int>(std::count(begin, begin + offset, '\n'));
+
+   std::size_t lineStart = 0;
+   if (offset > 0)
+   {
+      std::size_t newline = text.rfind('\n', offset - 1);
+      if (newline != std::string::npos)
+         lineStart = newline + 1;
+   }
+
+   int character = 0;
+   for (std::size_t i = lineStart; i < offset; i++)
+   {
+      char ch = text[i];
+      if (isContinuationByte(ch))
+         continue;
+
+      // characters outside the BMP (4-byte sequences) are surrogate pairs in UTF-16
+      character += (static_cast<unsigned char>(ch) >= 0xF0) ? 2 : 1;
+   }
+
+   json::Object positionJson;
+   positionJson["line"] = line;
+   positionJson["character"] = character;
+   return positionJson;
+}
+
+// Builds a 'didChange' content change event describing the edit which
+// turns 'before' into 'after', as a single replaced range.
+json::Object contentChangeFromEdit(const std::string& before, const std::string& after)
+{
+   std::size_t size = std::min(before.size(), after.size());
+
+   // find the common prefix, without splitting a multi-byte character
+   std::size_t prefix = 0;
+   while (prefix < size && before[prefix] == after[prefix])
+      prefix++;
+   while (prefix > 0 && (isContinuationByte(before[prefix]) || isContinuationByte(after[prefix])))
+      prefix--;
+
+   // find the common suffix, not overlapping the prefix
+   std::size_t suffix = 0;
+   while (suffix < size - prefix &&
+          before[before.size() - suffix - 1] == after[after.size() - suffix - 1])
+   {
+      suffix++;
+   }
+   while (suffix > 0 && isContinuationByte(before[before.size() - suffix]))
+      suffix--;
+
+   json::Object rangeJson;
+   rangeJson["start"] = positionFromOffset(before, prefix);
+   rangeJson["end"] = positionFromOffset(before, before.size() - suffix);
 
-   // Convert into HTTP request with JSON payload in body
-   return fmt::format("Content-Length: {}\r\n\r\n{}", requestBody.size(), requestBody);
+   json::Object changeJson;
+   changeJson["range"] = rangeJson;
+   changeJson["text"] = after.substr(prefix, after.size() - suffix - prefix);
+   return changeJson;
 }
 
 
@@ -737,6 +854,59 @@ void setEditorInfo()
    sendRequest("setEditorInfo", requestId, paramsJson, CopilotContinuation());
 }
 
+void updateDocument(const std::string& uri,
+                    const std::string& languageId,
+                    const std::string& contents,
+                    bool incremental)
+{
+   // Changes are sent to the agent from onContinue, so that several
+   // updates received in the meantime are sent as a single change.
+   CopilotDocument& document = s_documents[uri];
+   document.languageId = languageId;
+   document.incremental = document.incremental || incremental;
+   document.pendingText = contents;
+   s_changedDocuments.insert(uri);
+}
+
+void closeDocument(const std::string& uri)
+{
+   auto it = s_documents.find(uri);
+   if (it == s_documents.end())
+      return;
+
+   if (it->second.opened)
+      s_closedDocuments.push_back(uri);
+
+   s_documents.erase(it);
+   s_changedDocuments.erase(uri);
+}
+
+void resetDocuments()
+{
+   // A newly started agent knows nothing of our documents. Those whose
+   // contents we have are re-opened; others are re-opened on their next change.
+   s_closedDocuments.clear();
+   s_changedDocuments.clear();
+
+   for (auto it = s_documents.begin(); it != s_documents.end(); )
+   {
+      CopilotDocument& document = it->second;
+      if (!document.hasText)
+      {
+         it = s_documents.erase(it);
+         continue;
+      }
+
+      document.pendingText.swap(document.text);
+      document.text.clear();
+      document.hasText = false;
+      document.opened = false;
+      document.version = kCopilotDefaultDocumentVersion;
+      s_changedDocuments.insert(it->first);
+      ++it;
+   }
+}
+
 namespace agent {
 
 void onStarted(ProcessOperations& operations)
@@ -747,29 +917,115 @@ void onStarted(ProcessOperations& operations)
    s_agentRuntimeStatus = CopilotAgentRuntimeStatus::Starting;
 }
 
-bool onContinue(ProcessOperations& operations)
+void writeRequest(const CopilotRequest& request)
 {
-   auto debugCallback = [](const std::string& htmlRequest)
+   std::string requestBody = formatRequest(request);
+   if (copilotLogLevel() >= 2)
    {
-      if (copilotLogLevel() >= 2)
+      std::cerr << std::endl;
+      std::cerr << "REQUEST" << std::endl;
+      std::cerr << "----------------" << std::endl;
+      std::cerr << requestBody << std::endl;
+      std::cerr << "----------------" << std::endl;
+      std::cerr << std::endl << std::endl;
+   }
+
+   s_agentWriter.enqueue(requestBody);
+}
+
+void writeDocumentChanges()
+{
+   for (auto&& uri : s_closedDocuments)
+   {
+      json::Object textDocumentJson;
+      textDocumentJson["uri"] = uri;
+
+      json::Object paramsJson;
+      paramsJson["textDocument"] = textDocumentJson;
+
+      writeRequest({ "textDocument/didClose", "", paramsJson });
+   }
+   s_closedDocuments.clear();
+
+   for (auto&& uri : s_changedDocuments)
+   {
+      auto it = s_documents.find(uri);
+      if (it == s_documents.end())
+         continue;
+
+      CopilotDocument& document = it->second;
+      if (!document.opened)
       {
-         std::cerr << std::endl;
-         std::cerr << "REQUEST" << std::endl;
-         std::cerr << "----------------" << std::endl;
-         std::cerr << htmlRequest << std::endl;
-         std::cerr << "----------------" << std::endl;
-         std::cerr << std::endl << std::endl;
+         json::Object textDocumentJson;
+         textDocumentJson["uri"] = uri;
+         textDocumentJson["languageId"] = document.languageId;
+         textDocumentJson["version"] = document.version;
+         textDocumentJson["text"] = document.pendingText;
+
+         json::Object paramsJson;
+         paramsJson["textDocument"] = textDocumentJson;
+
+         writeRequest({ "textDocument/didOpen", "", paramsJson });
+         document.opened = true;
       }
-   };
-   
+      else
+      {
+         // Send only the edited range when we know what the agent has;
+         // otherwise, replace the whole document.
+         json::Object changeJson;
+         if (document.hasText)
+         {
+            if (document.text == document.pendingText)
+            {
+               document.pendingText.clear();
+               continue;
+            }
+
+            changeJson = contentChangeFromEdit(document.text, document.pendingText);
+         }
+         else
+         {
+            changeJson["text"] = document.pendingText;
+         }
+
+         json::Object textDocumentJson;
+         textDocumentJson["uri"] = uri;
+         textDocumentJson["version"] = ++document.version;
+
+         json::Array contentChangesJson;
+         contentChangesJson.push_back(changeJson);
+
+         json::Object paramsJson;
+         paramsJson["textDocument"] = textDocumentJson;
+         paramsJson["contentChanges"] = contentChangesJson;
+
+         writeRequest({ "textDocument/didChange", "", paramsJson });
+      }
+
+      // Retain the contents of incrementally-synchronized documents.
+      document.hasText = document.incremental;
+      if (document.incremental)
+         document.text.swap(document.pendingText);
+      document.pendingText.clear();
+   }
+   s_changedDocuments.clear();
+}
+
+bool onContinue(ProcessOperations& operations)
+{
    if (s_agentInitialized)
    {
-      for (auto&& request : s_pendingRequests)
+      // Document changes are held back while the agent is behind on its input,
+      // so that successive edits coalesce -- unless a request is waiting, as
+      // it must observe the latest contents.
+      if (!s_pendingRequests.empty() ||
+          s_agentWriter.pendingBytes() < kCopilotWriterHighWaterMark)
       {
-         std::string htmlRequest = formatRequest(request);
-         debugCallback(htmlRequest);
-         operations.writeToStdin(htmlRequest, false);
+         writeDocumentChanges();
       }
+
+      for (auto&& request : s_pendingRequests)
+         writeRequest(request);
       s_pendingRequests.clear();
    }
    else
@@ -788,82 +1044,59 @@ bool onContinue(ProcessOperations& operations)
          if (request.method == "initialized")
             s_agentInitialized = true;
          
-         std::string htmlRequest = formatRequest(request);
-         debugCallback(htmlRequest);
-         operations.writeToStdin(htmlRequest, false);
+         writeRequest(request);
          return true;
       });
    }
 
+   // Write as much as the writer allows; the remainder is written on
+   // subsequent calls.
+   Error error = s_agentWriter.flush([&](const std::string& frame)
+   {
+      return operations.writeToStdin(frame, false);
+   });
+
+   if (error)
+   {
+      // The agent is no longer reading its input; it will be restarted
+      // (and documents re-opened) on the next request.
+      LOG_ERROR(error);
+      s_agentWriter.clear();
+   }
+
    return true;
 }
 
 void onStdout(ProcessOperations& operations, const std::string& stdOut)
 {
-   // Discard empty lines.
-   static const boost::regex reWhitespace("^\\s*$");
-   if (regex_utils::match(stdOut, reWhitespace))
-      return;
-
-   // Copilot responses will have the format
+   // Copilot responses have the format
    //
    //    Content-Length: xyz
    //
    //    <body>
    //
-   // Importantly, there is no character separating the body from the
-   // next response, so we're forced to parse headers here.
-   //
-   // TODO: Does this need to be a state machine? Is it possible that we
-   // receive some incomplete requests here?
-   std::size_t startIndex = 0;
-
-   while (startIndex < stdOut.length())
+   // with no separator between the body and the next response. A response
+   // may be split across (or share) reads, so the parser retains any partial
+   // response until the rest of it arrives.
+   std::vector<std::string> responses;
+   Error error = s_agentParser.parse(stdOut, &responses);
+   if (error)
    {
-      // Find the split.
-      const char* splitText = "\r\n\r\n";
-      const int splitSize = 4;
-
-      auto splitIndex = stdOut.find(splitText, startIndex);
-      if (splitIndex == std::string::npos)
-      {
-         ELOG("Internal error: parsing response failed.");
-         break;
-      }
-
-      // Extract the header text.
-      std::string headerText = string_utils::substring(stdOut, startIndex, splitIndex + splitSize);
-
-      // Parse the headers.
-      core::http::Headers headers;
-      std::istringstream iss(headerText);
-      core::http::parseHeaders(iss, &headers);
+      ELOG("Internal error: parsing response failed: {}", error.getSummary());
 
-      // Check for content length.
-      std::string contentLength = core::http::headerValue(headers, "Content-Length");
-      if (contentLength.empty())
+      if (copilotLogLevel() >= 2)
       {
-         ELOG("Internal error: response contains no Content-Length header.");
-         
-         if (copilotLogLevel() >= 2)
-         {
-            std::cerr << std::endl;
-            std::cerr << "RESPONSE" << std::endl;
-            std::cerr << "------------------" << std::endl;
-            std::cerr << stdOut << std::endl;
-            std::cerr << "------------------" << std::endl;
-            std::cerr << std::endl << std::endl;
-         }
-
-         break;
+         std::cerr << std::endl;
+         std::cerr << "RESPONSE" << std::endl;
+         std::cerr << "------------------" << std::endl;
+         std::cerr << stdOut << std::endl;
+         std::cerr << "------------------" << std::endl;
+         std::cerr << std::endl << std::endl;
       }
+   }
 
-      // Consume that text.
-      auto bodyStart = splitIndex + splitSize;
-      auto bodyEnd = bodyStart + safe_convert::stringTo<int>(contentLength, 0);
-      std::string bodyText = string_utils::substring(stdOut, bodyStart, bodyEnd);
-      s_pendingResponses.push(bodyText);
-
+   for (auto&& bodyText : responses)
+   {
       if (copilotLogLevel() >= 2)
       {
          std::cerr << std::endl;
@@ -874,8 +1107,7 @@ void onStdout(ProcessOperations& operations, const std::string& stdOut)
          std::cerr << std::endl << std::endl;
       }
 
-      // Update the start index.
-      startIndex = bodyEnd;
+      s_pendingResponses.push(bodyText);
    }
    
    // Note that the agent is now ready.
@@ -1031,6 +1263,10 @@ Error startAgent()
    // successfully, but it later dies after trying to run the Copilot node script.
    s_agentRuntimeStatus = CopilotAgentRuntimeStatus::Unknown;
    s_agentStartupError = std::string();
+   s_agentInitialized = false;
+   s_agentParser.reset();
+   s_agentWriter.clear();
+   resetDocuments();
    waitFor([]() { return s_agentPid != -1; });
    if (s_agentPid == -1)
       return Error(boost::system::errc::no_such_process, ERROR_LOCATION);
@@ -1124,16 +1360,7 @@ void onDocAdded(boost::shared_ptr<source_database::SourceDocument> pDoc)
    if (!isIndexableDocument(pDoc))
       return;
    
-   json::Object textDocumentJson;
-   textDocumentJson["uri"] = uriFromDocument(pDoc);
-   textDocumentJson["languageId"] = languageIdFromDocument(pDoc);
-   textDocumentJson["version"] = kCopilotDefaultDocumentVersion;
-   textDocumentJson["text"] = "";
-
-   json::Object paramsJson;
-   paramsJson["textDocument"] = textDocumentJson;
-
-   sendNotification("textDocument/didOpen", paramsJson);
+   updateDocument(uriFromDocument(pDoc), languageIdFromDocument(pDoc), std::string(), true);
 }
 
 std::string contentsFromDocument(boost::shared_ptr<source_database::SourceDocument> pDoc)
@@ -1160,17 +1387,9 @@ void onDocUpdated(boost::shared_ptr<source_database::SourceDocument> pDoc)
    if (!isIndexableDocument(pDoc))
       return;
    
-   // Synchronize document contents with Copilot
-   json::Object textDocumentJson;
-   textDocumentJson["uri"] = uriFromDocument(pDoc);
-   textDocumentJson["languageId"] = languageIdFromDocument(pDoc);
-   textDocumentJson["version"] = kCopilotDefaultDocumentVersion;
-   textDocumentJson["text"] = contentsFromDocument(pDoc);
-
-   json::Object paramsJson;
-   paramsJson["textDocument"] = textDocumentJson;
-
-   sendNotification("textDocument/didOpen", paramsJson);
+   // Synchronize document contents with Copilot; only the edited
+   // range is sent once the agent has the previous contents
+   updateDocument(uriFromDocument(pDoc), languageIdFromDocument(pDoc), contentsFromDocument(pDoc), true);
 }
 
 void onDocRemoved(const std::string& id, const std::string& path)
@@ -1178,13 +1397,7 @@ void onDocRemoved(const std::string& id, const std::string& path)
    if (!ensureAgentRunning())
       return;
 
-   json::Object textDocumentJson;
-   textDocumentJson["uri"] = uriFromDocumentImpl(id, path, path.empty());
-
-   json::Object paramsJson;
-   paramsJson["textDocument"] = textDocumentJson;
-
-   sendNotification("textDocument/didClose", paramsJson);
+   closeDocument(uriFromDocumentImpl(id, path, path.empty()));
 }
 
 void onBackgroundProcessing(bool isIdle)
@@ -1290,16 +1503,9 @@ void indexFile(const core::FileInfo& info)
    
    DLOG("Indexing document: {}", info.absolutePath());
    
-   json::Object textDocumentJson;
-   textDocumentJson["uri"] = uriFromDocumentPath(documentPath.getAbsolutePath());
-   textDocumentJson["languageId"] = languageId;
-   textDocumentJson["version"] = kCopilotDefaultDocumentVersion;
-   textDocumentJson["text"] = contents;
-
-   json::Object paramsJson;
-   paramsJson["textDocument"] = textDocumentJson;
-
-   sendNotification("textDocument/didOpen", paramsJson);
+   // Indexed files aren't edited here, so their contents aren't retained
+   // (later changes on disk replace the whole document)
+   updateDocument(uriFromDocumentPath(documentPath.getAbsolutePath()), languageId, contents, false);
 }
 
 } // end anonymous namespace
@@ -16,6 +16,8 @@
 #include "SessionHelp.hpp"
 
 #include <algorithm>
+#include <deque>
+#include <set>
 #include <gsl/gsl>
 
 #include <boost/regex.hpp>
@@ -26,8 +28,10 @@
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/iostreams/filter/aggregate.hpp>
+#include <boost/make_shared.hpp>
 
 #include <shared_core/Error.hpp>
+#include <shared_core/Hash.hpp>
 
 #include <core/Algorithm.hpp>
 #include <core/Exec.hpp>
@@ -39,6 +43,7 @@
 #include <core/FileSerializer.hpp>
 #include <core/system/Process.hpp>
 #include <core/system/ShellUtils.hpp>
+#include <core/system/Xdg.hpp>
 #include <core/r_util/RPackageInfo.hpp>
 
 #define R_INTERNAL_FUNCTIONS
@@ -58,6 +63,7 @@
 
 #include "presentation/SlideRequestHandler.hpp"
 
+#include "SessionHelpCache.hpp"
 #include "SessionHelpHome.hpp"
 #include "session-config.h"
 
@@ -736,6 +742,240 @@ SEXP callHandler(const std::string& path,
    return resultSEXP;
 }
 
+// rendered help topics are cached on disk (see SessionHelpCache.hpp)
+const uintmax_t kHelpCacheMaxBytes = 64 * 1024 * 1024;
+const std::size_t kHelpCachePrewarmTopics = 100;
+const uint64_t kHelpCacheStatsInterval = 100;
+
+boost::shared_ptr<HelpCache> s_pHelpCache;
+
+// help topics waiting to be rendered into the cache (package, topic)
+std::deque<std::pair<std::string, std::string> > s_prewarmTopics;
+
+FilePath findPackage(const std::string& package)
+{
+   std::vector<std::string> packagePaths;
+   Error error = r::exec::RFunction("base:::find.package", package)
+         .addParam("quiet", true)
+         .call(&packagePaths);
+   if (error || packagePaths.empty())
+      return FilePath();
+
+   return FilePath(string_utils::systemToUtf8(packagePaths[0]));
+}
+
+// returns the cache key for a help topic request, or an empty string if the
+// request can't be served from the cache
+std::string helpCacheKey(const std::string& path, const http::Request& request)
+{
+   if (!s_pHelpCache || !request.queryParams().empty())
+      return std::string();
+
+   static const boost::regex reTopic("^/library/([^/]+)/html/([^/]+)\\.html$");
+   boost::smatch match;
+   if (!boost::regex_match(path, match, reTopic))
+      return std::string();
+
+   std::string package = match[1];
+   std::string topic = match[2];
+
+   FilePath packageDir = findPackage(package);
+   if (packageDir.isEmpty())
+      return std::string();
+
+   r_util::RPackageInfo pkgInfo;
+   Error error = pkgInfo.read(packageDir);
+   if (error)
+      return std::string();
+
+   // the help database timestamp distinguishes reinstalls of the same version
+   FilePath rdbPath = packageDir.completeChildPath("help/" + package + ".rdb");
+
+   boost::format fmt("%1%|%2%|%3%|%4%");
+   return boost::str(fmt % package % pkgInfo.version() % rdbPath.getLastWriteTime() % topic);
+}
+
+void logHelpCacheStats()
+{
+   HelpCacheStats stats = s_pHelpCache->stats();
+   if ((stats.hits + stats.misses) % kHelpCacheStatsInterval != 0)
+      return;
+
+   LOG_DEBUG_MESSAGE("Help cache: " + std::to_string(stats.hits) + " hits, " +
+                     std::to_string(stats.misses) + " misses, " +
+                     std::to_string(stats.inserts) + " inserts, " +
+                     std::to_string(stats.evictions) + " evictions, " +
+                     std::to_string(stats.totalBytes) + " bytes");
+}
+
+// stores the page returned by httpd if it is plain rendered html (not a
+// file, redirect, error or a response with custom headers)
+void cacheHttpdResult(const std::string& cacheKey, SEXP httpdSEXP)
+{
+   if (TYPEOF(httpdSEXP) != VECSXP || LENGTH(httpdSEXP) < 1)
+      return;
+
+   SEXP payloadSEXP = VECTOR_ELT(httpdSEXP, 0);
+   if (TYPEOF(payloadSEXP) != STRSXP || LENGTH(payloadSEXP) != 1 ||
+       isHttpdErrorPayload(payloadSEXP))
+   {
+      return;
+   }
+
+   SEXP namesSEXP = r::sexp::getNames(httpdSEXP);
+   if (TYPEOF(namesSEXP) == STRSXP && LENGTH(namesSEXP) > 0 &&
+       !std::strcmp(CHAR(STRING_ELT(namesSEXP, 0)), "file"))
+   {
+      return;
+   }
+
+   if (LENGTH(httpdSEXP) > 1)
+   {
+      SEXP ctSEXP = VECTOR_ELT(httpdSEXP, 1);
+      if (TYPEOF(ctSEXP) == STRSXP && LENGTH(ctSEXP) > 0 &&
+          std::string(CHAR(STRING_ELT(ctSEXP, 0))) != "text/html")
+      {
+         return;
+      }
+   }
+
+   if (LENGTH(httpdSEXP) > 2)
+   {
+      SEXP headersSEXP = VECTOR_ELT(httpdSEXP, 2);
+      if (TYPEOF(headersSEXP) == STRSXP && LENGTH(headersSEXP) > 0)
+         return;
+   }
+
+   if (LENGTH(httpdSEXP) > 3 &&
+       r::sexp::asInteger(VECTOR_ELT(httpdSEXP, 3)) != http::status::Ok)
+   {
+      return;
+   }
+
+   Error error = s_pHelpCache->insert(cacheKey, r::sexp::asString(STRING_ELT(payloadSEXP, 0)));
+   if (error)
+      LOG_ERROR(error);
+}
+
+// renders one queued help topic into the cache (called back during idle time)
+bool prewarmNextHelpTopic()
+{
+   while (!s_prewarmTopics.empty())
+   {
+      std::pair<std::string, std::string> topic = s_prewarmTopics.front();
+      s_prewarmTopics.pop_front();
+
+      std::string path = "/library/" + topic.first + "/html/" + topic.second + ".html";
+      http::Request request;
+      std::string cacheKey = helpCacheKey(path, request);
+      if (cacheKey.empty() || s_pHelpCache->contains(cacheKey))
+         continue;
+
+      HandlerSource handlerSource = boost::bind(r::sexp::findFunction, "httpd", "tools");
+
+      r::sexp::Protect rp;
+      SEXP httpdSEXP;
+      Error error = r::exec::executeSafely<SEXP>(
+            boost::bind(callHandler,
+                        path,
+                        boost::cref(request),
+                        handlerSource,
+                        &rp),
+            &httpdSEXP);
+      if (!error)
+         cacheHttpdResult(cacheKey, httpdSEXP);
+
+      // one topic per callback so that the session stays responsive
+      break;
+   }
+
+   return !s_prewarmTopics.empty();
+}
+
+// queues the help topics of the attached packages for rendering while the
+// session is idle, so that they are likely to be cached when first viewed
+void prewarmHelpCache()
+{
+   std::vector<std::string> packages;
+   Error error = r::exec::RFunction("base:::.packages").call(&packages);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   for (const std::string& package : packages)
+   {
+      FilePath packageDir = findPackage(package);
+      if (packageDir.isEmpty())
+         continue;
+
+      // AnIndex maps each alias to the topic (file) documenting it
+      std::vector<std::string> lines;
+      error = readStringVectorFromFile(packageDir.completeChildPath("help/AnIndex"), &lines);
+      if (error)
+         continue;
+
+      std::set<std::string> topics;
+      for (const std::string& line : lines)
+      {
+         std::string::size_type tab = line.find('\t');
+         if (tab == std::string::npos)
+            continue;
+
+         std::string topic = line.substr(tab + 1);
+         if (topics.insert(topic).second)
+            s_prewarmTopics.push_back(std::make_pair(package, topic));
+
+         if (s_prewarmTopics.size() >= kHelpCachePrewarmTopics)
+            break;
+      }
+
+      if (s_prewarmTopics.size() >= kHelpCachePrewarmTopics)
+         break;
+   }
+
+   if (!s_prewarmTopics.empty())
+   {
+      module_context::scheduleIncrementalWork(
+               boost::posix_time::milliseconds(20),
+               prewarmNextHelpTopic,
+               true);
+   }
+}
+
+Error initializeHelpCache()
+{
+   // rendered pages depend on the R installation as well as the package,
+   // so each R installation gets its own cache directory
+   FilePath cacheDir = core::system::xdg::userCacheDir()
+         .completePath("help")
+         .completePath(hash::crc32HexHash(module_context::rHomeDir() + "|" +
+                                          module_context::rVersion()));
+
+   boost::shared_ptr<HelpCache> pHelpCache =
+         boost::make_shared<HelpCache>(cacheDir, kHelpCacheMaxBytes);
+   Error error = pHelpCache->initialize();
+   if (error)
+      return error;
+
+   s_pHelpCache = pHelpCache;
+   return Success();
+}
+
+void onDeferredInit(bool)
+{
+   Error error = initializeHelpCache();
+   if (error)
+   {
+      // help is still served, just without caching
+      LOG_ERROR(error);
+      return;
+   }
+
+   prewarmHelpCache();
+}
+
 r_util::RPackageInfo packageInfoForRd(const FilePath& rdFilePath)
 {
    FilePath packageDir = rdFilePath.getParent().getParent();
@@ -960,6 +1200,22 @@ void handleHttpdRequest(const std::string& location,
       return;
    }
 
+   // serve help topics which have already been rendered from the cache
+   std::string cacheKey;
+   if (location == kHelpLocation)
+   {
+      cacheKey = helpCacheKey(path, request);
+
+      std::string content;
+      if (!cacheKey.empty() && s_pHelpCache->lookup(cacheKey, &content))
+      {
+         logHelpCacheStats();
+         pResponse->setContentType("text/html");
+         setDynamicContentResponse(content, request, filter, pResponse);
+         return;
+      }
+   }
+
    // evaluate the handler
    r::sexp::Protect rp;
    SEXP httpdSEXP;
@@ -989,6 +1245,12 @@ void handleHttpdRequest(const std::string& location,
    // content returned from httpd
    else if (TYPEOF(httpdSEXP) == VECSXP && LENGTH(httpdSEXP) > 0)
    {
+      if (!cacheKey.empty())
+      {
+         cacheHttpdResult(cacheKey, httpdSEXP);
+         logHelpCacheStats();
+      }
+
       handleHttpdResult(httpdSEXP, request, filter, pResponse);
    }
    
@@ -1145,6 +1407,8 @@ Error initialize()
    RS_REGISTER_CALL_METHOD(rs_previewRd, 1);
    RS_REGISTER_CALL_METHOD(rs_showPythonHelp, 1);
 
+   module_context::events().onDeferredInit.connect(onDeferredInit);
+
    using boost::bind;
    using core::http::UriHandler;
    using namespace module_context;
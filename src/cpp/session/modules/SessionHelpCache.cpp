@@ -0,0 +1,254 @@
+/*
+ * SessionHelpCache.cpp
+ *
+ * Copyright (C) 2022 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionHelpCache.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <istream>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/format.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/Hash.hpp>
+
+#include <core/FileSerializer.hpp>
+#include <core/Log.hpp>
+
+#include <core/system/System.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace help {
+
+namespace {
+
+const char * const kEntryExtension = ".html";
+
+// longer entry names are truncated (and suffixed with a hash of the key)
+const std::size_t kMaxEntryNameLength = 200;
+
+// entries are named by their key, with characters which may not be valid in
+// file names escaped, so distinct keys never share an entry
+std::string entryFileName(const std::string& key)
+{
+   std::string name;
+   for (char ch : key)
+   {
+      if (std::isalnum(static_cast<unsigned char>(ch)) || ch == '.' || ch == '-' || ch == '_')
+         name.push_back(ch);
+      else
+         name.append(boost::str(boost::format("%%%02X") % static_cast<int>(static_cast<unsigned char>(ch))));
+   }
+
+   if (name.size() > kMaxEntryNameLength)
+      name = name.substr(0, kMaxEntryNameLength) + "-" + hash::crc32HexHash(key);
+
+   return name + kEntryExtension;
+}
+
+// whether an entry holds the given key (which each entry begins with, on a
+// line of its own); guards against truncated entry names which coincide
+bool entryHasKey(const FilePath& path, const std::string& key)
+{
+   std::shared_ptr<std::istream> pStream;
+   if (path.openForRead(pStream))
+      return false;
+
+   std::string header;
+   return std::getline(*pStream, header) && header == key;
+}
+
+} // anonymous namespace
+
+HelpCache::HelpCache(const FilePath& cacheDir, uintmax_t maxBytes)
+   : cacheDir_(cacheDir),
+     maxBytes_(maxBytes),
+     stats_()
+{
+}
+
+Error HelpCache::initialize()
+{
+   Error error = cacheDir_.ensureDirectory();
+   if (error)
+      return error;
+
+   std::vector<FilePath> children;
+   error = cacheDir_.getChildren(children);
+   if (error)
+      return error;
+
+   // order existing entries by last use (oldest first)
+   std::vector<std::tuple<std::time_t, std::string, uintmax_t> > existing;
+   for (const FilePath& child : children)
+   {
+      std::string fileName = child.getFilename();
+      if (boost::algorithm::ends_with(fileName, kEntryExtension))
+      {
+         existing.push_back(std::make_tuple(child.getLastWriteTime(), fileName, child.getSize()));
+      }
+      else if (boost::algorithm::ends_with(fileName, ".tmp") &&
+               std::time(nullptr) - child.getLastWriteTime() > 60)
+      {
+         // abandoned by a session which exited while writing it
+         child.removeIfExists();
+      }
+   }
+   std::sort(existing.begin(), existing.end());
+
+   for (const auto& entry : existing)
+      addEntry(std::get<1>(entry), std::get<2>(entry));
+
+   evict();
+   return Success();
+}
+
+FilePath HelpCache::entryPath(const std::string& key) const
+{
+   return cacheDir_.completeChildPath(entryFileName(key));
+}
+
+bool HelpCache::lookup(const std::string& key, std::string* pContent)
+{
+   FilePath path = entryPath(key);
+   std::string fileName = path.getFilename();
+
+   // the entry may have been evicted by another session sharing the cache
+   std::string contents;
+   if (!path.exists() || readStringFromFile(path, &contents))
+   {
+      removeEntry(fileName);
+      stats_.misses++;
+      return false;
+   }
+
+   // each entry begins with its full key, which guards against truncated
+   // entry names which coincide
+   std::string header = key + "\n";
+   if (!boost::algorithm::starts_with(contents, header))
+   {
+      stats_.misses++;
+      return false;
+   }
+
+   *pContent = contents.substr(header.size());
+   stats_.hits++;
+
+   if (entries_.find(fileName) == entries_.end())
+      addEntry(fileName, contents.size());
+   touch(fileName);
+   return true;
+}
+
+bool HelpCache::contains(const std::string& key)
+{
+   return entryHasKey(entryPath(key), key);
+}
+
+Error HelpCache::insert(const std::string& key, const std::string& content)
+{
+   FilePath path = entryPath(key);
+
+   // write to a temporary file first so that other sessions never read a
+   // partially written entry
+   FilePath tempPath = cacheDir_.completeChildPath(
+            path.getFilename() + "." + core::system::generateShortenedUuid() + ".tmp");
+   Error error = writeStringToFile(tempPath, key + "\n" + content);
+   if (error)
+   {
+      tempPath.removeIfExists();
+      return error;
+   }
+
+   error = tempPath.move(path, FilePath::MoveDirect, true);
+   if (error)
+   {
+      tempPath.removeIfExists();
+      return error;
+   }
+
+   std::string fileName = path.getFilename();
+   removeEntry(fileName);
+   addEntry(fileName, key.size() + 1 + content.size());
+   stats_.inserts++;
+
+   evict();
+   return Success();
+}
+
+void HelpCache::touch(const std::string& fileName)
+{
+   auto it = entries_.find(fileName);
+   if (it == entries_.end())
+      return;
+
+   lru_.splice(lru_.begin(), lru_, it->second.lruPosition);
+
+   // record the use on disk too, so that it survives into the LRU order
+   // of sessions started later
+   cacheDir_.completeChildPath(fileName).setLastWriteTime();
+}
+
+void HelpCache::addEntry(const std::string& fileName, uintmax_t size)
+{
+   lru_.push_front(fileName);
+
+   Entry entry;
+   entry.size = size;
+   entry.lruPosition = lru_.begin();
+   entries_[fileName] = entry;
+
+   stats_.totalBytes += size;
+}
+
+void HelpCache::removeEntry(const std::string& fileName)
+{
+   auto it = entries_.find(fileName);
+   if (it == entries_.end())
+      return;
+
+   stats_.totalBytes -= it->second.size;
+   lru_.erase(it->second.lruPosition);
+   entries_.erase(it);
+}
+
+void HelpCache::evict()
+{
+   while (stats_.totalBytes > maxBytes_ && !lru_.empty())
+   {
+      std::string fileName = lru_.back();
+      removeEntry(fileName);
+
+      Error error = cacheDir_.completeChildPath(fileName).removeIfExists();
+      if (error)
+         LOG_DEBUG_MESSAGE("Unable to evict help cache entry: " + error.getSummary());
+
+      stats_.evictions++;
+   }
+}
+
+} // namespace help
+} // namespace modules
+} // namespace session
+} // namespace rstudio
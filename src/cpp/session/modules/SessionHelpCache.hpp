@@ -0,0 +1,97 @@
+/*
+ * SessionHelpCache.hpp
+ *
+ * Copyright (C) 2022 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_SESSION_HELP_CACHE_HPP
+#define SESSION_SESSION_HELP_CACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include <shared_core/FilePath.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace help {
+
+struct HelpCacheStats
+{
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t inserts;
+   uint64_t evictions;
+   uintmax_t totalBytes;
+};
+
+// Disk-backed cache of rendered help topics. Entries are keyed by a string
+// which identifies the R installation, package, package version and topic,
+// so that a cached page never needs to be invalidated: a new package (or R)
+// version simply produces a new key. The cache directory may be shared by
+// several sessions; each session keeps its own LRU index and evicts the
+// least recently used entries once the cache exceeds its size limit.
+class HelpCache : boost::noncopyable
+{
+public:
+   HelpCache(const core::FilePath& cacheDir, uintmax_t maxBytes);
+
+   // indexes the entries already present in the cache directory
+   core::Error initialize();
+
+   bool lookup(const std::string& key, std::string* pContent);
+   bool contains(const std::string& key);
+
+   core::Error insert(const std::string& key, const std::string& content);
+
+   HelpCacheStats stats() const { return stats_; }
+
+private:
+   struct Entry
+   {
+      uintmax_t size;
+      std::list<std::string>::iterator lruPosition;
+   };
+
+   core::FilePath entryPath(const std::string& key) const;
+   void touch(const std::string& fileName);
+   void addEntry(const std::string& fileName, uintmax_t size);
+   void removeEntry(const std::string& fileName);
+   void evict();
+
+   core::FilePath cacheDir_;
+   uintmax_t maxBytes_;
+
+   // file names, most recently used first
+   std::list<std::string> lru_;
+   std::map<std::string, Entry> entries_;
+
+   HelpCacheStats stats_;
+};
+
+} // namespace help
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_SESSION_HELP_CACHE_HPP
@@ -0,0 +1,399 @@
+/*
+ * SessionInstalledPackages.cpp
+ *
+ * Copyright (C) 2022 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionInstalledPackages.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <ctime>
+#include <map>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/format.hpp>
+
+#include <shared_core/Error.hpp>
+#include <shared_core/FilePath.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/BoostErrors.hpp>
+#include <core/Log.hpp>
+#include <core/Macros.hpp>
+#include <core/Thread.hpp>
+#include <core/text/DcfParser.hpp>
+
+#include <core/system/System.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace packages {
+
+namespace {
+
+// upper bound on the number of threads used to read DESCRIPTION files
+const unsigned int kMaxScanThreads = 8;
+
+// DESCRIPTION fields of an installed package which the Packages pane uses
+struct PackageDescription
+{
+   PackageDescription() : valid(false), readFailed(false), hasBiocViews(false) {}
+
+   bool valid;
+   bool readFailed;
+
+   std::string name;
+   std::string libraryPath;
+   std::string packagePath;
+   std::string version;
+   std::string title;
+   std::string priority;
+   std::string url;
+   std::string repository;
+   std::string githubUsername;
+   std::string githubRepo;
+   bool hasBiocViews;
+};
+
+struct LibraryEntry
+{
+   std::time_t lastWriteTime;
+   std::vector<PackageDescription> packages;
+};
+
+boost::mutex s_mutex;
+std::map<std::string, LibraryEntry> s_libraries;
+
+// collapses the whitespace of folded fields (e.g. a multi-line Title)
+std::string collapseWhitespace(const std::string& value)
+{
+   std::string collapsed;
+   bool pendingSpace = false;
+   for (char ch : value)
+   {
+      if (::isspace(static_cast<unsigned char>(ch)))
+      {
+         pendingSpace = !collapsed.empty();
+         continue;
+      }
+
+      if (pendingSpace)
+         collapsed.push_back(' ');
+      collapsed.push_back(ch);
+      pendingSpace = false;
+   }
+   return collapsed;
+}
+
+std::string fieldValue(const std::map<std::string, std::string>& fields,
+                       const std::string& name)
+{
+   auto it = fields.find(name);
+   return it != fields.end() ? it->second : std::string();
+}
+
+void readPackageDescription(const FilePath& packageDir,
+                            const std::string& libraryPath,
+                            PackageDescription* pDescription)
+{
+   // only include packages that have a Meta folder. note that the
+   // pseudo-package 'translations' lives in the R system library, and has a
+   // DESCRIPTION file, but cannot be loaded as a regular R package.
+   if (!packageDir.completeChildPath("Meta").isDirectory())
+      return;
+
+   pDescription->valid = true;
+   pDescription->libraryPath = libraryPath;
+
+   FilePath realPackageDir;
+   Error error = core::system::realPath(packageDir, &realPackageDir);
+   pDescription->packagePath = error ?
+            packageDir.getAbsolutePath() :
+            realPackageDir.getAbsolutePath();
+
+   std::map<std::string, std::string> fields;
+   std::string errMsg;
+   error = text::parseDcfFile(packageDir.completeChildPath("DESCRIPTION"), true, &fields, &errMsg);
+   if (error)
+   {
+      pDescription->readFailed = true;
+      pDescription->name = packageDir.getFilename();
+      return;
+   }
+
+   pDescription->name = fieldValue(fields, "Package");
+   pDescription->version = fieldValue(fields, "Version");
+   pDescription->title = collapseWhitespace(fieldValue(fields, "Title"));
+   pDescription->priority = fieldValue(fields, "Priority");
+   pDescription->url = fieldValue(fields, "URL");
+   pDescription->repository = fieldValue(fields, "Repository");
+   pDescription->githubUsername = fieldValue(fields, "GithubUsername");
+   pDescription->githubRepo = fieldValue(fields, "GithubRepo");
+   pDescription->hasBiocViews = fields.count("biocViews") > 0;
+}
+
+struct ScanItem
+{
+   FilePath packageDir;
+   std::string libraryPath;
+   PackageDescription* pDescription;
+};
+
+void scanWorker(const std::vector<ScanItem>* pItems, std::atomic<size_t>* pNext)
+{
+   try
+   {
+      for (size_t i = (*pNext)++; i < pItems->size(); i = (*pNext)++)
+      {
+         const ScanItem& item = (*pItems)[i];
+         readPackageDescription(item.packageDir, item.libraryPath, item.pDescription);
+      }
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+void scanPackages(const std::vector<ScanItem>& items)
+{
+   unsigned int threads = std::min(boost::thread::hardware_concurrency(), kMaxScanThreads);
+   if (threads > items.size())
+      threads = static_cast<unsigned int>(items.size());
+
+   std::atomic<size_t> next(0);
+
+   if (threads > 1)
+   {
+      // block all signals for launch of the scan threads (will cause them
+      // to never receive signals)
+      core::system::SignalBlocker signalBlocker;
+      Error error = signalBlocker.blockAll();
+      if (!error)
+      {
+         boost::thread_group workers;
+         try
+         {
+            for (unsigned int i = 0; i < threads; i++)
+               workers.create_thread(boost::bind(scanWorker, &items, &next));
+         }
+         catch(const boost::thread_resource_error& e)
+         {
+            LOG_ERROR(Error(boost::thread_error::ec_from_exception(e), ERROR_LOCATION));
+         }
+         workers.join_all();
+      }
+      else
+      {
+         LOG_ERROR(error);
+      }
+   }
+
+   // scan anything left over (no threads, or thread creation failed)
+   scanWorker(&items, &next);
+}
+
+bool hasEncodedCharacters(const std::string& url)
+{
+   for (size_t i = 0; i + 2 < url.size(); i++)
+   {
+      if (url[i] == '%' &&
+          ::isxdigit(static_cast<unsigned char>(url[i + 1])) &&
+          ::isxdigit(static_cast<unsigned char>(url[i + 2])))
+         return true;
+   }
+   return false;
+}
+
+// equivalent of utils::URLencode(url, reserved = FALSE)
+std::string encodeUrl(const std::string& url)
+{
+   if (hasEncodedCharacters(url))
+      return url;
+
+   static const std::string kAllowed = "][!$&'()*+,;=:/?@#._~-";
+
+   std::string encoded;
+   for (char ch : url)
+   {
+      if (::isalnum(static_cast<unsigned char>(ch)) || kAllowed.find(ch) != std::string::npos)
+      {
+         encoded.push_back(ch);
+      }
+      else
+      {
+         encoded.append(boost::str(boost::format("%%%02X") %
+                                   static_cast<unsigned int>(static_cast<unsigned char>(ch))));
+      }
+   }
+   return encoded;
+}
+
+InstalledPackage asInstalledPackage(const PackageDescription& description,
+                                    const std::string& cranUrl)
+{
+   InstalledPackage package;
+   package.libraryPath = description.libraryPath;
+   package.packagePath = description.packagePath;
+
+   if (description.readFailed)
+   {
+      package.name = description.name;
+      package.version = "[Unknown]";
+      package.title = "[Failed to read package metadata]";
+      package.source = "Unknown";
+      return package;
+   }
+
+   package.name = description.name.empty() ? "[Unknown]" : description.name;
+   package.version = description.version.empty() ? "[Unknown]" : description.version;
+   package.title = description.title.empty() ? "[No description available]" : description.title;
+
+   // attempt to infer an appropriate URL for this package
+   std::string url;
+   if (description.priority == "base")
+   {
+      package.source = "Base";
+   }
+   else if (!description.url.empty())
+   {
+      package.source = "Custom";
+      std::string trimmed = boost::algorithm::trim_copy(description.url);
+      url = trimmed.substr(0, trimmed.find_first_of(" ,"));
+   }
+   else if (description.hasBiocViews)
+   {
+      package.source = "Bioconductor";
+      url = "https://www.bioconductor.org/packages/release/bioc/html/" + description.name + ".html";
+   }
+   else if (description.repository == "CRAN")
+   {
+      package.source = "CRAN";
+      url = cranUrl + "/package=" + description.name;
+   }
+   else if (!description.githubRepo.empty())
+   {
+      package.source = "GitHub";
+      url = "https://github.com/" + description.githubUsername + "/" + description.githubRepo;
+   }
+   else
+   {
+      package.source = "Unknown";
+      url = cranUrl + "/package=" + description.name;
+   }
+
+   package.browseUrl = encodeUrl(url);
+   return package;
+}
+
+} // anonymous namespace
+
+Error listInstalledPackages(const std::vector<std::string>& libraryPaths,
+                            const std::string& cranUrl,
+                            std::vector<InstalledPackage>* pPackages)
+{
+   std::string cran = cranUrl;
+   boost::algorithm::trim_right_if(cran, boost::algorithm::is_any_of("/"));
+
+   LOCK_MUTEX(s_mutex)
+   {
+      std::time_t scanTime = std::time(nullptr);
+
+      // collect the package directories of libraries which are new or have
+      // changed since they were last scanned
+      std::map<std::string, LibraryEntry> scanned;
+      std::vector<ScanItem> items;
+      for (const std::string& libraryPath : libraryPaths)
+      {
+         FilePath libraryDir(libraryPath);
+         std::time_t lastWriteTime = libraryDir.getLastWriteTime();
+
+         auto it = s_libraries.find(libraryPath);
+         if (it != s_libraries.end() &&
+             it->second.lastWriteTime != 0 &&
+             it->second.lastWriteTime == lastWriteTime)
+         {
+            continue;
+         }
+
+         std::vector<FilePath> children;
+         Error error = libraryDir.getChildren(children);
+         if (error)
+         {
+            // not fatal; the library may have been removed
+            LOG_DEBUG_MESSAGE("Unable to list package library " + libraryPath + ": " + error.getSummary());
+            s_libraries.erase(libraryPath);
+            continue;
+         }
+
+         LibraryEntry& entry = scanned[libraryPath];
+         entry.lastWriteTime = lastWriteTime;
+         entry.packages.resize(children.size());
+         for (size_t i = 0; i < children.size(); i++)
+         {
+            ScanItem item;
+            item.packageDir = children[i];
+            item.libraryPath = libraryPath;
+            item.pDescription = &entry.packages[i];
+            items.push_back(item);
+         }
+      }
+
+      if (!items.empty())
+         scanPackages(items);
+
+      for (auto& library : scanned)
+      {
+         std::vector<PackageDescription>& packages = library.second.packages;
+         packages.erase(std::remove_if(packages.begin(), packages.end(),
+                                       [](const PackageDescription& description) { return !description.valid; }),
+                        packages.end());
+
+         // a library modified within the current second could change again
+         // without its timestamp changing, so don't trust it next time
+         if (library.second.lastWriteTime >= scanTime)
+            library.second.lastWriteTime = 0;
+
+         s_libraries[library.first] = library.second;
+      }
+
+      for (const std::string& libraryPath : libraryPaths)
+      {
+         auto it = s_libraries.find(libraryPath);
+         if (it == s_libraries.end())
+            continue;
+
+         for (const PackageDescription& description : it->second.packages)
+            pPackages->push_back(asInstalledPackage(description, cran));
+      }
+   }
+   END_LOCK_MUTEX
+
+   return Success();
+}
+
+void invalidateInstalledPackages()
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      s_libraries.clear();
+   }
+   END_LOCK_MUTEX
+}
+
+} // namespace packages
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,64 @@
+/*
+ * SessionInstalledPackages.hpp
+ *
+ * Copyright (C) 2022 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_INSTALLED_PACKAGES_HPP
+#define SESSION_INSTALLED_PACKAGES_HPP
+
+#include <string>
+#include <vector>
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace packages {
+
+// metadata for an installed package, as shown in the Packages pane
+struct InstalledPackage
+{
+   std::string name;
+   std::string libraryPath;
+
+   // the package directory with any symlinks resolved
+   std::string packagePath;
+
+   std::string version;
+   std::string title;
+   std::string source;
+   std::string browseUrl;
+};
+
+// Lists the packages installed in the given library paths by reading their
+// DESCRIPTION files directly (without calling into R). The parsed metadata
+// for each library is cached until the library directory is modified, and
+// libraries which need to be (re)scanned are read in parallel.
+core::Error listInstalledPackages(const std::vector<std::string>& libraryPaths,
+                                  const std::string& cranUrl,
+                                  std::vector<InstalledPackage>* pPackages);
+
+// discards all cached library metadata (e.g. after packages are installed)
+void invalidateInstalledPackages();
+
+} // namespace packages
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_INSTALLED_PACKAGES_HPP
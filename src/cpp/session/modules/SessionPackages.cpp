@@ -20,6 +20,9 @@
 
 #include "SessionPackages.hpp"
 
+#include <set>
+
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/format.hpp>
 #include <boost/bind/bind.hpp>
 
@@ -37,6 +40,7 @@
 #include <session/projects/SessionProjects.hpp>
 #include <session/prefs/UserPrefs.hpp>
 
+#include "SessionInstalledPackages.hpp"
 #include "SessionPackrat.hpp"
 
 #include "session-config.h"
@@ -190,6 +194,73 @@ Error availablePackages(const core::json::JsonRpcRequest&,
    return Success();
 }
 
+Error listInstalledPackagesJson(json::Value* pPackageListJson)
+{
+   r::sexp::Protect protect;
+   SEXP contextSEXP;
+   Error error = r::exec::RFunction(".rs.installedPackagesContext")
+         .call(&contextSEXP, &protect);
+   if (error)
+      return error;
+
+   std::string cranUrl;
+   std::vector<std::string> libPaths, uniqueLibPaths, loadedPaths;
+   SEXP valueSEXP;
+   const std::vector<std::pair<std::string, std::vector<std::string>*> > pathFields = {
+      { "libPaths",       &libPaths },
+      { "uniqueLibPaths", &uniqueLibPaths },
+      { "loaded",         &loadedPaths }
+   };
+   for (const auto& field : pathFields)
+   {
+      error = r::sexp::getNamedListSEXP(contextSEXP, field.first, &valueSEXP);
+      if (!error)
+         error = r::sexp::extract(valueSEXP, field.second, true);
+      if (error)
+         return error;
+   }
+
+   error = r::sexp::getNamedListElement(contextSEXP, "cran", &cranUrl);
+   if (error)
+      return error;
+
+   std::vector<InstalledPackage> packages;
+   error = listInstalledPackages(uniqueLibPaths, cranUrl, &packages);
+   if (error)
+      return error;
+
+   std::set<std::string> loaded(loadedPaths.begin(), loadedPaths.end());
+
+   std::stable_sort(packages.begin(), packages.end(),
+                    [](const InstalledPackage& lhs, const InstalledPackage& rhs)
+   {
+      return boost::algorithm::ilexicographical_compare(lhs.name, rhs.name);
+   });
+
+   json::Array packageListJson;
+   for (const InstalledPackage& package : packages)
+   {
+      auto libIt = std::find(libPaths.begin(), libPaths.end(), package.libraryPath);
+      int libraryIndex = libIt == libPaths.end() ?
+               0 : static_cast<int>(libIt - libPaths.begin()) + 1;
+
+      json::Object packageJson;
+      packageJson["name"] = package.name;
+      packageJson["library"] = module_context::createAliasedPath(FilePath(package.libraryPath));
+      packageJson["library_absolute"] = package.libraryPath;
+      packageJson["library_index"] = libraryIndex;
+      packageJson["version"] = package.version;
+      packageJson["desc"] = package.title;
+      packageJson["loaded"] = loaded.count(package.packagePath) > 0;
+      packageJson["source"] = package.source;
+      packageJson["browse_url"] = package.browseUrl;
+      packageListJson.push_back(packageJson);
+   }
+
+   *pPackageListJson = packageListJson;
+   return Success();
+}
+
 Error getPackageStateJson(json::Object* pJson)
 {
    using namespace module_context;
@@ -224,14 +295,22 @@ Error getPackageStateJson(json::Object* pJson)
    }
    else
    {
-      error = r::exec::RFunction(".rs.listInstalledPackages")
-              .call(&packageList, &protect);
+      // read the libraries natively when possible; this avoids re-reading
+      // every DESCRIPTION file on the main thread for each refresh
+      error = listInstalledPackagesJson(&packageListJson);
+      if (error)
+      {
+         LOG_ERROR(error);
+         error = r::exec::RFunction(".rs.listInstalledPackages")
+                 .call(&packageList, &protect);
+      }
    }
 
    if (!error)
    {
       // return the generated package list and the Packrat context
-      r::json::jsonValueFromObject(packageList, &packageListJson);
+      if (packageListJson.isNull())
+         r::json::jsonValueFromObject(packageList, &packageListJson);
 
       (*pJson)["package_list"] = packageListJson;
       (*pJson)["packrat_context"] = packrat::contextAsJson(packratContext);
@@ -262,6 +341,10 @@ SEXP rs_canInstallPackages()
 
 SEXP rs_packageLibraryMutated()
 {
+   // the library timestamps will usually reflect the change, but there is
+   // no harm in rescanning after an explicit mutation
+   invalidateInstalledPackages();
+
    // broadcast event to server
    module_context::events().onPackageLibraryMutated();
 
@@ -27,6 +27,7 @@
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/join.hpp>
 
+#include <core/DateTime.hpp>
 #include <core/Exec.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/Version.hpp>
@@ -244,6 +245,9 @@ const char * const kTestFile = "test-file";
 const char * const kTestShiny = "test-shiny";
 const char * const kTestShinyFile = "test-shiny-file";
 
+// the minimum interval between updates to the build errors while a build runs
+const int kBuildErrorsUpdateIntervalMs = 500;
+
 class Build : boost::noncopyable,
               public boost::enable_shared_from_this<Build>
 {
@@ -258,8 +262,8 @@ public:
 
 private:
    Build()
-      : isRunning_(false), terminationRequested_(false), restartR_(false),
-        usedDevtools_(false), openErrorList_(true)
+      : isRunning_(false), terminationRequested_(false), errorsPending_(false),
+        restartR_(false), usedDevtools_(false), openErrorList_(true)
    {
    }
 
@@ -646,8 +650,8 @@ private:
 
       // use both the R and gcc error parsers
       CompileErrorParsers parsers;
-      parsers.add(rErrorParser(packagePath.completePath("R")));
-      parsers.add(gccErrorParser(packagePath.completePath("src")));
+      parsers.add(rErrorExtractor(packagePath.completePath("R")));
+      parsers.add(gccErrorExtractor(packagePath.completePath("src")));
 
       // track build type
       type_ = type;
@@ -1421,7 +1425,9 @@ private:
       }
 
       // install the gcc error parser
-      initErrorParser(targetPath, gccErrorParser(targetPath));
+      CompileErrorParsers parsers;
+      parsers.add(gccErrorExtractor(targetPath));
+      initErrorParser(targetPath, parsers);
 
       std::string make = "make";
       if (!options_.makefileArgs.empty())
@@ -1706,13 +1712,13 @@ private:
       using namespace module_context;
 
       // call the error parser if one has been specified
-      if (errorParser_)
+      if (!errorParsers_.empty())
       {
-         std::vector<SourceMarker> errors = errorParser_(outputAsText());
+         std::vector<SourceMarker> errors = errorParsers_(outputAsText());
          if (!errors.empty())
          {
             errorsJson_ = sourceMarkersAsJson(errors);
-            enqueBuildErrors(errorsJson_);
+            enqueBuildErrors(errorsJson_, openErrorList_);
          }
       }
 
@@ -1774,6 +1780,36 @@ private:
                         compileOutputAsJson(compileOutput));
 
       module_context::enqueClientEvent(event);
+
+      // extract errors as the output arrives, so they can be shown before
+      // the build completes
+      if (!errorParsers_.empty())
+      {
+         if (errorParsers_.addOutput(output))
+            errorsPending_ = true;
+
+         if (errorsPending_ &&
+             boost::posix_time::microsec_clock::universal_time() >= nextErrorsUpdate_)
+         {
+            enqueBuildErrorsUpdate();
+         }
+      }
+   }
+
+   void enqueBuildErrorsUpdate()
+   {
+      using namespace module_context;
+
+      // updates are sent at most every kBuildErrorsUpdateIntervalMs; any
+      // still pending when the build completes are superseded by the final
+      // set of errors
+      errorsPending_ = false;
+      nextErrorsUpdate_ = boost::posix_time::microsec_clock::universal_time() +
+                          boost::posix_time::milliseconds(kBuildErrorsUpdateIntervalMs);
+
+      // the error list is opened (if requested) only once the build completes
+      errorsJson_ = sourceMarkersAsJson(errorParsers_.markers());
+      enqueBuildErrors(errorsJson_, false);
    }
 
    void enqueCommandString(const std::string& cmd)
@@ -1782,12 +1818,12 @@ private:
                        "==> " + cmd + "\n\n");
    }
 
-   void enqueBuildErrors(const json::Array& errors)
+   void enqueBuildErrors(const json::Array& errors, bool openErrorList)
    {
       json::Object jsonData;
       jsonData["base_dir"] = errorsBaseDir_;
       jsonData["errors"] = errors;
-      jsonData["open_error_list"] = openErrorList_;
+      jsonData["open_error_list"] = openErrorList;
       jsonData["type"] = type_;
 
       ClientEvent event(client_events::kBuildErrors, jsonData);
@@ -1893,7 +1929,7 @@ private:
       return type + " package written to " + written;
    }
 
-   void initErrorParser(const FilePath& baseDir, CompileErrorParser parser)
+   void initErrorParser(const FilePath& baseDir, const CompileErrorParsers& parsers)
    {
       // set base dir -- make sure it ends with a / so the slash is
       // excluded from error display
@@ -1904,14 +1940,18 @@ private:
          errorsBaseDir_.append("/");
       }
 
-      errorParser_ = parser;
+      errorParsers_ = parsers;
+      errorsPending_ = false;
+      nextErrorsUpdate_ = boost::posix_time::microsec_clock::universal_time();
    }
 
 private:
    bool isRunning_;
    bool terminationRequested_;
    std::vector<module_context::CompileOutput> output_;
-   CompileErrorParser errorParser_;
+   CompileErrorParsers errorParsers_;
+   bool errorsPending_;
+   boost::posix_time::ptime nextErrorsUpdate_;
    std::string errorsBaseDir_;
    json::Array errorsJson_;
    r_util::RPackageInfo pkgInfo_;
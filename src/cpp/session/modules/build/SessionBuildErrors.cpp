@@ -16,6 +16,7 @@
 #include "SessionBuildErrors.hpp"
 
 #include <algorithm>
+#include <map>
 
 #include <boost/regex.hpp>
 #include <boost/format.hpp>
@@ -99,167 +100,440 @@ FilePath scanForRSourceFile(const FilePath& basePath,
    return FilePath();
 }
 
-std::vector<module_context::SourceMarker> parseRErrors(
-                                       const FilePath& basePath,
-                                       const std::string& output)
+bool isDigit(char ch)
 {
-   using namespace module_context;
-   std::vector<SourceMarker> errors;
+   return ch >= '0' && ch <= '9';
+}
 
-   boost::regex re("^Error in parse\\(outFile\\) : ([0-9]+?):([0-9]+?): (.+?)\\n"
-                   "([0-9]+?): (.*?)\\n([0-9]+?): (.+?)$");
-   try
+// reads one or more digits starting at pos, returning the position following
+// them (or npos if there are none)
+std::size_t readDigits(const std::string& line, std::size_t pos, std::string* pDigits)
+{
+   std::size_t end = pos;
+   while (end < line.size() && isDigit(line[end]))
+      end++;
+
+   if (end == pos)
+      return std::string::npos;
+
+   *pDigits = line.substr(pos, end - pos);
+   return end;
+}
+
+// reads "<digits>: " starting at pos, returning the position of the text
+// which follows (or npos if the line doesn't match)
+std::size_t readLineNumberPrefix(const std::string& line,
+                                 std::size_t pos,
+                                 std::string* pLineNumber)
+{
+   pos = readDigits(line, pos, pLineNumber);
+   if (pos == std::string::npos || line.compare(pos, 2, ": ") != 0)
+      return std::string::npos;
+
+   return pos + 2;
+}
+
+// Extracts the errors reported by R when a package's R sources fail to
+// parse, which look like:
+//
+//    Error in parse(outFile) : 3:5: unexpected symbol
+//    2: foo <- function() {
+//    3:   bar baz
+//
+// The file isn't named, so we look for the R source file with the lines shown.
+class RErrorExtractor : public CompileErrorExtractor
+{
+public:
+   explicit RErrorExtractor(const FilePath& basePath)
+      : basePath_(basePath)
    {
-      boost::sregex_iterator iter(output.begin(), output.end(), re,
-                                  boost::regex_constants::match_not_dot_newline);
-      boost::sregex_iterator end;
-      for (; iter != end; iter++)
+   }
+
+   void addLine(const std::string& line,
+                std::vector<module_context::SourceMarker>* pMarkers) override
+   {
+      using namespace module_context;
+
+      lines_.push_back(line);
+      if (lines_.size() < 3)
+         return;
+
+      if (lines_.size() > 3)
+         lines_.erase(lines_.begin());
+
+      std::string line1, column, message, diagLine, lineContents, nextLine, nextLineContents;
+      if (!parseErrorLine(lines_[0], &line1, &column, &message) ||
+          !parseContextLine(lines_[1], false, &diagLine, &lineContents) ||
+          !parseContextLine(lines_[2], true, &nextLine, &nextLineContents))
       {
-         boost::smatch match = *iter;
-         BOOST_ASSERT(match.size() == 8);
+         return;
+      }
 
-         // first part is straightforward
-         std::string line = match[1];
-         std::string column = match[2];
-         std::string message = match[3];
+      lines_.clear();
 
-         // we need to guess the file based on the contextual information
-         // provided in the error message
-         int diagLine = core::safe_convert::stringTo<int>(match[4], -1);
-         if (diagLine != -1)
-         {
-            FilePath rSrcFile = scanForRSourceFile(basePath,
-                                                   diagLine,
-                                                   match[5],
-                  match[7]);
-            if (!rSrcFile.isEmpty())
-            {
-               // create error and add it
-               SourceMarker err(SourceMarker::Error,
-                                rSrcFile,
-                                core::safe_convert::stringTo<int>(line, 1),
-                                core::safe_convert::stringTo<int>(column, 1),
-                                core::html_utils::HTML(message),
-                                false);
-               errors.push_back(err);
-            }
-         }
+      // we need to guess the file based on the contextual information
+      // provided in the error message
+      int diagLineNumber = core::safe_convert::stringTo<int>(diagLine, -1);
+      if (diagLineNumber == -1)
+         return;
 
+      FilePath rSrcFile = scanForRSourceFile(basePath_,
+                                             diagLineNumber,
+                                             lineContents,
+                                             nextLineContents);
+      if (!rSrcFile.isEmpty())
+      {
+         // create error and add it
+         SourceMarker err(SourceMarker::Error,
+                          rSrcFile,
+                          core::safe_convert::stringTo<int>(line1, 1),
+                          core::safe_convert::stringTo<int>(column, 1),
+                          core::html_utils::HTML(message),
+                          false);
+         pMarkers->push_back(err);
       }
    }
-   CATCH_UNEXPECTED_EXCEPTION;
 
-   return errors;
+private:
+   static bool parseErrorLine(const std::string& line,
+                              std::string* pLine,
+                              std::string* pColumn,
+                              std::string* pMessage)
+   {
+      static const std::string kPrefix = "Error in parse(outFile) : ";
+      if (line.compare(0, kPrefix.size(), kPrefix) != 0)
+         return false;
 
-}
+      std::size_t pos = readDigits(line, kPrefix.size(), pLine);
+      if (pos == std::string::npos || pos >= line.size() || line[pos] != ':')
+         return false;
 
+      pos = readLineNumberPrefix(line, pos + 1, pColumn);
+      if (pos == std::string::npos || pos >= line.size())
+         return false;
 
-std::vector<module_context::SourceMarker> parseGccErrors(
-                                           const FilePath& basePath,
-                                           const std::string& output)
-{
-   // check to see if we are in a package
-   std::string pkgInclude;
-   using namespace projects;
-   if (projectContext().hasProject() &&
-       (projectContext().config().buildType == r_util::kBuildTypePackage))
+      *pMessage = line.substr(pos);
+      return true;
+   }
+
+   static bool parseContextLine(const std::string& line,
+                                bool requireContents,
+                                std::string* pLine,
+                                std::string* pContents)
    {
-      pkgInclude = "/" + projectContext().packageInfo().name() + "/include/";
+      std::size_t pos = readLineNumberPrefix(line, 0, pLine);
+      if (pos == std::string::npos || (requireContents && pos >= line.size()))
+         return false;
+
+      *pContents = line.substr(pos);
+      return true;
    }
 
-   using namespace module_context;
-   std::vector<SourceMarker> errors;
+   FilePath basePath_;
 
-   // parse standard gcc errors and warning lines but also pickup "from"
-   // prefixed errors and substitute the from file for the error/warning file
-   boost::regex re("(?:from (.+?):([0-9]+?).+?\\n)?"
-                   "^(.+?):([0-9]+?):(?:([0-9]+?):)? (error|warning): (.+)$");
-   try
+   // the most recent (up to three) lines of output
+   std::vector<std::string> lines_;
+};
+
+// Extracts gcc (and clang) errors and warnings. As well as the usual
+// diagnostic lines, these are read from the JSON diagnostics written by
+// gcc when -fdiagnostics-format=json is in use.
+class GccErrorExtractor : public CompileErrorExtractor
+{
+public:
+   explicit GccErrorExtractor(const FilePath& basePath)
+      : basePath_(basePath),
+        previousLineMatched_(false)
    {
-      boost::sregex_iterator iter(output.begin(), output.end(), re,
-                                  boost::regex_constants::match_not_dot_newline);
-      boost::sregex_iterator end;
-      for (; iter != end; iter++)
+      // check to see if we are in a package
+      using namespace projects;
+      if (projectContext().hasProject() &&
+          (projectContext().config().buildType == r_util::kBuildTypePackage))
       {
-         boost::smatch match = *iter;
-         BOOST_ASSERT(match.size() == 8);
+         pkgInclude_ = "/" + projectContext().packageInfo().name() + "/include/";
+      }
+   }
+
+   void addLine(const std::string& line,
+                std::vector<module_context::SourceMarker>* pMarkers) override
+   {
+      if (boost::algorithm::starts_with(line, "[{") &&
+          line.find("\"kind\"") != std::string::npos &&
+          line.find("\"locations\"") != std::string::npos)
+      {
+         addJsonDiagnostics(line, pMarkers);
+         previousLine_.clear();
+         previousLineMatched_ = false;
+         return;
+      }
 
-         std::string file, line, column, type, message;
-         std::string match1 = match[1];
-         if (!match1.empty() && FilePath::isRootPath(match[1]))
+      std::string file, lineNumber, column, type, message;
+      bool matched = parseDiagnosticLine(line, &file, &lineNumber, &column, &type, &message);
+      if (matched)
+      {
+         // pickup "from" prefixed errors and substitute the from file for
+         // the error/warning file
+         std::string fromFile, fromLineNumber;
+         if (!previousLineMatched_ &&
+             parseFromLine(previousLine_, &fromFile, &fromLineNumber) &&
+             FilePath::isRootPath(fromFile))
          {
-            file = match[1];
-            line = match[2];
+            file = fromFile;
+            lineNumber = fromLineNumber;
             column = "1";
          }
-         else
+         else if (column.empty())
          {
-            file = match[3];
-            line = match[4];
-            column = match[5];
-            if (column.empty())
-               column = "1";
+            column = "1";
          }
-         type = match[6];
-         message = match[7];
 
-         // resolve file path
-         FilePath filePath;
-         if (FilePath::isRootPath(file))
-            filePath = FilePath(file);
-         else
-            filePath = basePath.completeChildPath(file);
+         addMarker(file,
+                   core::safe_convert::stringTo<int>(lineNumber, 1),
+                   core::safe_convert::stringTo<int>(column, 1),
+                   type,
+                   message,
+                   pMarkers);
+      }
+
+      previousLine_ = line;
+      previousLineMatched_ = matched;
+   }
 
-         // skip if the file doesn't exist
-         if (!filePath.exists())
+private:
+   // parses "<file>:<line>:[<column>:] (error|warning): <message>"
+   static bool parseDiagnosticLine(const std::string& line,
+                                   std::string* pFile,
+                                   std::string* pLine,
+                                   std::string* pColumn,
+                                   std::string* pType,
+                                   std::string* pMessage)
+   {
+      // the file name is the shortest prefix which leaves a match, since
+      // file names can themselves contain colons
+      for (std::size_t colon = line.find(':', 1);
+           colon != std::string::npos;
+           colon = line.find(':', colon + 1))
+      {
+         std::size_t pos = readDigits(line, colon + 1, pLine);
+         if (pos == std::string::npos || pos >= line.size() || line[pos] != ':')
             continue;
+         pos++;
 
-         FilePath realPath;
-         Error error = core::system::realPath(filePath, &realPath);
-         if (error)
-            LOG_ERROR(error);
-         else
-            filePath = realPath;
+         // with a column, then without
+         std::size_t columnEnd = readDigits(line, pos, pColumn);
+         if (columnEnd != std::string::npos &&
+             columnEnd < line.size() && line[columnEnd] == ':' &&
+             parseTypeAndMessage(line, columnEnd + 1, pType, pMessage))
+         {
+            *pFile = line.substr(0, colon);
+            return true;
+         }
+
+         pColumn->clear();
+         if (parseTypeAndMessage(line, pos, pType, pMessage))
+         {
+            *pFile = line.substr(0, colon);
+            return true;
+         }
+      }
+
+      return false;
+   }
+
+   static bool parseTypeAndMessage(const std::string& line,
+                                   std::size_t pos,
+                                   std::string* pType,
+                                   std::string* pMessage)
+   {
+      for (const char* type : { "error", "warning" })
+      {
+         std::string prefix = std::string(" ") + type + ": ";
+         if (line.compare(pos, prefix.size(), prefix) == 0 &&
+             pos + prefix.size() < line.size())
+         {
+            *pType = type;
+            *pMessage = line.substr(pos + prefix.size());
+            return true;
+         }
+      }
 
-         // if we are in a package and the file where the error occurred
-         // has /<package-name>/include/ in it then it might be a template
-         // instantiation error. in that case re-map it to the appropriate
-         // source file within the package
-         if (!pkgInclude.empty())
+      return false;
+   }
+
+   // parses the file and line from "... from <file>:<line>..." (as in
+   // "In file included from <file>:<line>:")
+   static bool parseFromLine(const std::string& line,
+                             std::string* pFile,
+                             std::string* pLine)
+   {
+      for (std::size_t from = line.find("from ");
+           from != std::string::npos;
+           from = line.find("from ", from + 1))
+      {
+         std::size_t fileStart = from + 5;
+         for (std::size_t colon = line.find(':', fileStart + 1);
+              colon != std::string::npos;
+              colon = line.find(':', colon + 1))
          {
-            std::string path = filePath.getAbsolutePath();
-            size_t pos = path.find(pkgInclude);
-            if (pos != std::string::npos)
+            // a line number must follow, and then something else
+            if (colon + 2 < line.size() && isDigit(line[colon + 1]))
             {
-               // advance to end and calculate relative path
-               pos += pkgInclude.length();
-               std::string relativePath = path.substr(pos);
-
-               // does this file exist? if so substitute it
-               FilePath includePath = projectContext().buildTargetPath()
-                                                      .completeChildPath("inst/include/" + relativePath);
-               if (includePath.exists())
-                  filePath = includePath;
+               *pFile = line.substr(fileStart, colon - fileStart);
+               readDigits(line, colon + 1, pLine);
+               return true;
             }
          }
+      }
 
-         // don't show warnings from Makeconf
-         if (filePath.getFilename() == "Makeconf")
+      return false;
+   }
+
+   void addJsonDiagnostics(const std::string& line,
+                           std::vector<module_context::SourceMarker>* pMarkers)
+   {
+      json::Value diagnosticsJson;
+      if (diagnosticsJson.parse(line) || !diagnosticsJson.isArray())
+         return;
+
+      for (const json::Value& diagnosticJson : diagnosticsJson.getArray())
+      {
+         if (!diagnosticJson.isObject())
             continue;
 
-         // create marker and add it
-         SourceMarker err(module_context::sourceMarkerTypeFromString(type),
-                          filePath,
-                          core::safe_convert::stringTo<int>(line, 1),
-                          core::safe_convert::stringTo<int>(column, 1),
-                          core::html_utils::HTML(message),
-                          true);
-         errors.push_back(err);
+         const json::Object& diagnostic = diagnosticJson.getObject();
+         std::string kind, message;
+         json::Array locations;
+         Error error = json::readObject(diagnostic,
+                                        "kind", kind,
+                                        "message", message,
+                                        "locations", locations);
+         if (error || locations.isEmpty() || !locations[0].isObject())
+            continue;
+
+         // "error" or "fatal error"; notes aren't shown (as with the text
+         // diagnostics)
+         std::string type;
+         if (kind.find("error") != std::string::npos)
+            type = "error";
+         else if (kind == "warning")
+            type = "warning";
+         else
+            continue;
+
+         json::Object caret;
+         error = json::readObject(locations[0].getObject(), "caret", caret);
+         if (error)
+            continue;
+
+         std::string file;
+         int lineNumber = 1, column = 1;
+         error = json::readObject(caret, "file", file, "line", lineNumber);
+         if (error)
+            continue;
+         json::readObject(caret, "column", column);
+
+         addMarker(file, lineNumber, column, type, message, pMarkers);
       }
    }
-   CATCH_UNEXPECTED_EXCEPTION;
 
-   return errors;
+   void addMarker(const std::string& file,
+                  int line,
+                  int column,
+                  const std::string& type,
+                  const std::string& message,
+                  std::vector<module_context::SourceMarker>* pMarkers)
+   {
+      FilePath filePath = resolvePath(file);
+
+      // skip if the file doesn't exist
+      if (filePath.isEmpty())
+         return;
+
+      // don't show warnings from Makeconf
+      if (filePath.getFilename() == "Makeconf")
+         return;
+
+      // create marker and add it
+      using namespace module_context;
+      SourceMarker err(module_context::sourceMarkerTypeFromString(type),
+                       filePath,
+                       line,
+                       column,
+                       core::html_utils::HTML(message),
+                       true);
+      pMarkers->push_back(err);
+   }
+
+   // returns the path to show for a file named in a diagnostic, or an empty
+   // path if the file doesn't exist; this is cached since the same files
+   // are typically named over and over in the output of a build
+   FilePath resolvePath(const std::string& file)
+   {
+      auto it = resolvedPaths_.find(file);
+      if (it != resolvedPaths_.end())
+         return it->second;
+
+      FilePath filePath;
+      if (FilePath::isRootPath(file))
+         filePath = FilePath(file);
+      else
+         filePath = basePath_.completeChildPath(file);
+
+      if (!filePath.exists())
+      {
+         resolvedPaths_[file] = FilePath();
+         return FilePath();
+      }
+
+      FilePath realPath;
+      Error error = core::system::realPath(filePath, &realPath);
+      if (error)
+         LOG_ERROR(error);
+      else
+         filePath = realPath;
+
+      // if we are in a package and the file where the error occurred
+      // has /<package-name>/include/ in it then it might be a template
+      // instantiation error. in that case re-map it to the appropriate
+      // source file within the package
+      if (!pkgInclude_.empty())
+      {
+         std::string path = filePath.getAbsolutePath();
+         size_t pos = path.find(pkgInclude_);
+         if (pos != std::string::npos)
+         {
+            // advance to end and calculate relative path
+            pos += pkgInclude_.length();
+            std::string relativePath = path.substr(pos);
+
+            // does this file exist? if so substitute it
+            FilePath includePath = projects::projectContext().buildTargetPath()
+                                                   .completeChildPath("inst/include/" + relativePath);
+            if (includePath.exists())
+               filePath = includePath;
+         }
+      }
+
+      resolvedPaths_[file] = filePath;
+      return filePath;
+   }
+
+   FilePath basePath_;
+   std::string pkgInclude_;
+   std::map<std::string, FilePath> resolvedPaths_;
+
+   std::string previousLine_;
+   bool previousLineMatched_;
+};
+
+std::vector<module_context::SourceMarker> parseGccErrors(
+                                           const FilePath& basePath,
+                                           const std::string& output)
+{
+   CompileErrorParsers parsers;
+   parsers.add(gccErrorExtractor(basePath));
+   parsers.addOutput(output);
+   return parsers(output);
 }
 
 std::vector<module_context::SourceMarker> parseTestThatErrors(
@@ -428,14 +702,103 @@ std::vector<module_context::SourceMarker> parseShinyTestErrors(
 
 } // anonymous namespace
 
+bool CompileErrorParsers::addOutput(const std::string& output)
+{
+   bool found = false;
+   std::size_t pos = 0;
+   while (true)
+   {
+      std::size_t newline = output.find('\n', pos);
+      if (newline == std::string::npos)
+      {
+         partialLine_.append(output, pos, std::string::npos);
+         break;
+      }
+
+      partialLine_.append(output, pos, newline - pos);
+      if (addLine(partialLine_))
+         found = true;
+
+      partialLine_.clear();
+      pos = newline + 1;
+   }
+
+   return found;
+}
+
+bool CompileErrorParsers::addLine(const std::string& line)
+{
+   // treat \r\n as a line ending
+   std::string text = line;
+   if (!text.empty() && text.back() == '\r')
+      text.pop_back();
+
+   bool found = false;
+   for (Source& source : sources_)
+   {
+      if (!source.pExtractor)
+         continue;
+
+      std::size_t count = source.markers.size();
+      try
+      {
+         source.pExtractor->addLine(text, &source.markers);
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      if (source.markers.size() != count)
+         found = true;
+   }
+
+   return found;
+}
+
+std::vector<module_context::SourceMarker> CompileErrorParsers::markers() const
+{
+   std::vector<module_context::SourceMarker> allErrors;
+   for (const Source& source : sources_)
+   {
+      std::copy(source.markers.begin(),
+                source.markers.end(),
+                std::back_inserter(allErrors));
+   }
+
+   return allErrors;
+}
+
+std::vector<module_context::SourceMarker> CompileErrorParsers::operator()(const std::string& output)
+{
+   // the output may not have ended with a newline
+   if (!partialLine_.empty())
+   {
+      addLine(partialLine_);
+      partialLine_.clear();
+   }
+
+   std::vector<module_context::SourceMarker> allErrors;
+   for (const Source& source : sources_)
+   {
+      std::vector<module_context::SourceMarker> errors =
+            source.pExtractor ? source.markers : source.parser(output);
+      std::copy(errors.begin(), errors.end(), std::back_inserter(allErrors));
+   }
+
+   return allErrors;
+}
+
 CompileErrorParser gccErrorParser(const FilePath& basePath)
 {
    return boost::bind(parseGccErrors, basePath, _1);
 }
 
-CompileErrorParser rErrorParser(const FilePath& basePath)
+boost::shared_ptr<CompileErrorExtractor> gccErrorExtractor(const FilePath& basePath)
+{
+   return boost::shared_ptr<CompileErrorExtractor>(new GccErrorExtractor(basePath));
+}
+
+boost::shared_ptr<CompileErrorExtractor> rErrorExtractor(const FilePath& basePath)
 {
-   return boost::bind(parseRErrors, basePath, _1);
+   return boost::shared_ptr<CompileErrorExtractor>(new RErrorExtractor(basePath));
 }
 
 CompileErrorParser testthatErrorParser(const FilePath& basePath)
@@ -20,6 +20,7 @@
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <shared_core/FilePath.hpp>
 #include <shared_core/json/Json.hpp>
@@ -36,6 +37,21 @@ namespace build {
 using CompileErrorParserSignature = std::vector<module_context::SourceMarker>(const std::string&);
 using CompileErrorParser = boost::function<CompileErrorParserSignature>;
 
+// Extracts source markers from build output as the output is produced,
+// a line at a time (so that markers can be shown before the build completes).
+class CompileErrorExtractor
+{
+public:
+   virtual ~CompileErrorExtractor()
+   {
+   }
+
+   // called for each line of output (without the line terminator); markers
+   // found are appended to pMarkers
+   virtual void addLine(const std::string& line,
+                        std::vector<module_context::SourceMarker>* pMarkers) = 0;
+};
+
 class CompileErrorParsers
 {
 public:
@@ -43,32 +59,59 @@ public:
    {
    }
 
+   // parsers are run on the complete output when the build completes
    void add(CompileErrorParser parser)
    {
-      parsers_.push_back(parser);
+      Source source;
+      source.parser = parser;
+      sources_.push_back(source);
    }
 
-public:
-   std::vector<module_context::SourceMarker> operator()(const std::string& output)
+   // extractors are passed output as it arrives (see addOutput)
+   void add(boost::shared_ptr<CompileErrorExtractor> pExtractor)
+   {
+      Source source;
+      source.pExtractor = pExtractor;
+      sources_.push_back(source);
+   }
+
+   bool empty() const
    {
-      using namespace module_context;
-      std::vector<SourceMarker> allErrors;
-      for (const CompileErrorParser& parser : parsers_)
-      {
-         std::vector<SourceMarker> errors = parser(output);
-         std::copy(errors.begin(), errors.end(), std::back_inserter(allErrors));
-      }
-
-      return allErrors;
+      return sources_.empty();
    }
 
+   // passes output to the extractors, returning true if new markers were found
+   bool addOutput(const std::string& output);
+
+   // the markers found by the extractors so far
+   std::vector<module_context::SourceMarker> markers() const;
+
+public:
+   // called with the complete output when the build completes, returning
+   // all markers (in the order their extractors and parsers were added)
+   std::vector<module_context::SourceMarker> operator()(const std::string& output);
+
 private:
-   std::vector<CompileErrorParser> parsers_;
+   bool addLine(const std::string& line);
+
+   struct Source
+   {
+      CompileErrorParser parser;
+      boost::shared_ptr<CompileErrorExtractor> pExtractor;
+      std::vector<module_context::SourceMarker> markers;
+   };
+
+   std::vector<Source> sources_;
+
+   // output following the last complete line
+   std::string partialLine_;
 };
 
 CompileErrorParser gccErrorParser(const core::FilePath& basePath);
 
-CompileErrorParser rErrorParser(const core::FilePath& basePath);
+boost::shared_ptr<CompileErrorExtractor> gccErrorExtractor(const core::FilePath& basePath);
+
+boost::shared_ptr<CompileErrorExtractor> rErrorExtractor(const core::FilePath& basePath);
 
 CompileErrorParser testthatErrorParser(const core::FilePath& basePath);
 
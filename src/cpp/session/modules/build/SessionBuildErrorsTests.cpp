@@ -0,0 +1,123 @@
+/*
+ * SessionBuildErrorsTests.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionBuildErrors.hpp"
+
+#include <core/FileSerializer.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace build {
+namespace tests {
+
+using namespace rstudio::core;
+using namespace module_context;
+
+TEST_CASE("SessionBuildErrors")
+{
+   FilePath srcPath;
+   REQUIRE_FALSE(FilePath::tempFilePath(srcPath));
+   REQUIRE_FALSE(srcPath.ensureDirectory());
+   REQUIRE_FALSE(core::writeStringToFile(srcPath.completeChildPath("code.cpp"), "int x;\n"));
+   REQUIRE_FALSE(core::writeStringToFile(srcPath.completeChildPath("code.h"), "int y;\n"));
+   REQUIRE_FALSE(core::writeStringToFile(srcPath.completeChildPath("code.R"),
+                                         "f <- function() {\n  x y\n}\n"));
+
+   FilePath codePath, headerPath;
+   REQUIRE_FALSE(core::system::realPath(srcPath.completeChildPath("code.cpp"), &codePath));
+   REQUIRE_FALSE(core::system::realPath(srcPath.completeChildPath("code.h"), &headerPath));
+
+   SECTION("gcc errors and warnings are extracted as output arrives")
+   {
+      CompileErrorParsers parsers;
+      parsers.add(gccErrorExtractor(srcPath));
+
+      expect_false(parsers.addOutput("g++ -c code.cpp -o code.o\n"));
+      expect_false(parsers.addOutput("code.cpp:12:3: error: 'foo' was not"));
+      expect_true(parsers.addOutput(" declared in this scope\ncode.cpp:4: warning: unused\n"));
+      expect_false(parsers.addOutput("missing.cpp:1:1: error: not a file we know of\n"));
+
+      std::vector<SourceMarker> markers = parsers.markers();
+      REQUIRE(markers.size() == 2);
+      expect_true(markers[0].type == SourceMarker::Error);
+      expect_true(markers[0].path == codePath);
+      expect_true(markers[0].line == 12);
+      expect_true(markers[0].column == 3);
+      expect_true(markers[0].message.text() == "'foo' was not declared in this scope");
+      expect_true(markers[1].type == SourceMarker::Warning);
+      expect_true(markers[1].line == 4);
+      expect_true(markers[1].column == 1);
+   }
+
+   SECTION("Errors in included files are reported against the including file")
+   {
+      std::string output =
+            "In file included from " + codePath.getAbsolutePath() + ":27:\n"
+            "code.h:3:5: error: redefinition of 'y'\n"
+            "code.h:4:5: error: redefinition of 'z'";
+
+      std::vector<SourceMarker> markers = gccErrorParser(srcPath)(output);
+      REQUIRE(markers.size() == 2);
+      expect_true(markers[0].path == codePath);
+      expect_true(markers[0].line == 27);
+      expect_true(markers[0].column == 1);
+      expect_true(markers[1].path == headerPath);
+      expect_true(markers[1].line == 4);
+   }
+
+   SECTION("gcc JSON diagnostics are extracted")
+   {
+      std::string output =
+            "[{\"kind\": \"warning\", \"message\": \"unused variable 'x'\", "
+            "\"children\": [], \"locations\": [{\"caret\": {\"file\": \"code.cpp\", "
+            "\"line\": 7, \"column\": 9}}]}, "
+            "{\"kind\": \"note\", \"message\": \"declared here\", "
+            "\"children\": [], \"locations\": [{\"caret\": {\"file\": \"code.cpp\", "
+            "\"line\": 2, \"column\": 1}}]}]\n";
+
+      std::vector<SourceMarker> markers = gccErrorParser(srcPath)(output);
+      REQUIRE(markers.size() == 1);
+      expect_true(markers[0].type == SourceMarker::Warning);
+      expect_true(markers[0].line == 7);
+      expect_true(markers[0].column == 9);
+      expect_true(markers[0].message.text() == "unused variable 'x'");
+   }
+
+   SECTION("R parse errors are matched to their source file")
+   {
+      CompileErrorParsers parsers;
+      parsers.add(rErrorExtractor(srcPath));
+      parsers.addOutput("Error in parse(outFile) : 2:5: unexpected symbol\n"
+                        "1: f <- function() {\n"
+                        "2:   x y\n");
+
+      std::vector<SourceMarker> markers = parsers("");
+      REQUIRE(markers.size() == 1);
+      expect_true(markers[0].path == srcPath.completeChildPath("code.R"));
+      expect_true(markers[0].line == 2);
+      expect_true(markers[0].column == 5);
+   }
+
+   srcPath.remove();
+}
+
+} // namespace tests
+} // namespace build
+} // namespace modules
+} // namespace session
+} // namespace rstudio
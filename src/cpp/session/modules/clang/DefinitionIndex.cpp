@@ -15,20 +15,30 @@
 
 #include "DefinitionIndex.hpp"
 
+#include <cstdio>
 #include <deque>
+#include <set>
+#include <sstream>
 #include <gsl/gsl>
 
+#include <boost/algorithm/string/split.hpp>
+
 #include <shared_core/FilePath.hpp>
+#include <shared_core/Hash.hpp>
+#include <core/BoostThread.hpp>
+#include <core/BoostErrors.hpp>
 #include <core/DateTime.hpp>
 #include <core/PerformanceTimer.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/libclang/LibClang.hpp>
 #include <core/system/ProcessArgs.hpp>
+#include <core/system/System.hpp>
 #include <session/IncrementalFileChangeHandler.hpp>
 
 #include <session/SessionModuleContext.hpp>
 #include <session/projects/SessionProjects.hpp>
 
+#include "FindReferences.hpp"
 #include "RSourceIndex.hpp"
 #include "RCompilationDatabase.hpp"
 
@@ -46,12 +56,28 @@ namespace {
 // flag indicating whether we are initialized
 bool s_initialized = false;
 
+// location of a reference within the indexed file
+struct CppReference
+{
+   unsigned startLine;
+   unsigned startColumn;
+   unsigned endLine;
+   unsigned endColumn;
+};
+
+typedef std::map<std::string, std::vector<CppReference> > CppReferencesByUSR;
+
 struct CppDefinitions
 {
+   CppDefinitions() : fileLastWrite(0), hidden(false) {}
+
    std::string file;
    std::time_t fileLastWrite;
    bool hidden;
    std::deque<CppDefinition> definitions;
+
+   // references made from the file, by normalized USR
+   CppReferencesByUSR references;
 };
 
 bool isHeaderGuard(const std::string& name)
@@ -64,6 +90,55 @@ bool isHeaderGuard(const std::string& name)
 typedef std::map<std::string,CppDefinitions> DefinitionsByFile;
 DefinitionsByFile s_definitionsByFile;
 
+// files which define or reference each (normalized) USR
+std::map<std::string, std::set<std::string> > s_filesByUSR;
+
+// the index is written to by the background indexing threads
+boost::mutex s_indexMutex;
+
+// directory holding the on-disk index (one file per source file)
+FilePath s_indexDir;
+
+// must be called with s_indexMutex held
+void removeIndexEntry(const std::string& file)
+{
+   DefinitionsByFile::iterator it = s_definitionsByFile.find(file);
+   if (it == s_definitionsByFile.end())
+      return;
+
+   std::set<std::string> USRs;
+   for (const CppDefinition& definition : it->second.definitions)
+      USRs.insert(normalizedUSR(definition.USR));
+   for (const CppReferencesByUSR::value_type& references : it->second.references)
+      USRs.insert(references.first);
+
+   for (const std::string& USR : USRs)
+   {
+      std::map<std::string, std::set<std::string> >::iterator filesIt = s_filesByUSR.find(USR);
+      if (filesIt == s_filesByUSR.end())
+         continue;
+
+      filesIt->second.erase(file);
+      if (filesIt->second.empty())
+         s_filesByUSR.erase(filesIt);
+   }
+
+   s_definitionsByFile.erase(it);
+}
+
+// must be called with s_indexMutex held
+void insertIndexEntry(const CppDefinitions& definitions)
+{
+   removeIndexEntry(definitions.file);
+
+   for (const CppDefinition& definition : definitions.definitions)
+      s_filesByUSR[normalizedUSR(definition.USR)].insert(definitions.file);
+   for (const CppReferencesByUSR::value_type& references : definitions.references)
+      s_filesByUSR[references.first].insert(definitions.file);
+
+   s_definitionsByFile[definitions.file] = definitions;
+}
+
 // visitor used to populate deque
 bool insertDefinition(const CppDefinition& definition,
                       CppDefinitions* pDefinitions)
@@ -205,79 +280,386 @@ bool isGeneratedFile(const FilePath& inputFile) {
    return boost::algorithm::contains(contents, "do not edit by hand");
 }
 
+FilePath indexFilePath(const std::string& file)
+{
+   return s_indexDir.completeChildPath(hash::crc32HexHash(file) + ".idx");
+}
+
+// Each source file's index is stored as tab-separated lines:
+//
+//    file        <path>
+//    last_write  <time>
+//    hidden      <0|1>
+//    D  <kind>  <line>  <column>  <usr>  <parent name>  <name>
+//    R  <usr>   <start line>,<start column>,<end line>,<end column> ...
+//
+Error writeIndexFile(const CppDefinitions& definitions)
+{
+   std::ostringstream ostr;
+   ostr << "file\t" << definitions.file << "\n";
+   ostr << "last_write\t" << definitions.fileLastWrite << "\n";
+   ostr << "hidden\t" << (definitions.hidden ? 1 : 0) << "\n";
+
+   for (const CppDefinition& definition : definitions.definitions)
+   {
+      ostr << "D\t" << static_cast<int>(definition.kind) << "\t"
+           << definition.location.line << "\t" << definition.location.column << "\t"
+           << definition.USR << "\t" << definition.parentName << "\t" << definition.name << "\n";
+   }
+
+   for (const CppReferencesByUSR::value_type& references : definitions.references)
+   {
+      ostr << "R\t" << references.first;
+      for (const CppReference& reference : references.second)
+      {
+         ostr << "\t" << reference.startLine << "," << reference.startColumn << ","
+              << reference.endLine << "," << reference.endColumn;
+      }
+      ostr << "\n";
+   }
+
+   return writeStringToFile(indexFilePath(definitions.file), ostr.str());
+}
+
+Error readIndexFile(const FilePath& indexFile, CppDefinitions* pDefinitions)
+{
+   using namespace safe_convert;
+
+   std::vector<std::string> lines;
+   Error error = readStringVectorFromFile(indexFile, &lines);
+   if (error)
+      return error;
+
+   bool hasHidden = false;
+   for (const std::string& line : lines)
+   {
+      std::vector<std::string> fields;
+      boost::algorithm::split(fields, line, boost::algorithm::is_any_of("\t"));
+
+      if (fields.size() == 2 && fields[0] == "file")
+      {
+         pDefinitions->file = fields[1];
+      }
+      else if (fields.size() == 2 && fields[0] == "last_write")
+      {
+         pDefinitions->fileLastWrite = stringTo<std::time_t>(fields[1], 0);
+      }
+      else if (fields.size() == 2 && fields[0] == "hidden")
+      {
+         pDefinitions->hidden = fields[1] == "1";
+         hasHidden = true;
+      }
+      else if (fields.size() == 7 && fields[0] == "D")
+      {
+         CppDefinition definition(fields[4],
+                                  static_cast<CppDefinitionKind>(stringTo<int>(fields[1], 0)),
+                                  fields[5],
+                                  fields[6],
+                                  pDefinitions->hidden,
+                                  FileLocation(FilePath(pDefinitions->file),
+                                               stringTo<unsigned>(fields[2], 1),
+                                               stringTo<unsigned>(fields[3], 1)));
+         if (!definition.empty())
+            pDefinitions->definitions.push_back(definition);
+      }
+      else if (fields.size() > 2 && fields[0] == "R")
+      {
+         std::vector<CppReference>& references = pDefinitions->references[fields[1]];
+         for (std::size_t i = 2; i < fields.size(); i++)
+         {
+            CppReference reference;
+            if (std::sscanf(fields[i].c_str(), "%u,%u,%u,%u",
+                            &reference.startLine, &reference.startColumn,
+                            &reference.endLine, &reference.endColumn) == 4)
+            {
+               references.push_back(reference);
+            }
+         }
+      }
+   }
+
+   if (pDefinitions->file.empty() || !hasHidden)
+      return systemError(boost::system::errc::invalid_argument, ERROR_LOCATION);
+
+   return Success();
+}
+
+// a source file waiting to be (re)indexed
+struct IndexJob
+{
+   std::string file;
+   std::time_t fileLastWrite;
+   std::vector<std::string> compileArgs;
+   bool verbose;
+};
+
+void indexTranslationUnit(CXIndex index, const IndexJob& job)
+{
+   // get args in form clang expects
+   core::system::ProcessArgs argsArray(job.compileArgs);
+
+   // parse the translation unit
+   CXTranslationUnit tu = libclang::clang().parseTranslationUnit(
+                         index,
+                         job.file.c_str(),
+                         argsArray.args(),
+                         gsl::narrow_cast<int>(argsArray.argCount()),
+                         nullptr, 0, // no unsaved files
+                         parseTranslationUnitOptions());
+   if (tu == nullptr)
+      return;
+
+   // collect definitions
+   CppDefinitions definitions;
+   definitions.file = job.file;
+   definitions.fileLastWrite = job.fileLastWrite;
+   definitions.hidden = isGeneratedFile(FilePath(definitions.file));
+
+   DefinitionVisitor visitor = {
+      definitions.hidden,
+      0,
+      boost::bind(insertDefinition, _1, &definitions)
+   };
+   libclang::clang().visitChildren(
+        libclang::clang().getTranslationUnitCursor(tu),
+        cursorVisitor,
+        (CXClientData)&visitor);
+
+   // collect references (all of which are in this file)
+   ReferencesByUSR references;
+   indexReferences(tu, &references);
+   for (const ReferencesByUSR::value_type& usrReferences : references)
+   {
+      std::vector<CppReference>& ranges = definitions.references[usrReferences.first];
+      for (const FileRange& range : usrReferences.second)
+      {
+         CppReference reference = {
+            range.start.line, range.start.column, range.end.line, range.end.column
+         };
+         ranges.push_back(reference);
+      }
+   }
+
+   // dispose translation unit
+   libclang::clang().disposeTranslationUnit(tu);
+
+   // update the index unless the file has since been removed or a
+   // newer version of it was indexed by another thread
+   bool updated = false;
+   LOCK_MUTEX(s_indexMutex)
+   {
+      DefinitionsByFile::const_iterator it = s_definitionsByFile.find(job.file);
+      if (FilePath::exists(job.file) &&
+          (it == s_definitionsByFile.end() || it->second.fileLastWrite <= job.fileLastWrite))
+      {
+         insertIndexEntry(definitions);
+         updated = true;
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (updated)
+   {
+      Error error = writeIndexFile(definitions);
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+// Parses translation units on a small pool of background threads (each with
+// its own CXIndex) so that indexing a large package doesn't tie up the
+// main thread.
+class BackgroundIndexer : boost::noncopyable
+{
+public:
+   BackgroundIndexer() : stopped_(false) {}
+
+   void enqueue(const IndexJob& job)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (stopped_)
+            return;
+
+         // a newer change to a file supersedes any pending one
+         for (IndexJob& pending : pending_)
+         {
+            if (pending.file == job.file)
+            {
+               pending = job;
+               return;
+            }
+         }
+
+         pending_.push_back(job);
+      }
+      END_LOCK_MUTEX
+
+      ensureStarted();
+      wakeup_.notify_one();
+   }
+
+   void cancel(const std::string& file)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         pending_.erase(std::remove_if(pending_.begin(), pending_.end(),
+                                       [&](const IndexJob& job) { return job.file == file; }),
+                        pending_.end());
+      }
+      END_LOCK_MUTEX
+   }
+
+   void stop()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         stopped_ = true;
+         pending_.clear();
+      }
+      END_LOCK_MUTEX
+
+      wakeup_.notify_all();
+
+      // translation units which are being parsed can't be interrupted;
+      // don't hold up shutdown waiting for them
+      for (boost::shared_ptr<boost::thread>& pThread : threads_)
+      {
+         if (!pThread->timed_join(boost::posix_time::seconds(1)))
+            pThread->detach();
+      }
+   }
+
+private:
+   void ensureStarted()
+   {
+      if (!threads_.empty())
+         return;
+
+      unsigned int count = std::max(1u, std::min(boost::thread::hardware_concurrency(), 4u));
+
+      // block all signals for launch of the indexing threads (will cause
+      // them to never receive signals)
+      core::system::SignalBlocker signalBlocker;
+      Error error = signalBlocker.blockAll();
+      if (error)
+         LOG_ERROR(error);
+
+      try
+      {
+         for (unsigned int i = 0; i < count; i++)
+         {
+            threads_.push_back(boost::shared_ptr<boost::thread>(
+                  new boost::thread(boost::bind(&BackgroundIndexer::run, this))));
+         }
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         LOG_ERROR(Error(boost::thread_error::ec_from_exception(e), ERROR_LOCATION));
+      }
+   }
+
+   void run()
+   {
+      CXIndex index = nullptr;
+      try
+      {
+         while (true)
+         {
+            IndexJob job;
+            {
+               boost::unique_lock<boost::mutex> lock(mutex_);
+               while (!stopped_ && pending_.empty())
+                  wakeup_.wait(lock);
+
+               if (stopped_)
+                  break;
+
+               job = pending_.front();
+               pending_.pop_front();
+            }
+
+            if (index == nullptr)
+            {
+               index = libclang::clang().createIndex(1 /* Exclude PCH */,
+                                                     job.verbose ? 1 : 0);
+            }
+
+            indexTranslationUnit(index, job);
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      if (index != nullptr)
+         libclang::clang().disposeIndex(index);
+   }
+
+   boost::mutex mutex_;
+   boost::condition_variable wakeup_;
+   std::deque<IndexJob> pending_;
+   bool stopped_;
+
+   // only accessed from the main thread
+   std::vector<boost::shared_ptr<boost::thread> > threads_;
+};
+
+BackgroundIndexer& backgroundIndexer()
+{
+   static BackgroundIndexer instance;
+   return instance;
+}
+
 void fileChangeHandler(const core::system::FileChangeEvent& event)
 {
    // alias the filename
    std::string file = event.fileInfo().absolutePath();
 
-   // special case: we write all definitions to disk at shutdown, when
-   // we come back up all of the files will come back in as "add" events,
-   // for this case we need to ignore the add if we already have a fresh
-   // enough index of the file
+   // special case: the index is persisted on disk, so when we come back
+   // up all of the files will come back in as "add" events; for this
+   // case we need to ignore the add if we already have a fresh enough
+   // index of the file
    if (event.type() == core::system::FileChangeEvent::FileAdded)
    {
-      // if we have a definition
-      DefinitionsByFile::const_iterator it = s_definitionsByFile.find(file);
-      if (it != s_definitionsByFile.end())
+      LOCK_MUTEX(s_indexMutex)
       {
-         // if the definition is fresh enough then bail
-         if (it->second.fileLastWrite >= event.fileInfo().lastWriteTime())
-            return;
+         // if we have a definition
+         DefinitionsByFile::const_iterator it = s_definitionsByFile.find(file);
+         if (it != s_definitionsByFile.end())
+         {
+            // if the definition is fresh enough then bail
+            if (it->second.fileLastWrite >= event.fileInfo().lastWriteTime())
+               return;
+         }
       }
+      END_LOCK_MUTEX
    }
 
    // always remove existing definitions
-   s_definitionsByFile.erase(file);
+   backgroundIndexer().cancel(file);
+   LOCK_MUTEX(s_indexMutex)
+   {
+      removeIndexEntry(file);
+   }
+   END_LOCK_MUTEX
+   indexFilePath(file).removeIfExists();
 
    // if this is an add or an update then re-index
    if (event.type() == core::system::FileChangeEvent::FileAdded ||
        event.type() == core::system::FileChangeEvent::FileModified)
    {    
-      // get the compilation arguments for this file and use them to
-      // create a translation unit
+      // get the compilation arguments for this file (this may need R, so
+      // it's done here rather than on the indexing thread)
       std::vector<std::string> compileArgs =
             rCompilationDatabase().compileArgsForTranslationUnit(file, true);
 
       if (!compileArgs.empty())
       {
-         // create index
-         CXIndex index = libclang::clang().createIndex(
-                   1 /* Exclude PCH */,
-                   (rSourceIndex().verbose() > 0) ? 1 : 0);
-
-         // get args in form clang expects
-         core::system::ProcessArgs argsArray(compileArgs);
-
-         // parse the translation unit
-         CXTranslationUnit tu = libclang::clang().parseTranslationUnit(
-                               index,
-                               file.c_str(),
-                               argsArray.args(),
-                               gsl::narrow_cast<int>(argsArray.argCount()),
-                               nullptr, 0, // no unsaved files
-                               parseTranslationUnitOptions());
-
-
-         // create definitions and wire visitor to it
-         CppDefinitions definitions;
-         definitions.file = file;
-         definitions.fileLastWrite = event.fileInfo().lastWriteTime();
-         definitions.hidden = isGeneratedFile(FilePath(definitions.file));
-         s_definitionsByFile[file] = definitions;
-
-         DefinitionVisitor visitor = {
-            definitions.hidden,
-            0,
-            boost::bind(insertDefinition, _1, &s_definitionsByFile[file])
-         };
-         libclang::clang().visitChildren(
-              libclang::clang().getTranslationUnitCursor(tu),
-              cursorVisitor,
-              (CXClientData)&visitor);
-         
-         // dispose translation unit and index
-         libclang::clang().disposeTranslationUnit(tu);
-         libclang::clang().disposeIndex(index);
+         IndexJob job;
+         job.file = file;
+         job.fileLastWrite = event.fileInfo().lastWriteTime();
+         job.compileArgs = compileArgs;
+         job.verbose = rSourceIndex().verbose() > 0;
+         backgroundIndexer().enqueue(job);
       }
    }
 }
@@ -402,14 +784,27 @@ FileLocation findDefinitionLocation(const FileLocation& location)
 
       // if we didn't find it there then look for it in our index
       // of all saved files
-      for (const DefinitionsByFile::value_type& defs : s_definitionsByFile)
+      LOCK_MUTEX(s_indexMutex)
       {
-         for (const CppDefinition& def : defs.second.definitions)
+         std::map<std::string, std::set<std::string> >::const_iterator filesIt =
+               s_filesByUSR.find(normalizedUSR(USR));
+         if (filesIt != s_filesByUSR.end())
          {
-            if (def.USR == USR)
-               return def.location;
+            for (const std::string& file : filesIt->second)
+            {
+               DefinitionsByFile::const_iterator it = s_definitionsByFile.find(file);
+               if (it == s_definitionsByFile.end())
+                  continue;
+
+               for (const CppDefinition& def : it->second.definitions)
+               {
+                  if (def.USR == USR)
+                     return def.location;
+               }
+            }
          }
       }
+      END_LOCK_MUTEX
    }
 
    // see if we can resolve the cursor to a definition (if we can't
@@ -452,168 +847,57 @@ bool insertMatching(const std::string& term,
 }
 
 
-json::Object cppDefinitionToJson(const CppDefinition& definition)
-{
-   using namespace safe_convert;
-   json::Object definitionJson;
-   definitionJson["usr"] = definition.USR;
-   definitionJson["kind"] = numberTo<int>(definition.kind, 0);
-   definitionJson["parent_name"] = definition.parentName;
-   definitionJson["name"] = definition.name;
-   definitionJson["file"] = definition.location.filePath.getAbsolutePath();
-   definitionJson["line"] = numberTo<int>(definition.location.line, 1);
-   definitionJson["column"] = numberTo<int>(definition.location.column, 1);
-   definitionJson["hidden"] = definition.hidden;
-   return definitionJson;
-}
-
-CppDefinition cppDefinitionFromJson(const json::Object& object)
-{
-   // read json
-   int kind;
-   int line, column;
-   std::string file;
-   CppDefinition definition;
-   Error error = json::readObject(object,
-                                  "usr", definition.USR,
-                                  "kind", kind,
-                                  "parent_name", definition.parentName,
-                                  "name", definition.name,
-                                  "file", file,
-                                  "line", line,
-                                  "column", column, 
-                                  "hidden", definition.hidden
-                                  );
-   if (error)
-   {
-      LOG_ERROR(error);
-      return CppDefinition();
-   }
-
-   // required data transforms
-   using namespace safe_convert;
-   definition.kind = static_cast<CppDefinitionKind>(kind);
-   definition.location.filePath = FilePath(file);
-   definition.location.line = numberTo<unsigned>(line, 1);
-   definition.location.column = numberTo<unsigned>(column, 1);
-
-   // return definition
-   return definition;
-}
-
-FilePath definitionIndexFilePath()
+FilePath legacyDefinitionIndexFilePath()
 {
    return module_context::scopedScratchPath().completeChildPath("cpp-definition-cache");
 }
 
 void loadDefinitionIndex()
 {
-   using namespace safe_convert;
-
-   FilePath indexFilePath = definitionIndexFilePath();
-   if (!indexFilePath.exists())
-      return;
+   // the index used to be saved as a single json file at shutdown
+   Error error = legacyDefinitionIndexFilePath().removeIfExists();
+   if (error)
+      LOG_ERROR(error);
 
-   std::string contents;
-   Error error = readStringFromFile(indexFilePath, &contents);
+   error = s_indexDir.ensureDirectory();
    if (error)
    {
       LOG_ERROR(error);
       return;
    }
 
-   json::Value indexValueJson;
-   if (indexValueJson.parse(contents) ||
-       !json::isType<json::Array>(indexValueJson))
+   std::vector<FilePath> indexFiles;
+   error = s_indexDir.getChildren(indexFiles);
+   if (error)
    {
-      LOG_ERROR_MESSAGE("Error parsing definition index: " + contents);
+      LOG_ERROR(error);
       return;
    }
 
-   const json::Array& indexJson = indexValueJson.getArray();
-   for (const json::Value& definitionsJson : indexJson)
+   LOCK_MUTEX(s_indexMutex)
    {
-      if (!json::isType<json::Object>(definitionsJson))
-      {
-         LOG_ERROR_MESSAGE("Unexpected non-object type in definition index");
-         continue;
-      }
-
-      json::Array defsArrayJson;
-      double fileLastWrite;
-      CppDefinitions definitions;
-      Error error = json::readObject(definitionsJson.getObject(),
-                                     "file", definitions.file,
-                                     "file_last_write", fileLastWrite,
-                                     "definitions", defsArrayJson);
-      if (error)
+      for (const FilePath& indexFile : indexFiles)
       {
-         LOG_ERROR(error);
-         continue;
-      }
-      definitions.fileLastWrite = numberTo<double, std::time_t>(fileLastWrite, 0);
-
-      // if the file doesn't exist then bail
-      if (!FilePath::exists(definitions.file))
-         continue;
-
-      // if the json does not have the hidden field, bail
-      // so that the file is parsed again
-      error = json::readObject(definitionsJson.getObject(), "hidden", definitions.hidden);
-      if (error)
-         continue;
+         CppDefinitions definitions;
+         Error error = readIndexFile(indexFile, &definitions);
 
-      for (const json::Value& defJson : defsArrayJson)
-      {
-         if (!json::isType<json::Object>(defJson))
+         // if the index can't be read, or the file no longer exists, then
+         // drop the index so that the file is parsed again if necessary
+         if (error || !FilePath::exists(definitions.file))
          {
-            LOG_ERROR_MESSAGE("Unexpected non-object type in definition index");
+            indexFile.removeIfExists();
             continue;
          }
 
-         CppDefinition definition = cppDefinitionFromJson(defJson.getObject());
-         if (!definition.empty())
-            definitions.definitions.push_back(definition);
+         insertIndexEntry(definitions);
       }
-
-      s_definitionsByFile[definitions.file] = definitions;
    }
+   END_LOCK_MUTEX
 }
 
-
-void saveDefinitionIndex()
+void onShutdown(bool)
 {
-   using namespace safe_convert;
-
-   json::Array indexJson;
-   for (const DefinitionsByFile::value_type& defs : s_definitionsByFile)
-   {
-      const CppDefinitions& definitions = defs.second;
-      json::Object definitionsJson;
-      definitionsJson["file"] = definitions.file;
-      definitionsJson["file_last_write"] = numberTo<std::time_t, double>(
-                                               definitions.fileLastWrite, 0);
-      json::Array defsArrayJson;
-      std::transform(definitions.definitions.begin(),
-                     definitions.definitions.end(),
-                     std::back_inserter(defsArrayJson),
-                     cppDefinitionToJson);
-      definitionsJson["definitions"] = defsArrayJson;
-      definitionsJson["hidden"] = definitions.hidden;
-
-      indexJson.push_back(definitionsJson);
-   }
-
-   ;
-   Error error = writeStringToFile(definitionIndexFilePath(), indexJson.writeFormatted());
-   if (error)
-      LOG_ERROR(error);
-}
-
-void onShutdown(bool terminatedNormally)
-{
-   if (terminatedNormally)
-      saveDefinitionIndex();
+   backgroundIndexer().stop();
 }
 
 
@@ -658,18 +942,57 @@ void searchDefinitions(const std::string& term,
    // for within the in-memory index)
    // if we didn't find it there then look for it in our index
    // of all saved files
-   for (const DefinitionsByFile::value_type& defs : s_definitionsByFile)
+   LOCK_MUTEX(s_indexMutex)
    {
-      // skip files we've already searched
-      if (units.find(defs.first) != units.end())
-         continue;
+      for (const DefinitionsByFile::value_type& defs : s_definitionsByFile)
+      {
+         // skip files we've already searched
+         if (units.find(defs.first) != units.end())
+            continue;
+
+         for (const CppDefinition& def : defs.second.definitions)
+         {
+            if (matches(term, pattern, def))
+               pDefinitions->push_back(def);
+         }
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+bool findIndexedReferences(const std::string& file,
+                           const std::string& USR,
+                           std::vector<FileRange>* pRefs)
+{
+   if (!s_initialized)
+      return false;
 
-      for (const CppDefinition& def : defs.second.definitions)
+   std::time_t lastWrite = FilePath(file).getLastWriteTime();
+
+   LOCK_MUTEX(s_indexMutex)
+   {
+      DefinitionsByFile::const_iterator it = s_definitionsByFile.find(file);
+      if (it == s_definitionsByFile.end() || it->second.fileLastWrite < lastWrite)
+         return false;
+
+      CppReferencesByUSR::const_iterator refsIt =
+            it->second.references.find(normalizedUSR(USR));
+      if (refsIt == it->second.references.end())
+         return true;
+
+      FilePath filePath(file);
+      for (const CppReference& reference : refsIt->second)
       {
-         if (matches(term, pattern, def))
-            pDefinitions->push_back(def);
+         FileRange range;
+         range.start = FileLocation(filePath, reference.startLine, reference.startColumn);
+         range.end = FileLocation(filePath, reference.endLine, reference.endColumn);
+         pRefs->push_back(range);
       }
+      return true;
    }
+   END_LOCK_MUTEX
+
+   return false;
 }
 
 Error initializeDefinitionIndex()
@@ -678,6 +1001,7 @@ Error initializeDefinitionIndex()
    if (projectContext().config().buildType == r_util::kBuildTypePackage)
    {
       // read in any index saved on disk
+      s_indexDir = module_context::scopedScratchPath().completeChildPath("cpp-index");
       loadDefinitionIndex();
 
       // check for src and inst/include dirs
@@ -700,7 +1024,7 @@ Error initializeDefinitionIndex()
       // set initialized flag
       s_initialized = true;
 
-      // setup handler to save index at shutdown
+      // setup handler to stop background indexing at shutdown
       module_context::events().onShutdown.connect(onShutdown);
    }
 
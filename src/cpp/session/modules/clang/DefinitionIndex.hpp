@@ -89,6 +89,12 @@ core::libclang::FileLocation findDefinitionLocation(
 void searchDefinitions(const std::string& term,
                        std::vector<CppDefinition>* pDefinitions);
 
+// looks up references to the USR made from the given file in the background
+// index; returns false if there is no up to date index of the file
+bool findIndexedReferences(const std::string& file,
+                           const std::string& USR,
+                           std::vector<core::libclang::FileRange>* pRefs);
+
 core::Error initializeDefinitionIndex();
 
 } // namespace clang
@@ -27,6 +27,7 @@
 
 #include <session/SessionModuleContext.hpp>
 
+#include "DefinitionIndex.hpp"
 #include "RSourceIndex.hpp"
 #include "RCompilationDatabase.hpp"
 
@@ -74,6 +75,58 @@ bool equalUSR(const std::string& USR1, const std::string& USR2)
    }
 }
 
+// determine the range of the identifier which makes the reference
+FileRange referenceRange(CXTranslationUnit tu,
+                         const Cursor& cursor,
+                         const Cursor& referencedCursor)
+{
+   // tokenize to extract identifier location for cursors that
+   // represent larger source constructs
+   FileRange foundRange;
+   libclang::Tokens tokens(tu, cursor.getExtent());
+   std::vector<unsigned> indexes;
+
+   // for constructors & destructors we search backwards so that the
+   // match is for the constructor identifier rather than the class
+   // identifier
+   unsigned numTokens = tokens.numTokens();
+   if (referencedCursor.getKind() == CXCursor_Constructor ||
+       referencedCursor.getKind() == CXCursor_Destructor)
+   {
+      for (unsigned i = 0; i < numTokens; i++)
+         indexes.push_back(numTokens - i - 1);
+   }
+   else
+   {
+      for (unsigned i = 0; i < numTokens; i++)
+         indexes.push_back(i);
+   }
+
+   // cycle through the tokens
+   std::string spelling = cursor.spelling();
+   for (unsigned i : indexes)
+   {
+      Token token = tokens.getToken(i);
+      if (token.kind() == CXToken_Identifier &&
+          token.spelling() == spelling)
+      {
+         // record the range
+         foundRange = token.extent().getFileRange();
+
+         break;
+      }
+   }
+
+   // if we didn't find an identifier that matches use the
+   // original match (i.e. important for constructors where
+   // the 'spelling' of the invocation is the name of the
+   // variable declared)
+   if (foundRange.empty())
+      foundRange = cursor.getExtent().getFileRange();
+
+   return foundRange;
+}
+
 CXChildVisitResult findReferencesVisitor(CXCursor cxCursor,
                                          CXCursor,
                                          CXClientData data)
@@ -100,52 +153,11 @@ CXChildVisitResult findReferencesVisitor(CXCursor cxCursor,
       // check for matching USR
       if (equalUSR(referencedCursor.getUSR(), pData->USR))
       {
-         // tokenize to extract identifier location for cursors that
-         // represent larger source constructs
-         FileRange foundRange;
-         libclang::Tokens tokens(pData->tu, cursor.getExtent());
-         std::vector<unsigned> indexes;
-
-         // for constructors & destructors we search backwards so that the
-         // match is for the constructor identifier rather than the class
-         // identifier
-         unsigned numTokens = tokens.numTokens();
-         if (referencedCursor.getKind() == CXCursor_Constructor ||
-             referencedCursor.getKind() == CXCursor_Destructor)
-         {
-            for (unsigned i = 0; i < numTokens; i++)
-               indexes.push_back(numTokens - i - 1);
-         }
-         else
-         {
-            for (unsigned i = 0; i < numTokens; i++)
-               indexes.push_back(i);
-         }
-
-         // cycle through the tokens
-         for (unsigned i : indexes)
-         {
-            Token token = tokens.getToken(i);
-            if (token.kind() == CXToken_Identifier &&
-                token.spelling() == cursor.spelling())
-            {
-               // record spelling if necessary
-               if (pData->spelling.empty())
-                  pData->spelling = cursor.spelling();
-
-               // record the range
-               foundRange = token.extent().getFileRange();
+         FileRange foundRange = referenceRange(pData->tu, cursor, referencedCursor);
 
-               break;
-            }
-         }
-
-         // if we didn't find an identifier that matches use the
-         // original match (i.e. important for constructors where
-         // the 'spelling' of the invocation is the name of the
-         // variable declared)
-         if (foundRange.empty())
-            foundRange = cursor.getExtent().getFileRange();
+         // record spelling if necessary
+         if (pData->spelling.empty())
+            pData->spelling = cursor.spelling();
 
          // record the range if it's not a duplicate of the previous range
          if (pData->references.empty() ||
@@ -160,6 +172,46 @@ CXChildVisitResult findReferencesVisitor(CXCursor cxCursor,
    return CXChildVisit_Recurse;
 }
 
+struct IndexReferencesData
+{
+   IndexReferencesData(CXTranslationUnit tu, ReferencesByUSR* pReferences)
+      : tu(tu), pReferences(pReferences)
+   {
+   }
+   CXTranslationUnit tu;
+   ReferencesByUSR* pReferences;
+};
+
+CXChildVisitResult indexReferencesVisitor(CXCursor cxCursor,
+                                          CXCursor,
+                                          CXClientData data)
+{
+   IndexReferencesData* pData = (IndexReferencesData*)data;
+
+   Cursor cursor(cxCursor);
+   if (!cursor.isValid())
+      return CXChildVisit_Continue;
+
+   SourceLocation location = cursor.getSourceLocation();
+   if (!location.isFromMainFile())
+      return CXChildVisit_Continue;
+
+   Cursor referencedCursor = cursor.getReferenced();
+   if (referencedCursor.isValid() && referencedCursor.isDeclaration())
+   {
+      std::string USR = referencedCursor.getUSR();
+      if (!USR.empty())
+      {
+         FileRange foundRange = referenceRange(pData->tu, cursor, referencedCursor);
+         std::vector<FileRange>& references = (*pData->pReferences)[normalizedUSR(USR)];
+         if (references.empty() || references.back() != foundRange)
+            references.push_back(foundRange);
+      }
+   }
+
+   return CXChildVisit_Recurse;
+}
+
 class SourceMarkerGenerator
 {
 public:
@@ -314,6 +366,24 @@ void findReferences(std::string USR,
 
 
 
+std::string normalizedUSR(const std::string& USR)
+{
+   // see equalUSR
+   if (boost::algorithm::ends_with(USR, "#"))
+      return USR.substr(0, USR.length() - 1);
+   else
+      return USR;
+}
+
+void indexReferences(CXTranslationUnit tu, ReferencesByUSR* pReferences)
+{
+   IndexReferencesData indexReferencesData(tu, pReferences);
+   libclang::clang().visitChildren(
+               libclang::clang().getTranslationUnitCursor(tu),
+               indexReferencesVisitor,
+               (CXClientData)&indexReferencesData);
+}
+
 core::Error findReferences(const core::libclang::FileLocation& location,
                            std::string* pSpelling,
                            std::vector<core::libclang::FileRange>* pRefs)
@@ -353,6 +423,12 @@ core::Error findReferences(const core::libclang::FileLocation& location,
                            pSpelling,
                            pRefs);
          }
+         // then in the background index of saved files
+         else if (findIndexedReferences(filename, USR, pRefs))
+         {
+            if (pSpelling->empty())
+               *pSpelling = cursor.spelling();
+         }
          else
          {
             // get the compilation arguments for this file and use them to
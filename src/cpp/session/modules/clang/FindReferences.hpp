@@ -16,25 +16,33 @@
 #ifndef SESSION_MODULES_CLANG_FIND_REFERENCES_HPP
 #define SESSION_MODULES_CLANG_FIND_REFERENCES_HPP
 
+#include <map>
+#include <string>
 #include <vector>
 
 #include <shared_core/Error.hpp>
 
+#include <core/libclang/LibClang.hpp>
+
 #include <core/json/JsonRpc.hpp>
  
 namespace rstudio {
-
-namespace core {
-namespace libclang {
-   struct FileLocation;
-   struct FileRange;
-}
-}
-
 namespace session {
 namespace modules {      
 namespace clang {
 
+// references made from the main file of a translation unit, keyed by the
+// normalized USR of the referenced declaration
+typedef std::map<std::string, std::vector<core::libclang::FileRange> > ReferencesByUSR;
+
+// USRs of references to function declarations may carry an extra trailing #;
+// normalizing strips it so that they compare equal to the declaration's USR
+std::string normalizedUSR(const std::string& USR);
+
+// collects all references made from the main file of the translation unit
+// (safe to call from a background thread with its own translation unit)
+void indexReferences(CXTranslationUnit tu, ReferencesByUSR* pReferences);
+
 core::Error findReferences(const core::libclang::FileLocation& location,
                            std::string* pSpelling,
                            std::vector<core::libclang::FileRange>* pRefs);
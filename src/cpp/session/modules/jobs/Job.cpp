@@ -18,12 +18,15 @@
 #include <ctime>
 
 #include <boost/make_shared.hpp>
+#include <boost/weak_ptr.hpp>
 #include <core/json/JsonRpc.hpp>
 
 #include <session/SessionModuleContext.hpp>
 
 #include <r/RExec.hpp>
 
+#include "JobOutputLog.hpp"
+
 #define kJobId          "id"
 #define kJobName        "name"
 #define kJobStatus      "status"
@@ -47,6 +50,9 @@
 #define kJobStateCancelled "cancelled"
 #define kJobStateFailed    "failed"
 
+// how long buffered output may wait before it's written to disk
+#define kOutputFlushDelayMs 1000
+
 using namespace rstudio::core;
 
 namespace rstudio {
@@ -54,6 +60,21 @@ namespace session {
 namespace modules { 
 namespace jobs {
 
+namespace {
+
+void flushOutputLog(boost::weak_ptr<JobOutputLog> pWeakLog)
+{
+   boost::shared_ptr<JobOutputLog> pLog = pWeakLog.lock();
+   if (!pLog)
+      return;
+
+   Error error = pLog->flush();
+   if (error)
+      LOG_ERROR(error);
+}
+
+} // anonymous namespace
+
 Job::Job(const std::string& id,
          time_t recorded,
          time_t started,
@@ -126,7 +147,7 @@ Error Job::reset()
    }
 
    // remove the stored output (cache) from the previous run
-   outputCacheFile().removeIfExists();
+   outputLog().remove();
 
    // emit a formfeed as job output if the client is listening so that output from the previous run
    // is cleared
@@ -363,6 +384,10 @@ void Job::setState(JobState state)
    // if we don't already have it
    if (complete() && completed_ == 0)
       completed_ = ::time(0);
+
+   // a completed job rarely writes more output, so don't hold its output files open
+   if (complete() && pOutputLog_)
+      pOutputLog_->close();
 }
 
 void Job::setListening(bool listening)
@@ -420,6 +445,13 @@ FilePath Job::outputCacheFile()
    return jobCacheFolder().completePath(id_ + "-output.json");
 }
 
+JobOutputLog& Job::outputLog()
+{
+   if (!pOutputLog_)
+      pOutputLog_ = boost::make_shared<JobOutputLog>(outputCacheFile());
+   return *pOutputLog_;
+}
+
 void Job::addOutput(const std::string& output, bool asError)
 {
    // don't bother the client with empty output events
@@ -446,93 +478,29 @@ void Job::addOutput(const std::string& output, bool asError)
    if (!saveOutput_)
       return;
 
-   // look up output file
-   Error error;
-   FilePath outputFile = outputCacheFile();
-
-   // create parent folder if necessary
-   if (!outputFile.getParent().exists())
+   // writes are buffered; make sure they reach the disk shortly even if no more output arrives
+   JobOutputLog& log = outputLog();
+   if (!log.hasUnflushedOutput())
    {
-      error = outputFile.getParent().ensureDirectory();
-      if (error)
-      {
-         LOG_ERROR(error);
-         return;
-      }
+      module_context::scheduleDelayedWork(
+               boost::posix_time::milliseconds(kOutputFlushDelayMs),
+               boost::bind(flushOutputLog, boost::weak_ptr<JobOutputLog>(pOutputLog_)),
+               false);
    }
 
-   // open output file for writing
-   std::shared_ptr<std::ostream> file;
-   error = outputFile.openForWrite(file, false /* don't truncate */);
+   Error error = log.append(type, output);
    if (error)
-   {
       LOG_ERROR(error);
-      return;
-   }
-
-   // create json array with output and write it to the file
-   json::Array contents;
-   contents.push_back(type);
-   contents.push_back(output);
-   contents.write(*file);
-
-   // append a newline (the file is newline-delimited JSON)
-   *file << std::endl;
 }
 
 json::Array Job::output(int position)
 {
-   // read the lines from the file
-   json::Array output;
-   FilePath outputFile = outputCacheFile();
-   std::shared_ptr<std::istream> pIfs;
-   Error error = outputFile.openForRead(pIfs);
-   if (error)
-   {
-      // path not found is expected if the job hasn't produced any output yet
-      if (!isPathNotFoundError(error))
-         LOG_ERROR(error);
-      return json::Array();
-   }
-
-   try
-   {
-      int line = 0;
-      std::string content;
-      json::Value val;
-
-      // reading eof can trigger a failbit
-      pIfs->exceptions(std::istream::badbit);
-
-      // read each line; parse it as JSON and add it to the output array if it's past the sought
-      // position
-      while (!pIfs->eof())
-      {
-         std::getline(*pIfs, content);
-         if (++line > position)
-         {
-            if (!val.parse(content))
-            {
-               output.push_back(val);
-            }
-         }
-      }
-   }
-   catch(const std::exception& e)
-   {
-      error = systemError(boost::system::errc::io_error, 
-                                ERROR_LOCATION);
-      error.addProperty("what", e.what());
-      error.addProperty("path", outputFile.getAbsolutePath());
-      LOG_ERROR(error);
-   }
-
-   return output;
+   return outputLog().read(position);
 }
 
 void Job::cleanup()
 {
-   outputCacheFile().removeIfExists();
+   outputLog().remove();
 }
 
 std::string Job::stateAsString(JobState state)
@@ -0,0 +1,499 @@
+/*
+ * JobOutputLog.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "JobOutputLog.hpp"
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include <shared_core/Error.hpp>
+
+#include <core/Log.hpp>
+
+using namespace rstudio::core;
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace jobs {
+
+namespace {
+
+// the index file is a header holding the number of the first retained entry, followed by the
+// offset of each retained entry in the data file; all are stored as 8 byte integers in native
+// byte order (the index never leaves the machine that wrote it)
+const std::uint64_t kIndexHeaderSize = sizeof(std::uint64_t);
+const std::uint64_t kIndexEntrySize = sizeof(std::uint64_t);
+
+void writeInteger(std::ostream& stream, std::uint64_t value)
+{
+   stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+bool readInteger(std::istream& stream, std::uint64_t* pValue)
+{
+   stream.read(reinterpret_cast<char*>(pValue), sizeof(*pValue));
+   return stream.gcount() == sizeof(*pValue);
+}
+
+bool readIndexEntry(std::istream& index, std::uint64_t entry, std::uint64_t* pOffset)
+{
+   index.clear();
+   index.seekg(static_cast<std::streamoff>(kIndexHeaderSize + entry * kIndexEntrySize));
+   return readInteger(index, pOffset);
+}
+
+Error ioError(const FilePath& filePath, const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::io_error, location);
+   error.addProperty("path", filePath.getAbsolutePath());
+   return error;
+}
+
+} // anonymous namespace
+
+JobOutputLog::JobOutputLog(const FilePath& dataFile, std::uintmax_t maxBytes):
+   dataFile_(dataFile),
+   indexFile_(dataFile.getParent().completePath(dataFile.getStem() + ".idx")),
+   maxBytes_(maxBytes),
+   loaded_(false),
+   firstEntry_(0),
+   entryCount_(0),
+   dataSize_(0),
+   unflushed_(false)
+{
+}
+
+JobOutputLog::~JobOutputLog()
+{
+   try
+   {
+      close();
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+Error JobOutputLog::append(int type, const std::string& output)
+{
+   Error error;
+   if (!loaded_)
+   {
+      error = load();
+      if (error)
+         return error;
+   }
+
+   if (!pData_)
+   {
+      error = openWriters();
+      if (error)
+         return error;
+   }
+
+   json::Array contents;
+   contents.push_back(type);
+   contents.push_back(output);
+   std::string line = contents.write();
+   line.push_back('\n');
+
+   writeInteger(*pIndex_, dataSize_);
+   pData_->write(line.data(), static_cast<std::streamsize>(line.size()));
+   if (pData_->fail() || pIndex_->fail())
+   {
+      // don't leave the streams in a state we can't reason about; the next write reloads the
+      // log from disk
+      pData_.reset();
+      pIndex_.reset();
+      loaded_ = false;
+      return ioError(dataFile_, ERROR_LOCATION);
+   }
+
+   dataSize_ += line.size();
+   entryCount_++;
+   unflushed_ = true;
+
+   if (dataSize_ > maxBytes_ && entryCount_ > 1)
+      return compact();
+
+   return Success();
+}
+
+json::Array JobOutputLog::read(int position)
+{
+   Error error = flush();
+   if (error)
+      LOG_ERROR(error);
+
+   if (!loaded_)
+   {
+      error = load();
+      if (error)
+      {
+         LOG_ERROR(error);
+         return json::Array();
+      }
+   }
+
+   std::uint64_t entry = std::max(firstEntry_, static_cast<std::uint64_t>(std::max(position, 0)));
+   if (entry >= firstEntry_ + entryCount_)
+      return json::Array();
+
+   // find where the entry starts
+   std::uint64_t offset = 0;
+   std::shared_ptr<std::istream> pIndex;
+   error = indexFile_.openForRead(pIndex);
+   if (!error && !readIndexEntry(*pIndex, entry - firstEntry_, &offset))
+      error = ioError(indexFile_, ERROR_LOCATION);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return json::Array();
+   }
+
+   // read it and everything after it
+   std::shared_ptr<std::istream> pData;
+   error = dataFile_.openForRead(pData);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return json::Array();
+   }
+
+   json::Array output;
+   try
+   {
+      pData->exceptions(std::istream::badbit);
+      pData->seekg(static_cast<std::streamoff>(offset));
+
+      std::string content;
+      json::Value val;
+      while (std::getline(*pData, content))
+      {
+         if (!val.parse(content))
+            output.push_back(val);
+      }
+   }
+   catch (const std::exception& e)
+   {
+      error = ioError(dataFile_, ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      LOG_ERROR(error);
+   }
+
+   return output;
+}
+
+Error JobOutputLog::flush()
+{
+   if (!unflushed_)
+      return Success();
+
+   unflushed_ = false;
+   if (!pData_)
+      return Success();
+
+   // flush the data ahead of the index; should a crash leave them out of step, the index is
+   // rebuilt when the log is next loaded
+   pData_->flush();
+   pIndex_->flush();
+   if (pData_->fail() || pIndex_->fail())
+   {
+      pData_.reset();
+      pIndex_.reset();
+      loaded_ = false;
+      return ioError(dataFile_, ERROR_LOCATION);
+   }
+
+   return Success();
+}
+
+bool JobOutputLog::hasUnflushedOutput() const
+{
+   return unflushed_;
+}
+
+void JobOutputLog::close()
+{
+   Error error = flush();
+   if (error)
+      LOG_ERROR(error);
+
+   pData_.reset();
+   pIndex_.reset();
+}
+
+void JobOutputLog::remove()
+{
+   pData_.reset();
+   pIndex_.reset();
+   unflushed_ = false;
+
+   Error error = dataFile_.removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+
+   error = indexFile_.removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+
+   loaded_ = true;
+   firstEntry_ = 0;
+   entryCount_ = 0;
+   dataSize_ = 0;
+}
+
+std::uint64_t JobOutputLog::firstEntry()
+{
+   if (!loaded_)
+   {
+      Error error = load();
+      if (error)
+         LOG_ERROR(error);
+   }
+   return firstEntry_;
+}
+
+std::uint64_t JobOutputLog::nextEntry()
+{
+   return firstEntry() + entryCount_;
+}
+
+Error JobOutputLog::load()
+{
+   firstEntry_ = 0;
+   entryCount_ = 0;
+   dataSize_ = 0;
+
+   if (!dataFile_.exists())
+   {
+      loaded_ = true;
+      return indexFile_.removeIfExists();
+   }
+
+   dataSize_ = dataFile_.getSize();
+
+   // the index is usable if it's well formed and its last entry is the last line of the data
+   // file; otherwise (a crash between writes, or output written before there were indexes) it's
+   // rebuilt from the data
+   bool indexValid = false;
+   std::uintmax_t indexSize = indexFile_.exists() ? indexFile_.getSize() : 0;
+   if (indexSize >= kIndexHeaderSize && (indexSize - kIndexHeaderSize) % kIndexEntrySize == 0)
+   {
+      std::shared_ptr<std::istream> pIndex;
+      Error error = indexFile_.openForRead(pIndex);
+      if (!error && readInteger(*pIndex, &firstEntry_))
+      {
+         entryCount_ = (indexSize - kIndexHeaderSize) / kIndexEntrySize;
+         std::uint64_t lastOffset = 0;
+         if (entryCount_ == 0)
+         {
+            indexValid = dataSize_ == 0;
+         }
+         else if (readIndexEntry(*pIndex, entryCount_ - 1, &lastOffset) && lastOffset < dataSize_)
+         {
+            std::shared_ptr<std::istream> pData;
+            error = dataFile_.openForRead(pData);
+            if (!error)
+            {
+               pData->seekg(static_cast<std::streamoff>(lastOffset));
+               std::string line;
+               indexValid = std::getline(*pData, line) &&
+                            lastOffset + line.size() + 1 == dataSize_ &&
+                            pData->peek() == std::char_traits<char>::eof();
+            }
+         }
+      }
+   }
+
+   if (!indexValid)
+   {
+      Error error = rebuildIndex();
+      if (error)
+         return error;
+   }
+
+   loaded_ = true;
+   return Success();
+}
+
+Error JobOutputLog::rebuildIndex()
+{
+   std::shared_ptr<std::istream> pData;
+   Error error = dataFile_.openForRead(pData);
+   if (error)
+      return error;
+
+   std::vector<std::uint64_t> offsets;
+   std::uint64_t offset = 0;
+   std::string line;
+   bool terminated = true;
+   while (std::getline(*pData, line))
+   {
+      offsets.push_back(offset);
+      offset += line.size();
+      terminated = !pData->eof();
+      if (terminated)
+         offset += 1;
+   }
+   pData.reset();
+
+   // a line torn by a crash is kept as an entry of its own (it won't parse, so it's skipped on
+   // read) rather than having the next entry appended to it
+   if (!terminated)
+   {
+      std::shared_ptr<std::ostream> pOut;
+      error = dataFile_.openForWrite(pOut, false);
+      if (error)
+         return error;
+      *pOut << '\n';
+      offset += 1;
+   }
+
+   std::shared_ptr<std::ostream> pIndex;
+   error = indexFile_.openForWrite(pIndex);
+   if (error)
+      return error;
+
+   writeInteger(*pIndex, firstEntry_);
+   for (std::uint64_t entryOffset : offsets)
+      writeInteger(*pIndex, entryOffset);
+   pIndex->flush();
+   if (pIndex->fail())
+      return ioError(indexFile_, ERROR_LOCATION);
+
+   entryCount_ = offsets.size();
+   dataSize_ = offset;
+   return Success();
+}
+
+Error JobOutputLog::openWriters()
+{
+   Error error = dataFile_.getParent().ensureDirectory();
+   if (error)
+      return error;
+
+   bool newIndex = !indexFile_.exists();
+
+   error = dataFile_.openForWrite(pData_, false);
+   if (!error)
+      error = indexFile_.openForWrite(pIndex_, newIndex);
+   if (error)
+   {
+      pData_.reset();
+      pIndex_.reset();
+      return error;
+   }
+
+   if (newIndex)
+      writeInteger(*pIndex_, firstEntry_);
+
+   return Success();
+}
+
+Error JobOutputLog::compact()
+{
+   Error error = flush();
+   if (error)
+      return error;
+   pData_.reset();
+   pIndex_.reset();
+
+   std::shared_ptr<std::istream> pIndex;
+   error = indexFile_.openForRead(pIndex);
+   if (error)
+      return error;
+
+   // find the first entry to keep: the earliest one after which at most half the maximum size
+   // remains (but always keep the last entry, however large it is)
+   std::uint64_t keepFrom = dataSize_ > maxBytes_ / 2 ? dataSize_ - maxBytes_ / 2 : 0;
+   std::uint64_t low = 0, high = entryCount_ - 1;
+   while (low < high)
+   {
+      std::uint64_t mid = low + (high - low) / 2;
+      std::uint64_t offset = 0;
+      if (!readIndexEntry(*pIndex, mid, &offset))
+         return ioError(indexFile_, ERROR_LOCATION);
+
+      if (offset >= keepFrom)
+         high = mid;
+      else
+         low = mid + 1;
+   }
+
+   std::uint64_t dropped = low;
+   std::uint64_t base = 0;
+   if (dropped == 0 || !readIndexEntry(*pIndex, dropped, &base))
+      return Success();
+
+   // write the retained entries and their index to new files, then move them into place
+   FilePath compactDataFile(dataFile_.getAbsolutePath() + ".compact");
+   FilePath compactIndexFile(indexFile_.getAbsolutePath() + ".compact");
+
+   std::shared_ptr<std::istream> pData;
+   std::shared_ptr<std::ostream> pCompactData, pCompactIndex;
+   error = dataFile_.openForRead(pData);
+   if (!error)
+      error = compactDataFile.openForWrite(pCompactData);
+   if (!error)
+      error = compactIndexFile.openForWrite(pCompactIndex);
+   if (error)
+      return error;
+
+   pData->seekg(static_cast<std::streamoff>(base));
+   *pCompactData << pData->rdbuf();
+
+   writeInteger(*pCompactIndex, firstEntry_ + dropped);
+   pIndex->clear();
+   pIndex->seekg(static_cast<std::streamoff>(kIndexHeaderSize + dropped * kIndexEntrySize));
+   std::uint64_t offset = 0;
+   while (readInteger(*pIndex, &offset))
+      writeInteger(*pCompactIndex, offset - base);
+
+   pCompactData->flush();
+   pCompactIndex->flush();
+   bool failed = pCompactData->fail() || pCompactIndex->fail();
+   pData.reset();
+   pIndex.reset();
+   pCompactData.reset();
+   pCompactIndex.reset();
+   if (failed)
+   {
+      compactDataFile.removeIfExists();
+      compactIndexFile.removeIfExists();
+      return ioError(compactDataFile, ERROR_LOCATION);
+   }
+
+   error = compactDataFile.move(dataFile_, FilePath::MoveDirect, true);
+   if (!error)
+      error = compactIndexFile.move(indexFile_, FilePath::MoveDirect, true);
+   if (error)
+   {
+      // the index no longer matches the data; have it rebuilt on next use
+      loaded_ = false;
+      return error;
+   }
+
+   firstEntry_ += dropped;
+   entryCount_ -= dropped;
+   dataSize_ -= base;
+   return Success();
+}
+
+} // namespace jobs
+} // namespace modules
+} // namespace session
+} // namespace rstudio
@@ -0,0 +1,113 @@
+/*
+ * JobOutputLog.hpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_JOB_OUTPUT_LOG_HPP
+#define SESSION_JOB_OUTPUT_LOG_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include <shared_core/FilePath.hpp>
+#include <shared_core/json/Json.hpp>
+
+namespace rstudio {
+namespace core {
+   class Error;
+}
+}
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace jobs {
+
+// output logs larger than this are compacted by discarding their oldest entries
+constexpr std::uintmax_t kJobOutputLogMaxBytes = 64 * 1024 * 1024;
+
+/**
+ * JobOutputLog stores the output of a job as newline-delimited JSON, one [type, output] array per
+ * entry. Alongside it is an index file holding the offset of each entry, so that output can be
+ * read from any position without scanning what comes before it.
+ *
+ * The log keeps its files open between writes and buffers them; call flush() to write buffered
+ * output, or close() to flush it and release the files (they are reopened on the next write).
+ *
+ * Entries are numbered from the first ever written. When the log grows past its maximum size, the
+ * oldest entries are discarded so that roughly half the maximum remains; the numbers of the
+ * remaining entries don't change.
+ */
+class JobOutputLog : boost::noncopyable
+{
+public:
+   JobOutputLog(const core::FilePath& dataFile,
+                std::uintmax_t maxBytes = kJobOutputLogMaxBytes);
+   ~JobOutputLog();
+
+   // append an entry to the log
+   core::Error append(int type, const std::string& output);
+
+   // read the entries from the given position onwards; positions before the first retained entry
+   // read from the first retained entry
+   core::json::Array read(int position);
+
+   // write any buffered output to disk
+   core::Error flush();
+
+   // whether there's buffered output which hasn't been written to disk
+   bool hasUnflushedOutput() const;
+
+   // flush and close the files; they are reopened as needed
+   void close();
+
+   // close and delete the files, discarding all entries
+   void remove();
+
+   // the number of the first retained entry, and the number of the entry which will be written
+   // next
+   std::uint64_t firstEntry();
+   std::uint64_t nextEntry();
+
+private:
+   core::Error load();
+   core::Error rebuildIndex();
+   core::Error openWriters();
+   core::Error compact();
+
+   core::FilePath dataFile_;
+   core::FilePath indexFile_;
+   std::uintmax_t maxBytes_;
+
+   // whether the state below reflects the files on disk
+   bool loaded_;
+
+   std::uint64_t firstEntry_;
+   std::uint64_t entryCount_;
+   std::uint64_t dataSize_;
+   bool unflushed_;
+
+   std::shared_ptr<std::ostream> pData_;
+   std::shared_ptr<std::ostream> pIndex_;
+};
+
+} // namespace jobs
+} // namespace modules
+} // namespace session
+} // namespace rstudio
+
+#endif // SESSION_JOB_OUTPUT_LOG_HPP
@@ -0,0 +1,131 @@
+/*
+ * JobOutputLogTests.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "JobOutputLog.hpp"
+
+#include <core/FileSerializer.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace jobs {
+namespace tests {
+
+using namespace rstudio::core;
+
+namespace {
+
+std::string entryText(const json::Array& entries, std::size_t i)
+{
+   return entries[i].getArray()[1].getString();
+}
+
+} // anonymous namespace
+
+TEST_CASE("JobOutputLog")
+{
+   FilePath dirPath;
+   REQUIRE_FALSE(FilePath::tempFilePath(dirPath));
+   FilePath dataFile = dirPath.completeChildPath("job-output.json");
+
+   SECTION("Output can be read from any position")
+   {
+      JobOutputLog log(dataFile);
+      for (int i = 0; i < 100; i++)
+         REQUIRE_FALSE(log.append(i % 2, "line " + std::to_string(i) + "\n"));
+
+      json::Array entries = log.read(0);
+      REQUIRE(entries.getSize() == 100);
+      expect_true(entries[3].getArray()[0].getInt() == 1);
+      expect_true(entryText(entries, 3) == "line 3\n");
+
+      entries = log.read(97);
+      REQUIRE(entries.getSize() == 3);
+      expect_true(entryText(entries, 0) == "line 97\n");
+      expect_true(log.read(100).isEmpty());
+
+      // a second log over the same files sees the same output
+      log.close();
+      JobOutputLog reopened(dataFile);
+      expect_true(reopened.nextEntry() == 100);
+      expect_true(entryText(reopened.read(50), 0) == "line 50\n");
+   }
+
+   SECTION("Output written without an index is indexed when loaded")
+   {
+      REQUIRE_FALSE(dirPath.ensureDirectory());
+      REQUIRE_FALSE(core::writeStringToFile(dataFile,
+                                            "[0,\"one\"]\n"
+                                            "[1,\"two\"]\n"
+                                            "[0,\"thr"));
+
+      JobOutputLog log(dataFile);
+      REQUIRE_FALSE(log.append(0, "four"));
+
+      // the torn entry is skipped, but still counted
+      json::Array entries = log.read(1);
+      REQUIRE(entries.getSize() == 2);
+      expect_true(entryText(entries, 0) == "two");
+      expect_true(entryText(entries, 1) == "four");
+      expect_true(log.nextEntry() == 4);
+   }
+
+   SECTION("Oldest output is discarded when the log grows too large")
+   {
+      JobOutputLog log(dataFile, 1000);
+      std::string line(90, 'x');
+      for (int i = 0; i < 50; i++)
+         REQUIRE_FALSE(log.append(0, std::to_string(i) + line));
+
+      // entries keep their numbers after older ones are discarded
+      expect_true(dataFile.getSize() <= 1000);
+      expect_true(log.firstEntry() > 0);
+      expect_true(log.nextEntry() == 50);
+
+      json::Array entries = log.read(0);
+      REQUIRE(entries.getSize() == log.nextEntry() - log.firstEntry());
+      expect_true(entryText(entries, 0) == std::to_string(log.firstEntry()) + line);
+
+      entries = log.read(48);
+      REQUIRE(entries.getSize() == 2);
+      expect_true(entryText(entries, 0) == "48" + line);
+
+      // the compacted log is read back as it was written
+      log.close();
+      JobOutputLog reopened(dataFile, 1000);
+      expect_true(reopened.firstEntry() == log.firstEntry());
+      expect_true(entryText(reopened.read(49), 0) == "49" + line);
+   }
+
+   SECTION("Removing the log discards its output")
+   {
+      JobOutputLog log(dataFile);
+      REQUIRE_FALSE(log.append(0, "output"));
+      log.remove();
+      expect_false(dataFile.exists());
+      expect_true(log.read(0).isEmpty());
+      expect_true(log.nextEntry() == 0);
+   }
+
+   dirPath.removeIfExists();
+}
+
+} // namespace tests
+} // namespace jobs
+} // namespace modules
+} // namespace session
+} // namespace rstudio
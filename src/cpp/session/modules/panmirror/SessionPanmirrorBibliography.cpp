@@ -16,6 +16,7 @@
 #include "SessionPanmirrorBibliography.hpp"
 
 #include <boost/bind/bind.hpp>
+#include <boost/make_shared.hpp>
 
 #include <shared_core/Error.hpp>
 #include <shared_core/Hash.hpp>
@@ -330,82 +331,210 @@ json::Object createBiblioJson(const json::Array& jsonCitations, bool project)
    return biblioJson;
 }
 
-void indexProjectCompleted(const std::vector<core::FileInfo>& biblioFiles,
-                           const core::system::ProcessResult& result)
+// maximum number of pandoc processes converting bibliographies at once
+const int kMaxConcurrentConversions = 4;
+
+// invoked with the CSL-JSON for a conversion, or with the error (or failed
+// pandoc result) that prevented it
+typedef boost::function<void(const Error&,
+                             const core::system::ProcessResult&,
+                             const json::Array&)> CslConversionCallback;
+
+std::string contentHash(const std::string& contents)
 {
-   if (result.exitStatus == EXIT_SUCCESS)
+   return hash::crc32HexHash(contents) + "-" + std::to_string(contents.size());
+}
+
+FilePath cslStoragePath()
+{
+   FilePath path = module_context::scopedScratchPath().completeChildPath("bibliography-index/csl");
+   Error error = path.ensureDirectory();
+   if (error)
+      LOG_ERROR(error);
+   return path;
+}
+
+// caches the CSL-JSON for each bibliography file (in memory and in the project
+// scratch dir), keyed by a hash of the file's contents, so that only files whose
+// contents have changed need to be converted again
+class CslCache
+{
+public:
+   // returns true (and the cached CSL-JSON) if the file's contents are unchanged
+   // since it was last converted; pHash receives the hash of its current contents
+   bool lookup(const FileInfo& file, std::string* pHash, json::Array* pCsl)
    {
-      json::Array jsonCitations;
-      Error error = jsonCitations.parse(result.stdOut);
-      if (!error)
-      {
-         // create bibliography
-         json::Object biblioJson = createBiblioJson(jsonCitations, true);
+      const std::string& path = file.absolutePath();
 
-         // cache it
-         s_biblioCache.update(biblioJson, biblioFiles, "");
+      auto it = entries_.find(path);
+      if (it == entries_.end())
+      {
+         Entry entry;
+         if (readEntry(path, &entry))
+            it = entries_.insert(std::make_pair(path, entry)).first;
+      }
 
-         // status
-         logBiblioStatus("Indexed and updated project bibliography");
+      // file is unchanged since we last hashed it
+      if (it != entries_.end() &&
+          it->second.lastWriteTime == file.lastWriteTime() &&
+          it->second.size == file.size())
+      {
+         *pHash = it->second.hash;
+         *pCsl = it->second.csl;
+         return true;
       }
-      else
+
+      std::string contents;
+      Error error = readStringFromFile(FilePath(path), &contents);
+      if (error)
       {
          LOG_ERROR(error);
+         pHash->clear();
+         return false;
+      }
+
+      *pHash = contentHash(contents);
+
+      // file was touched (or rewritten) without changing its contents
+      if (it != entries_.end() && it->second.hash == *pHash)
+      {
+         it->second.lastWriteTime = file.lastWriteTime();
+         it->second.size = file.size();
+         *pCsl = it->second.csl;
+         writeEntry(path, it->second);
+         return true;
       }
+
+      return false;
    }
-   else
+
+   void update(const FileInfo& file, const std::string& hash, const json::Array& csl)
    {
-      Error error = systemError(boost::system::errc::state_not_recoverable, ERROR_LOCATION);
-      error.addProperty("stderr", result.stdErr);
-      LOG_ERROR(error);
+      if (hash.empty())
+         return;
+
+      Entry& entry = entries_[file.absolutePath()];
+      entry.hash = hash;
+      entry.lastWriteTime = file.lastWriteTime();
+      entry.size = file.size();
+      entry.csl = csl;
+      writeEntry(file.absolutePath(), entry);
    }
-}
 
-void bibliographiesToCslJson(
-  bool isProjectFile,
-  const std::vector<core::FileInfo>& biblioFiles,
-  const std::string& refBlock,
-  std::vector<core::FileInfo> biblioQueue,
-  json::Array cslJson,
-  const json::JsonRpcFunctionContinuation& cont,
-  const boost::optional<core::system::ProcessResult> result = boost::none
-) {
-
-   // process any result we receive
-   if (result.has_value())
-   {
-      json::JsonRpcResponse response;
-      if (result.value().exitStatus == EXIT_SUCCESS)
+private:
+   struct Entry
+   {
+      Entry() : lastWriteTime(0), size(0) {}
+
+      std::string hash;
+      std::time_t lastWriteTime;
+      uintmax_t size;
+      json::Array csl;
+   };
+
+   static FilePath entryPath(const std::string& path)
+   {
+      return cslStoragePath().completeChildPath(hash::crc32HexHash(path) + ".json");
+   }
+
+   static bool readEntry(const std::string& path, Entry* pEntry)
+   {
+      FilePath entryFile = entryPath(path);
+      if (!entryFile.exists())
+         return false;
+
+      std::string contents;
+      json::Object entryJson;
+      Error error = readStringFromFile(entryFile, &contents);
+      if (!error)
+         error = entryJson.parse(contents);
+      if (error)
       {
-         json::Array jsonCitations;
-         if (json::parseJsonForResponse(result.value().stdOut, &jsonCitations, &response))
-            std::copy(jsonCitations.begin(), jsonCitations.end(), std::back_inserter(cslJson));
+         LOG_ERROR(error);
+         return false;
       }
-      else
+
+      // guard against a (crc32) collision between paths
+      std::string entryPathName;
+      double lastWriteTime = 0, size = 0;
+      error = json::readObject(entryJson,
+                               "path", entryPathName,
+                               "hash", pEntry->hash,
+                               "last_write_time", lastWriteTime,
+                               "size", size,
+                               "csl", pEntry->csl);
+      if (error || entryPathName != path)
+         return false;
+
+      pEntry->lastWriteTime = static_cast<std::time_t>(lastWriteTime);
+      pEntry->size = static_cast<uintmax_t>(size);
+      return true;
+   }
+
+   static void writeEntry(const std::string& path, const Entry& entry)
+   {
+      json::Object entryJson;
+      entryJson["path"] = path;
+      entryJson["hash"] = entry.hash;
+      entryJson["last_write_time"] = static_cast<double>(entry.lastWriteTime);
+      entryJson["size"] = static_cast<double>(entry.size);
+      entryJson["csl"] = entry.csl;
+
+      Error error = writeString(entryPath(path), entryJson.write());
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   std::map<std::string, Entry> entries_;
+};
+CslCache s_cslCache;
+
+// CSL-JSON for the most recently converted reference block
+std::string s_refBlockHash;
+json::Array s_refBlockCsl;
+
+// runs pandoc to convert bibliographies to CSL-JSON, with a bounded number of
+// conversions in flight at once. requests to convert the same contents while
+// a conversion is already running share its result
+class CslConverter
+{
+public:
+   CslConverter() : running_(0) {}
+
+   void convert(const FilePath& biblioPath,
+                const std::string& key,
+                const CslConversionCallback& callback)
+   {
+      auto it = waiters_.find(key);
+      if (it != waiters_.end())
       {
-         LOG_ERROR_MESSAGE("Error converting to csjson: " + result.value().stdErr);
-         json::setProcessErrorResponse(result.value(), ERROR_LOCATION, &response);
-         cont(Success(), &response);
+         it->second.push_back(callback);
          return;
       }
+
+      waiters_[key].push_back(callback);
+      queue_.push_back(std::make_pair(biblioPath, key));
+      launchNext();
    }
 
-   // get next target
-   if (biblioQueue.size() > 0)
+private:
+   void launchNext()
    {
-      FileInfo biblioFile = biblioQueue.front();
-      biblioQueue.erase(biblioQueue.begin());
-      if (FilePath::exists(biblioFile.absolutePath()))
+      while (running_ < kMaxConcurrentConversions && !queue_.empty())
       {
+         FilePath biblioPath = queue_.front().first;
+         std::string key = queue_.front().second;
+         queue_.pop_front();
+
          std::vector<std::string> args;
-         args.push_back(string_utils::utf8ToSystem(biblioFile.absolutePath()));
+         args.push_back(string_utils::utf8ToSystem(biblioPath.getAbsolutePath()));
          args.push_back("--standalone");
-         if (isYAMLBibliography(FilePath(biblioFile.absolutePath())))
+         if (isYAMLBibliography(biblioPath))
          {
             args.push_back("--from");
             args.push_back("markdown");
          }
-         else if (isJSONBibliography(FilePath(biblioFile.absolutePath())))
+         else if (isJSONBibliography(biblioPath))
          {
             args.push_back("--from");
             args.push_back("csljson");
@@ -413,50 +542,268 @@ void bibliographiesToCslJson(
          args.push_back("--to");
          args.push_back("csljson");
 
-         // run pandoc and call ourselves back when done
          Error error = module_context::runPandocAsync(
-            args, "", boost::bind(bibliographiesToCslJson, isProjectFile, biblioFiles, refBlock, biblioQueue, cslJson, cont, _1)
-         );
+            args, "", boost::bind(&CslConverter::onCompleted, this, key, _1));
          if (error)
          {
-            json::JsonRpcResponse response;
-            json::setErrorResponse(error, &response);
-            cont(Success(), &response);
-            return;
+            notify(key, error, core::system::ProcessResult(), json::Array());
+            continue;
          }
+
+         ++running_;
+      }
+   }
+
+   void onCompleted(const std::string& key, const core::system::ProcessResult& result)
+   {
+      --running_;
+
+      json::Array csl;
+      Error error;
+      if (result.exitStatus == EXIT_SUCCESS)
+      {
+         error = csl.parse(result.stdOut);
       }
       else
       {
-         // bibliography didn't exist, call ourselves back w/ updated queue
-         bibliographiesToCslJson(
-            isProjectFile,
-            biblioFiles,
-            refBlock,
-            biblioQueue,
-            cslJson,
-            cont
-         );
+         LOG_ERROR_MESSAGE("Error converting to csjson: " + result.stdErr);
       }
+
+      notify(key, error, result, csl);
+      launchNext();
    }
 
-   // queue is empty so we are done, cache and return the csl json bibliography
-   else
+   void notify(const std::string& key,
+               const Error& error,
+               const core::system::ProcessResult& result,
+               const json::Array& csl)
    {
-      // create bibliography
-      json::Object biblioJson = createBiblioJson(cslJson, isProjectFile);
+      std::vector<CslConversionCallback> callbacks;
+      auto it = waiters_.find(key);
+      if (it == waiters_.end())
+         return;
 
-      // cache last successful bibliograpy
-      s_biblioCache.update(biblioJson, biblioFiles, refBlock);
+      callbacks.swap(it->second);
+      waiters_.erase(it);
 
-      // status
-      logBiblioStatus("Cached getBibliography response");
+      for (const CslConversionCallback& callback : callbacks)
+         callback(error, result, csl);
+   }
 
-      // set response
-      json::JsonRpcResponse response;
-      s_biblioCache.setResponse(&response);
+   int running_;
+   std::deque<std::pair<FilePath, std::string> > queue_;
+   std::map<std::string, std::vector<CslConversionCallback> > waiters_;
+};
+CslConverter s_cslConverter;
+
+// the state of converting a set of bibliographies
+struct BiblioConversion
+{
+   explicit BiblioConversion(const CslConversionCallback& onCompleted)
+      : remaining(0), failed(false), onCompleted(onCompleted)
+   {
+   }
+
+   // CSL-JSON for each bibliography, in order
+   std::vector<json::Array> parts;
+
+   // number of parts which still need to be converted
+   std::size_t remaining;
+
+   bool failed;
+
+   CslConversionCallback onCompleted;
+};
+
+void completeBiblioConversion(boost::shared_ptr<BiblioConversion> pConversion)
+{
+   json::Array cslJson;
+   for (const json::Array& part : pConversion->parts)
+      std::copy(part.begin(), part.end(), std::back_inserter(cslJson));
+
+   pConversion->onCompleted(Success(), core::system::ProcessResult(), cslJson);
+}
+
+void onBiblioPartConverted(boost::shared_ptr<BiblioConversion> pConversion,
+                           std::size_t index,
+                           const boost::function<void(const json::Array&)>& cacheResult,
+                           const Error& error,
+                           const core::system::ProcessResult& result,
+                           const json::Array& csl)
+{
+   if (pConversion->failed)
+      return;
+
+   if (error || result.exitStatus != EXIT_SUCCESS)
+   {
+      pConversion->failed = true;
+      pConversion->onCompleted(error, result, json::Array());
+      return;
+   }
+
+   pConversion->parts[index] = csl;
+   cacheResult(csl);
+
+   if (--pConversion->remaining == 0)
+      completeBiblioConversion(pConversion);
+}
+
+void cacheRefBlockCsl(const std::string& hash, const json::Array& csl)
+{
+   s_refBlockHash = hash;
+   s_refBlockCsl = csl;
+}
+
+// converts the bibliographies (and the reference block, if any) to CSL-JSON,
+// only running pandoc for those whose contents have changed since they were
+// last converted, and combines the results in order
+void bibliographiesToCslJson(const std::vector<core::FileInfo>& biblioFiles,
+                             const std::string& refBlock,
+                             const CslConversionCallback& onCompleted)
+{
+   boost::shared_ptr<BiblioConversion> pConversion =
+         boost::make_shared<BiblioConversion>(onCompleted);
+
+   struct PendingPart
+   {
+      std::size_t index;
+      FilePath sourcePath;
+      std::string key;
+      boost::function<void(const json::Array&)> cacheResult;
+   };
+   std::vector<PendingPart> pending;
+
+   for (const FileInfo& biblioFile : biblioFiles)
+   {
+      if (!FilePath::exists(biblioFile.absolutePath()))
+         continue;
+
+      std::size_t index = pConversion->parts.size();
+      pConversion->parts.push_back(json::Array());
+
+      std::string hash;
+      if (s_cslCache.lookup(biblioFile, &hash, &pConversion->parts.back()))
+         continue;
+
+      PendingPart part;
+      part.index = index;
+      part.sourcePath = FilePath(biblioFile.absolutePath());
+      part.key = biblioFile.absolutePath() + ":" + hash;
+      part.cacheResult = boost::bind(&CslCache::update, &s_cslCache, biblioFile, hash, _1);
+      pending.push_back(part);
+   }
+
+   if (!refBlock.empty())
+   {
+      std::size_t index = pConversion->parts.size();
+      pConversion->parts.push_back(json::Array());
+
+      std::string hash = contentHash(refBlock);
+      if (hash == s_refBlockHash)
+      {
+         pConversion->parts.back() = s_refBlockCsl;
+      }
+      else
+      {
+         FilePath refBlockYaml = module_context::tempFile("biblio", "yaml");
+         Error error = writeStringToFile(refBlockYaml, refBlock);
+         if (error)
+         {
+            LOG_ERROR(error);
+         }
+         else
+         {
+            PendingPart part;
+            part.index = index;
+            part.sourcePath = refBlockYaml;
+            part.key = "refblock:" + hash;
+            part.cacheResult = boost::bind(cacheRefBlockCsl, hash, _1);
+            pending.push_back(part);
+         }
+      }
+   }
+
+   logBiblioStatus("Converting " + std::to_string(pending.size()) + " of " +
+                   std::to_string(pConversion->parts.size()) + " bibliographies");
+
+   pConversion->remaining = pending.size();
+   if (pending.empty())
+   {
+      completeBiblioConversion(pConversion);
+      return;
+   }
+
+   for (const PendingPart& part : pending)
+   {
+      s_cslConverter.convert(
+               part.sourcePath,
+               part.key,
+               boost::bind(onBiblioPartConverted, pConversion, part.index, part.cacheResult, _1, _2, _3));
+   }
+}
+
+void onGetBibliographyConverted(bool isProjectFile,
+                                const std::vector<core::FileInfo>& biblioFiles,
+                                const std::string& refBlock,
+                                const json::JsonRpcFunctionContinuation& cont,
+                                const Error& error,
+                                const core::system::ProcessResult& result,
+                                const json::Array& cslJson)
+{
+   json::JsonRpcResponse response;
+   if (error)
+   {
+      json::setErrorResponse(error, &response);
+      cont(Success(), &response);
+      return;
+   }
+   else if (result.exitStatus != EXIT_SUCCESS)
+   {
+      json::setProcessErrorResponse(result, ERROR_LOCATION, &response);
       cont(Success(), &response);
+      return;
+   }
+
+   // create bibliography
+   json::Object biblioJson = createBiblioJson(cslJson, isProjectFile);
+
+   // cache last successful bibliograpy
+   s_biblioCache.update(biblioJson, biblioFiles, refBlock);
+
+   // status
+   logBiblioStatus("Cached getBibliography response");
+
+   // set response
+   s_biblioCache.setResponse(&response);
+   cont(Success(), &response);
+}
+
+void indexProjectCompleted(const std::vector<core::FileInfo>& biblioFiles,
+                           const Error& error,
+                           const core::system::ProcessResult& result,
+                           const json::Array& cslJson)
+{
+   if (error)
+   {
+      LOG_ERROR(error);
+   }
+   else if (result.exitStatus != EXIT_SUCCESS)
+   {
+      Error error = systemError(boost::system::errc::state_not_recoverable, ERROR_LOCATION);
+      error.addProperty("stderr", result.stdErr);
+      LOG_ERROR(error);
    }
+   else
+   {
+      // create bibliography
+      json::Object biblioJson = createBiblioJson(cslJson, true);
 
+      // cache it
+      s_biblioCache.update(biblioJson, biblioFiles, "");
+
+      // status
+      logBiblioStatus("Indexed and updated project bibliography");
+   }
 }
 
 
@@ -546,33 +893,13 @@ void pandocGetBibliography(const json::JsonRpcRequest& request,
       return;
    }
 
-   // create queue from biblio files and refBlock
-   std::vector<FileInfo> biblioQueue = biblioFiles;
-   if (!refBlock.empty())
-   {
-      FilePath refBlockYaml = module_context::tempFile("biblio", "yaml");
-      Error error = writeStringToFile(refBlockYaml, refBlock);
-      if (error)
-      {
-         LOG_ERROR(error);
-      }
-      else
-      {
-         FileInfo targetBiblio = FileInfo(refBlockYaml);
-         biblioQueue.push_back(targetBiblio);
-      }
-   }
-
-   // process the queue
-   if (biblioQueue.size() > 0)
+   // convert the bibliographies (reusing the CSL-JSON of those which haven't changed)
+   if (biblioFiles.size() > 0 || !refBlock.empty())
    {
       bibliographiesToCslJson(
-         isProjectFile,
          biblioFiles,
          refBlock,
-         biblioQueue,
-         json::Array(),
-         cont
+         boost::bind(onGetBibliographyConverted, isProjectFile, biblioFiles, refBlock, cont, _1, _2, _3)
       );
    }
    else
@@ -910,18 +1237,7 @@ Error pandocCitationHTML(const json::JsonRpcRequest& request, json::JsonRpcRespo
 void updateProjectBibliography()
 {
    std::vector<FileInfo> biblioFiles = projectBibliographies();
-   std::vector<std::string> args;
-   for (auto biblioFile : biblioFiles)
-   {
-      if (FilePath::exists(biblioFile.absolutePath()))
-         args.push_back(string_utils::utf8ToSystem(biblioFile.absolutePath()));
-   }
-   args.push_back("--standalone");
-   args.push_back("--to");
-   args.push_back("csljson");
-   Error error = module_context::runPandocAsync(args, "", boost::bind(indexProjectCompleted, biblioFiles, _1));
-   if (error)
-      LOG_ERROR(error);
+   bibliographiesToCslJson(biblioFiles, "", boost::bind(indexProjectCompleted, biblioFiles, _1, _2, _3));
 }
 
 void onCheckForBiblioChange(const std::vector<FileInfo>& biblioFiles,
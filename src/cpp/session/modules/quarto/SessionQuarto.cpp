@@ -16,16 +16,22 @@
 #include "SessionQuarto.hpp"
 
 #include <string>
+#include <tuple>
+
+#include <boost/optional.hpp>
 
 #include <yaml-cpp/yaml.h>
 
 #include <shared_core/Error.hpp>
 #include <shared_core/FilePath.hpp>
+#include <shared_core/Hash.hpp>
+#include <shared_core/SafeConvert.hpp>
 #include <shared_core/json/Json.hpp>
 
 #include <r/RExec.hpp>
 #include <r/RRoutines.hpp>
 
+#include <core/BoostThread.hpp>
 #include <core/Exec.hpp>
 #include <core/Version.hpp>
 #include <core/YamlUtil.hpp>
@@ -225,6 +231,39 @@ std::tuple<FilePath,Version,bool> userInstalledQuarto()
    return std::make_tuple(FilePath(), Version(), false);
 }
 
+// A user installed quarto found ahead of initialization (see findUserInstalledQuarto), along
+// with the environment it was found in.
+struct PrefetchedQuarto
+{
+   std::string path;
+   std::string rstudioQuarto;
+   std::tuple<FilePath,Version,bool> userInstalled;
+};
+
+boost::mutex s_prefetchedQuartoMutex;
+boost::optional<PrefetchedQuarto> s_prefetchedQuarto;
+
+// Returns the user installed quarto, using the one found ahead of initialization if it was
+// found with the same PATH and RSTUDIO_QUARTO.
+std::tuple<FilePath,Version,bool> detectUserInstalledQuarto()
+{
+   boost::optional<PrefetchedQuarto> prefetched;
+   LOCK_MUTEX(s_prefetchedQuartoMutex)
+   {
+      prefetched.swap(s_prefetchedQuarto);
+   }
+   END_LOCK_MUTEX
+
+   if (prefetched &&
+       prefetched->path == core::system::getenv("PATH") &&
+       prefetched->rstudioQuarto == core::system::getenv(kRStudioQuarto))
+   {
+      return prefetched->userInstalled;
+   }
+
+   return userInstalledQuarto();
+}
+
 core::FilePath quartoConfigFilePath(const FilePath& dirPath)
 {
    FilePath quartoYml = dirPath.completePath("_quarto.yml");
@@ -253,7 +292,7 @@ void detectQuartoInstallation()
    s_quartoVersion = "";
 
    // detect user installed version
-   auto userInstalled = userInstalledQuarto();
+   auto userInstalled = detectUserInstalledQuarto();
    s_userInstalledPath = std::get<0>(userInstalled);
    s_quartoVersion = std::get<1>(userInstalled);
    bool prepend = std::get<2>(userInstalled);
@@ -431,6 +470,75 @@ Error runQuarto(const std::vector<std::string>& args,
 }
 
 
+// quarto inspect boots quarto's runtime for each call, and the same files are
+// inspected repeatedly (editor, preview, publishing), so results are cached.
+struct InspectMetrics
+{
+   int hits = 0;
+   int misses = 0;
+   double hitMs = 0;
+   double missMs = 0;
+};
+
+modules::quarto::InspectCache s_inspectCache;
+InspectMetrics s_inspectMetrics;
+
+// project config (including profile variants such as _quarto-production.yml),
+// directory metadata, and project environment files
+bool isQuartoMetadataFile(const FilePath& filePath)
+{
+   using namespace boost::algorithm;
+
+   std::string filename = filePath.getFilename();
+   bool isYaml = ends_with(filename, ".yml") || ends_with(filename, ".yaml");
+   if (isYaml && (starts_with(filename, "_quarto.") || starts_with(filename, "_quarto-")))
+      return true;
+   if (filename == "_metadata.yml" || filename == "_metadata.yaml")
+      return true;
+   return filename == "_environment" || starts_with(filename, "_environment-") ||
+          filename == "_environment.local";
+}
+
+// whether a document's content comes (in part) from other files
+bool hasIncludeShortcode(const std::string& contents)
+{
+   static const boost::regex reInclude("\\{\\{<\\s*(include|embed)\\s");
+   return regex_utils::search(contents, reInclude);
+}
+
+double elapsedMs(const boost::posix_time::ptime& since)
+{
+   using namespace boost::posix_time;
+   return (microsec_clock::universal_time() - since).total_microseconds() / 1000.0;
+}
+
+void onInspectCacheFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   s_inspectCache.onFilesChanged(events);
+}
+
+void onInspectCacheMonitoringDisabled()
+{
+   s_inspectCache.clear();
+}
+
+SEXP rs_quartoInspectMetrics()
+{
+   const InspectMetrics& metrics = s_inspectMetrics;
+   int total = metrics.hits + metrics.misses;
+
+   json::Object metricsJson;
+   metricsJson["hits"] = metrics.hits;
+   metricsJson["misses"] = metrics.misses;
+   metricsJson["hit_rate"] = total > 0 ? double(metrics.hits) / total : 0.0;
+   metricsJson["mean_hit_ms"] = metrics.hits > 0 ? metrics.hitMs / metrics.hits : 0.0;
+   metricsJson["mean_miss_ms"] = metrics.misses > 0 ? metrics.missMs / metrics.misses : 0.0;
+   metricsJson["entries"] = static_cast<int>(s_inspectCache.size());
+
+   r::sexp::Protect protect;
+   return r::sexp::create(metricsJson, &protect);
+}
+
 Error quartoExec(const std::vector<std::string>& args,
                  const core::FilePath& workingDir,
                  core::system::ProcessResult* pResult)
@@ -683,36 +791,32 @@ SEXP rs_quartoFileProject(SEXP basenameSEXP, SEXP dirnameSEXP)
    std::string dirname = r::sexp::safeAsString(dirnameSEXP);
 
    json::Object jsonInspect;
-   std::string output;
-   core::system::ProcessResult result;
-   Error error = runQuarto({"inspect", basename}, FilePath(dirname), &result);
+   Error error = quartoInspect(
+      FilePath(dirname).completeChildPath(basename).getAbsolutePath(), &jsonInspect
+   );
    if (!error)
    {
-      error = jsonInspect.parse(result.stdOut);
-      if (!error)
+      json::Value proj = jsonInspect["project"];
+      if (proj.isString())
       {
-         json::Value proj = jsonInspect["project"];
-         if (proj.isString())
-         {
-            project.push_back(proj.getString());
-         }
-         // Schema changed in Quarto v1.2
-         else if (proj.isObject())
+         project.push_back(proj.getString());
+      }
+      // Schema changed in Quarto v1.2
+      else if (proj.isObject())
+      {
+         json::Value dir = proj.getObject()["dir"];
+         if (dir.isString())
          {
-            json::Value dir = proj.getObject()["dir"];
-            if (dir.isString())
-            {
-               FilePath inspectedFileDir(dirname);
-               FilePath projectDir(dir.getString());
-               std::string projectDirRelative = projectDir.getRelativePath(inspectedFileDir);
-               if (projectDirRelative == ".")
-                  projectDirRelative = "";
-               project.push_back(projectDirRelative);
-            }
+            FilePath inspectedFileDir(dirname);
+            FilePath projectDir(dir.getString());
+            std::string projectDirRelative = projectDir.getRelativePath(inspectedFileDir);
+            if (projectDirRelative == ".")
+               projectDirRelative = "";
+            project.push_back(projectDirRelative);
          }
-
-         jsonInspect["resources"].getArray().toVectorString(resources);   
       }
+
+      jsonInspect["resources"].getArray().toVectorString(resources);   
    }
    
    r::sexp::Protect protect;
@@ -972,8 +1076,21 @@ json::Value quartoCapabilities()
 Error quartoInspect(const std::string& path,
                     json::Object *pResultObject)
 {
+   using namespace boost::posix_time;
+   ptime start = microsec_clock::universal_time();
+
+   // Use the cached result if the file and its metadata are unchanged
+   FilePath targetPath(path);
+   std::string key = modules::quarto::InspectCache::key(
+      targetPath, s_quartoPath.getAbsolutePath() + "@" + s_quartoVersion);
+   if (s_inspectCache.find(targetPath, key, pResultObject))
+   {
+      s_inspectMetrics.hits++;
+      s_inspectMetrics.hitMs += elapsedMs(start);
+      return Success();
+   }
+
    // Run quarto and retrieve metadata
-   std::string output;
    core::system::ProcessResult result;
    Error error = runQuarto({"inspect", path}, FilePath(), &result);
    if (error)
@@ -982,7 +1099,21 @@ Error quartoInspect(const std::string& path,
    }
 
    // Parse JSON result
-   return pResultObject->parse(result.stdOut);
+   error = pResultObject->parse(result.stdOut);
+   if (error)
+      return error;
+
+   double ms = elapsedMs(start);
+   s_inspectMetrics.misses++;
+   s_inspectMetrics.missMs += ms;
+   LOG_DEBUG_MESSAGE("quarto inspect " + path + ": " +
+                     safe_convert::numberToString(ms) + "ms");
+
+   // only successful inspections are cached
+   if (result.exitStatus == EXIT_SUCCESS)
+      s_inspectCache.insert(targetPath, key, *pResultObject);
+
+   return Success();
 }
 
 const char* const kQuartoCrossrefScope = "quarto-crossref";
@@ -1419,10 +1550,130 @@ int jupyterErrorLineNumber(const std::vector<std::string>& srcLines, const std::
 namespace modules {
 namespace quarto {
 
+// an entry is only used while the inspected file's content, the quarto
+// installation, the active quarto profile, and the mtimes of the project and
+// directory metadata files governing it are unchanged. directories aren't
+// cached, since inspecting one reports on every file within it.
+std::string InspectCache::key(const FilePath& targetPath, const std::string& quartoId)
+{
+   if (!targetPath.exists() || targetPath.isDirectory())
+      return std::string();
+
+   std::string contents;
+   Error error = core::readStringFromFile(targetPath, &contents);
+   if (error || hasIncludeShortcode(contents))
+      return std::string();
+
+   std::string key = quartoId +
+                     ":" + core::system::getenv("QUARTO_PROFILE") +
+                     ":" + core::hash::crc32HexHash(contents);
+
+   // metadata files contribute their path and modification time
+   auto addMetadataFile = [&](const FilePath& filePath)
+   {
+      if (filePath.exists())
+      {
+         key += ":" + filePath.getAbsolutePath() + "@" +
+                safe_convert::numberToString(filePath.getLastWriteTime());
+      }
+   };
+
+   FilePath configFile = session::quarto::quartoProjectConfigFile(targetPath);
+   if (!configFile.isEmpty())
+   {
+      // the project config, its profiles and environment files
+      FilePath projectDir = configFile.getParent();
+      std::vector<FilePath> projectFiles;
+      error = projectDir.getChildren(projectFiles);
+      if (error)
+         return std::string();
+      std::sort(projectFiles.begin(), projectFiles.end());
+      for (const FilePath& projectFile : projectFiles)
+      {
+         if (isQuartoMetadataFile(projectFile))
+            addMetadataFile(projectFile);
+      }
+
+      // directory metadata below the project
+      FilePath dir = targetPath.getParent();
+      for (; !dir.isEmpty() && dir.isWithin(projectDir); dir = dir.getParent())
+      {
+         addMetadataFile(dir.completeChildPath("_metadata.yml"));
+         addMetadataFile(dir.completeChildPath("_metadata.yaml"));
+         if (dir == projectDir)
+            break;
+      }
+   }
+
+   return key;
+}
+
+bool InspectCache::find(const FilePath& targetPath,
+                        const std::string& key,
+                        json::Object* pResult) const
+{
+   if (key.empty())
+      return false;
+
+   auto it = entries_.find(targetPath.getAbsolutePath());
+   if (it == entries_.end() || it->second.key != key)
+      return false;
+
+   *pResult = it->second.result;
+   return true;
+}
+
+void InspectCache::insert(const FilePath& targetPath,
+                          const std::string& key,
+                          const json::Object& result)
+{
+   if (key.empty())
+      return;
+
+   if (entries_.size() >= kMaxEntries)
+      entries_.clear();
+   entries_[targetPath.getAbsolutePath()] = { key, result };
+}
+
+void InspectCache::onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   // inspect results can depend on any file in the project (such as the
+   // resources a document refers to), so any change invalidates them all
+   if (!events.empty())
+      clear();
+}
+
+void InspectCache::clear()
+{
+   entries_.clear();
+}
+
+std::size_t InspectCache::size() const
+{
+   return entries_.size();
+}
+
+Error findUserInstalledQuarto()
+{
+   PrefetchedQuarto prefetched;
+   prefetched.path = core::system::getenv("PATH");
+   prefetched.rstudioQuarto = core::system::getenv(kRStudioQuarto);
+   prefetched.userInstalled = userInstalledQuarto();
+
+   LOCK_MUTEX(s_prefetchedQuartoMutex)
+   {
+      s_prefetchedQuarto = prefetched;
+   }
+   END_LOCK_MUTEX
+
+   return Success();
+}
+
 Error initialize()
 {
    RS_REGISTER_CALL_METHOD(rs_quartoFileResources, 1);
    RS_REGISTER_CALL_METHOD(rs_quartoFileProject, 2);
+   RS_REGISTER_CALL_METHOD(rs_quartoInspectMetrics, 0);
 
    // source SessionQuarto.R so we can call it from config init
    Error error = module_context::sourceModuleRFile("SessionQuarto.R");
@@ -1435,6 +1686,12 @@ Error initialize()
    module_context::events().onDetectSourceExtendedType
                                         .connect(onDetectQuartoSourceType);
 
+   // invalidate cached inspections as project files change
+   projects::FileMonitorCallbacks cb;
+   cb.onFilesChanged = onInspectCacheFilesChanged;
+   cb.onMonitoringDisabled = onInspectCacheMonitoringDisabled;
+   projects::projectContext().subscribeToFileMonitor("Quarto inspect cache", cb);
+
    // additional initialization
    ExecBlock initBlock;
    initBlock.addFunctions()
@@ -16,12 +16,19 @@
 #ifndef SESSION_MODULES_QUARTO_HPP
 #define SESSION_MODULES_QUARTO_HPP
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include <shared_core/json/Json.hpp>
 
 namespace rstudio {
 namespace core {
    class Error;
    class FilePath;
+namespace system {
+   class FileChangeEvent;
+}
 }
 }
 
@@ -30,7 +37,49 @@ namespace session {
 namespace modules {
 namespace quarto {
 
+// Looks for a user installed quarto (on the PATH, via RSTUDIO_QUARTO or via qvm) ahead of
+// initialize, which uses the result if the environment hasn't changed since. Performs only file
+// and process I/O, so it can run on any thread.
+core::Error findUserInstalledQuarto();
+
 core::Error initialize();
+
+// Results of quarto inspect, which boots quarto's runtime for each call. An entry is only used
+// while its key (see key()) is unchanged, and entries are dropped whenever a project file changes,
+// since results also depend on included files and resources.
+class InspectCache
+{
+public:
+   // The key for a file inspected by the given quarto installation, or an empty key for targets
+   // which can't be cached (directories, and files which include or embed other files).
+   static std::string key(const core::FilePath& targetPath, const std::string& quartoId);
+
+   bool find(const core::FilePath& targetPath,
+             const std::string& key,
+             core::json::Object* pResult) const;
+
+   void insert(const core::FilePath& targetPath,
+               const std::string& key,
+               const core::json::Object& result);
+
+   void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events);
+
+   void clear();
+
+   std::size_t size() const;
+
+private:
+   struct Entry
+   {
+      std::string key;
+      core::json::Object result;
+   };
+
+   // the cache is simply emptied if it grows this large
+   static const std::size_t kMaxEntries = 256;
+
+   std::map<std::string, Entry> entries_;
+};
    
 } // namespace quarto
 } // namespace modules
@@ -0,0 +1,129 @@
+/*
+ * SessionQuartoTests.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionQuarto.hpp"
+
+#include <shared_core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/system/FileChangeEvent.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace quarto {
+namespace tests {
+
+using namespace rstudio::core;
+
+TEST_CASE("Quarto inspect cache")
+{
+   FilePath dirPath;
+   REQUIRE_FALSE(FilePath::tempFilePath(dirPath));
+   REQUIRE_FALSE(dirPath.ensureDirectory());
+   FilePath docPath = dirPath.completeChildPath("doc.qmd");
+   REQUIRE_FALSE(writeStringToFile(docPath, "---\ntitle: Doc\n---\n\nHello\n"));
+
+   const std::string quartoId = "/opt/quarto/bin/quarto@1.4.550";
+
+   SECTION("Keys change with the document and the quarto installation")
+   {
+      std::string key = InspectCache::key(docPath, quartoId);
+      REQUIRE_FALSE(key.empty());
+      expect_true(InspectCache::key(docPath, quartoId) == key);
+      expect_true(InspectCache::key(docPath, "/opt/quarto/bin/quarto@1.5.57") != key);
+
+      REQUIRE_FALSE(writeStringToFile(docPath, "---\ntitle: Doc\n---\n\nGoodbye\n"));
+      expect_true(InspectCache::key(docPath, quartoId) != key);
+   }
+
+   SECTION("Directories and documents built from other files aren't cached")
+   {
+      expect_true(InspectCache::key(dirPath, quartoId).empty());
+      expect_true(InspectCache::key(dirPath.completeChildPath("missing.qmd"), quartoId).empty());
+
+      REQUIRE_FALSE(writeStringToFile(docPath, "Intro\n\n{{< include _part.qmd >}}\n"));
+      expect_true(InspectCache::key(docPath, quartoId).empty());
+
+      REQUIRE_FALSE(writeStringToFile(docPath, "{{< embed notebook.ipynb#fig-plot >}}\n"));
+      expect_true(InspectCache::key(docPath, quartoId).empty());
+
+      // other shortcodes don't depend on other files
+      REQUIRE_FALSE(writeStringToFile(docPath, "{{< pagebreak >}}\n"));
+      expect_false(InspectCache::key(docPath, quartoId).empty());
+   }
+
+   SECTION("Results are only used while their key matches")
+   {
+      InspectCache cache;
+      std::string key = InspectCache::key(docPath, quartoId);
+      json::Object result;
+      result["quarto"] = "1.4.550";
+      cache.insert(docPath, key, result);
+
+      json::Object cached;
+      REQUIRE(cache.find(docPath, key, &cached));
+      expect_true(cached == result);
+      expect_false(cache.find(docPath, key + "-changed", &cached));
+      expect_false(cache.find(dirPath.completeChildPath("other.qmd"), key, &cached));
+
+      // targets which can't be cached are never stored
+      cache.insert(dirPath, std::string(), result);
+      expect_true(cache.size() == 1);
+      expect_false(cache.find(dirPath, std::string(), &cached));
+   }
+
+   SECTION("Any change to a project file empties the cache")
+   {
+      InspectCache cache;
+      std::string key = InspectCache::key(docPath, quartoId);
+      cache.insert(docPath, key, json::Object());
+      cache.insert(dirPath.completeChildPath("other.qmd"), key, json::Object());
+
+      cache.onFilesChanged({});
+      expect_true(cache.size() == 2);
+
+      // such as a resource the document refers to
+      FilePath imagePath = dirPath.completeChildPath("plot.png");
+      std::vector<core::system::FileChangeEvent> events;
+      events.push_back(core::system::FileChangeEvent(
+         core::system::FileChangeEvent::FileAdded, FileInfo(imagePath)));
+      cache.onFilesChanged(events);
+      expect_true(cache.size() == 0);
+      json::Object cached;
+      expect_false(cache.find(docPath, key, &cached));
+   }
+
+   SECTION("The cache is emptied when it grows too large")
+   {
+      InspectCache cache;
+      for (int i = 0; i < 1000; ++i)
+      {
+         FilePath filePath = dirPath.completeChildPath(std::to_string(i) + ".qmd");
+         cache.insert(filePath, "key", json::Object());
+         REQUIRE(cache.size() <= 256);
+      }
+      expect_true(cache.size() > 0);
+   }
+
+   REQUIRE_FALSE(dirPath.removeIfExists());
+}
+
+} // namespace tests
+} // namespace quarto
+} // namespace modules
+} // namespace session
+} // namespace rstudio
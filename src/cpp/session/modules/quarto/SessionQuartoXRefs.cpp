@@ -16,6 +16,10 @@
 #include "SessionQuartoXRefs.hpp"
 
 #include <algorithm>
+#include <map>
+#include <set>
+
+#include <boost/unordered_map.hpp>
 
 #include <shared_core/Error.hpp>
 #include <shared_core/json/Json.hpp>
@@ -633,6 +637,255 @@ json::Array readAllProjectXRefIndexes(const core::FilePath& projectDir)
       return readAllProjectXRefIndexesV1(projectDir);
 }
 
+std::string xrefId(const json::Value& xrefValue)
+{
+   json::Object xref = xrefValue.getObject();
+   return xref[kType].getString() + "-" +
+          xref[kId].getString() +
+          xref[kSuffix].getString();
+}
+
+json::Array filterXRefsById(const json::Array& xrefs, const std::string& id)
+{
+   json::Array xrefArray;
+   auto it = std::find_if(xrefs.begin(), xrefs.end(), [&id](const json::Value& xref) {
+      return xrefId(xref) == id;
+   });
+   if (it != xrefs.end())
+      xrefArray.push_back(*it);
+   return xrefArray;
+}
+
+// Resident xref index for the session's Quarto project, so that xref requests
+// don't re-read and re-resolve the index of every file in the project (which
+// for large books made completion sluggish). Files are re-resolved only when:
+//
+//  - the project file monitor or the source database reports a change to
+//    their source (including unsaved edits); or
+//  - quarto writes a new rendered index for them. The .quarto directory isn't
+//    file monitored, so this is detected by quarto's main index (which it
+//    rewrites on every render) changing.
+//
+// Only the V2 (main index based) layout is supported; older versions of
+// quarto read the indexes on each request as before.
+class ProjectXRefIndex : boost::noncopyable
+{
+public:
+   void reset(const FilePath& projectDir = FilePath())
+   {
+      projectDir_ = projectDir;
+      files_.clear();
+      staleFiles_.clear();
+      mainIndexTime_ = 0;
+      populated_ = false;
+      allXRefs_ = json::Array();
+      idFiles_.clear();
+   }
+
+   bool covers(const FilePath& projectDir) const
+   {
+      return !projectDir_.isEmpty() && projectDir == projectDir_;
+   }
+
+   void populate()
+   {
+      update();
+   }
+
+   void invalidate(const FilePath& srcFile)
+   {
+      if (!projectDir_.isEmpty() && srcFile.isWithin(projectDir_))
+         staleFiles_.insert(projectRelativePath(srcFile));
+   }
+
+   void invalidateAll()
+   {
+      for (const auto& file : files_)
+         staleFiles_.insert(file.first);
+   }
+
+   void remove(const FilePath& srcFile)
+   {
+      if (projectDir_.isEmpty() || !srcFile.isWithin(projectDir_))
+         return;
+
+      std::string projRelative = projectRelativePath(srcFile);
+      auto it = files_.find(projRelative);
+      if (it != files_.end())
+      {
+         bool inMainIndex = !it->second.renderedIndex.isEmpty();
+         files_.erase(it);
+         if (inMainIndex)
+            rebuildProjectXRefs();
+      }
+      staleFiles_.erase(projRelative);
+   }
+
+   // xrefs for all files in the project's main index (i.e. for books)
+   json::Array projectXRefs()
+   {
+      update();
+      return allXRefs_;
+   }
+
+   json::Array fileXRefs(const FilePath& srcFile)
+   {
+      return fileEntry(srcFile).xrefs;
+   }
+
+   json::Array projectXRef(const std::string& id)
+   {
+      update();
+      json::Array xrefArray;
+      auto it = idFiles_.find(id);
+      if (it != idFiles_.end() && !it->second.empty())
+         xrefArray.push_back(xrefAt(files_[*it->second.begin()], id));
+      return xrefArray;
+   }
+
+   json::Array fileXRef(const FilePath& srcFile, const std::string& id)
+   {
+      json::Array xrefArray;
+      const FileEntry& entry = fileEntry(srcFile);
+      if (entry.ids.count(id))
+         xrefArray.push_back(xrefAt(entry, id));
+      return xrefArray;
+   }
+
+private:
+   struct FileEntry
+   {
+      FilePath renderedIndex;
+      std::time_t renderedTime = 0;
+      json::Array xrefs;
+      boost::unordered_map<std::string, std::size_t> ids;
+   };
+
+   std::string projectRelativePath(const FilePath& srcFile) const
+   {
+      std::string projRelative = srcFile.getRelativePath(projectDir_);
+      boost::algorithm::replace_all(projRelative, "\\", "/");
+      return projRelative;
+   }
+
+   static json::Value xrefAt(const FileEntry& entry, const std::string& id)
+   {
+      return entry.xrefs[entry.ids.at(id)];
+   }
+
+   const FileEntry& fileEntry(const FilePath& srcFile)
+   {
+      update();
+
+      // files which haven't been rendered are indexed from source alone
+      std::string projRelative = projectRelativePath(srcFile);
+      auto it = files_.find(projRelative);
+      if (it == files_.end())
+      {
+         FileEntry& entry = files_[projRelative];
+         resolve(projRelative, &entry);
+         return entry;
+      }
+      return it->second;
+   }
+
+   void resolve(const std::string& projRelative, FileEntry* pEntry)
+   {
+      pEntry->xrefs = resolvedXRefIndex(pEntry->renderedIndex,
+                                        projectDir_.completeChildPath(projRelative),
+                                        projRelative);
+      pEntry->ids.clear();
+      for (std::size_t i = 0; i < pEntry->xrefs.getSize(); i++)
+         pEntry->ids.insert(std::make_pair(xrefId(pEntry->xrefs[i]), i));
+   }
+
+   void update()
+   {
+      if (projectDir_.isEmpty())
+         return;
+
+      bool changed = false;
+
+      // re-read the main index when quarto has rendered something
+      FilePath mainIndexFile = quartoCrossrefDirV2(projectDir_).completeChildPath("INDEX");
+      std::time_t mainIndexTime = mainIndexFile.exists() ? mainIndexFile.getLastWriteTime() : 0;
+      if (!populated_ || mainIndexTime != mainIndexTime_)
+      {
+         populated_ = true;
+         mainIndexTime_ = mainIndexTime;
+         changed = true;
+
+         std::map<std::string, FilePath> mainIndex = readProjectXRrefMainIndex(projectDir_);
+
+         // files which have dropped out of the main index
+         for (auto& file : files_)
+         {
+            if (!file.second.renderedIndex.isEmpty() && !mainIndex.count(file.first))
+            {
+               file.second.renderedIndex = FilePath();
+               staleFiles_.insert(file.first);
+            }
+         }
+
+         // files with a new rendered index
+         for (const auto& member : mainIndex)
+         {
+            FileEntry& entry = files_[member.first];
+            std::time_t renderedTime = member.second.getLastWriteTime();
+            if (entry.renderedIndex != member.second || entry.renderedTime != renderedTime)
+            {
+               entry.renderedIndex = member.second;
+               entry.renderedTime = renderedTime;
+               staleFiles_.insert(member.first);
+            }
+         }
+      }
+
+      // re-resolve changed files we're tracking
+      for (const std::string& projRelative : staleFiles_)
+      {
+         auto it = files_.find(projRelative);
+         if (it != files_.end())
+         {
+            resolve(projRelative, &it->second);
+            changed = changed || !it->second.renderedIndex.isEmpty();
+         }
+      }
+      staleFiles_.clear();
+
+      if (changed)
+         rebuildProjectXRefs();
+   }
+
+   void rebuildProjectXRefs()
+   {
+      allXRefs_ = json::Array();
+      idFiles_.clear();
+      for (const auto& file : files_)
+      {
+         const FileEntry& entry = file.second;
+         if (entry.renderedIndex.isEmpty())
+            continue;
+
+         std::copy(entry.xrefs.begin(), entry.xrefs.end(), std::back_inserter(allXRefs_));
+         for (const auto& id : entry.ids)
+            idFiles_[id.first].insert(file.first);
+      }
+   }
+
+   FilePath projectDir_;
+   std::map<std::string, FileEntry> files_;
+   std::set<std::string> staleFiles_;
+   std::time_t mainIndexTime_ = 0;
+   bool populated_ = false;
+
+   // xrefs from all files in the main index, and the files defining each id
+   json::Array allXRefs_;
+   boost::unordered_map<std::string, std::set<std::string> > idFiles_;
+};
+
+ProjectXRefIndex s_projectXRefIndex;
+
 } // anonymous namespace
 
 namespace modules {
@@ -642,7 +895,10 @@ namespace xrefs {
 namespace {
 
 
-Error xrefIndexForFile(const FilePath& filePath, json::Object& indexJson)
+// reads the xref index for the file (restricted to the given id, if any)
+Error xrefIndexForFile(const FilePath& filePath,
+                       const std::string* pId,
+                       json::Object& indexJson)
 {
    indexJson[kRefs] = json::Array();
 
@@ -670,7 +926,17 @@ Error xrefIndexForFile(const FilePath& filePath, json::Object& indexJson)
       }
 
       // books get the entire index, non-books get just the file
-      if (isBook)
+      if (s_projectXRefIndex.covers(projectDir))
+      {
+         if (isBook)
+            indexJson[kRefs] = pId ? s_projectXRefIndex.projectXRef(*pId)
+                                   : s_projectXRefIndex.projectXRefs();
+         else
+            indexJson[kRefs] = pId ? s_projectXRefIndex.fileXRef(filePath, *pId)
+                                   : s_projectXRefIndex.fileXRefs(filePath);
+         return Success();
+      }
+      else if (isBook)
       {
          indexJson[kRefs] = readAllProjectXRefIndexes(projectDir);
       }
@@ -696,6 +962,10 @@ Error xrefIndexForFile(const FilePath& filePath, json::Object& indexJson)
       indexJson[kRefs] = resolvedXRefIndex(indexPath, filePath, filePath.getFilename());
 
    }
+
+   if (pId)
+      indexJson[kRefs] = filterXRefsById(indexJson[kRefs].getArray(), *pId);
+
    return Success();
 }
 
@@ -714,7 +984,7 @@ Error quartoXRefIndexForFile(const json::JsonRpcRequest& request,
 
    // read index
    json::Object indexJson;
-   error = xrefIndexForFile(filePath, indexJson);
+   error = xrefIndexForFile(filePath, nullptr, indexJson);
    if (error)
       return error;
 
@@ -735,41 +1005,91 @@ Error quartoXRefForId(const json::JsonRpcRequest& request,
    // resolve path
    FilePath filePath = resolveAliasedPath(file);
 
-   // read index
+   // read index for the id
    json::Object indexJson;
-   error = xrefIndexForFile(filePath, indexJson);
+   error = xrefIndexForFile(filePath, &id, indexJson);
    if (error)
       return error;
 
-   // search it the id
-   const json::Array& xrefs = indexJson[kRefs].getArray();
-   auto it = std::find_if(xrefs.begin(), xrefs.end(), [&id](const json::Value& xref) {
-      json::Object xrefJson = xref.getObject();
-      std::string xrefId = xrefJson[kType].getString() + "-" +
-                           xrefJson[kId].getString() +
-                           xrefJson[kSuffix].getString();
-      return xrefId == id;
-   });
-   if (it != xrefs.end())
+   pResponse->setResult(indexJson);
+
+   return Success();
+}
+
+void onMonitoringEnabled(const tree<core::FileInfo>&)
+{
+   // index the session's quarto project (once the session is idle)
+   QuartoConfig config = quartoConfig();
+   if (config.is_project && useXRefIndexV2())
    {
-      json::Array xrefArray;
-      xrefArray.push_back(*it);
-      indexJson[kRefs] = xrefArray;
+      s_projectXRefIndex.reset(module_context::resolveAliasedPath(config.project_dir));
+      module_context::scheduleDelayedWork(boost::posix_time::seconds(1),
+                                          boost::bind(&ProjectXRefIndex::populate,
+                                                      &s_projectXRefIndex),
+                                          true);
    }
-   else
+}
+
+void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   for (const core::system::FileChangeEvent& event : events)
    {
-      indexJson[kRefs] = json::Array();
+      FilePath filePath(event.fileInfo().absolutePath());
+      if (event.type() == core::system::FileChangeEvent::FileRemoved)
+         s_projectXRefIndex.remove(filePath);
+      else
+         s_projectXRefIndex.invalidate(filePath);
    }
+}
 
-   pResponse->setResult(indexJson);
+void onMonitoringDisabled()
+{
+   // without file monitoring we can't tell when sources change
+   s_projectXRefIndex.reset();
+}
 
-   return Success();
+void onSourceDocUpdated(boost::shared_ptr<source_database::SourceDocument> pDoc)
+{
+   if (!pDoc->path().empty())
+      s_projectXRefIndex.invalidate(resolveAliasedPath(pDoc->path()));
+}
+
+void onSourceDocRenamed(const std::string& oldPath,
+                        boost::shared_ptr<source_database::SourceDocument> pDoc)
+{
+   if (!oldPath.empty())
+      s_projectXRefIndex.invalidate(resolveAliasedPath(oldPath));
+   onSourceDocUpdated(pDoc);
+}
+
+void onSourceDocRemoved(const std::string&, const std::string& path)
+{
+   // any unsaved changes are gone
+   if (!path.empty())
+      s_projectXRefIndex.invalidate(resolveAliasedPath(path));
+}
+
+void onAllSourceDocsRemoved()
+{
+   s_projectXRefIndex.invalidateAll();
 }
 
 } // anonymous namespace
 
 Error initialize()
 {
+   // maintain the project xref index as sources change
+   projects::FileMonitorCallbacks cb;
+   cb.onMonitoringEnabled = onMonitoringEnabled;
+   cb.onFilesChanged = onFilesChanged;
+   cb.onMonitoringDisabled = onMonitoringDisabled;
+   projects::projectContext().subscribeToFileMonitor("Quarto cross references", cb);
+
+   source_database::events().onDocUpdated.connect(onSourceDocUpdated);
+   source_database::events().onDocRenamed.connect(onSourceDocRenamed);
+   source_database::events().onDocRemoved.connect(onSourceDocRemoved);
+   source_database::events().onRemoveAll.connect(onAllSourceDocsRemoved);
+
    // register rpc functions
    ExecBlock initBlock;
    initBlock.addFunctions()
@@ -791,10 +1111,12 @@ core::json::Value quartoXRefIndex()
    if (config.is_project)
    {
       json::Object indexJson;
+      FilePath projectDir = module_context::resolveAliasedPath(config.project_dir);
       indexJson[kBaseDir] = config.project_dir;
-      indexJson[kRefs] =  readAllProjectXRefIndexes(
-         module_context::resolveAliasedPath(config.project_dir)
-      );
+      if (s_projectXRefIndex.covers(projectDir))
+         indexJson[kRefs] = s_projectXRefIndex.projectXRefs();
+      else
+         indexJson[kRefs] = readAllProjectXRefIndexes(projectDir);
       json::Value resultValue = indexJson;
       return resultValue;
    }
@@ -48,30 +48,12 @@ namespace notebook {
 
 namespace {
 
-struct PendingChunkConsoleOutput
-{
-   int type;
-   std::string output;
-};
-
-std::map<FilePath, std::vector<PendingChunkConsoleOutput>> s_pendingChunkOutput;
+std::map<FilePath, PendingConsoleOutput> s_pendingChunkOutput;
 
-void flushPendingChunkConsoleOutput(const FilePath& outputCsv)
+void flushPendingChunkConsoleOutput(const FilePath& outputCsv,
+                                    PendingConsoleOutput* pPending)
 {
-   auto&& chunkOutputs = s_pendingChunkOutput[outputCsv];
-   if (chunkOutputs.empty())
-      return;
-   
-   std::stringstream ss;
-   for (auto&& chunkOutput : chunkOutputs)
-   {
-      std::vector<std::string> values;
-      values.push_back(safe_convert::numberToString(chunkOutput.type));
-      values.push_back(chunkOutput.output);
-      ss << text::encodeCsvLine(values) << "\n";
-   }
-   
-   Error error = core::writeStringToFile(outputCsv, ss.str());
+   Error error = pPending->write(outputCsv);
    if (error)
       LOG_ERROR(error);
 }
@@ -94,7 +76,7 @@ FilePath getNextOutputFile(const std::string& docId, const std::string& chunkId,
 void flushPendingChunkConsoleOutputs(bool clear)
 {
    for (auto&& entry : s_pendingChunkOutput)
-      flushPendingChunkConsoleOutput(entry.first);
+      flushPendingChunkConsoleOutput(entry.first, &entry.second);
    if (clear)
       s_pendingChunkOutput.clear();
 }
@@ -486,15 +468,10 @@ void ChunkExecContext::onConsoleText(int type, const std::string& output,
       }
    }
 
-   // truncate if necessary
-   if (truncate)
-      s_pendingChunkOutput.erase(outputCsv);
-   
-   // add pending chunk output
-   PendingChunkConsoleOutput chunkOutput;
-   chunkOutput.type = type;
-   chunkOutput.output = output;
-   s_pendingChunkOutput[outputCsv].push_back(chunkOutput);
+   // add pending chunk output (discarding what's pending if truncating)
+   PendingConsoleOutput& pendingOutput = s_pendingChunkOutput[outputCsv];
+   if (pendingOutput.add(type, output, truncate))
+      flushPendingChunkConsoleOutput(outputCsv, &pendingOutput);
 
    // if we got some real output, fire event for it
    if (!output.empty())
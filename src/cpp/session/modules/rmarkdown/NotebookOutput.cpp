@@ -38,6 +38,8 @@
 #include <session/SessionSourceDatabase.hpp>
 #include <session/SessionModuleContext.hpp>
 
+#include <deque>
+#include <iterator>
 #include <map>
 
 #define kRequestId    "request_id"
@@ -97,34 +99,97 @@ std::string chunkOutputExt(ChunkOutputType outputType)
    return "";
 }
 
-Error chunkConsoleContents(const FilePath& consoleFile, json::Array* pArray)
+// the parsed text kept to recognize a console output file that has been
+// appended to (rather than replaced) since it was last read
+const std::size_t kParsedTailBytes = 1024;
+
+// pending console output is written out once this much has accumulated,
+// so long-running chunks don't hold all their output in memory
+const std::size_t kMaxPendingConsoleOutputBytes = 64 * 1024;
+
+// parsed console output files, by document; all of a document's output files
+// are kept, for the documents most recently read from
+const std::size_t kMaxCachedConsoleDocuments = 8;
+typedef std::map<std::string, ChunkConsoleContents> DocConsoleContents;
+std::map<std::string, DocConsoleContents> s_consoleContents;
+std::deque<std::string> s_consoleContentsOrder;
+
+ChunkConsoleContents& cachedConsoleContents(const std::string& docId,
+                                            const FilePath& consoleFile)
 {
-   std::string contents;
-   Error error = readStringFromFile(consoleFile, &contents);
+   auto it = std::find(s_consoleContentsOrder.begin(), s_consoleContentsOrder.end(), docId);
+   if (it != s_consoleContentsOrder.end())
+   {
+      s_consoleContentsOrder.erase(it);
+   }
+   else if (s_consoleContentsOrder.size() >= kMaxCachedConsoleDocuments)
+   {
+      s_consoleContents.erase(s_consoleContentsOrder.front());
+      s_consoleContentsOrder.pop_front();
+   }
+   s_consoleContentsOrder.push_back(docId);
+
+   return s_consoleContents[docId][consoleFile.getAbsolutePath()];
+}
+
+void removeCachedConsoleContents(const std::string& docId,
+                                 const FilePath& outputPath)
+{
+   auto it = s_consoleContents.find(docId);
+   if (it == s_consoleContents.end())
+      return;
+
+   DocConsoleContents& contents = it->second;
+   for (auto entry = contents.begin(); entry != contents.end(); )
+   {
+      if (FilePath(entry->first).isWithin(outputPath))
+         entry = contents.erase(entry);
+      else
+         ++entry;
+   }
+}
+
+Error readFileFrom(const FilePath& filePath, uintmax_t offset, std::string* pContents)
+{
+   std::shared_ptr<std::istream> pStream;
+   Error error = filePath.openForRead(pStream);
    if (error)
       return error;
 
-   // parse each line of the CSV file
-   std::pair<std::vector<std::string>, std::string::iterator> line;
-   line = text::parseCsvLine(contents.begin(), contents.end());
-   while (!line.first.empty())
+   try
    {
-      if (line.first.size() > 1)
-      {
-         int outputType = safe_convert::stringTo<int>(line.first[0], 
-               kChunkConsoleOutput);
+      pStream->seekg(offset);
+      pContents->assign(std::istreambuf_iterator<char>(*pStream),
+                        std::istreambuf_iterator<char>());
+   }
+   catch (const std::exception& e)
+   {
+      error = systemError(boost::system::errc::io_error, e.what(), ERROR_LOCATION);
+      error.addProperty("path", filePath);
+      return error;
+   }
 
-         // don't emit input data to the client
-         if (outputType != kChunkConsoleInput)
-         {
-            json::Array output;
-            output.push_back(outputType);
-            output.push_back(line.first[1]);
-            pArray->push_back(output);
-         }
-      }
-      // read next line
-      line = text::parseCsvLine(line.second, contents.end());
+   return Success();
+}
+
+Error chunkConsoleContents(const std::string& docId,
+                           const FilePath& consoleFile,
+                           json::Array* pArray)
+{
+   ChunkConsoleContents& cached = cachedConsoleContents(docId, consoleFile);
+   Error error = readChunkConsoleContents(consoleFile, &cached);
+   if (error)
+   {
+      cached = ChunkConsoleContents();
+      return error;
+   }
+
+   for (const auto& output : cached.output)
+   {
+      json::Array entry;
+      entry.push_back(output.first);
+      entry.push_back(output.second);
+      pArray->push_back(entry);
    }
 
    return Success();
@@ -154,7 +219,7 @@ Error fillOutputObject(const std::string& docId, const std::string& chunkId,
    {
       // deserialize console output
       json::Array consoleOutput;
-      Error error = chunkConsoleContents(path, &consoleOutput);
+      Error error = chunkConsoleContents(docId, path, &consoleOutput);
       (*pObj)[kChunkOutputValue] = consoleOutput;
    }
    else if (outputType == ChunkOutputPlot || outputType == ChunkOutputHtml)
@@ -578,6 +643,8 @@ core::Error cleanChunkOutput(const std::string& docId,
       updateLastChunkOutput(docId, chunkId, OutputPair());
    }
 
+   removeCachedConsoleContents(docId, outputPath);
+
    Error error = outputPath.remove();
    if (error)
       return error;
@@ -590,6 +657,112 @@ core::Error cleanChunkOutput(const std::string& docId,
    return Success();
 }
 
+Error readChunkConsoleContents(const FilePath& consoleFile,
+                               ChunkConsoleContents* pContents)
+{
+   ChunkConsoleContents& contents = *pContents;
+   if (!consoleFile.exists())
+      return fileNotFoundError(consoleFile, ERROR_LOCATION);
+
+   // nothing to do if the file hasn't changed since it was last read
+   uintmax_t fileSize = consoleFile.getSize();
+   std::time_t lastWriteTime = consoleFile.getLastWriteTime();
+   if (fileSize == contents.fileSize && lastWriteTime == contents.lastWriteTime)
+      return Success();
+
+   // chunk output files are only appended to while a chunk runs, so when the
+   // file still has the text parsed last time only the lines after it need to
+   // be read and parsed; otherwise the file was replaced and we start over
+   std::string text;
+   std::size_t tailLength = contents.parsedTail.size();
+   if (fileSize >= contents.parsedLength)
+   {
+      Error error = readFileFrom(consoleFile, contents.parsedLength - tailLength, &text);
+      if (error)
+         return error;
+   }
+
+   if (fileSize < contents.parsedLength ||
+       text.compare(0, tailLength, contents.parsedTail) != 0)
+   {
+      contents = ChunkConsoleContents();
+      tailLength = 0;
+      Error error = readFileFrom(consoleFile, 0, &text);
+      if (error)
+         return error;
+   }
+
+   contents.fileSize = fileSize;
+   contents.lastWriteTime = lastWriteTime;
+
+   // parse each (new) line of the CSV file
+   std::string::iterator begin = text.begin() + tailLength;
+   std::pair<std::vector<std::string>, std::string::iterator> line;
+   line = text::parseCsvLine(begin, text.end());
+   while (!line.first.empty())
+   {
+      if (line.first.size() > 1)
+      {
+         int outputType = safe_convert::stringTo<int>(line.first[0], 
+               kChunkConsoleOutput);
+
+         // don't emit input data to the client
+         if (outputType != kChunkConsoleInput)
+         {
+            if (!contents.output.empty() && contents.output.back().first == outputType)
+               contents.output.back().second.append(line.first[1]);
+            else
+               contents.output.push_back(std::make_pair(outputType, line.first[1]));
+         }
+      }
+
+      // read next line
+      begin = line.second;
+      line = text::parseCsvLine(line.second, text.end());
+   }
+
+   std::size_t parsed = begin - text.begin();
+   contents.parsedLength += parsed - tailLength;
+   contents.parsedTail.assign(begin - std::min(parsed, kParsedTailBytes), begin);
+
+   return Success();
+}
+
+bool PendingConsoleOutput::add(int chunkConsoleOutputType,
+                               const std::string& output,
+                               bool truncate)
+{
+   if (truncate)
+   {
+      encoded_.clear();
+      replace_ = true;
+   }
+
+   std::vector<std::string> values;
+   values.push_back(safe_convert::numberToString(chunkConsoleOutputType));
+   values.push_back(output);
+   encoded_.append(text::encodeCsvLine(values));
+   encoded_.append("\n");
+
+   return encoded_.size() >= kMaxPendingConsoleOutputBytes;
+}
+
+Error PendingConsoleOutput::write(const FilePath& filePath)
+{
+   if (encoded_.empty())
+      return Success();
+
+   Error error = writeStringToFile(
+            filePath,
+            encoded_,
+            string_utils::LineEndingPassthrough,
+            replace_);
+
+   encoded_.clear();
+   replace_ = false;
+   return error;
+}
+
 core::Error writeConsoleOutput(int chunkConsoleType,
                                const std::string& output,
                                const core::FilePath& targetPath,
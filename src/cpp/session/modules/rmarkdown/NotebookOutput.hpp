@@ -17,7 +17,10 @@
 #ifndef SESSION_NOTEBOOK_OUTPUT_HPP
 #define SESSION_NOTEBOOK_OUTPUT_HPP
 
+#include <ctime>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <shared_core/json/Json.hpp>
 
@@ -124,6 +127,46 @@ core::Error writeConsoleOutput(int chunkConsoleOutputType,
                                bool truncate);
 
 
+// console output parsed from a chunk's console output (.csv) file
+struct ChunkConsoleContents
+{
+   // size and modification time of the file when it was last read
+   uintmax_t fileSize = 0;
+   std::time_t lastWriteTime = 0;
+
+   // the number of bytes parsed so far (only complete lines are parsed), and
+   // the last of those bytes, used to tell appended files from replaced ones
+   uintmax_t parsedLength = 0;
+   std::string parsedTail;
+
+   // output (not input) with consecutive output of the same type combined
+   std::vector<std::pair<int, std::string>> output;
+};
+
+// reads a chunk's console output file into contents previously read from the
+// same file; when the file has only been appended to since, just the new
+// lines are read and parsed
+core::Error readChunkConsoleContents(const core::FilePath& consoleFile,
+                                     ChunkConsoleContents* pContents);
+
+// console output which has not yet been written to a chunk's output file; the
+// file is replaced on the first write (and after the output is truncated),
+// and appended to afterwards
+class PendingConsoleOutput
+{
+public:
+   PendingConsoleOutput() : replace_(true) {}
+
+   // returns true once enough output has accumulated that it should be written
+   bool add(int chunkConsoleOutputType, const std::string& output, bool truncate);
+
+   core::Error write(const core::FilePath& filePath);
+
+private:
+   std::string encoded_;
+   bool replace_;
+};
+
 // send chunk output to client
 void enqueueChunkOutput(const std::string& docId,
       const std::string& chunkId, const std::string& nbCtxId, 
@@ -0,0 +1,160 @@
+/*
+ * NotebookOutputTests.cpp
+ *
+ * Copyright (C) 2023 by Posit Software, PBC
+ *
+ * Unless you have received this program directly from Posit Software pursuant
+ * to the terms of a commercial license agreement with Posit Software, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "NotebookOutput.hpp"
+
+#include <shared_core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+
+#include <tests/TestThat.hpp>
+
+namespace rstudio {
+namespace session {
+namespace modules {
+namespace rmarkdown {
+namespace notebook {
+namespace tests {
+
+using namespace rstudio::core;
+
+namespace {
+
+std::string readConsoleFile(const FilePath& consoleFile)
+{
+   std::string contents;
+   REQUIRE_FALSE(readStringFromFile(consoleFile, &contents));
+   return contents;
+}
+
+} // anonymous namespace
+
+TEST_CASE("NotebookOutput")
+{
+   FilePath dirPath;
+   REQUIRE_FALSE(FilePath::tempFilePath(dirPath));
+   REQUIRE_FALSE(dirPath.ensureDirectory());
+   FilePath consoleFile = dirPath.completeChildPath("00001.csv");
+
+   SECTION("Pending console output replaces the file, then appends to it")
+   {
+      REQUIRE_FALSE(writeStringToFile(consoleFile, "\"1\",\"stale output\"\n"));
+
+      PendingConsoleOutput pending;
+      expect_false(pending.add(kChunkConsoleOutput, "one", false));
+      REQUIRE_FALSE(pending.write(consoleFile));
+      expect_true(readConsoleFile(consoleFile) == "\"1\",\"one\"\n");
+
+      // nothing is written when nothing is pending
+      REQUIRE_FALSE(pending.write(consoleFile));
+      expect_true(readConsoleFile(consoleFile) == "\"1\",\"one\"\n");
+
+      pending.add(kChunkConsoleError, "two", false);
+      REQUIRE_FALSE(pending.write(consoleFile));
+      expect_true(readConsoleFile(consoleFile) == "\"1\",\"one\"\n\"2\",\"two\"\n");
+
+      // truncating discards pending output, and replaces the file again
+      pending.add(kChunkConsoleOutput, "three", false);
+      pending.add(kChunkConsoleOutput, "four", true);
+      REQUIRE_FALSE(pending.write(consoleFile));
+      expect_true(readConsoleFile(consoleFile) == "\"1\",\"four\"\n");
+   }
+
+   SECTION("Pending console output asks to be written once it grows large")
+   {
+      PendingConsoleOutput pending;
+      std::string output(1024, 'x');
+      int added = 1;
+      while (!pending.add(kChunkConsoleOutput, output, false))
+         ++added;
+
+      expect_true(added > 1);
+      REQUIRE_FALSE(pending.write(consoleFile));
+      expect_true(consoleFile.getSize() >= 64 * 1024);
+   }
+
+   SECTION("Console output is parsed incrementally as it's appended")
+   {
+      REQUIRE_FALSE(writeConsoleOutput(kChunkConsoleInput, "x <- 1", consoleFile, true));
+      REQUIRE_FALSE(appendConsoleOutput(kChunkConsoleOutput, "one ", consoleFile));
+      REQUIRE_FALSE(appendConsoleOutput(kChunkConsoleOutput, "two", consoleFile));
+
+      ChunkConsoleContents contents;
+      REQUIRE_FALSE(readChunkConsoleContents(consoleFile, &contents));
+
+      // input is skipped, and output of the same type is combined
+      REQUIRE(contents.output.size() == 1);
+      expect_true(contents.output[0].first == kChunkConsoleOutput);
+      expect_true(contents.output[0].second == "one two");
+      expect_true(contents.parsedLength == consoleFile.getSize());
+
+      // mark what has been parsed, so we can tell whether it's parsed again
+      contents.output[0].second = "parsed";
+
+      // nothing is parsed again while the file is unchanged
+      REQUIRE_FALSE(readChunkConsoleContents(consoleFile, &contents));
+      expect_true(contents.output[0].second == "parsed");
+
+      // only appended lines are parsed
+      REQUIRE_FALSE(appendConsoleOutput(kChunkConsoleOutput, " three", consoleFile));
+      REQUIRE_FALSE(appendConsoleOutput(kChunkConsoleError, "oops", consoleFile));
+      REQUIRE_FALSE(readChunkConsoleContents(consoleFile, &contents));
+      REQUIRE(contents.output.size() == 2);
+      expect_true(contents.output[0].second == "parsed three");
+      expect_true(contents.output[1].first == kChunkConsoleError);
+      expect_true(contents.output[1].second == "oops");
+      expect_true(contents.parsedLength == consoleFile.getSize());
+   }
+
+   SECTION("Replaced console output is parsed from the start")
+   {
+      REQUIRE_FALSE(writeConsoleOutput(kChunkConsoleOutput, "one", consoleFile, true));
+      REQUIRE_FALSE(appendConsoleOutput(kChunkConsoleOutput, "two", consoleFile));
+
+      ChunkConsoleContents contents;
+      REQUIRE_FALSE(readChunkConsoleContents(consoleFile, &contents));
+      contents.output[0].second = "parsed";
+
+      // a shorter file
+      REQUIRE_FALSE(writeConsoleOutput(kChunkConsoleError, "three", consoleFile, true));
+      REQUIRE_FALSE(readChunkConsoleContents(consoleFile, &contents));
+      REQUIRE(contents.output.size() == 1);
+      expect_true(contents.output[0].first == kChunkConsoleError);
+      expect_true(contents.output[0].second == "three");
+      contents.output[0].second = "parsed";
+
+      // a longer file which doesn't start with what was parsed before
+      REQUIRE_FALSE(writeConsoleOutput(kChunkConsoleOutput, "four", consoleFile, true));
+      REQUIRE_FALSE(appendConsoleOutput(kChunkConsoleOutput, "five", consoleFile));
+      REQUIRE_FALSE(readChunkConsoleContents(consoleFile, &contents));
+      REQUIRE(contents.output.size() == 1);
+      expect_true(contents.output[0].first == kChunkConsoleOutput);
+      expect_true(contents.output[0].second == "fourfive");
+   }
+
+   SECTION("Missing console output files are reported")
+   {
+      ChunkConsoleContents contents;
+      expect_true(readChunkConsoleContents(consoleFile, &contents));
+   }
+
+   REQUIRE_FALSE(dirPath.removeIfExists());
+}
+
+} // namespace tests
+} // namespace notebook
+} // namespace rmarkdown
+} // namespace modules
+} // namespace session
+} // namespace rstudio
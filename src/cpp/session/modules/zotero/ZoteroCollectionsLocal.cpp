@@ -16,6 +16,7 @@
 #include "ZoteroCollectionsLocal.hpp"
 
 #include <boost/algorithm/algorithm.hpp>
+#include <boost/algorithm/string/replace.hpp>
 #include <boost/bind/bind.hpp>
 
 #include <shared_core/Error.hpp>
@@ -101,7 +102,21 @@ std::string readString(const database::Row& row, T accessor, std::string default
 }
 
 
-std::string creatorsSQL(const ZoteroCollectionSpec& spec)
+// restricts the items queries below to the items with the given keys
+std::string itemKeysFilter(const std::vector<std::string>& keys)
+{
+   std::string filter = "AND items.key IN (";
+   for (std::size_t i = 0; i < keys.size(); i++)
+   {
+      if (i > 0)
+         filter += ", ";
+      filter += "'" + boost::algorithm::replace_all_copy(keys[i], "'", "''") + "'";
+   }
+   filter += ")";
+   return filter;
+}
+
+std::string creatorsSQL(const ZoteroCollectionSpec& spec, const std::string& itemFilter = "")
 {
    boost::format fmt(R"(
       SELECT
@@ -132,10 +147,10 @@ std::string creatorsSQL(const ZoteroCollectionSpec& spec)
    return boost::str(fmt %
         (spec.parentKey.empty() ? "" :  R"(join collectionItems on items.itemID = collectionItems.itemID
          join collections on collectionItems.collectionID = collections.collectionID)") %
-        (spec.parentKey.empty() ? "AND libraries.libraryID = " + spec.key : "AND collections.key = '" + spec.key + "'"));
+        ((spec.parentKey.empty() ? "AND libraries.libraryID = " + spec.key : "AND collections.key = '" + spec.key + "'") + "\n" + itemFilter));
 }
 
-std::string collectionSQL(const ZoteroCollectionSpec& spec)
+std::string collectionSQL(const ZoteroCollectionSpec& spec, const std::string& itemFilter = "")
 {
    boost::format fmt(R"(
       SELECT
@@ -218,18 +233,58 @@ std::string collectionSQL(const ZoteroCollectionSpec& spec)
 
    if (spec.parentKey.empty())
    {
-      return boost::str(fmt % "" % ("AND libraries.libraryID = " + spec.key));
+      return boost::str(fmt % "" % ("AND libraries.libraryID = " + spec.key + "\n" + itemFilter));
    }
    else
    {
       return boost::str(fmt %
          ("join collectionItems on items.itemID = collectionItems.itemID\n"
           "join collections on collectionItems.collectionID = collections.collectionID") %
-         ("AND collections.key = '" + spec.key + "'")
+         ("AND collections.key = '" + spec.key + "'\n" + itemFilter)
       );
    }
 }
 
+// the version of each (live) item in a library: its sync version and whether
+// it has unsynced local edits, along with its client modification time as
+// stored (a local edit clears synced, so an edit within the same second as the
+// previous read is still seen)
+std::string itemVersionsSQL(const ZoteroCollectionSpec& spec)
+{
+   boost::format fmt(R"(
+      SELECT
+         items.key as key,
+         items.version || ':' || items.synced || ':' ||
+            IFNULL(items.clientDateModified, '') AS version
+      FROM
+         items
+         join itemTypes on items.itemTypeID = itemTypes.itemTypeID
+         left join deletedItems on items.itemId = deletedItems.itemID
+      WHERE
+         itemTypes.typeName <> 'attachment'
+         AND itemTypes.typeName <> 'note'
+         AND deletedItems.dateDeleted IS NULL
+         AND items.libraryID = %1%
+   )");
+   return boost::str(fmt % spec.key);
+}
+
+// the version of the collections in a library, from the number of collections
+// and their most recent sync version and client modification time
+std::string collectionsVersionSQL(const ZoteroCollectionSpec& spec)
+{
+   boost::format fmt(R"(
+      SELECT
+         COUNT(*) || ':' || IFNULL(MAX(collections.version), 0) || ':' ||
+            IFNULL(MAX(collections.clientDateModified), '') AS version
+      FROM
+         collections
+      WHERE
+         collections.libraryID = %1%
+   )");
+   return boost::str(fmt % spec.key);
+}
+
 double getCollectionVersion(boost::shared_ptr<database::IConnection> pConnection, const ZoteroCollectionSpec& spec) {
     // This is a library
     std::string query;
@@ -282,14 +337,16 @@ double getCollectionVersion(boost::shared_ptr<database::IConnection> pConnection
     return version;
 }
 
-ZoteroCollection getCollection(boost::shared_ptr<database::IConnection> pConnection, const ZoteroCollectionSpec& spec)
+// reads the items of a collection (optionally restricted by an items filter),
+// passing the key and CSL of each item to the handler in key order
+Error readItems(boost::shared_ptr<database::IConnection> pConnection,
+                const ZoteroCollectionSpec& spec,
+                const std::string& itemFilter,
+                boost::function<void(const std::string&, const json::Object&)> itemHandler)
 {
-   // default to return in case of error
-   ZoteroCollection collection(spec);
-
    // get creators
    ZoteroCreatorsByKey creators;
-   Error error = execQuery(pConnection, creatorsSQL(spec), [&creators](const database::Row& row) {
+   Error error = execQuery(pConnection, creatorsSQL(spec, itemFilter), [&creators](const database::Row& row) {
      std::string key = row.get<std::string>("key");
      ZoteroCreator creator;
 
@@ -313,15 +370,11 @@ ZoteroCollection getCollection(boost::shared_ptr<database::IConnection> pConnect
      creators[key].push_back(creator);
    });
    if (error)
-   {
-      LOG_ERROR(error);
-      return collection;
-   }
+      return error;
 
    std::map<std::string,std::string> currentItem;
-   json::Array itemsJson;
-   error = execQuery(pConnection, collectionSQL(spec),
-                     [&creators, &currentItem, &itemsJson](const database::Row& row) {
+   error = execQuery(pConnection, collectionSQL(spec, itemFilter),
+                     [&creators, &currentItem, &itemHandler](const database::Row& row) {
 
       std::string key = row.get<std::string>("key");
       std::string currentKey = currentItem.count("key") ? currentItem["key"] : "";
@@ -335,7 +388,7 @@ ZoteroCollection getCollection(boost::shared_ptr<database::IConnection> pConnect
       // finished an item
       else if (key != currentKey)
       {
-         itemsJson.push_back(sqliteItemToCSL(currentItem, creators));
+         itemHandler(currentKey, sqliteItemToCSL(currentItem, creators));
          currentItem.clear();
          currentItem["key"] = key;
       }
@@ -355,7 +408,230 @@ ZoteroCollection getCollection(boost::shared_ptr<database::IConnection> pConnect
 
    // add the final item (if we had one)
    if (currentItem.count("key"))
-      itemsJson.push_back(sqliteItemToCSL(currentItem, creators));
+   {
+      std::string key = currentItem["key"];
+      itemHandler(key, sqliteItemToCSL(currentItem, creators));
+   }
+
+   return error;
+}
+
+// when more items than this have changed, query the whole library rather
+// than listing the changed items in the query
+const std::size_t kMaxFilteredItems = 500;
+
+// the CSL for the items of a library as of its last sync, keyed by item key
+struct LibraryItemCache
+{
+   LibraryItemCache() : loaded(false) {}
+
+   struct Item
+   {
+      std::string version;
+      json::Object csl;
+   };
+
+   bool loaded;
+   std::string collectionsVersion;
+   std::map<std::string, Item> items;
+};
+
+// item caches, indexed by cache file path
+std::map<std::string, LibraryItemCache> s_libraryItemCaches;
+
+FilePath libraryItemCachePath(const std::string& dataDir, const ZoteroCollectionSpec& spec)
+{
+   FilePath cacheDir = module_context::userScratchPath()
+        .completeChildPath("zotero")
+        .completeChildPath("items-cache");
+
+   Error error = cacheDir.ensureDirectory();
+   if (error)
+      LOG_ERROR(error);
+
+   return cacheDir.completeChildPath(hash::crc32HexHash(dataDir) + "-" + spec.key + ".json");
+}
+
+LibraryItemCache& libraryItemCache(const FilePath& cachePath)
+{
+   LibraryItemCache& cache = s_libraryItemCaches[cachePath.getAbsolutePath()];
+   if (cache.loaded)
+      return cache;
+
+   cache.loaded = true;
+   if (!cachePath.exists())
+      return cache;
+
+   std::string contents;
+   json::Object cacheJson;
+   Error error = core::readStringFromFile(cachePath, &contents);
+   if (!error)
+      error = cacheJson.parse(contents);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return cache;
+   }
+
+   json::Object itemsJson;
+   error = json::readObject(cacheJson,
+                            "collectionsVersion", cache.collectionsVersion,
+                            kItems, itemsJson);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return cache;
+   }
+
+   for (const json::Object::Member& member : itemsJson)
+   {
+      if (!member.getValue().isObject())
+         continue;
+
+      json::Object itemJson = member.getValue().getObject();
+      LibraryItemCache::Item item;
+      error = json::readObject(itemJson, kVersion, item.version, "csl", item.csl);
+      if (!error)
+         cache.items[member.getName()] = item;
+   }
+
+   TRACE("Read item cache", cache.items.size());
+   return cache;
+}
+
+void writeLibraryItemCache(const FilePath& cachePath, const LibraryItemCache& cache)
+{
+   json::Object itemsJson;
+   for (const auto& entry : cache.items)
+   {
+      json::Object itemJson;
+      itemJson[kVersion] = entry.second.version;
+      itemJson["csl"] = entry.second.csl;
+      itemsJson[entry.first] = itemJson;
+   }
+
+   json::Object cacheJson;
+   cacheJson["collectionsVersion"] = cache.collectionsVersion;
+   cacheJson[kItems] = itemsJson;
+
+   Error error = core::writeStringToFile(cachePath, cacheJson.write());
+   if (error)
+      LOG_ERROR(error);
+}
+
+// brings the item cache for a library up to date, converting only those items
+// which have been added or modified since the last sync, and returns its items
+Error syncLibraryItems(boost::shared_ptr<database::IConnection> pConnection,
+                       const std::string& dataDir,
+                       const ZoteroCollectionSpec& spec,
+                       json::Array* pItems)
+{
+   // read the current modification time of each item
+   std::map<std::string, std::string> versions;
+   Error error = execQuery(pConnection, itemVersionsSQL(spec), [&versions](const database::Row& row) {
+      versions[row.get<std::string>("key")] = readString(row, "version", "0");
+   });
+   if (error)
+      return error;
+
+   std::string collectionsVersion = "0";
+   error = execQuery(pConnection, collectionsVersionSQL(spec), [&collectionsVersion](const database::Row& row) {
+      collectionsVersion = readString(row, "version", "0");
+   });
+   if (error)
+      return error;
+
+   FilePath cachePath = libraryItemCachePath(dataDir, spec);
+   LibraryItemCache& cache = libraryItemCache(cachePath);
+
+   // the collections each item belongs to are part of its CSL, so if the
+   // collections have changed then re-read everything
+   if (cache.collectionsVersion != collectionsVersion)
+   {
+      cache.items.clear();
+      cache.collectionsVersion = collectionsVersion;
+   }
+
+   // drop items which have been deleted (or moved to the trash)
+   bool modified = false;
+   for (auto it = cache.items.begin(); it != cache.items.end(); )
+   {
+      if (versions.count(it->first) == 0)
+      {
+         it = cache.items.erase(it);
+         modified = true;
+      }
+      else
+      {
+         ++it;
+      }
+   }
+
+   // find items which are new or have been modified
+   std::vector<std::string> changedKeys;
+   for (const auto& version : versions)
+   {
+      auto it = cache.items.find(version.first);
+      if (it == cache.items.end() || it->second.version != version.second)
+         changedKeys.push_back(version.first);
+   }
+
+   TRACE("Items changed since last sync", changedKeys.size());
+
+   if (!changedKeys.empty())
+   {
+      std::string itemFilter = changedKeys.size() <= kMaxFilteredItems ? itemKeysFilter(changedKeys) : "";
+      error = readItems(pConnection, spec, itemFilter, [&cache, &versions](const std::string& key, const json::Object& csl) {
+         auto version = versions.find(key);
+         if (version == versions.end())
+            return;
+
+         LibraryItemCache::Item& item = cache.items[key];
+         item.version = version->second;
+         item.csl = csl;
+      });
+
+      if (error)
+      {
+         // discard what we have, as it may be partially updated
+         cache.items.clear();
+         cache.collectionsVersion.clear();
+         return error;
+      }
+
+      modified = true;
+   }
+
+   if (modified)
+      writeLibraryItemCache(cachePath, cache);
+
+   // return the items in key order (as they would be read from the database)
+   for (const auto& entry : cache.items)
+      pItems->push_back(entry.second.csl);
+
+   return Success();
+}
+
+ZoteroCollection getCollection(boost::shared_ptr<database::IConnection> pConnection,
+                               const std::string& dataDir,
+                               const ZoteroCollectionSpec& spec)
+{
+   // default to return in case of error
+   ZoteroCollection collection(spec);
+
+   json::Array itemsJson;
+   Error error;
+   if (spec.parentKey.empty())
+   {
+      // libraries are synced incrementally
+      error = syncLibraryItems(pConnection, dataDir, spec, &itemsJson);
+   }
+   else
+   {
+      error = readItems(pConnection, spec, "", [&itemsJson](const std::string&, const json::Object& csl) {
+         itemsJson.push_back(csl);
+      });
+   }
 
    if (error)
    {
@@ -483,6 +759,45 @@ FilePath zoteroSqliteCopyPath(std::string dataDir)
    return zoteroSqliteDir().completePath(sqliteFile);
 }
 
+bool readSqliteHeader(const FilePath& dbFile, std::string* pHeader)
+{
+   std::shared_ptr<std::istream> pStream;
+   Error error = dbFile.openForRead(pStream);
+   if (error)
+      return false;
+
+   char header[100];
+   pStream->read(header, sizeof(header));
+   if (pStream->gcount() != sizeof(header))
+      return false;
+
+   pHeader->assign(header, sizeof(header));
+   return true;
+}
+
+// determines whether two sqlite databases have the same contents by comparing
+// the file change counters in their headers. the counter is only maintained
+// in rollback journal mode, so WAL databases are always considered changed
+bool sqliteContentsUnchanged(const FilePath& dbFile, const FilePath& dbCopyFile)
+{
+   if (dbFile.getSize() != dbCopyFile.getSize())
+      return false;
+
+   std::string header, copyHeader;
+   if (!readSqliteHeader(dbFile, &header) || !readSqliteHeader(dbCopyFile, &copyHeader))
+      return false;
+
+   if (header.compare(0, 16, "SQLite format 3\0", 16) != 0)
+      return false;
+
+   // file format write version (offset 18) is 1 for rollback journal mode
+   if (header[18] != 1)
+      return false;
+
+   // file change counter (offset 24) and database size in pages (offset 28)
+   return header.compare(24, 8, copyHeader, 24, 8) == 0;
+}
+
 Error connect(std::string dataDir, boost::shared_ptr<database::IConnection>* ppConnection)
 {
    // get path to actual sqlite db
@@ -492,7 +807,15 @@ Error connect(std::string dataDir, boost::shared_ptr<database::IConnection>* ppC
    FilePath dbCopyFile = zoteroSqliteCopyPath(dataDir);
 
    // if the copy file doesn't exist or is older than the dbFile then make another copy
+   // (unless the database was only touched, and its contents haven't changed)
    bool databaseIsStale = dbCopyFile.getLastWriteTime() < dbFile.getLastWriteTime();
+   if (databaseIsStale && dbCopyFile.exists() && sqliteContentsUnchanged(dbFile, dbCopyFile))
+   {
+      TRACE("Contents unchanged for " + dbFile.getAbsolutePath());
+      dbCopyFile.setLastWriteTime(dbFile.getLastWriteTime());
+      databaseIsStale = false;
+   }
+
    if (databaseIsStale)
    {
       TRACE("Copying " + dbFile.getAbsolutePath());
@@ -652,7 +975,7 @@ void getLocalCollections(std::string key,
    ZoteroCollections resultCollections = upToDateCollections;
    for (auto downloadSpec : downloadCollections)
    {
-      ZoteroCollection coll = getCollection(pConnection, downloadSpec.second);
+      ZoteroCollection coll = getCollection(pConnection, key, downloadSpec.second);
       resultCollections.push_back(coll);
    }
 
@@ -26,14 +26,19 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/thread.hpp>
 
+#include <algorithm>
 #include <vector>
 
 #include <shared_core/DateTime.hpp>
 #include <shared_core/Error.hpp>
 #include <shared_core/Logger.hpp>
 #include <shared_core/SafeConvert.hpp>
+#include <shared_core/json/Json.hpp>
 
 #ifndef _WIN32
+#include <pthread.h>
+#include <signal.h>
+
 #include <shared_core/system/PosixSystem.hpp>
 #include <shared_core/system/SyslogDestination.hpp>
 #endif
@@ -44,6 +49,97 @@ namespace rstudio {
 namespace core {
 namespace log {
 
+namespace {
+
+// How long the tracked size of the log file is trusted before it is refreshed. Other processes may write to the same
+// log file, so the size we track from our own writes can fall behind the actual size.
+const boost::posix_time::time_duration kLogFileSizeRefreshInterval = boost::posix_time::seconds(5);
+
+// How often queued log messages are written when writing asynchronously.
+const boost::posix_time::time_duration kAsyncFlushInterval = boost::posix_time::milliseconds(200);
+
+// The size of queued log messages at which the writer is woken early.
+const std::size_t kAsyncBatchBytes = 64 * 1024;
+
+// The maximum size of queued log messages; messages logged beyond this are dropped (and counted).
+const std::size_t kAsyncMaxQueuedBytes = 8 * 1024 * 1024;
+
+#ifndef _WIN32
+
+// The file and queue mutexes of each asynchronous file log destination. These are held across fork() so that a child
+// doesn't inherit one locked by the writer thread (mid-write) and deadlock on its first log write.
+typedef std::pair<boost::mutex*, boost::mutex*> ForkMutexes;
+
+// The registry is never destroyed, since destinations may outlive it during static destruction.
+boost::mutex& forkRegistryMutex()
+{
+   static boost::mutex* pMutex = new boost::mutex();
+   return *pMutex;
+}
+
+std::vector<ForkMutexes>& forkRegistry()
+{
+   static std::vector<ForkMutexes>* pRegistry = new std::vector<ForkMutexes>();
+   return *pRegistry;
+}
+
+void prepareFork()
+{
+   forkRegistryMutex().lock();
+   for (const ForkMutexes& mutexes : forkRegistry())
+   {
+      mutexes.first->lock();
+      mutexes.second->lock();
+   }
+}
+
+void afterFork()
+{
+   for (const ForkMutexes& mutexes : forkRegistry())
+   {
+      mutexes.second->unlock();
+      mutexes.first->unlock();
+   }
+   forkRegistryMutex().unlock();
+}
+
+void installForkHandlers()
+{
+   static boost::once_flag once = BOOST_ONCE_INIT;
+   boost::call_once(once, []()
+   {
+      ::pthread_atfork(prepareFork, afterFork, afterFork);
+   });
+}
+
+// Registers a destination's file and queue mutexes (locked in that order before a fork) for as long as it exists.
+class ForkRegistration : boost::noncopyable
+{
+public:
+   ForkRegistration(boost::mutex& in_fileMutex, boost::mutex& in_queueMutex) :
+      m_mutexes(&in_fileMutex, &in_queueMutex)
+   {
+      installForkHandlers();
+
+      boost::lock_guard<boost::mutex> lock(forkRegistryMutex());
+      forkRegistry().push_back(m_mutexes);
+   }
+
+   ~ForkRegistration()
+   {
+      boost::lock_guard<boost::mutex> lock(forkRegistryMutex());
+      std::vector<ForkMutexes>& registry = forkRegistry();
+      registry.erase(std::remove(registry.begin(), registry.end(), m_mutexes), registry.end());
+   }
+
+private:
+   ForkMutexes m_mutexes;
+};
+
+#endif
+
+} // anonymous namespace
+
 // FileLogOptions ======================================================================================================
 FileLogOptions::FileLogOptions(FilePath in_directory) :
    m_directory(std::move(in_directory)),
@@ -55,7 +151,8 @@ FileLogOptions::FileLogOptions(FilePath in_directory) :
    m_doRotation(s_defaultDoRotation),
    m_includePid(s_defaultIncludePid),
    m_warnSyslog(s_defaultWarnSyslog),
-   m_forceDirectory(s_defaultForceDirectory)
+   m_forceDirectory(s_defaultForceDirectory),
+   m_asyncWrites(s_defaultAsyncWrites)
 {
 }
 
@@ -70,7 +167,8 @@ FileLogOptions::FileLogOptions(FilePath in_directory,
    m_doRotation(s_defaultDoRotation),
    m_includePid(s_defaultIncludePid),
    m_warnSyslog(in_warnSyslog),
-   m_forceDirectory(s_defaultForceDirectory)
+   m_forceDirectory(s_defaultForceDirectory),
+   m_asyncWrites(s_defaultAsyncWrites)
 {
 }
 
@@ -94,8 +192,14 @@ FileLogOptions::FileLogOptions(
       m_doRotation(in_doRotation),
       m_includePid(in_includePid),
       m_warnSyslog(in_warnSyslog),
-      m_forceDirectory(in_forceDirectory)
+      m_forceDirectory(in_forceDirectory),
+      m_asyncWrites(s_defaultAsyncWrites)
+{
+}
+
+bool FileLogOptions::asyncWrites() const
 {
+   return m_asyncWrites;
 }
 
 int FileLogOptions::getDeletionDays() const
@@ -148,6 +252,11 @@ bool FileLogOptions::includePid() const
    return m_includePid;
 }
 
+void FileLogOptions::setAsyncWrites(bool in_asyncWrites)
+{
+   m_asyncWrites = in_asyncWrites;
+}
+
 void FileLogOptions::setDeletionDays(int in_deletionDays)
 {
    m_deletionDays = in_deletionDays;
@@ -198,7 +307,16 @@ struct FileLogDestination::Impl
 {
    Impl(const std::string& in_name, FileLogOptions in_options) :
       LogOptions(std::move(in_options)),
-      LogName(in_name + ".log")
+      LogName(in_name + ".log"),
+      ProgramId(in_name),
+      FormatType(LogMessageFormatType::PRETTY),
+      QueuedBytes(0),
+      DroppedMessages(0),
+      TotalDroppedMessages(0),
+      BatchesTaken(0),
+      BatchesWritten(0),
+      StopWriter(false),
+      WriterStarted(false)
    {
 #ifndef _WIN32
       if (!LogOptions.getDirectory().exists())
@@ -259,6 +377,7 @@ struct FileLogDestination::Impl
 
    ~Impl()
    {
+      stopWriter();
       closeLogFile();
    }
 
@@ -511,6 +630,29 @@ struct FileLogDestination::Impl
       return ((now - FirstLogLineTime.get()) >= rotateTime);
    }
 
+   uintmax_t getLogFileSize()
+   {
+      // The size is tracked from the bytes we write so that we don't need to stat the file for every message.
+      boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+      if (!LogFileSize || (now - LogFileSizeTime) >= kLogFileSizeRefreshInterval)
+      {
+         LogFileSize = LogFile.getSize();
+         LogFileSizeTime = now;
+      }
+
+      return LogFileSize.get();
+   }
+
+   bool shouldSizeRotate(uintmax_t maxSize)
+   {
+      if (getLogFileSize() < maxSize)
+         return false;
+
+      // Confirm with the actual size before rotating - another process may have rotated the file already.
+      LogFileSize.reset();
+      return getLogFileSize() >= maxSize;
+   }
+
    // Returns true if it is safe to log; false otherwise.
    bool rotateLogFile()
    {
@@ -520,8 +662,9 @@ struct FileLogDestination::Impl
       // Only rotate if we're configured to rotate.
       if (LogOptions.doRotation())
       {
-         if (LogFile.getSize() >= maxSize || shouldTimeRotate())
+         if (shouldSizeRotate(maxSize) || shouldTimeRotate())
          {
+            LogFileSize.reset();
             if (!rotateLogFileImpl(LogFile))
                return false;
          }
@@ -537,12 +680,276 @@ struct FileLogDestination::Impl
       }
    }
 
+   // Writes the given log messages to the log file. Must be called with Mutex held.
+   void writeToLogFile(const std::string& in_messages)
+   {
+      // Check to make sure path to file is valid. If not, log nothing.
+      if (!verifyLogFilePath())
+         return;
+
+      // Rotate the log file if necessary. If it fails to rotate, log nothing.
+      if (!rotateLogFile())
+         return;
+
+      // Open the log file. If it fails to open, log nothing.
+      if (!openLogFile())
+      {
+         closeLogFile();
+         return;
+      }
+
+      (*LogOutputStream) << in_messages;
+      LogOutputStream->flush();
+
+      // If the output stream has bad state after writing, it might have been closed. Try re-opening it and writing the
+      // message again. Often it is not possible to tell that a stream has failed until a write is attempted.
+      if (!LogOutputStream->good())
+      {
+         if (!openLogFile())
+         {
+            closeLogFile();
+            return;
+         }
+
+         (*LogOutputStream) << in_messages;
+         LogOutputStream->flush();
+      }
+
+      if (LogFileSize)
+         LogFileSize = LogFileSize.get() + in_messages.size();
+
+      closeLogFile();
+   }
+
+   std::string droppedMessagesNotice(uint64_t in_count)
+   {
+      using namespace boost::posix_time;
+      std::string time = core::date_time::format(microsec_clock::universal_time(), core::date_time::kIso8601Format);
+      std::string message = safe_convert::numberToString(in_count) +
+         " log messages were dropped because they were logged faster than they could be written";
+
+      std::string level = logLevelName(LogLevel::WARN);
+
+      if (FormatType == LogMessageFormatType::JSON)
+      {
+         json::Object logObject;
+         logObject["time"] = time;
+         logObject["service"] = ProgramId;
+         logObject["level"] = level;
+         logObject["message"] = message;
+         return logObject.write() + "\n";
+      }
+
+      return time + " [" + ProgramId + "] " + level + " " + message + "\n";
+   }
+
+   void startWriter()
+   {
+      try
+      {
+#ifndef _WIN32
+         WriterPid = ::getpid();
+         ForkMutexRegistration.reset(new ForkRegistration(Mutex, QueueMutex));
+
+         // Block all signals while the writer thread is created, so that it inherits a mask which never receives them.
+         sigset_t blockAll, previous;
+         ::sigfillset(&blockAll);
+         ::pthread_sigmask(SIG_SETMASK, &blockAll, &previous);
+         try
+         {
+            WriterThread = boost::thread(&Impl::runWriter, this);
+         }
+         catch (...)
+         {
+            ::pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+            throw;
+         }
+         ::pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+#else
+         WriterThread = boost::thread(&Impl::runWriter, this);
+#endif
+         WriterStarted = true;
+      }
+      catch (...)
+      {
+         // Fall back to synchronous writes - we can't log the failure!
+#ifndef _WIN32
+         ForkMutexRegistration.reset();
+#endif
+      }
+   }
+
+   void stopWriter()
+   {
+      if (!WriterStarted || !isWriterProcess())
+         return;
+
+      {
+         boost::lock_guard<boost::mutex> lock(QueueMutex);
+         StopWriter = true;
+      }
+      QueueCondition.notify_all();
+
+      try
+      {
+         WriterThread.join();
+      }
+      catch (...)
+      {
+      }
+
+      WriterStarted = false;
+      flushQueue();
+   }
+
+   // Whether this is the process which started the writer thread. A forked child has no writer thread (and may have
+   // inherited the queue in an inconsistent state), so it writes synchronously.
+   bool isWriterProcess() const
+   {
+#ifndef _WIN32
+      return WriterPid == ::getpid();
+#else
+      return true;
+#endif
+   }
+
+   // Queues a message for the writer thread. Returns false if the message should be written synchronously instead.
+   bool enqueue(const std::string& in_message, bool in_flush)
+   {
+      if (!WriterStarted || !isWriterProcess())
+         return false;
+
+      bool notify = false;
+      {
+         boost::lock_guard<boost::mutex> lock(QueueMutex);
+         if (StopWriter)
+            return false;
+
+         // Bound the memory used by the queue; messages which must be flushed are always kept.
+         if (!in_flush && QueuedBytes + in_message.size() > kAsyncMaxQueuedBytes)
+         {
+            ++DroppedMessages;
+            ++TotalDroppedMessages;
+            return true;
+         }
+
+         Queue.push_back(in_message);
+         QueuedBytes += in_message.size();
+         notify = QueuedBytes >= kAsyncBatchBytes;
+      }
+
+      if (in_flush)
+         flushQueue();
+      else if (notify)
+         QueueCondition.notify_one();
+
+      return true;
+   }
+
+   // Writes all queued messages as a single batch.
+   void flushQueue()
+   {
+      // Take the queue without holding the file mutex, so that producers never wait on a write in progress. Each
+      // batch is numbered as it is taken, and concurrent flushes write their batches in that order.
+      std::vector<std::string> messages;
+      uint64_t dropped = 0;
+      uint64_t batchNumber = 0;
+      {
+         boost::lock_guard<boost::mutex> lock(QueueMutex);
+         if (Queue.empty() && DroppedMessages == 0)
+            return;
+
+         messages.swap(Queue);
+         dropped = DroppedMessages;
+         DroppedMessages = 0;
+         QueuedBytes = 0;
+         batchNumber = BatchesTaken++;
+      }
+
+      std::string batch;
+      if (dropped > 0)
+         batch = droppedMessagesNotice(dropped);
+
+      for (const std::string& message : messages)
+         batch.append(message);
+
+      {
+         boost::unique_lock<boost::mutex> fileLock(Mutex);
+         BatchCondition.wait(fileLock, [&]() { return BatchesWritten == batchNumber; });
+
+         try
+         {
+            writeToLogFile(batch);
+         }
+         catch (...)
+         {
+            // Swallow exceptions because we'd trigger recursive logging otherwise.
+         }
+
+         ++BatchesWritten;
+      }
+      BatchCondition.notify_all();
+   }
+
+   void runWriter()
+   {
+      try
+      {
+         while (true)
+         {
+            {
+               boost::unique_lock<boost::mutex> lock(QueueMutex);
+               QueueCondition.timed_wait(lock, kAsyncFlushInterval, [this]()
+               {
+                  return StopWriter || QueuedBytes >= kAsyncBatchBytes;
+               });
+
+               if (StopWriter)
+                  return;
+            }
+
+            flushQueue();
+         }
+      }
+      catch (...)
+      {
+         // Swallow exceptions because we'd trigger recursive logging otherwise.
+      }
+   }
+
    FileLogOptions LogOptions;
    FilePath LogFile;
    std::string LogName;
+   std::string ProgramId;
+   LogMessageFormatType FormatType;
    boost::mutex Mutex;
    std::shared_ptr<std::ostream> LogOutputStream;
    boost::optional<boost::posix_time::ptime> FirstLogLineTime;
+   boost::optional<uintmax_t> LogFileSize;
+   boost::posix_time::ptime LogFileSizeTime;
+
+   // Asynchronous writes: producers append preformatted messages to the queue (only ever holding QueueMutex briefly)
+   // and the writer thread writes them to the log file in batches. Batches are written (under Mutex) in the order they
+   // were taken from the queue.
+   boost::mutex QueueMutex;
+   boost::condition_variable QueueCondition;
+   std::vector<std::string> Queue;
+   std::size_t QueuedBytes;
+   uint64_t DroppedMessages;
+   uint64_t TotalDroppedMessages;
+   uint64_t BatchesTaken;
+   uint64_t BatchesWritten;
+   boost::condition_variable BatchCondition;
+   bool StopWriter;
+   bool WriterStarted;
+   boost::thread WriterThread;
+#ifndef _WIN32
+   pid_t WriterPid;
+
+   // Only set once the writer thread is started. Declared after the mutexes it registers, so that it's destroyed
+   // before them.
+   std::unique_ptr<ForkRegistration> ForkMutexRegistration;
+#endif
 
 #ifndef _WIN32
    std::shared_ptr<core::system::SyslogDestination> SyslogDest;
@@ -559,6 +966,10 @@ FileLogDestination::FileLogDestination(
       ILogDestination(in_id, in_logLevel, in_formatType, in_reloadable),
       m_impl(new Impl(in_programId, std::move(in_logOptions)))
 {
+   m_impl->FormatType = in_formatType;
+   if (m_impl->LogOptions.asyncWrites())
+      m_impl->startWriter();
+
 #ifndef _WIN32
    if (in_logOptions.warnSyslog())
    {
@@ -573,6 +984,8 @@ FileLogDestination::FileLogDestination(
 
 FileLogDestination::~FileLogDestination()
 {
+   m_impl->stopWriter();
+
    if (m_impl->LogOutputStream.get())
       m_impl->LogOutputStream->flush();
 }
@@ -582,10 +995,36 @@ std::string FileLogDestination::path()
    return m_impl->LogFile.getAbsolutePath();
 }
 
+void FileLogDestination::flush()
+{
+   try
+   {
+      if (m_impl->WriterStarted && m_impl->isWriterProcess())
+         m_impl->flushQueue();
+   }
+   catch (...)
+   {
+      // Swallow exceptions because we'd trigger recursive logging otherwise.
+   }
+}
+
+uint64_t FileLogDestination::getDroppedMessageCount() const
+{
+   boost::lock_guard<boost::mutex> lock(m_impl->QueueMutex);
+   return m_impl->TotalDroppedMessages;
+}
+
 void FileLogDestination::refresh(const RefreshParams& in_refreshParams)
 {
+   // Write any queued messages before the log file is moved or changes hands
+   flush();
+
    // Close the log file to ensure that if we just forked old FDs are cleared out
-   m_impl->closeLogFile();
+   {
+      boost::lock_guard<boost::mutex> lock(m_impl->Mutex);
+      m_impl->closeLogFile();
+      m_impl->LogFileSize.reset();
+   }
 
 #ifndef _WIN32
    if (in_refreshParams.newUser)
@@ -609,50 +1048,29 @@ void FileLogDestination::writeLog(LogLevel in_logLevel, const std::string& in_me
    if (in_logLevel > m_logLevel)
       return;
 
-   // Lock the mutex before attempting to write.
    try
    {
-      boost::lock_guard<boost::mutex> lock(m_impl->Mutex);
-
+      // When writing asynchronously, queue the message for the writer thread. Errors are written before returning
+      // (along with anything queued before them) so that they're on disk if the process is about to crash.
+      if (m_impl->enqueue(in_message, in_logLevel <= LogLevel::ERR))
+      {
 #ifndef _WIN32
-         // First write to syslog if configured
          if (in_logLevel <= LogLevel::WARN && m_impl->SyslogDest)
             m_impl->SyslogDest->writeLog(in_logLevel, in_message);
 #endif
-
-      // Check to make sure path to file is valid. If not, log nothing.
-      if (!m_impl->verifyLogFilePath())
-         return;
-
-      // Rotate the log file if necessary. If it fails to rotate, log nothing.
-      if (!m_impl->rotateLogFile())
-         return;
-
-      // Open the log file. If it fails to open, log nothing.
-      if (!m_impl->openLogFile())
-      {
-         m_impl->closeLogFile();
          return;
       }
 
-      (*m_impl->LogOutputStream) << in_message;
-      m_impl->LogOutputStream->flush();
-
-      // If the output stream has bad state after writing, it might have been closed. Try re-opening it and writing the
-      // message again. Often it is not possible to tell that a stream has failed until a write is attempted.
-      if (!m_impl->LogOutputStream->good())
-      {
-         if (!m_impl->openLogFile())
-         {
-            m_impl->closeLogFile();
-            return;
-         }
+      // Lock the mutex before attempting to write.
+      boost::lock_guard<boost::mutex> lock(m_impl->Mutex);
 
-         (*m_impl->LogOutputStream) << in_message;
-         m_impl->LogOutputStream->flush();
-      }
+#ifndef _WIN32
+         // First write to syslog if configured
+         if (in_logLevel <= LogLevel::WARN && m_impl->SyslogDest)
+            m_impl->SyslogDest->writeLog(in_logLevel, in_message);
+#endif
 
-      m_impl->closeLogFile();
+      m_impl->writeToLogFile(in_message);
    }
    catch (...)
    {
@@ -87,6 +87,13 @@ public:
       bool in_warnSyslog,
       bool in_forceLogDirectory);
 
+   /**
+    * @brief Returns whether log messages are written asynchronously (in batches, by a background thread).
+    *
+    * @return True if log messages should be written asynchronously; false otherwise.
+    */
+   bool asyncWrites() const;
+
    /**
     * @brief Gets the number of days a rotated log file should persist before being deleted.
     *
@@ -157,6 +164,15 @@ public:
     */
    bool warnSyslog() const;
 
+   /**
+    * @brief Sets whether log messages are written asynchronously. When set, messages are queued by the logging
+    *        thread and written in batches by a background thread; error messages are still written before the
+    *        logging call returns.
+    *
+    * @param in_asyncWrites    Whether to write log messages asynchronously.
+    */
+   void setAsyncWrites(bool in_asyncWrites);
+
    /**
     * @brief Sets the number of days a rotated log file should persist before being deleted.
     *
@@ -242,6 +258,7 @@ private:
    static constexpr bool s_defaultIncludePid = false;
    static constexpr bool s_defaultWarnSyslog = true;
    static constexpr bool s_defaultForceDirectory = false;
+   static constexpr bool s_defaultAsyncWrites = false;
 
    // The directory where log files should be written.
    FilePath m_directory;
@@ -272,6 +289,9 @@ private:
 
    // Whether or not to force the directory to prevent user override.
    bool m_forceDirectory;
+
+   // Whether to write log messages asynchronously.
+   bool m_asyncWrites;
 };
 
 /**
@@ -313,6 +333,19 @@ public:
     */
    std::string path();
 
+   /**
+    * @brief Writes any queued log messages to the log file (when writing asynchronously).
+    */
+   void flush();
+
+   /**
+    * @brief Gets the number of log messages which were dropped because too many were queued for writing (when
+    *        writing asynchronously).
+    *
+    * @return The number of dropped log messages.
+    */
+   uint64_t getDroppedMessageCount() const;
+
    /**
     * @brief Refreshes the log destintation. Ensures that the log does not have any stale file handles.
     *
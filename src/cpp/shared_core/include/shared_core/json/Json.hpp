@@ -505,6 +505,26 @@ public:
     */
    virtual Error parse(const std::string& in_jsonStr);
 
+   /**
+    * @brief Parses JSON produced by a JSON writer into this value, reading numbers in full precision (so that
+    *        written doubles are read back exactly) and accepting NaN and Infinity.
+    *
+    * @param in_jsonStr     The JSON string to parse.
+    *
+    * @return Success on successful parse; error otherwise (e.g. ParseError)
+    */
+   Error parseFullPrecision(const char* in_jsonStr);
+
+   /**
+    * @brief Parses JSON produced by a JSON writer into this value, reading numbers in full precision (so that
+    *        written doubles are read back exactly) and accepting NaN and Infinity.
+    *
+    * @param in_jsonStr     The JSON string to parse.
+    *
+    * @return Success on successful parse; error otherwise (e.g. ParseError)
+    */
+   Error parseFullPrecision(const std::string& in_jsonStr);
+
    /**
     * @brief Parses the JSON string and validates it against the schema.
     *
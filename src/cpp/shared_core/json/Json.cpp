@@ -677,6 +677,25 @@ Error Value::parse(const std::string& in_jsonStr)
    return parse(in_jsonStr.c_str());
 }
 
+Error Value::parseFullPrecision(const char* in_jsonStr)
+{
+   rapidjson::ParseResult result =
+      m_impl->Document->Parse<rapidjson::kParseFullPrecisionFlag | rapidjson::kParseNanAndInfFlag>(in_jsonStr);
+
+   if (result.IsError())
+   {
+      std::string message = "An error occurred while parsing json. Offset: " + std::to_string(result.Offset());
+      return Error(result.Code(), message, ERROR_LOCATION);
+   }
+
+   return Success();
+}
+
+Error Value::parseFullPrecision(const std::string& in_jsonStr)
+{
+   return parseFullPrecision(in_jsonStr.c_str());
+}
+
 Error Value::parseAndValidate(const std::string& in_jsonStr, const std::string& in_schema)
 {
    Error error;
@@ -15,6 +15,7 @@
 
 #include <tests/TestThat.hpp>
 
+#include <cmath>
 #include <iostream>
 #include <set>
 
@@ -945,6 +946,25 @@ TEST_CASE("Json")
       REQUIRE(error);
    }
 
+   SECTION("Parse written json in full precision")
+   {
+      double number = 0.1 + 0.2;
+      json::Array written;
+      written.push_back(json::Value(number));
+
+      json::Value actual;
+      REQUIRE_FALSE(actual.parseFullPrecision(written.write()));
+      CHECK(actual.getArray()[0].getDouble() == number);
+
+      REQUIRE_FALSE(actual.parseFullPrecision("[ NaN, Infinity ]"));
+      CHECK(std::isnan(actual.getArray()[0].getDouble()));
+      CHECK(std::isinf(actual.getArray()[1].getDouble()));
+
+      // plain parsing is unchanged, and rejects non-finite values
+      json::Value plain;
+      REQUIRE(plain.parse("[ NaN ]"));
+   }
+
    SECTION("readObject tests")
    {
       json::Object obj;
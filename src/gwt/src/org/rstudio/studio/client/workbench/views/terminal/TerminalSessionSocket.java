@@ -220,12 +220,16 @@ public class TerminalSessionSocket
                else
                {
                   onConsoleOutput(new ConsoleOutputEvent(TerminalSocketPacket.getMessage(msg)));
+                  framesReceived_++;
+                  acknowledgeOutput();
                }
             }
 
             @Override
             public void onOpen()
             {
+               framesReceived_ = 0;
+               ackPending_ = false;
                connectWebSocketTimer_.cancel();
                diagnostic_.log(constants_.websocketConnectedMessage());
                callback.onConnected();
@@ -364,6 +368,33 @@ public class TerminalSessionSocket
       session_.receivedOutput(event.getOutput());
    }
 
+   /**
+    * Tell the server how much output has been written to the terminal, once
+    * the terminal has caught up with what was received; the server stops
+    * sending output when too much is unacknowledged.
+    */
+   private void acknowledgeOutput()
+   {
+      if (ackPending_)
+         return;
+
+      ackPending_ = true;
+      final Websocket socket = socket_;
+      final int frames = framesReceived_;
+      xterm_.afterWrites(() ->
+      {
+         ackPending_ = false;
+         if (socket_ != socket || socket_ == null)
+            return;
+
+         socket_.send(TerminalSocketPacket.ackPacket(frames));
+
+         // output which arrived in the meantime is acknowledged once written
+         if (framesReceived_ > frames)
+            acknowledgeOutput();
+      });
+   }
+
    private void addHandlerRegistration(HandlerRegistration reg)
    {
       registrations_.add(reg);
@@ -425,6 +456,8 @@ public class TerminalSessionSocket
    private ConnectCallback connectCallback_;
    private HandlerRegistration terminalInputHandler_;
    private Websocket socket_;
+   private int framesReceived_;
+   private boolean ackPending_;
    private final TerminalLocalEcho localEcho_;
    private final TerminalDiagnostics diagnostic_ = new TerminalDiagnostics();
 
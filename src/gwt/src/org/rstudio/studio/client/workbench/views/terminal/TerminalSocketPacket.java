@@ -25,8 +25,11 @@ import org.rstudio.core.client.StringUtil;
  * First character is a method indicator, as follows:
  *    "a" = send text, e.g. "aHello"
  *    "b" = ping/pong, e.g. "b"
+ *    "c" = acknowledge output, e.g. "c42"
  *
- * Only the "send text" method has a payload (everything after the "a").
+ * The "send text" method has a payload (everything after the "a"). Output is
+ * acknowledged once it has been written to the terminal, with the number of
+ * text packets written since connecting (everything after the "c").
  *
  * See SessionConsoleProcessSocketPacket in session code for C++ side of this sophisticated
  * wire format.
@@ -43,6 +46,11 @@ public class TerminalSocketPacket
       return keepAlivePrefix;
    }
 
+   public static String ackPacket(int frames)
+   {
+      return ackPrefix + frames;
+   }
+
    public static boolean isKeepAlive(String text)
    {
       return StringUtil.equals(text, keepAlivePrefix);
@@ -59,4 +67,5 @@ public class TerminalSocketPacket
 
    private static final String keepAlivePrefix = "b";
    private static final String textPrefix = "a";
+   private static final String ackPrefix = "c";
 }
@@ -19,6 +19,7 @@ import org.rstudio.core.client.CommandWithArg;
 
 import com.google.gwt.core.client.JavaScriptObject;
 import com.google.gwt.dom.client.Element;
+import com.google.gwt.user.client.Command;
 
 /**
  * <code>JavaScriptObject</code> wrapper for xterm.js
@@ -64,6 +65,17 @@ public class XTermNative extends JavaScriptObject
       this.write(data);
    }-*/;
 
+   /**
+    * Run a command once all text written so far has been processed by the
+    * terminal (writes are parsed asynchronously).
+    * @param command command to run
+    */
+   public final native void afterWrites(Command command) /*-{
+      this.write("", $entry(function() {
+         command.@com.google.gwt.user.client.Command::execute()();
+      }));
+   }-*/;
+
    /**
     * Compute and return available dimensions for terminal.
     * @return Visible number of columns and rows
@@ -146,6 +146,15 @@ public class XTermWidget extends Widget
       terminal_.write(str);
    }
 
+   /**
+    * Run a command once output written so far has been processed.
+    * @param command command to run
+    */
+   public void afterWrites(Command command)
+   {
+      terminal_.afterWrites(command);
+   }
+
    /**
     * Clear terminal buffer.
     */